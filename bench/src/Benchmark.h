@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct BenchmarkSettings
+{
+    // Number of timed samples, the reported time is their median
+    int sampleCount = 15;
+    // Each sample repeats the operation until it runs at least this long
+    double minSampleMilliseconds = 10.0;
+    // Only benchmarks whose name contains this text are run
+    std::string filter;
+    bool csv = false;
+};
+
+struct BenchmarkResult
+{
+    std::string name;
+    double nanosecondsPerOp = 0.0;
+    double pixelsPerSecond = 0.0;
+    // Median absolute deviation of the samples relative to the median
+    double deviation = 0.0;
+    std::int64_t iterationsPerSample = 0;
+};
+
+struct BenchmarkRunner
+{
+    static constexpr const char* Usage = "[--filter text] [--samples N] [--min-time ms] [--csv]";
+
+    BenchmarkSettings settings;
+    std::vector<BenchmarkResult> results;
+
+    static bool ParseArguments(int argc, char* argv[], BenchmarkSettings& settings)
+    {
+        for (int i = 0; i < argc; ++i)
+        {
+            std::string_view argument = argv[i];
+            if (argument == "--csv")
+            {
+                settings.csv = true;
+                continue;
+            }
+            if (i + 1 >= argc)
+            {
+                return false;
+            }
+            const char* value = argv[++i];
+            if (argument == "--filter")
+            {
+                settings.filter = value;
+            }
+            else if (argument == "--samples")
+            {
+                settings.sampleCount = std::max(1, std::atoi(value));
+            }
+            else if (argument == "--min-time")
+            {
+                settings.minSampleMilliseconds = std::max(0.0, std::atof(value));
+            }
+            else
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool IsSelected(std::string_view name) const
+    {
+        return settings.filter.empty() || name.find(settings.filter) != std::string_view::npos;
+    }
+
+    // operation is called repeatedly and returns the number of pixels it wrote
+    template<typename Operation>
+    void Run(std::string_view name, Operation&& operation)
+    {
+        if (!IsSelected(name))
+        {
+            return;
+        }
+
+        // Warm up caches and lazily allocated memory before calibrating
+        std::int64_t pixels = operation();
+
+        // Grow the iteration count until one sample takes long enough for the clock to be accurate
+        double minSampleNanoseconds = settings.minSampleMilliseconds * 1e6;
+        std::int64_t iterations = 1;
+        while (true)
+        {
+            double elapsed = Measure(operation, iterations, pixels);
+            if (elapsed >= minSampleNanoseconds || iterations >= (std::int64_t(1) << 40))
+            {
+                break;
+            }
+            double scale = elapsed > 0.0 ? minSampleNanoseconds / elapsed : 2.0;
+            iterations = static_cast<std::int64_t>(std::ceil(iterations * std::clamp(scale * 1.1, 1.5, 100.0)));
+        }
+
+        std::vector<double> samples;
+        samples.reserve(settings.sampleCount);
+        std::int64_t totalPixels = 0;
+        for (int i = 0; i < settings.sampleCount; ++i)
+        {
+            samples.push_back(Measure(operation, iterations, totalPixels) / iterations);
+        }
+
+        BenchmarkResult result;
+        result.name = name;
+        result.iterationsPerSample = iterations;
+        result.nanosecondsPerOp = Median(samples);
+
+        std::vector<double> deviations;
+        for (double sample : samples)
+        {
+            deviations.push_back(std::abs(sample - result.nanosecondsPerOp));
+        }
+        result.deviation = result.nanosecondsPerOp > 0.0 ? Median(deviations) / result.nanosecondsPerOp : 0.0;
+
+        double pixelsPerOp = static_cast<double>(totalPixels) / (static_cast<double>(iterations) * settings.sampleCount);
+        result.pixelsPerSecond = result.nanosecondsPerOp > 0.0 ? pixelsPerOp * 1e9 / result.nanosecondsPerOp : 0.0;
+
+        Print(result);
+        results.push_back(result);
+    }
+
+    void PrintHeader() const
+    {
+        if (settings.csv)
+        {
+            std::printf("name,ns_per_op,pixels_per_second,deviation,iterations\n");
+        }
+        else
+        {
+            std::printf("%-44s %14s %14s %8s %12s\n", "benchmark", "ns/op", "Mpixels/s", "+-", "iterations");
+        }
+    }
+
+private:
+    template<typename Operation>
+    static double Measure(Operation& operation, std::int64_t iterations, std::int64_t& pixels)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (std::int64_t i = 0; i < iterations; ++i)
+        {
+            pixels += operation();
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count();
+    }
+
+    static double Median(std::vector<double> values)
+    {
+        std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+        return values[values.size() / 2];
+    }
+
+    void Print(const BenchmarkResult& result) const
+    {
+        if (settings.csv)
+        {
+            std::printf("%s,%.3f,%.0f,%.4f,%lld\n", result.name.c_str(), result.nanosecondsPerOp, result.pixelsPerSecond,
+                result.deviation, static_cast<long long>(result.iterationsPerSample));
+        }
+        else
+        {
+            std::printf("%-44s %14.1f %14.2f %7.1f%% %12lld\n", result.name.c_str(), result.nanosecondsPerOp, result.pixelsPerSecond / 1e6,
+                result.deviation * 100.0, static_cast<long long>(result.iterationsPerSample));
+        }
+        std::fflush(stdout);
+    }
+};
+
+// Each lab defines its own Pixel and Bitmap, so every lab is benchmarked from its own translation unit
+void RunLab1Benchmarks(BenchmarkRunner& runner);
+void RunLab2Benchmarks(BenchmarkRunner& runner);
@@ -0,0 +1,344 @@
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <utility>
+#include <algorithm>
+
+#include "SFML/System/Vector2.hpp"
+
+#include "Benchmark.h"
+
+#include "../../lab1/src/Bitmap.h"
+#include "../../lab1/src/Patterns.h"
+#include "../../lab1/src/Canvas.h"
+
+using namespace std;
+using namespace lab1;
+
+namespace
+{
+    const Pixel FillPixels[2] = { { 0, 255, 0, 255 }, { 0, 0, 255, 255 } };
+
+    struct FillCase
+    {
+        string name;
+        Bitmap pattern;
+        sf::Vector2i start;
+    };
+
+    int64_t CountPixels(const Bitmap& bitmap, const Pixel& pixel)
+    {
+        int64_t count = 0;
+        for (auto& p : bitmap.pixels)
+        {
+            count += p == pixel ? 1 : 0;
+        }
+        return count;
+    }
+
+    // Noise may put a wall right on the requested start, walk forward to the first open pixel
+    sf::Vector2i FindOpenPixel(const Bitmap& bitmap, sf::Vector2i start)
+    {
+        for (int i = start.y * bitmap.width + start.x; i < static_cast<int>(bitmap.pixels.size()); ++i)
+        {
+            if (bitmap.pixels[i] != WallPixel)
+            {
+                return { i % bitmap.width, i / bitmap.width };
+            }
+        }
+        return start;
+    }
+
+    void RunFillBenchmark(BenchmarkRunner& runner, const FillCase& fillCase)
+    {
+        string name = "lab1/fill/" + fillCase.name + "/" + to_string(fillCase.pattern.width) + "x" + to_string(fillCase.pattern.height);
+        if (!runner.IsSelected(name))
+        {
+            return;
+        }
+
+        // Alternating between two fill colors refills the same region every call without restoring the pattern
+        Bitmap bitmap = fillCase.pattern;
+        sf::Vector2i start = FindOpenPixel(bitmap, fillCase.start);
+        bitmap.FillShape(start, FillPixels[0]);
+        int64_t regionSize = CountPixels(bitmap, FillPixels[0]);
+        int iteration = 0;
+
+        runner.Run(name, [&] {
+            bitmap.FillShape(start, FillPixels[++iteration & 1]);
+            return regionSize;
+        });
+    }
+
+    // The same fill on one byte per pixel, the region is found by comparing indices
+    void RunIndexedFillBenchmark(BenchmarkRunner& runner, const FillCase& fillCase)
+    {
+        string name = "lab1/fill_indexed/" + fillCase.name + "/" + to_string(fillCase.pattern.width) + "x" + to_string(fillCase.pattern.height);
+        if (!runner.IsSelected(name))
+        {
+            return;
+        }
+
+        IndexedBitmap bitmap;
+        IndexedBitmap::FromBitmap(fillCase.pattern, bitmap);
+        const uint8_t fillIndices[2] = { static_cast<uint8_t>(bitmap.PaletteIndex(FillPixels[0])), static_cast<uint8_t>(bitmap.PaletteIndex(FillPixels[1])) };
+        sf::Vector2i start = FindOpenPixel(fillCase.pattern, fillCase.start);
+        bitmap.FillShape(start, fillIndices[0]);
+        int64_t regionSize = count(bitmap.indices.begin(), bitmap.indices.end(), fillIndices[0]);
+        int iteration = 0;
+
+        runner.Run(name, [&] {
+            bitmap.FillShape(start, fillIndices[++iteration & 1]);
+            return regionSize;
+        });
+    }
+}
+
+void RunLab1Benchmarks(BenchmarkRunner& runner)
+{
+    for (auto [width, height] : { pair{ 100, 75 }, pair{ 800, 600 } })
+    {
+        Bitmap bitmap = Bitmap::New(width, height);
+        runner.Run("lab1/clear/" + to_string(width) + "x" + to_string(height), [&] {
+            bitmap.Clear();
+            return static_cast<int64_t>(bitmap.pixels.size());
+        });
+    }
+
+    {
+        Bitmap bitmap = Bitmap::New(100, 75);
+        PatternRandom random{ 3 };
+        vector<sf::Vector2i> inside(4096);
+        vector<sf::Vector2i> mixed(4096);
+        for (int i = 0; i < 4096; ++i)
+        {
+            inside[i] = { static_cast<int>(random.Next() % bitmap.width), static_cast<int>(random.Next() % bitmap.height) };
+            // Roughly half of these miss the canvas, like strokes dragged outside the window
+            mixed[i] = { static_cast<int>(random.Next() % (bitmap.width * 2)) - bitmap.width / 2,
+                static_cast<int>(random.Next() % (bitmap.height * 2)) - bitmap.height / 2 };
+        }
+
+        size_t index = 0;
+        runner.Run("lab1/set_pixel/inside", [&] {
+            index = (index + 1) & 4095;
+            return static_cast<int64_t>(bitmap.SetPixel(inside[index], FillPixels[0]));
+        });
+        runner.Run("lab1/set_pixel/mixed", [&] {
+            index = (index + 1) & 4095;
+            return static_cast<int64_t>(bitmap.SetPixel(mixed[index], FillPixels[1]));
+        });
+    }
+
+    for (auto [width, height] : { pair{ 100, 75 }, pair{ 512, 512 } })
+    {
+        sf::Vector2i center = { width / 2, height / 2 };
+        vector<FillCase> fillCases = {
+            { "empty", Bitmap::New(width, height), center },
+            { "checkerboard_cell", CreateCheckerboardBitmap(width, height, 8), { 1, 1 } },
+            { "rings", CreateRingsBitmap(width, height, 4), center },
+            { "maze", CreateMazeBitmap(width, height, 1), { 1, 1 } },
+            { "noise_20", CreateNoiseBitmap(width, height, 20, 7), center },
+            { "noise_40", CreateNoiseBitmap(width, height, 40, 7), center },
+        };
+
+        for (auto& fillCase : fillCases)
+        {
+            RunFillBenchmark(runner, fillCase);
+            RunIndexedFillBenchmark(runner, fillCase);
+        }
+    }
+
+    // Magic wand regions of the fill patterns, the tolerance match alone and selection growth
+    {
+        const int width = 512;
+        const int height = 512;
+        vector<pair<string, Bitmap>> patterns = { { "empty", Bitmap::New(width, height) }, { "maze", CreateMazeBitmap(width, height, 1) },
+            { "noise_40", CreateNoiseBitmap(width, height, 40, 7) } };
+        for (auto& [patternName, bitmap] : patterns)
+        {
+            sf::Vector2i start = FindOpenPixel(bitmap, { width / 2, height / 2 });
+            int64_t regionSize = static_cast<int64_t>(ColorSelect::Contiguous(bitmap, start, 16).Count());
+            runner.Run("lab1/select/contiguous/" + patternName + "/512x512", [&, start, regionSize] {
+                return ColorSelect::Contiguous(bitmap, start, 16).Count() == static_cast<size_t>(regionSize) ? regionSize : 0;
+            });
+        }
+
+        Bitmap noise = CreateNoiseBitmap(width, height, 40, 7);
+        vector<uint64_t> bits(width / 64);
+        runner.Run("lab1/select/match_row/scalar", [&] {
+            ColorSelect::MatchRowScalar(noise.pixels.data(), width, { 0, 0, 0, 255 }, 16, bits.data());
+            return static_cast<int64_t>(width);
+        });
+        runner.Run("lab1/select/match_row/simd", [&] {
+            ColorSelect::MatchRow(noise.pixels.data(), width, { 0, 0, 0, 255 }, 16, bits.data());
+            return static_cast<int64_t>(width);
+        });
+
+        SelectionMask selection = ColorSelect::ByColor(noise, { 0, 0, 0, 255 }, 0);
+        runner.Run("lab1/select/grow_shrink/512x512", [&] {
+            selection.Grow(1);
+            selection.Shrink(1);
+            return static_cast<int64_t>(2) * width * height;
+        });
+    }
+
+    // One full width row of translucent pixels blended with each mode, scalar against SIMD
+    {
+        PatternRandom random{ 5 };
+        vector<Pixel> source(800), destination(800, Pixel{ 40, 80, 120, 255 });
+        for (auto& pixel : source)
+        {
+            uint8_t alpha = static_cast<uint8_t>(random.Next());
+            pixel = { static_cast<uint8_t>(random.Next() % (alpha + 1u)), static_cast<uint8_t>(random.Next() % (alpha + 1u)),
+                static_cast<uint8_t>(random.Next() % (alpha + 1u)), alpha };
+        }
+        const pair<const char*, BlendMode> modes[4] = { { "normal", BlendMode::Normal }, { "multiply", BlendMode::Multiply },
+            { "screen", BlendMode::Screen }, { "add", BlendMode::Add } };
+        for (auto [modeName, mode] : modes)
+        {
+            runner.Run(string("lab1/blend_row/scalar/") + modeName, [&, mode] {
+                Compositor::BlendRowScalar(destination.data(), source.data(), 800, 200, mode);
+                return static_cast<int64_t>(800);
+            });
+            runner.Run(string("lab1/blend_row/simd/") + modeName, [&, mode] {
+                Compositor::BlendRow(destination.data(), source.data(), 800, 200, mode);
+                return static_cast<int64_t>(800);
+            });
+        }
+    }
+
+    // One full width row of palette indices expanded to RGBA, a lookup per pixel against the gather
+    {
+        PatternRandom random{ 9 };
+        vector<Pixel> palette(256);
+        for (auto& pixel : palette)
+        {
+            pixel = { static_cast<uint8_t>(random.Next()), static_cast<uint8_t>(random.Next()), static_cast<uint8_t>(random.Next()), 255 };
+        }
+        vector<uint8_t> indices(800);
+        for (auto& index : indices)
+        {
+            index = static_cast<uint8_t>(random.Next());
+        }
+        vector<Pixel> row(800);
+        runner.Run("lab1/expand_row/scalar", [&] {
+            IndexedBitmap::ExpandIndicesScalar(indices.data(), 800, palette.data(), row.data());
+            return static_cast<int64_t>(800);
+        });
+        runner.Run("lab1/expand_row/simd", [&] {
+            IndexedBitmap::ExpandIndices(indices.data(), 800, palette.data(), row.data());
+            return static_cast<int64_t>(800);
+        });
+    }
+
+    // Four layers, a full recomposite against the dirty tiles of a short stroke
+    for (auto [width, height] : { pair{ 100, 75 }, pair{ 800, 600 } })
+    {
+        string size = to_string(width) + "x" + to_string(height);
+        Canvas canvas = Canvas::New(width, height, 4);
+        canvas.layers[0].bitmap = CreateNoiseBitmap(width, height, 40, 7);
+        for (int i = 1; i < 4; ++i)
+        {
+            canvas.layers[i].bitmap = CreateCheckerboardBitmap(width, height, 4 * i);
+            canvas.layers[i].opacity = static_cast<uint8_t>(255 - 60 * i);
+            canvas.layers[i].blendMode = static_cast<BlendMode>(i);
+        }
+        canvas.Composite();
+
+        runner.Run("lab1/composite/full/" + size, [&] {
+            canvas.MarkAllDirty();
+            canvas.Composite();
+            return static_cast<int64_t>(canvas.composite.pixels.size());
+        });
+
+        // The same layers stored as palette indices, expanded row by row while compositing
+        Canvas indexed = Canvas::New(width, height, 4, LayerStorage::Indexed);
+        for (int i = 0; i < 4; ++i)
+        {
+            IndexedBitmap::FromBitmap(canvas.layers[i].bitmap, indexed.layers[i].indexed);
+            indexed.layers[i].opacity = canvas.layers[i].opacity;
+            indexed.layers[i].blendMode = canvas.layers[i].blendMode;
+        }
+        runner.Run("lab1/composite/full_indexed/" + size, [&] {
+            indexed.MarkAllDirty();
+            indexed.Composite();
+            return static_cast<int64_t>(indexed.composite.pixels.size());
+        });
+
+        int step = 0;
+        runner.Run("lab1/composite/stroke/" + size, [&] {
+            ++step;
+            for (int i = 0; i < 8; ++i)
+            {
+                canvas.SetPixel({ (step * 3 + i) % width, (step + i) % height }, FillPixels[step & 1]);
+            }
+            CanvasRect changed = canvas.Composite();
+            return static_cast<int64_t>(changed.right - changed.left) * (changed.bottom - changed.top);
+        });
+    }
+
+    // Brush strokes of segments up to 48 pixels long, as spans against stamping the brush at every pixel step
+    {
+        const int width = 800;
+        const int height = 600;
+        Canvas canvas = Canvas::New(width, height, 1);
+        SelectionMask noSelection;
+        vector<StrokeSpan> spans;
+        // The segments repeat after 400 steps
+        auto segmentEnd = [](int step) { return sf::Vector2i{ 100 + (step * 48) % 600, 100 + (step * 29) % 400 }; };
+
+        for (auto shape : { BrushShape::Round, BrushShape::Square })
+        {
+            for (int radius : { 1, 8, 32 })
+            {
+                Brush brush = { shape, radius };
+                vector<int64_t> segmentPixels(400);
+                for (int step = 0; step < 400; ++step)
+                {
+                    StrokeRasterizer::SegmentSpans(segmentEnd(step), segmentEnd(step + 1), brush, width, height, spans);
+                    for (auto& span : spans)
+                    {
+                        segmentPixels[step] += span.right - span.left;
+                    }
+                }
+
+                string name = string("lab1/stroke/") + (shape == BrushShape::Round ? "round" : "square") + "/r" + to_string(radius);
+                int step = 0;
+                runner.Run(name + "/spans", [&, brush] {
+                    step = (step + 1) % 400;
+                    canvas.PaintSegment(segmentEnd(step), segmentEnd(step + 1), brush, FillPixels[step & 1], noSelection);
+                    return segmentPixels[step];
+                });
+
+                if (shape != BrushShape::Round || radius != 8)
+                {
+                    continue;
+                }
+                runner.Run(name + "/dabs", [&] {
+                    step = (step + 1) % 400;
+                    sf::Vector2i from = segmentEnd(step);
+                    sf::Vector2i to = segmentEnd(step + 1);
+                    int steps = max(max(abs(to.x - from.x), abs(to.y - from.y)), 1);
+                    for (int i = 0; i <= steps; ++i)
+                    {
+                        int x = from.x + (to.x - from.x) * i / steps;
+                        int y = from.y + (to.y - from.y) * i / steps;
+                        for (int dy = -radius; dy <= radius; ++dy)
+                        {
+                            for (int dx = -radius; dx <= radius; ++dx)
+                            {
+                                if (4 * (dx * dx + dy * dy) < (2 * radius + 1) * (2 * radius + 1))
+                                {
+                                    canvas.SetPixel({ x + dx, y + dy }, FillPixels[step & 1]);
+                                }
+                            }
+                        }
+                    }
+                    return segmentPixels[step];
+                });
+            }
+        }
+    }
+}
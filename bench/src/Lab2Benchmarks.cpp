@@ -0,0 +1,110 @@
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <utility>
+#include <algorithm>
+
+#include "Benchmark.h"
+
+#include "../../lab2/src/Bitmap.h"
+
+using namespace std;
+
+namespace
+{
+    const Pixel DrawPixels[2] = { { 255, 0, 0, 255 }, { 0, 255, 255, 255 } };
+
+    // Pixels a call writes at least once, measured on a cleared canvas
+    template<typename Draw>
+    int64_t CountCoveredPixels(int width, int height, Draw&& draw)
+    {
+        Bitmap bitmap = Bitmap::New(width, height);
+        draw(bitmap, DrawPixels[0]);
+        int64_t count = 0;
+        for (auto& p : bitmap.pixels)
+        {
+            count += p.r == DrawPixels[0].r && p.g == DrawPixels[0].g && p.b == DrawPixels[0].b ? 1 : 0;
+        }
+        return count;
+    }
+
+    template<typename Draw>
+    void RunDrawBenchmark(BenchmarkRunner& runner, const string& name, Bitmap& bitmap, Draw&& draw)
+    {
+        if (!runner.IsSelected(name))
+        {
+            return;
+        }
+
+        int64_t covered = CountCoveredPixels(bitmap.width, bitmap.height, draw);
+        int iteration = 0;
+        runner.Run(name, [&] {
+            draw(bitmap, DrawPixels[++iteration & 1]);
+            return covered;
+        });
+    }
+}
+
+void RunLab2Benchmarks(BenchmarkRunner& runner)
+{
+    int width = 640;
+    int height = 480;
+    Bitmap bitmap = Bitmap::New(width, height);
+    Point center = { width / 2, height / 2 };
+
+    runner.Run("lab2/clear/" + to_string(width) + "x" + to_string(height), [&] {
+        bitmap.Clear();
+        return static_cast<int64_t>(bitmap.pixels.size());
+    });
+
+    // Direction vectors cover the four Bresenham cases: x-major, y-major, exact diagonal and both signs
+    struct Slope
+    {
+        const char* name;
+        int dx, dy;
+    };
+    const Slope slopes[] = {
+        { "horizontal", 1, 0 },
+        { "vertical", 0, 1 },
+        { "diagonal", 1, 1 },
+        { "shallow", 4, -1 },
+        { "steep", -1, 4 },
+    };
+
+    for (auto& slope : slopes)
+    {
+        for (int length : { 8, 64, 400 })
+        {
+            float scale = length / std::sqrt(static_cast<float>(slope.dx * slope.dx + slope.dy * slope.dy));
+            Point offset = { static_cast<int>(slope.dx * scale / 2), static_cast<int>(slope.dy * scale / 2) };
+            Point from = { center.x - offset.x, center.y - offset.y };
+            Point to = { center.x + offset.x, center.y + offset.y };
+            RunDrawBenchmark(runner, "lab2/draw_line/" + string(slope.name) + "/" + to_string(length), bitmap, [=](Bitmap& target, const Pixel& pixel) {
+                target.DrawLine(from, to, pixel);
+            });
+        }
+    }
+
+    // Half of a line far outside the canvas still walks every pixel through the bounds check
+    RunDrawBenchmark(runner, "lab2/draw_line/clipped/2000", bitmap, [=](Bitmap& target, const Pixel& pixel) {
+        target.DrawLine({ center.x - 1000, center.y }, { center.x + 1000, center.y + 10 }, pixel);
+    });
+
+    // Sizes from a single pixel to larger than the canvas, a generic shape so both flat halves are used
+    for (int size : { 1, 2, 8, 32, 128, 480, 1600 })
+    {
+        Point p1 = { center.x - size / 5, center.y - size / 2 };
+        Point p2 = { center.x + size / 2, center.y + size / 6 };
+        Point p3 = { center.x - size / 2, center.y + size / 2 };
+        string suffix = "/" + to_string(size);
+
+        RunDrawBenchmark(runner, "lab2/draw_triangle" + suffix, bitmap, [=](Bitmap& target, const Pixel& pixel) {
+            target.DrawTriangle(p1, p2, p3, pixel);
+        });
+        RunDrawBenchmark(runner, "lab2/fill_triangle" + suffix, bitmap, [=](Bitmap& target, const Pixel& pixel) {
+            target.FillTriangle(p1, p2, p3, pixel);
+        });
+    }
+}
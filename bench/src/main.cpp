@@ -0,0 +1,27 @@
+// Microbenchmarks for the lab1 and lab2 Bitmap primitives. Only needs the SFML System headers (for sf::Vector2i),
+// no window or graphics libraries, so it also builds on Linux:
+//     g++ -std=c++20 -O2 bench/src/*.cpp -o bench_bitmap
+#include <cstdio>
+
+#include "Benchmark.h"
+
+int main(int argc, char* argv[])
+{
+    BenchmarkRunner runner;
+    if (!BenchmarkRunner::ParseArguments(argc - 1, argv + 1, runner.settings))
+    {
+        std::fprintf(stderr, "Usage: %s %s\n", argv[0], BenchmarkRunner::Usage);
+        return 1;
+    }
+
+    runner.PrintHeader();
+    RunLab1Benchmarks(runner);
+    RunLab2Benchmarks(runner);
+
+    if (runner.results.empty())
+    {
+        std::fprintf(stderr, "No benchmark matches \"%s\"\n", runner.settings.filter.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file, data is nullptr if the file could not be mapped
+struct MappedFile
+{
+    const char* data = nullptr;
+    std::size_t size = 0;
+
+    MappedFile() = default;
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile& operator=(MappedFile&& other) noexcept
+    {
+        std::swap(data, other.data);
+        std::swap(size, other.size);
+        return *this;
+    }
+
+    ~MappedFile()
+    {
+        if (data == nullptr)
+        {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(const_cast<char*>(data), size);
+#endif
+    }
+
+    bool IsOpen() const
+    {
+        return data != nullptr;
+    }
+
+    static MappedFile Open(const char* path)
+    {
+        MappedFile result;
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return result;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+        {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr)
+            {
+                result.data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                result.size = result.data != nullptr ? static_cast<std::size_t>(fileSize.QuadPart) : 0;
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int file = open(path, O_RDONLY);
+        if (file < 0)
+        {
+            return result;
+        }
+
+        struct stat fileStat;
+        if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0)
+        {
+            void* mapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+            if (mapping != MAP_FAILED)
+            {
+                madvise(mapping, fileStat.st_size, MADV_SEQUENTIAL);
+                result.data = static_cast<const char*>(mapping);
+                result.size = static_cast<std::size_t>(fileStat.st_size);
+            }
+        }
+        close(file);
+#endif
+        return result;
+    }
+};
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct RegressionImage
+{
+    int width = 0;
+    int height = 0;
+    // RGBA, alpha is not compared
+    std::vector<std::uint8_t> pixels;
+};
+
+struct RegressionScene
+{
+    std::string name;
+    // Timed, must produce the same output every time it is called
+    std::function<void()> render;
+    std::function<RegressionImage()> capture;
+};
+
+struct RegressionSettings
+{
+    bool record = false;
+    std::string directory;
+    // Largest per-channel difference that still counts as a matching pixel
+    int tolerance = 2;
+    // Fraction of pixels allowed to exceed the tolerance, absorbs edge rounding between compilers
+    double maxMismatchFraction = 0.001;
+    int repeatCount = 20;
+    std::string baselinePath;
+    std::string timingsPath;
+    // A scene is slower than the baseline when its median exceeds it by more than this fraction
+    double regressionThreshold = 0.25;
+};
+
+// Golden image and timing checks for headless scenes.
+// "record" stores reference PPM images and a baseline timings file, "check" compares against them.
+struct Regression
+{
+    static constexpr const char* Usage =
+        "--regression record|check <directory> [--tolerance N] [--mismatch F] [--repeat N] [--baseline file] [--timings file] [--threshold F]\n"
+        "  References are not part of the repository, timings only compare on the machine that recorded them.\n"
+        "  Record them once from a known good build, then check later builds against the same directory:\n"
+        "    record <directory>  writes <scene>.ppm for every scene and the timings.json baseline\n"
+        "    check <directory>   compares images and timings, writes <scene>.actual.ppm and timings.latest.json";
+
+    static bool ParseArguments(int argc, char* argv[], RegressionSettings& settings)
+    {
+        if (argc < 2)
+        {
+            return false;
+        }
+
+        std::string_view mode = argv[0];
+        if (mode != "record" && mode != "check")
+        {
+            return false;
+        }
+        settings.record = mode == "record";
+        settings.directory = argv[1];
+
+        for (int i = 2; i < argc; ++i)
+        {
+            std::string_view argument = argv[i];
+            if (i + 1 >= argc)
+            {
+                return false;
+            }
+            const char* value = argv[++i];
+            if (argument == "--tolerance")
+            {
+                settings.tolerance = std::atoi(value);
+            }
+            else if (argument == "--mismatch")
+            {
+                settings.maxMismatchFraction = std::atof(value);
+            }
+            else if (argument == "--repeat")
+            {
+                settings.repeatCount = std::max(1, std::atoi(value));
+            }
+            else if (argument == "--baseline")
+            {
+                settings.baselinePath = value;
+            }
+            else if (argument == "--timings")
+            {
+                settings.timingsPath = value;
+            }
+            else if (argument == "--threshold")
+            {
+                settings.regressionThreshold = std::atof(value);
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        if (settings.baselinePath.empty())
+        {
+            settings.baselinePath = settings.directory + "/timings.json";
+        }
+        if (settings.timingsPath.empty())
+        {
+            settings.timingsPath = settings.record ? settings.baselinePath : settings.directory + "/timings.latest.json";
+        }
+        return true;
+    }
+
+    // Returns the process exit code, 0 when every image matched and no scene regressed
+    static int Run(const std::vector<RegressionScene>& scenes, const RegressionSettings& settings)
+    {
+        std::map<std::string, double> timings;
+        int failures = 0;
+
+        if (settings.record)
+        {
+            std::error_code error;
+            std::filesystem::create_directories(settings.directory, error);
+        }
+
+        if (!settings.record && !HasReferences(scenes, settings.directory))
+        {
+            std::cout << "No reference images in " << settings.directory << ", record them first with --regression record "
+                << settings.directory << std::endl;
+            return 1;
+        }
+
+        for (auto& scene : scenes)
+        {
+            timings[scene.name] = MeasureMedianNanoseconds(scene, settings.repeatCount);
+            RegressionImage image = scene.capture();
+            std::string imagePath = settings.directory + "/" + scene.name + ".ppm";
+
+            if (settings.record)
+            {
+                if (!WritePpm(imagePath, image))
+                {
+                    std::cout << "FAIL " << scene.name << ": unable to write " << imagePath << std::endl;
+                    ++failures;
+                }
+                continue;
+            }
+
+            RegressionImage reference;
+            if (!ReadPpm(imagePath, reference))
+            {
+                std::cout << "FAIL " << scene.name << ": no reference image " << imagePath << std::endl;
+                ++failures;
+                continue;
+            }
+
+            int maxDifference = 0;
+            std::size_t mismatched = CountMismatchedPixels(image, reference, settings.tolerance, maxDifference);
+            std::size_t allowed = static_cast<std::size_t>(settings.maxMismatchFraction * image.width * image.height);
+            if (image.width != reference.width || image.height != reference.height || mismatched > allowed)
+            {
+                std::cout << "FAIL " << scene.name << ": " << mismatched << " pixels differ by more than " << settings.tolerance
+                    << " (max difference " << maxDifference << ")" << std::endl;
+                WritePpm(settings.directory + "/" + scene.name + ".actual.ppm", image);
+                ++failures;
+            }
+        }
+
+        if (!WriteTimings(settings.timingsPath, timings))
+        {
+            std::cout << "FAIL unable to write timings to " << settings.timingsPath << std::endl;
+            ++failures;
+        }
+
+        if (!settings.record)
+        {
+            std::map<std::string, double> baseline;
+            if (!ReadTimings(settings.baselinePath, baseline))
+            {
+                std::cout << "No baseline timings in " << settings.baselinePath << ", skipping performance comparison" << std::endl;
+            }
+            for (auto& [name, nanoseconds] : timings)
+            {
+                auto found = baseline.find(name);
+                if (found == baseline.end() || found->second <= 0.0)
+                {
+                    continue;
+                }
+                double change = nanoseconds / found->second - 1.0;
+                bool regressed = change > settings.regressionThreshold;
+                std::cout << (regressed ? "SLOW " : "     ") << name << ": " << nanoseconds / 1000.0 << " us vs "
+                    << found->second / 1000.0 << " us baseline (" << (change >= 0.0 ? "+" : "") << change * 100.0 << "%)" << std::endl;
+                failures += regressed ? 1 : 0;
+            }
+        }
+
+        std::cout << scenes.size() << " scenes " << (settings.record ? "recorded" : "checked") << ", " << failures << " failures" << std::endl;
+        return failures == 0 ? 0 : 1;
+    }
+
+private:
+    // Any reference at all, a directory with only some of them still fails the missing scenes one by one
+    static bool HasReferences(const std::vector<RegressionScene>& scenes, const std::string& directory)
+    {
+        std::error_code error;
+        return std::any_of(scenes.begin(), scenes.end(), [&](const RegressionScene& scene) {
+            return std::filesystem::exists(directory + "/" + scene.name + ".ppm", error);
+        });
+    }
+
+    // Short scenes are repeated inside each sample so timer resolution and scheduler noise stay small
+    static constexpr double MinSampleNanoseconds = 2'000'000.0;
+
+    static double MeasureMedianNanoseconds(const RegressionScene& scene, int repeatCount)
+    {
+        auto measure = [&](int iterations) {
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; ++i)
+            {
+                scene.render();
+            }
+            auto end = std::chrono::steady_clock::now();
+            return std::chrono::duration<double, std::nano>(end - start).count();
+        };
+
+        // The first call also warms up caches and allocations
+        int iterations = 1;
+        double first = measure(1);
+        if (first < MinSampleNanoseconds)
+        {
+            iterations = static_cast<int>(std::ceil(MinSampleNanoseconds / std::max(first, 1.0)));
+        }
+
+        std::vector<double> samples;
+        samples.reserve(repeatCount);
+        for (int i = 0; i < repeatCount; ++i)
+        {
+            samples.push_back(measure(iterations) / iterations);
+        }
+        std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+        return samples[samples.size() / 2];
+    }
+
+    static std::size_t CountMismatchedPixels(const RegressionImage& image, const RegressionImage& reference, int tolerance, int& maxDifference)
+    {
+        maxDifference = 0;
+        if (image.width != reference.width || image.height != reference.height)
+        {
+            return static_cast<std::size_t>(image.width) * image.height;
+        }
+
+        std::size_t mismatched = 0;
+        for (std::size_t i = 0; i < image.pixels.size(); i += 4)
+        {
+            int difference = 0;
+            for (int channel = 0; channel < 3; ++channel)
+            {
+                difference = std::max(difference, std::abs(image.pixels[i + channel] - reference.pixels[i + channel]));
+            }
+            maxDifference = std::max(maxDifference, difference);
+            mismatched += difference > tolerance ? 1 : 0;
+        }
+        return mismatched;
+    }
+
+    static bool WritePpm(const std::string& path, const RegressionImage& image)
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open())
+        {
+            return false;
+        }
+        file << "P6\n" << image.width << " " << image.height << "\n255\n";
+        for (std::size_t i = 0; i < image.pixels.size(); i += 4)
+        {
+            file.write(reinterpret_cast<const char*>(&image.pixels[i]), 3);
+        }
+        return file.good();
+    }
+
+    static bool ReadPpm(const std::string& path, RegressionImage& image)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::string magic;
+        int maxValue = 0;
+        if (!(file >> magic >> image.width >> image.height >> maxValue) || magic != "P6" || maxValue != 255)
+        {
+            return false;
+        }
+        file.get();
+
+        image.pixels.assign(static_cast<std::size_t>(image.width) * image.height * 4, 255);
+        for (std::size_t i = 0; i < image.pixels.size(); i += 4)
+        {
+            file.read(reinterpret_cast<char*>(&image.pixels[i]), 3);
+        }
+        return file.good();
+    }
+
+    static bool WriteTimings(const std::string& path, const std::map<std::string, double>& timings)
+    {
+        std::ofstream file(path);
+        if (!file.is_open())
+        {
+            return false;
+        }
+        file << "{\n  \"median_ns\": {\n";
+        std::size_t written = 0;
+        for (auto& [name, nanoseconds] : timings)
+        {
+            file << "    \"" << name << "\": " << static_cast<long long>(std::llround(nanoseconds)) << (++written < timings.size() ? ",\n" : "\n");
+        }
+        file << "  }\n}\n";
+        return file.good();
+    }
+
+    // Reads the flat "name": number pairs written by WriteTimings
+    static bool ReadTimings(const std::string& path, std::map<std::string, double>& timings)
+    {
+        std::ifstream file(path);
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            auto nameBegin = line.find('"');
+            auto nameEnd = line.find('"', nameBegin + 1);
+            auto colon = line.find(':', nameEnd);
+            if (nameBegin == std::string::npos || nameEnd == std::string::npos || colon == std::string::npos)
+            {
+                continue;
+            }
+            char* valueEnd = nullptr;
+            double value = std::strtod(line.c_str() + colon + 1, &valueEnd);
+            if (valueEnd != line.c_str() + colon + 1)
+            {
+                timings[line.substr(nameBegin + 1, nameEnd - nameBegin - 1)] = value;
+            }
+        }
+        return !timings.empty();
+    }
+};
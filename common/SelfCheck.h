@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Pass/fail state of one "--check-*" mode. A failure is reported and the check goes on, so one run lists all of them.
+struct SelfCheck
+{
+    // Where failures go, lab3 routes them to spdlog
+    static inline void (*Report)(std::string_view message) = [](std::string_view message) { std::cerr << message << std::endl; };
+
+    std::string name;
+    bool passed = true;
+
+    explicit SelfCheck(std::string name)
+        : name(std::move(name))
+    {
+    }
+
+    void Fail(std::string_view what)
+    {
+        Report(name + " check failed: " + std::string{ what });
+        passed = false;
+    }
+
+    int ExitCode() const
+    {
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+};
+
+struct SelfCheckMode
+{
+    std::string_view flag;
+    int (*run)();
+};
+
+// Runs the mode named by flag and stores its exit code, false when no mode has that flag
+inline bool RunSelfCheck(std::span<const SelfCheckMode> modes, std::string_view flag, int& exitCode)
+{
+    for (const SelfCheckMode& mode : modes)
+    {
+        if (mode.flag == flag)
+        {
+            exitCode = mode.run();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,686 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class SnapshotFormat
+{
+    Qoi,
+    Png
+};
+
+// Lossless RGBA encoders for saving a frame. QOI is a single pass over the pixels, PNG uses one fixed Huffman
+// deflate block with a single probe hash table, which is roughly what zlib's fastest level does. Images are rows of
+// 4 byte r, g, b, a pixels, the layout of every lab's Pixel, so the labs share this header.
+struct ImageEncoder
+{
+    static const char* Extension(SnapshotFormat format)
+    {
+        return format == SnapshotFormat::Qoi ? ".qoi" : ".png";
+    }
+
+    static void Encode(SnapshotFormat format, const std::uint8_t* rgba, int width, int height, std::vector<std::uint8_t>& output)
+    {
+        if (format == SnapshotFormat::Qoi)
+        {
+            EncodeQoi(rgba, width, height, output);
+        }
+        else
+        {
+            EncodePng(rgba, width, height, output);
+        }
+    }
+
+    static void EncodeQoi(const std::uint8_t* rgba, int width, int height, std::vector<std::uint8_t>& output)
+    {
+        output.clear();
+        output.reserve(QoiHeaderSize + static_cast<std::size_t>(width) * height * 5 + sizeof(QoiEnd));
+        output.insert(output.end(), { 'q', 'o', 'i', 'f' });
+        AppendBigEndian(output, static_cast<std::uint32_t>(width));
+        AppendBigEndian(output, static_cast<std::uint32_t>(height));
+        // Four channels, sRGB with linear alpha
+        output.push_back(4);
+        output.push_back(0);
+
+        std::array<Rgba, 64> index = {};
+        Rgba previous = { 0, 0, 0, 255 };
+        int run = 0;
+        const std::size_t count = static_cast<std::size_t>(width) * height;
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const Rgba pixel = { rgba[4 * i], rgba[4 * i + 1], rgba[4 * i + 2], rgba[4 * i + 3] };
+            if (SamePixel(pixel, previous))
+            {
+                if (++run == 62 || i + 1 == count)
+                {
+                    output.push_back(static_cast<std::uint8_t>(QoiRun | (run - 1)));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0)
+            {
+                output.push_back(static_cast<std::uint8_t>(QoiRun | (run - 1)));
+                run = 0;
+            }
+
+            const int slot = QoiHash(pixel);
+            if (SamePixel(index[slot], pixel))
+            {
+                output.push_back(static_cast<std::uint8_t>(QoiIndex | slot));
+            }
+            else
+            {
+                index[slot] = pixel;
+                if (pixel.a == previous.a)
+                {
+                    const int dr = static_cast<std::int8_t>(pixel.r - previous.r);
+                    const int dg = static_cast<std::int8_t>(pixel.g - previous.g);
+                    const int db = static_cast<std::int8_t>(pixel.b - previous.b);
+                    const int drg = dr - dg;
+                    const int dbg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                    {
+                        output.push_back(static_cast<std::uint8_t>(QoiDiff | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                    }
+                    else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+                    {
+                        output.push_back(static_cast<std::uint8_t>(QoiLuma | (dg + 32)));
+                        output.push_back(static_cast<std::uint8_t>((drg + 8) << 4 | (dbg + 8)));
+                    }
+                    else
+                    {
+                        output.insert(output.end(), { QoiRgb, pixel.r, pixel.g, pixel.b });
+                    }
+                }
+                else
+                {
+                    output.insert(output.end(), { QoiRgba, pixel.r, pixel.g, pixel.b, pixel.a });
+                }
+            }
+            previous = pixel;
+        }
+
+        output.insert(output.end(), std::begin(QoiEnd), std::end(QoiEnd));
+    }
+
+    // Replaces rgba with the decoded pixels
+    static bool DecodeQoi(const std::uint8_t* data, std::size_t size, std::vector<std::uint8_t>& rgba, int& width, int& height)
+    {
+        if (size < QoiHeaderSize + sizeof(QoiEnd) || std::memcmp(data, "qoif", 4) != 0)
+        {
+            return false;
+        }
+        const std::uint32_t headerWidth = ReadBigEndian(data + 4);
+        const std::uint32_t headerHeight = ReadBigEndian(data + 8);
+        if (headerWidth == 0 || headerHeight == 0 || headerWidth > 32768 || headerHeight > 32768)
+        {
+            return false;
+        }
+
+        width = static_cast<int>(headerWidth);
+        height = static_cast<int>(headerHeight);
+        rgba.resize(static_cast<std::size_t>(headerWidth) * headerHeight * 4);
+
+        std::array<Rgba, 64> index = {};
+        Rgba pixel = { 0, 0, 0, 255 };
+        std::size_t position = QoiHeaderSize;
+        const std::size_t end = size - sizeof(QoiEnd);
+        int run = 0;
+
+        for (std::size_t i = 0; i < rgba.size(); i += 4)
+        {
+            if (run > 0)
+            {
+                --run;
+            }
+            else
+            {
+                if (position >= end)
+                {
+                    return false;
+                }
+                const std::uint8_t tag = data[position++];
+                if (tag == QoiRgb || tag == QoiRgba)
+                {
+                    const std::size_t channels = tag == QoiRgb ? 3 : 4;
+                    if (position + channels > end)
+                    {
+                        return false;
+                    }
+                    pixel.r = data[position];
+                    pixel.g = data[position + 1];
+                    pixel.b = data[position + 2];
+                    pixel.a = tag == QoiRgb ? pixel.a : data[position + 3];
+                    position += channels;
+                }
+                else if ((tag & 0xc0) == QoiIndex)
+                {
+                    pixel = index[tag];
+                }
+                else if ((tag & 0xc0) == QoiDiff)
+                {
+                    pixel.r = static_cast<std::uint8_t>(pixel.r + ((tag >> 4) & 3) - 2);
+                    pixel.g = static_cast<std::uint8_t>(pixel.g + ((tag >> 2) & 3) - 2);
+                    pixel.b = static_cast<std::uint8_t>(pixel.b + (tag & 3) - 2);
+                }
+                else if ((tag & 0xc0) == QoiLuma)
+                {
+                    if (position >= end)
+                    {
+                        return false;
+                    }
+                    const int dg = (tag & 0x3f) - 32;
+                    const std::uint8_t next = data[position++];
+                    pixel.r = static_cast<std::uint8_t>(pixel.r + dg + (next >> 4) - 8);
+                    pixel.g = static_cast<std::uint8_t>(pixel.g + dg);
+                    pixel.b = static_cast<std::uint8_t>(pixel.b + dg + (next & 0x0f) - 8);
+                }
+                else
+                {
+                    run = tag & 0x3f;
+                }
+                index[QoiHash(pixel)] = pixel;
+            }
+            rgba[i] = pixel.r;
+            rgba[i + 1] = pixel.g;
+            rgba[i + 2] = pixel.b;
+            rgba[i + 3] = pixel.a;
+        }
+
+        return position == end && std::memcmp(data + end, QoiEnd, sizeof(QoiEnd)) == 0;
+    }
+
+    // Every scanline uses the Up filter so repeated rows deflate to long zero runs
+    static void EncodePng(const std::uint8_t* rgba, int width, int height, std::vector<std::uint8_t>& output)
+    {
+        const std::size_t stride = static_cast<std::size_t>(width) * 4;
+        std::vector<std::uint8_t> filtered((stride + 1) * height);
+        for (int y = 0; y < height; ++y)
+        {
+            std::uint8_t* row = filtered.data() + (stride + 1) * y;
+            const std::uint8_t* current = rgba + stride * y;
+            row[0] = 2;
+            if (y == 0)
+            {
+                std::memcpy(row + 1, current, stride);
+                continue;
+            }
+            const std::uint8_t* above = current - stride;
+            for (std::size_t i = 0; i < stride; ++i)
+            {
+                row[i + 1] = static_cast<std::uint8_t>(current[i] - above[i]);
+            }
+        }
+
+        output.clear();
+        output.reserve(filtered.size() / 4 + 1024);
+        static constexpr std::uint8_t Signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        output.insert(output.end(), std::begin(Signature), std::end(Signature));
+
+        std::vector<std::uint8_t> header;
+        AppendBigEndian(header, static_cast<std::uint32_t>(width));
+        AppendBigEndian(header, static_cast<std::uint32_t>(height));
+        // 8 bits per channel, RGBA, deflate, adaptive filtering, no interlace
+        header.insert(header.end(), { 8, 6, 0, 0, 0 });
+        AppendChunk(output, "IHDR", header.data(), header.size());
+
+        std::vector<std::uint8_t> stream;
+        Deflate(filtered.data(), filtered.size(), stream);
+        AppendChunk(output, "IDAT", stream.data(), stream.size());
+        AppendChunk(output, "IEND", nullptr, 0);
+    }
+
+    // zlib stream of a single fixed Huffman block
+    static void Deflate(const std::uint8_t* data, std::size_t size, std::vector<std::uint8_t>& output)
+    {
+        // 32K window, no preset dictionary, fastest compression
+        output.push_back(0x78);
+        output.push_back(0x01);
+
+        const auto& tables = FixedHuffman();
+        BitWriter writer{ output };
+        writer.Write(1, 1);
+        writer.Write(1, 2);
+
+        std::vector<std::int32_t> head(1 << HashBits, -1);
+        std::size_t position = 0;
+        while (position + 4 <= size)
+        {
+            std::uint32_t word;
+            std::memcpy(&word, data + position, 4);
+            const std::uint32_t hash = (word * 2654435761u) >> (32 - HashBits);
+            const std::int32_t candidate = head[hash];
+            head[hash] = static_cast<std::int32_t>(position);
+
+            std::size_t length = 0;
+            if (candidate >= 0 && position - candidate <= WindowSize && std::memcmp(data + candidate, &word, 4) == 0)
+            {
+                const std::size_t limit = std::min<std::size_t>(MaxMatch, size - position);
+                length = 4;
+                while (length < limit && data[candidate + length] == data[position + length])
+                {
+                    ++length;
+                }
+            }
+
+            if (length == 0)
+            {
+                writer.Write(tables.literalCodes[data[position]], tables.literalLengths[data[position]]);
+                ++position;
+                continue;
+            }
+
+            const int lengthCode = tables.lengthCodes[length];
+            const int symbol = 257 + lengthCode;
+            writer.Write(tables.literalCodes[symbol], tables.literalLengths[symbol]);
+            writer.Write(static_cast<std::uint32_t>(length - LengthBase[lengthCode]), LengthExtraBits[lengthCode]);
+
+            const std::size_t distance = position - candidate;
+            const int distanceCode = tables.distanceCodes[distance - 1];
+            writer.Write(tables.distanceSymbols[distanceCode], 5);
+            writer.Write(static_cast<std::uint32_t>(distance - DistanceBase[distanceCode]), DistanceExtraBits[distanceCode]);
+            position += length;
+        }
+        for (; position < size; ++position)
+        {
+            writer.Write(tables.literalCodes[data[position]], tables.literalLengths[data[position]]);
+        }
+
+        writer.Write(tables.literalCodes[256], tables.literalLengths[256]);
+        writer.Flush();
+        AppendBigEndian(output, Adler32(data, size));
+    }
+
+    static std::uint32_t Crc32(const std::uint8_t* data, std::size_t size, std::uint32_t crc = 0)
+    {
+        static const std::array<std::uint32_t, 256> table = [] {
+            std::array<std::uint32_t, 256> result = {};
+            for (std::uint32_t i = 0; i < 256; ++i)
+            {
+                std::uint32_t value = i;
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    value = value & 1 ? 0xedb88320u ^ (value >> 1) : value >> 1;
+                }
+                result[i] = value;
+            }
+            return result;
+        }();
+
+        crc = ~crc;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    static std::uint32_t Adler32(const std::uint8_t* data, std::size_t size)
+    {
+        std::uint32_t a = 1;
+        std::uint32_t b = 0;
+        while (size > 0)
+        {
+            // The largest block that cannot overflow b before the modulo
+            const std::size_t block = std::min<std::size_t>(size, 5552);
+            for (std::size_t i = 0; i < block; ++i)
+            {
+                a += data[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+            data += block;
+            size -= block;
+        }
+        return b << 16 | a;
+    }
+
+private:
+    static constexpr std::size_t QoiHeaderSize = 14;
+    static constexpr std::uint8_t QoiEnd[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    static constexpr std::uint8_t QoiIndex = 0x00;
+    static constexpr std::uint8_t QoiDiff = 0x40;
+    static constexpr std::uint8_t QoiLuma = 0x80;
+    static constexpr std::uint8_t QoiRun = 0xc0;
+    static constexpr std::uint8_t QoiRgb = 0xfe;
+    static constexpr std::uint8_t QoiRgba = 0xff;
+
+    static constexpr int HashBits = 15;
+    static constexpr std::size_t WindowSize = 32768;
+    static constexpr std::size_t MaxMatch = 258;
+    static constexpr std::uint16_t LengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115,
+        131, 163, 195, 227, 258 };
+    static constexpr std::uint8_t LengthExtraBits[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static constexpr std::uint16_t DistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025,
+        1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static constexpr std::uint8_t DistanceExtraBits[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+        12, 12, 13, 13 };
+
+    // Huffman codes are sent most significant bit first, so they are stored already reversed
+    struct FixedHuffmanTables
+    {
+        std::array<std::uint16_t, 288> literalCodes;
+        std::array<std::uint8_t, 288> literalLengths;
+        std::array<std::uint8_t, 30> distanceSymbols;
+        std::array<std::uint8_t, MaxMatch + 1> lengthCodes;
+        std::array<std::uint8_t, WindowSize> distanceCodes;
+    };
+
+    struct BitWriter
+    {
+        std::vector<std::uint8_t>& output;
+        std::uint64_t bits = 0;
+        int count = 0;
+
+        void Write(std::uint32_t value, int length)
+        {
+            bits |= static_cast<std::uint64_t>(value) << count;
+            count += length;
+            while (count >= 8)
+            {
+                output.push_back(static_cast<std::uint8_t>(bits));
+                bits >>= 8;
+                count -= 8;
+            }
+        }
+
+        void Flush()
+        {
+            if (count > 0)
+            {
+                output.push_back(static_cast<std::uint8_t>(bits));
+            }
+            bits = 0;
+            count = 0;
+        }
+    };
+
+    static std::uint32_t Reverse(std::uint32_t code, int length)
+    {
+        std::uint32_t result = 0;
+        for (int i = 0; i < length; ++i)
+        {
+            result = result << 1 | (code >> i & 1);
+        }
+        return result;
+    }
+
+    static const FixedHuffmanTables& FixedHuffman()
+    {
+        static const FixedHuffmanTables tables = [] {
+            FixedHuffmanTables result = {};
+            for (int symbol = 0; symbol < 288; ++symbol)
+            {
+                int length = symbol < 144 ? 8 : symbol < 256 ? 9 : symbol < 280 ? 7 : 8;
+                int code = symbol < 144 ? 0x30 + symbol : symbol < 256 ? 0x190 + symbol - 144 : symbol < 280 ? symbol - 256 : 0xc0 + symbol - 280;
+                result.literalCodes[symbol] = static_cast<std::uint16_t>(Reverse(code, length));
+                result.literalLengths[symbol] = static_cast<std::uint8_t>(length);
+            }
+            for (int symbol = 0; symbol < 30; ++symbol)
+            {
+                result.distanceSymbols[symbol] = static_cast<std::uint8_t>(Reverse(symbol, 5));
+            }
+            for (int code = 0; code < 29; ++code)
+            {
+                int end = code + 1 < 29 ? LengthBase[code + 1] : MaxMatch + 1;
+                for (int length = LengthBase[code]; length < end; ++length)
+                {
+                    result.lengthCodes[length] = static_cast<std::uint8_t>(code);
+                }
+            }
+            for (int code = 0; code < 30; ++code)
+            {
+                std::size_t end = code + 1 < 30 ? DistanceBase[code + 1] : WindowSize + 1;
+                for (std::size_t distance = DistanceBase[code]; distance < end; ++distance)
+                {
+                    result.distanceCodes[distance - 1] = static_cast<std::uint8_t>(code);
+                }
+            }
+            return result;
+        }();
+        return tables;
+    }
+
+    struct Rgba
+    {
+        std::uint8_t r, g, b, a;
+    };
+
+    static bool SamePixel(Rgba lhs, Rgba rhs)
+    {
+        return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b && lhs.a == rhs.a;
+    }
+
+    static int QoiHash(Rgba pixel)
+    {
+        return (pixel.r * 3 + pixel.g * 5 + pixel.b * 7 + pixel.a * 11) % 64;
+    }
+
+    static void AppendBigEndian(std::vector<std::uint8_t>& output, std::uint32_t value)
+    {
+        output.insert(output.end(), { static_cast<std::uint8_t>(value >> 24), static_cast<std::uint8_t>(value >> 16),
+            static_cast<std::uint8_t>(value >> 8), static_cast<std::uint8_t>(value) });
+    }
+
+    static std::uint32_t ReadBigEndian(const std::uint8_t* data)
+    {
+        return static_cast<std::uint32_t>(data[0]) << 24 | data[1] << 16 | data[2] << 8 | data[3];
+    }
+
+    static void AppendChunk(std::vector<std::uint8_t>& output, const char type[4], const std::uint8_t* data, std::size_t size)
+    {
+        AppendBigEndian(output, static_cast<std::uint32_t>(size));
+        const std::size_t start = output.size();
+        output.insert(output.end(), type, type + 4);
+        if (size > 0)
+        {
+            output.insert(output.end(), data, data + size);
+        }
+        AppendBigEndian(output, Crc32(output.data() + start, output.size() - start));
+    }
+};
+
+struct SnapshotResult
+{
+    std::string path;
+    SnapshotFormat format = SnapshotFormat::Qoi;
+    std::size_t rawBytes = 0;
+    std::size_t encodedBytes = 0;
+    double encodeSeconds = 0.0;
+    bool written = false;
+};
+
+struct SnapshotStats
+{
+    int exported = 0;
+    int dropped = 0;
+    int failed = 0;
+    std::uint64_t rawBytes = 0;
+    std::uint64_t encodedBytes = 0;
+    double encodeSeconds = 0.0;
+
+    // Uncompressed RGBA megabytes encoded per second of encoder time
+    double MegabytesPerSecond() const
+    {
+        return encodeSeconds > 0.0 ? rawBytes / (1024.0 * 1024.0) / encodeSeconds : 0.0;
+    }
+};
+
+// Saves frames on a background thread. Submit copies the pixels into one of a fixed number of recycled buffers and
+// returns immediately, when all of them are waiting or encoding the snapshot is dropped instead of queued, so a burst
+// of exports neither stalls the frame nor grows memory.
+struct SnapshotExporter
+{
+    SnapshotExporter() = default;
+    SnapshotExporter(const SnapshotExporter&) = delete;
+    SnapshotExporter& operator=(const SnapshotExporter&) = delete;
+
+    ~SnapshotExporter()
+    {
+        Stop();
+    }
+
+    void Start(int capacity = 4)
+    {
+        Stop();
+        std::lock_guard lock(mutex);
+        freeBuffers.assign(std::max(capacity, 1), {});
+        stopping = false;
+        worker = std::thread([this] { Work(); });
+    }
+
+    // Finishes every snapshot already submitted
+    void Stop()
+    {
+        if (!worker.joinable())
+        {
+            return;
+        }
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        jobReady.notify_one();
+        worker.join();
+    }
+
+    // rgba holds width * height pixels, path may be empty to encode without writing, e.g. for benchmarking
+    bool Submit(const std::uint8_t* rgba, int width, int height, SnapshotFormat format, std::string path)
+    {
+        Job job;
+        {
+            std::lock_guard lock(mutex);
+            if (freeBuffers.empty() || !worker.joinable())
+            {
+                ++stats.dropped;
+                return false;
+            }
+            job.rgba = std::move(freeBuffers.back());
+            freeBuffers.pop_back();
+        }
+
+        job.rgba.assign(rgba, rgba + static_cast<std::size_t>(width) * height * 4);
+        job.width = width;
+        job.height = height;
+        job.format = format;
+        job.path = std::move(path);
+
+        {
+            std::lock_guard lock(mutex);
+            jobs.push_back(std::move(job));
+        }
+        jobReady.notify_one();
+        return true;
+    }
+
+    // Blocks until every submitted snapshot is finished
+    void Wait()
+    {
+        std::unique_lock lock(mutex);
+        jobDone.wait(lock, [&] { return jobs.empty() && busy == 0; });
+    }
+
+    // Snapshots finished since the last call, for reporting on the main thread
+    std::vector<SnapshotResult> TakeResults()
+    {
+        std::lock_guard lock(mutex);
+        std::vector<SnapshotResult> result;
+        result.swap(results);
+        return result;
+    }
+
+    SnapshotStats Stats()
+    {
+        std::lock_guard lock(mutex);
+        return stats;
+    }
+
+private:
+    struct Job
+    {
+        std::vector<std::uint8_t> rgba;
+        int width = 0;
+        int height = 0;
+        SnapshotFormat format = SnapshotFormat::Qoi;
+        std::string path;
+    };
+
+    std::mutex mutex;
+    std::condition_variable jobReady;
+    std::condition_variable jobDone;
+    std::deque<Job> jobs;
+    std::vector<std::vector<std::uint8_t>> freeBuffers;
+    std::vector<SnapshotResult> results;
+    SnapshotStats stats;
+    int busy = 0;
+    bool stopping = false;
+    std::thread worker;
+
+    void Work()
+    {
+        std::vector<std::uint8_t> encoded;
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock lock(mutex);
+                jobReady.wait(lock, [&] { return stopping || !jobs.empty(); });
+                if (jobs.empty())
+                {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+                ++busy;
+            }
+
+            SnapshotResult result;
+            result.path = std::move(job.path);
+            result.format = job.format;
+            result.rawBytes = job.rgba.size();
+
+            auto start = std::chrono::steady_clock::now();
+            ImageEncoder::Encode(job.format, job.rgba.data(), job.width, job.height, encoded);
+            result.encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            result.encodedBytes = encoded.size();
+            result.written = result.path.empty() || WriteFile(result.path, encoded);
+
+            {
+                std::lock_guard lock(mutex);
+                freeBuffers.push_back(std::move(job.rgba));
+                --busy;
+                ++(result.written ? stats.exported : stats.failed);
+                stats.rawBytes += result.rawBytes;
+                stats.encodedBytes += result.encodedBytes;
+                stats.encodeSeconds += result.encodeSeconds;
+                results.push_back(std::move(result));
+            }
+            jobDone.notify_all();
+        }
+    }
+
+    static bool WriteFile(const std::string& path, const std::vector<std::uint8_t>& data)
+    {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr)
+        {
+            return false;
+        }
+        bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+        return std::fclose(file) == 0 && written;
+    }
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <queue>
+#include <array>
+#include <utility>
+
+#include "SFML/System/Vector2.hpp"
+
+namespace lab1
+{
+
+struct Pixel
+{
+    std::uint8_t r, g, b, a;
+
+    friend bool operator==(const Pixel& lhs, const Pixel& rhs)
+    {
+        return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b && lhs.a == rhs.a;
+    }
+
+    friend bool operator!=(const Pixel& lhs, const Pixel& rhs)
+    {
+        return !(lhs == rhs);
+    }
+};
+
+struct Bitmap
+{
+    std::vector<Pixel> pixels;
+    int width;
+    int height;
+
+    static Bitmap New(int pixelWidth, int pixelHeight)
+    {
+        Bitmap result;
+        result.width = pixelWidth;
+        result.height = pixelHeight;
+        result.pixels.assign(pixelWidth * pixelHeight, { 0, 0, 0, 255 });
+        return result;
+    }
+
+    bool Contains(sf::Vector2i position) const
+    {
+        int x = position.x;
+        int y = position.y;
+        return x >= 0 && y >= 0 && x < width && y < height;
+    }
+
+    bool SetPixel(sf::Vector2i position, Pixel pixel)
+    {
+        int x = position.x;
+        int y = position.y;
+        if (!Contains(position))
+        {
+            return false;
+        }
+        pixels[y * width + x] = pixel;
+        return true;
+    }
+
+    Pixel GetPixelAt(sf::Vector2i position) const
+    {
+        if (!Contains(position))
+        {
+            return Pixel{ 0, 0, 0, 0 };
+        }
+        return pixels[position.y * width + position.x];
+    }
+
+    void Clear()
+    {
+        for (auto& p : pixels)
+        {
+            p = { 0, 0, 0, 255 };
+        }
+    }
+
+    bool FillShape(sf::Vector2i start, Pixel fillPixel)
+    {
+        if (!Contains(start))
+        {
+            return false;
+        }
+
+        Pixel initialPixel = GetPixelAt(start);
+
+        if (initialPixel == fillPixel)
+        {
+            return true;
+        }
+
+        SetPixel(start, fillPixel);
+
+        std::queue<sf::Vector2i> queue;
+        queue.push(start);
+
+        constexpr std::array<std::pair<int, int>, 4> searchDirections = {{ { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } }};
+
+        while (!queue.empty())
+        {
+            sf::Vector2i currentPosition = queue.front();
+            queue.pop();
+
+            for (auto& [dx, dy] : searchDirections)
+            {
+                sf::Vector2i nextPosition = { currentPosition.x + dx, currentPosition.y + dy };
+                if (!Contains(nextPosition))
+                {
+                    continue;
+                }
+                Pixel currentPixel = GetPixelAt(nextPosition);
+                if (currentPixel != initialPixel)
+                {
+                    continue;
+                }
+                SetPixel(nextPosition, fillPixel);
+                queue.push(nextPosition);
+            }
+        }
+
+        return true;
+    }
+};
+
+// Rows of RGBA bytes, as the snapshot encoders take them
+inline const std::uint8_t* PixelBytes(const Bitmap& bitmap)
+{
+    return reinterpret_cast<const std::uint8_t*>(bitmap.pixels.data());
+}
+
+}
@@ -0,0 +1,602 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "SFML/System/Vector2.hpp"
+
+#include "Bitmap.h"
+#include "IndexedBitmap.h"
+#include "Selection.h"
+#include "Stroke.h"
+
+namespace lab1
+{
+
+enum class BlendMode
+{
+    Normal,
+    Multiply,
+    Screen,
+    Add,
+};
+
+// Layer pixels are premultiplied, no color channel exceeds alpha. Opaque colors look the same either way.
+inline const Pixel TransparentPixel = { 0, 0, 0, 0 };
+
+enum class LayerStorage
+{
+    Rgba,
+    // One palette index per pixel, for canvases painted from a few colors
+    Indexed,
+};
+
+// Holds its pixels in bitmap or, with indexed storage, in indexed and leaves bitmap empty
+struct Layer
+{
+    Bitmap bitmap;
+    IndexedBitmap indexed;
+    std::uint8_t opacity = 255;
+    BlendMode blendMode = BlendMode::Normal;
+    bool visible = true;
+
+    bool IsIndexed() const
+    {
+        return !indexed.indices.empty();
+    }
+};
+
+// Blends rows of premultiplied source pixels, scaled by the layer opacity, onto an opaque destination:
+//     Normal   s + d (1 - sa)
+//     Multiply s d + d (1 - sa)
+//     Screen   s + d - s d
+//     Add      min(s + d, 1)
+// Every equation leaves the destination opaque. Channels are 16 bit while blending and x / 255 rounds the same way
+// in the scalar and SIMD paths, so both give identical results.
+struct Compositor
+{
+#if defined(__AVX2__)
+    static constexpr int Width = 8;
+#else
+    static constexpr int Width = 4;
+#endif
+
+    static void BlendRowScalar(Pixel* destination, const Pixel* source, int count, std::uint8_t opacity, BlendMode mode)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            std::uint8_t* d = &destination[i].r;
+            const std::uint8_t* s = &source[i].r;
+            unsigned sa = Div255(s[3] * opacity);
+            for (int c = 0; c < 4; ++c)
+            {
+                unsigned sc = Div255(s[c] * opacity);
+                unsigned dc = d[c];
+                unsigned result;
+                switch (mode)
+                {
+                case BlendMode::Multiply:
+                    result = Div255(dc * (sc + 255 - sa));
+                    break;
+                case BlendMode::Screen:
+                    result = sc + dc - Div255(sc * dc);
+                    break;
+                case BlendMode::Add:
+                    result = sc + dc;
+                    break;
+                default:
+                    result = sc + Div255(dc * (255 - sa));
+                    break;
+                }
+                d[c] = static_cast<std::uint8_t>(std::min(result, 255u));
+            }
+        }
+    }
+
+    static void BlendRow(Pixel* destination, const Pixel* source, int count, std::uint8_t opacity, BlendMode mode)
+    {
+        switch (mode)
+        {
+        case BlendMode::Multiply:
+            BlendRowSimd<BlendMode::Multiply>(destination, source, count, opacity);
+            break;
+        case BlendMode::Screen:
+            BlendRowSimd<BlendMode::Screen>(destination, source, count, opacity);
+            break;
+        case BlendMode::Add:
+            BlendRowSimd<BlendMode::Add>(destination, source, count, opacity);
+            break;
+        default:
+            BlendRowSimd<BlendMode::Normal>(destination, source, count, opacity);
+            break;
+        }
+    }
+
+private:
+    // Exact rounding of x / 255 for x <= 255 * 255
+    static unsigned Div255(unsigned x)
+    {
+        unsigned t = x + 128;
+        return (t + (t >> 8)) >> 8;
+    }
+
+    template<BlendMode Mode>
+    static void BlendRowSimd(Pixel* destination, const Pixel* source, int count, std::uint8_t opacity)
+    {
+        const int simdEnd = count / Width * Width;
+        const Int zero = Zero();
+        const Int opacity16 = Set16(opacity);
+        for (int i = 0; i < simdEnd; i += Width)
+        {
+            Int s = Load(source + i);
+            Int d = Load(destination + i);
+            Int result = Pack(Blend<Mode>(Widen(UnpackLo(s, zero), opacity, opacity16), UnpackLo(d, zero)),
+                Blend<Mode>(Widen(UnpackHi(s, zero), opacity, opacity16), UnpackHi(d, zero)));
+            Store(destination + i, result);
+        }
+        BlendRowScalar(destination + simdEnd, source + simdEnd, count - simdEnd, opacity, Mode);
+    }
+
+#if defined(__AVX2__)
+    using Int = __m256i;
+    static Int Zero() { return _mm256_setzero_si256(); }
+    static Int Set16(int value) { return _mm256_set1_epi16(static_cast<short>(value)); }
+    static Int Load(const Pixel* pixels) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels)); }
+    static void Store(Pixel* pixels, Int value) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels), value); }
+    static Int UnpackLo(Int a, Int b) { return _mm256_unpacklo_epi8(a, b); }
+    static Int UnpackHi(Int a, Int b) { return _mm256_unpackhi_epi8(a, b); }
+    static Int Pack(Int lo, Int hi) { return _mm256_packus_epi16(lo, hi); }
+    static Int Add16(Int a, Int b) { return _mm256_add_epi16(a, b); }
+    static Int Sub16(Int a, Int b) { return _mm256_sub_epi16(a, b); }
+    static Int Mul16(Int a, Int b) { return _mm256_mullo_epi16(a, b); }
+    static Int MulHi16(Int a, Int b) { return _mm256_mulhi_epu16(a, b); }
+    static Int BroadcastAlpha(Int a) { return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(a, 0xFF), 0xFF); }
+#else
+    using Int = __m128i;
+    static Int Zero() { return _mm_setzero_si128(); }
+    static Int Set16(int value) { return _mm_set1_epi16(static_cast<short>(value)); }
+    static Int Load(const Pixel* pixels) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels)); }
+    static void Store(Pixel* pixels, Int value) { _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels), value); }
+    static Int UnpackLo(Int a, Int b) { return _mm_unpacklo_epi8(a, b); }
+    static Int UnpackHi(Int a, Int b) { return _mm_unpackhi_epi8(a, b); }
+    static Int Pack(Int lo, Int hi) { return _mm_packus_epi16(lo, hi); }
+    static Int Add16(Int a, Int b) { return _mm_add_epi16(a, b); }
+    static Int Sub16(Int a, Int b) { return _mm_sub_epi16(a, b); }
+    static Int Mul16(Int a, Int b) { return _mm_mullo_epi16(a, b); }
+    static Int MulHi16(Int a, Int b) { return _mm_mulhi_epu16(a, b); }
+    static Int BroadcastAlpha(Int a) { return _mm_shufflehi_epi16(_mm_shufflelo_epi16(a, 0xFF), 0xFF); }
+#endif
+
+    // (t + (t >> 8)) >> 8 is the high half of t * 257
+    static Int Div255(Int x)
+    {
+        return MulHi16(Add16(x, Set16(128)), Set16(257));
+    }
+
+    static Int Widen(Int s, std::uint8_t opacity, Int opacity16)
+    {
+        return opacity == 255 ? s : Div255(Mul16(s, opacity16));
+    }
+
+    template<BlendMode Mode>
+    static Int Blend(Int s, Int d)
+    {
+        const Int max = Set16(255);
+        if constexpr (Mode == BlendMode::Multiply)
+        {
+            return Div255(Mul16(d, Sub16(Add16(s, max), BroadcastAlpha(s))));
+        }
+        else if constexpr (Mode == BlendMode::Screen)
+        {
+            return Sub16(Add16(s, d), Div255(Mul16(s, d)));
+        }
+        else if constexpr (Mode == BlendMode::Add)
+        {
+            return Add16(s, d);
+        }
+        else
+        {
+            return Add16(s, Div255(Mul16(d, Sub16(max, BroadcastAlpha(s)))));
+        }
+    }
+};
+
+enum class FillSource
+{
+    ActiveLayer,
+    // Regions are found in the composited image, the fill still goes into the active layer
+    Composite,
+};
+
+// Half open pixel rectangle
+struct CanvasRect
+{
+    int left = 0;
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+
+    bool IsEmpty() const
+    {
+        return left >= right || top >= bottom;
+    }
+};
+
+// Paint layers composited into one opaque bitmap. Edits mark 16x16 tiles dirty and Composite only redoes those,
+// adjacent dirty tiles of a tile row are blended as one span so the SIMD rows stay long.
+struct Canvas
+{
+    static constexpr int TileSize = 16;
+    // Shows through where every layer is transparent or hidden
+    static constexpr Pixel BackgroundPixel = { 0, 0, 0, 255 };
+
+    std::vector<Layer> layers;
+    int activeLayer = 0;
+    Bitmap composite;
+
+    // The bottom layer starts opaque black like a plain Bitmap, the ones above transparent. Indexed layers start with
+    // those two colors in their palette and add the others as they are painted.
+    static Canvas New(int width, int height, int layerCount, LayerStorage storage = LayerStorage::Rgba)
+    {
+        Canvas result;
+        result.composite = Bitmap::New(width, height);
+        result.layers.resize(std::max(1, layerCount));
+        for (std::size_t i = 0; i < result.layers.size(); ++i)
+        {
+            if (storage == LayerStorage::Indexed)
+            {
+                result.layers[i].indexed = IndexedBitmap::New(width, height, { BackgroundPixel, TransparentPixel }, i > 0 ? 1 : 0);
+                continue;
+            }
+            result.layers[i].bitmap = Bitmap::New(width, height);
+            if (i > 0)
+            {
+                result.layers[i].bitmap.pixels.assign(result.layers[i].bitmap.pixels.size(), TransparentPixel);
+            }
+        }
+        result.tilesX = (width + TileSize - 1) / TileSize;
+        result.tilesY = (height + TileSize - 1) / TileSize;
+        result.dirtyTiles.assign(result.tilesX * result.tilesY, 1);
+        return result;
+    }
+
+    int Width() const
+    {
+        return composite.width;
+    }
+
+    int Height() const
+    {
+        return composite.height;
+    }
+
+    Layer& ActiveLayer()
+    {
+        return layers[activeLayer];
+    }
+
+    // Layer memory in bytes, the composite not included
+    std::size_t LayerBytes() const
+    {
+        std::size_t bytes = 0;
+        for (auto& layer : layers)
+        {
+            bytes += layer.bitmap.pixels.size() * sizeof(Pixel) + layer.indexed.indices.size() + layer.indexed.palette.size() * sizeof(Pixel);
+        }
+        return bytes;
+    }
+
+    // Fails outside the canvas and for a new color once an indexed layer's palette is full
+    bool SetPixel(sf::Vector2i position, Pixel pixel)
+    {
+        Layer& layer = ActiveLayer();
+        int index = layer.IsIndexed() ? layer.indexed.PaletteIndex(pixel) : 0;
+        bool set = layer.IsIndexed() ? index >= 0 && layer.indexed.SetPixel(position, static_cast<std::uint8_t>(index))
+                                     : layer.bitmap.SetPixel(position, pixel);
+        if (!set)
+        {
+            return false;
+        }
+        MarkDirty({ position.x, position.y, position.x + 1, position.y + 1 });
+        return true;
+    }
+
+    // Paints brush swept from one cursor sample to the next on the active layer, only inside selection unless it is
+    // empty. Returns the bounds of the painted pixels, which are also marked dirty.
+    CanvasRect PaintSegment(sf::Vector2i from, sf::Vector2i to, Brush brush, Pixel pixel, const SelectionMask& selection)
+    {
+        Layer& layer = ActiveLayer();
+        const int index = layer.IsIndexed() ? layer.indexed.PaletteIndex(pixel) : 0;
+        if (index < 0)
+        {
+            return {};
+        }
+        StrokeRasterizer::SegmentSpans(from, to, brush, Width(), Height(), strokeSpans);
+
+        auto fillSpan = [&](const StrokeSpan& span, auto* row, auto value) {
+            if (selection.IsEmpty())
+            {
+                std::fill(row + span.left, row + span.right, value);
+                return;
+            }
+            int x = span.left;
+            while (x < span.right)
+            {
+                if (!selection.Contains({ x, span.y }))
+                {
+                    ++x;
+                    continue;
+                }
+                int end = std::min(selection.RunEnd(span.y, x), span.right);
+                std::fill(row + x, row + end, value);
+                x = end;
+            }
+        };
+
+        CanvasRect bounds = { Width(), Height(), 0, 0 };
+        for (auto& span : strokeSpans)
+        {
+            const std::size_t rowStart = static_cast<std::size_t>(span.y) * Width();
+            if (layer.IsIndexed())
+            {
+                fillSpan(span, layer.indexed.indices.data() + rowStart, static_cast<std::uint8_t>(index));
+            }
+            else
+            {
+                fillSpan(span, layer.bitmap.pixels.data() + rowStart, pixel);
+            }
+            bounds.left = std::min(bounds.left, span.left);
+            bounds.top = std::min(bounds.top, span.y);
+            bounds.right = std::max(bounds.right, span.right);
+            bounds.bottom = std::max(bounds.bottom, span.y + 1);
+        }
+        MarkDirty(bounds);
+        return bounds;
+    }
+
+    void ClearActiveLayer()
+    {
+        Layer& layer = ActiveLayer();
+        const Pixel clearPixel = activeLayer == 0 ? BackgroundPixel : TransparentPixel;
+        if (layer.IsIndexed())
+        {
+            layer.indexed.Clear(static_cast<std::uint8_t>(layer.indexed.PaletteIndex(clearPixel)));
+        }
+        else
+        {
+            layer.bitmap.pixels.assign(layer.bitmap.pixels.size(), clearPixel);
+        }
+        MarkAllDirty();
+    }
+
+    bool FillShape(sf::Vector2i start, Pixel fillPixel, FillSource source)
+    {
+        Layer& layer = ActiveLayer();
+        if (!composite.Contains(start))
+        {
+            return false;
+        }
+        const int fillIndex = layer.IsIndexed() ? layer.indexed.PaletteIndex(fillPixel) : 0;
+        if (fillIndex < 0)
+        {
+            return false;
+        }
+        // Indexed layers compare indices, one byte per pixel
+        if (layer.IsIndexed() && source == FillSource::ActiveLayer)
+        {
+            CanvasRect bounds;
+            layer.indexed.FillShape(start, static_cast<std::uint8_t>(fillIndex), bounds.left, bounds.top, bounds.right, bounds.bottom);
+            MarkDirty(bounds);
+            return true;
+        }
+
+        if (source == FillSource::Composite)
+        {
+            Composite();
+        }
+        const Bitmap& reference = source == FillSource::Composite ? composite : layer.bitmap;
+        const Pixel initialPixel = reference.GetPixelAt(start);
+
+        // The region is decided on the reference, which may be the target itself, so visited pixels are tracked apart
+        std::vector<std::uint8_t>& visited = fillVisited;
+        visited.resize(composite.pixels.size(), 0);
+        visited[start.y * Width() + start.x] = 1;
+        std::queue<sf::Vector2i> queue;
+        queue.push(start);
+        CanvasRect bounds = { start.x, start.y, start.x + 1, start.y + 1 };
+
+        constexpr std::array<std::pair<int, int>, 4> searchDirections = {{ { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } }};
+
+        while (!queue.empty())
+        {
+            sf::Vector2i currentPosition = queue.front();
+            queue.pop();
+            const int currentIndex = currentPosition.y * Width() + currentPosition.x;
+            if (layer.IsIndexed())
+            {
+                layer.indexed.indices[currentIndex] = static_cast<std::uint8_t>(fillIndex);
+            }
+            else
+            {
+                layer.bitmap.pixels[currentIndex] = fillPixel;
+            }
+            bounds.left = std::min(bounds.left, currentPosition.x);
+            bounds.top = std::min(bounds.top, currentPosition.y);
+            bounds.right = std::max(bounds.right, currentPosition.x + 1);
+            bounds.bottom = std::max(bounds.bottom, currentPosition.y + 1);
+
+            for (auto& [dx, dy] : searchDirections)
+            {
+                sf::Vector2i nextPosition = { currentPosition.x + dx, currentPosition.y + dy };
+                if (!composite.Contains(nextPosition))
+                {
+                    continue;
+                }
+                int index = nextPosition.y * Width() + nextPosition.x;
+                if (visited[index] || reference.pixels[index] != initialPixel)
+                {
+                    continue;
+                }
+                visited[index] = 1;
+                queue.push(nextPosition);
+            }
+        }
+
+        // Every visited pixel was filled and lies inside bounds, clearing that is enough for the next fill
+        for (int y = bounds.top; y < bounds.bottom; ++y)
+        {
+            std::fill_n(visited.begin() + y * Width() + bounds.left, bounds.right - bounds.left, 0);
+        }
+        MarkDirty(bounds);
+        return true;
+    }
+
+    // Magic wand on the active layer or the composited image
+    SelectionMask SelectContiguous(sf::Vector2i start, std::uint8_t tolerance, FillSource source)
+    {
+        if (source == FillSource::Composite)
+        {
+            Composite();
+            return ColorSelect::Contiguous(composite, start, tolerance);
+        }
+        if (ActiveLayer().IsIndexed())
+        {
+            return ColorSelect::Contiguous(ActiveLayer().indexed, start, tolerance);
+        }
+        return ColorSelect::Contiguous(ActiveLayer().bitmap, start, tolerance);
+    }
+
+    void FillSelection(const SelectionMask& selection, Pixel pixel)
+    {
+        Layer& layer = ActiveLayer();
+        if (!layer.IsIndexed())
+        {
+            selection.Fill(layer.bitmap, pixel);
+        }
+        else if (int index = layer.indexed.PaletteIndex(pixel); index >= 0)
+        {
+            selection.Fill(layer.indexed, static_cast<std::uint8_t>(index));
+        }
+        else
+        {
+            return;
+        }
+        CanvasRect bounds;
+        if (selection.Bounds(bounds.left, bounds.top, bounds.right, bounds.bottom))
+        {
+            MarkDirty(bounds);
+        }
+    }
+
+    // Back to transparent, or to the background on the bottom layer
+    void ClearSelection(const SelectionMask& selection)
+    {
+        FillSelection(selection, activeLayer == 0 ? BackgroundPixel : TransparentPixel);
+    }
+
+    void MarkDirty(CanvasRect rect)
+    {
+        rect.left = std::max(rect.left, 0);
+        rect.top = std::max(rect.top, 0);
+        rect.right = std::min(rect.right, Width());
+        rect.bottom = std::min(rect.bottom, Height());
+        if (rect.IsEmpty())
+        {
+            return;
+        }
+        for (int ty = rect.top / TileSize; ty <= (rect.bottom - 1) / TileSize; ++ty)
+        {
+            for (int tx = rect.left / TileSize; tx <= (rect.right - 1) / TileSize; ++tx)
+            {
+                dirtyTiles[ty * tilesX + tx] = 1;
+            }
+        }
+    }
+
+    // After changing a layer's opacity, blend mode, visibility or pixels directly
+    void MarkAllDirty()
+    {
+        std::fill(dirtyTiles.begin(), dirtyTiles.end(), 1);
+    }
+
+    // Brings the dirty tiles of the composite up to date, returns the bounds of what changed (empty when nothing did)
+    CanvasRect Composite()
+    {
+        CanvasRect changed = { Width(), Height(), 0, 0 };
+        for (int ty = 0; ty < tilesY; ++ty)
+        {
+            int tx = 0;
+            while (tx < tilesX)
+            {
+                if (!dirtyTiles[ty * tilesX + tx])
+                {
+                    ++tx;
+                    continue;
+                }
+                int firstTile = tx;
+                while (tx < tilesX && dirtyTiles[ty * tilesX + tx])
+                {
+                    dirtyTiles[ty * tilesX + tx] = 0;
+                    ++tx;
+                }
+
+                CanvasRect span = { firstTile * TileSize, ty * TileSize, std::min(tx * TileSize, Width()), std::min((ty + 1) * TileSize, Height()) };
+                CompositeRect(span);
+                changed.left = std::min(changed.left, span.left);
+                changed.top = std::min(changed.top, span.top);
+                changed.right = std::max(changed.right, span.right);
+                changed.bottom = std::max(changed.bottom, span.bottom);
+            }
+        }
+        return changed;
+    }
+
+private:
+    int tilesX = 0;
+    int tilesY = 0;
+    std::vector<std::uint8_t> dirtyTiles;
+    std::vector<StrokeSpan> strokeSpans;
+    std::vector<Pixel> expandedRow;
+    // FillShape's visited flags, all zero between fills
+    std::vector<std::uint8_t> fillVisited;
+
+    void CompositeRect(const CanvasRect& rect)
+    {
+        const int width = rect.right - rect.left;
+        expandedRow.resize(width);
+        for (int y = rect.top; y < rect.bottom; ++y)
+        {
+            Pixel* destination = composite.pixels.data() + y * Width() + rect.left;
+            std::fill(destination, destination + width, BackgroundPixel);
+            for (auto& layer : layers)
+            {
+                if (!layer.visible || layer.opacity == 0)
+                {
+                    continue;
+                }
+                const Pixel* source = expandedRow.data();
+                if (layer.IsIndexed())
+                {
+                    layer.indexed.ExpandRow(rect.left, y, width, expandedRow.data());
+                }
+                else
+                {
+                    source = layer.bitmap.pixels.data() + y * Width() + rect.left;
+                }
+                Compositor::BlendRow(destination, source, width, layer.opacity, layer.blendMode);
+            }
+        }
+    }
+};
+
+}
@@ -0,0 +1,447 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "SFML/System/Vector2.hpp"
+
+#include "Bitmap.h"
+
+namespace lab1
+{
+
+// Canvas file: a 4 KiB header page followed by 64x64 pixel tiles in row major tile order, each tile row major
+// inside. A tile is 16 KiB, a whole number of pages, so pixels near each other share pages and a tile can be
+// flushed on its own.
+struct CanvasFileHeader
+{
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t tileSize;
+    std::uint32_t reserved;
+    std::uint64_t payloadOffset;
+};
+
+// Read-write mapping of a canvas file used directly as pixel storage. Pages are read from disk when first touched
+// and written back by the OS, so canvases far larger than RAM open at once and edit in place. Writes reach the file
+// even without Flush, Flush makes the dirty tiles durable without rewriting the rest.
+struct MappedCanvas
+{
+    static constexpr int TileSize = 64;
+    static constexpr int TileShift = 6;
+    static constexpr std::uint64_t TileBytes = TileSize * TileSize * sizeof(Pixel);
+    static constexpr std::uint64_t PayloadOffset = 4096;
+    // Largest width and height, keeps the tile math in 64 bits and the sizes in int
+    static constexpr int MaxSize = 1 << 20;
+
+    int width = 0;
+    int height = 0;
+
+    MappedCanvas() = default;
+
+    MappedCanvas(const MappedCanvas&) = delete;
+    MappedCanvas& operator=(const MappedCanvas&) = delete;
+
+    MappedCanvas(MappedCanvas&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedCanvas& operator=(MappedCanvas&& other) noexcept
+    {
+        std::swap(width, other.width);
+        std::swap(height, other.height);
+        std::swap(tilesX, other.tilesX);
+        std::swap(data, other.data);
+        std::swap(size, other.size);
+        std::swap(dirtyTiles, other.dirtyTiles);
+#ifdef _WIN32
+        std::swap(file, other.file);
+#endif
+        return *this;
+    }
+
+    ~MappedCanvas()
+    {
+        if (data == nullptr)
+        {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+        CloseHandle(file);
+#else
+        munmap(data, size);
+#endif
+    }
+
+    bool IsOpen() const
+    {
+        return data != nullptr;
+    }
+
+    // New file of transparent pixels, the payload is not written so the file starts sparse where the OS allows it
+    static MappedCanvas Create(const char* path, int width, int height)
+    {
+        MappedCanvas result;
+        if (width <= 0 || height <= 0 || width > MaxSize || height > MaxSize)
+        {
+            return result;
+        }
+        std::uint64_t tilesX = (width + TileSize - 1) / TileSize;
+        std::uint64_t tilesY = (height + TileSize - 1) / TileSize;
+        std::uint64_t fileSize = PayloadOffset + tilesX * tilesY * TileBytes;
+        if (!result.Map(path, fileSize, true))
+        {
+            return result;
+        }
+
+        CanvasFileHeader header = {};
+        std::memcpy(header.magic, Magic, sizeof(header.magic));
+        header.version = Version;
+        header.width = static_cast<std::uint32_t>(width);
+        header.height = static_cast<std::uint32_t>(height);
+        header.tileSize = TileSize;
+        header.payloadOffset = PayloadOffset;
+        std::memcpy(result.data, &header, sizeof(header));
+        result.SetSize(width, height);
+        return result;
+    }
+
+    // Only the header page is read here
+    static MappedCanvas Open(const char* path)
+    {
+        MappedCanvas result;
+        if (!result.Map(path, 0, false) || result.size < PayloadOffset)
+        {
+            return MappedCanvas{};
+        }
+
+        CanvasFileHeader header;
+        std::memcpy(&header, result.data, sizeof(header));
+        if (std::memcmp(header.magic, Magic, sizeof(header.magic)) != 0 || header.version != Version || header.tileSize != TileSize
+            || header.payloadOffset != PayloadOffset || header.width == 0 || header.height == 0 || header.width > MaxSize
+            || header.height > MaxSize)
+        {
+            return MappedCanvas{};
+        }
+        std::uint64_t tilesX = (header.width + TileSize - 1) / TileSize;
+        std::uint64_t tilesY = (header.height + TileSize - 1) / TileSize;
+        if (result.size < PayloadOffset + tilesX * tilesY * TileBytes)
+        {
+            return MappedCanvas{};
+        }
+        result.SetSize(static_cast<int>(header.width), static_cast<int>(header.height));
+        return result;
+    }
+
+    bool Contains(sf::Vector2i position) const
+    {
+        int x = position.x;
+        int y = position.y;
+        return x >= 0 && y >= 0 && x < width && y < height;
+    }
+
+    Pixel GetPixelAt(sf::Vector2i position) const
+    {
+        if (!Contains(position))
+        {
+            return Pixel{ 0, 0, 0, 0 };
+        }
+        return *Address(position.x, position.y);
+    }
+
+    bool SetPixel(sf::Vector2i position, Pixel pixel)
+    {
+        if (!Contains(position))
+        {
+            return false;
+        }
+        *Address(position.x, position.y) = pixel;
+        MarkTileDirty(position.x, position.y);
+        return true;
+    }
+
+    // Scanline fill: each span of the region is filled in one go and seeds one point per run of matching pixels in
+    // the rows above and below. No visited set and no per pixel queue, the seed stack stays small even when the
+    // region is larger than RAM.
+    bool FillShape(sf::Vector2i start, Pixel fillPixel)
+    {
+        if (!Contains(start))
+        {
+            return false;
+        }
+        const Pixel initialPixel = GetPixelAt(start);
+        if (initialPixel == fillPixel)
+        {
+            return true;
+        }
+
+        std::vector<sf::Vector2i> seeds = { start };
+        while (!seeds.empty())
+        {
+            sf::Vector2i seed = seeds.back();
+            seeds.pop_back();
+            if (*Address(seed.x, seed.y) != initialPixel)
+            {
+                continue;
+            }
+
+            int left = seed.x;
+            while (left > 0 && *Address(left - 1, seed.y) == initialPixel)
+            {
+                --left;
+            }
+            int right = seed.x + 1;
+            while (right < width && *Address(right, seed.y) == initialPixel)
+            {
+                ++right;
+            }
+            FillSpan(seed.y, left, right, fillPixel);
+
+            for (int y : { seed.y - 1, seed.y + 1 })
+            {
+                if (y < 0 || y >= height)
+                {
+                    continue;
+                }
+                bool inRun = false;
+                for (int x = left; x < right; ++x)
+                {
+                    bool matches = *Address(x, y) == initialPixel;
+                    if (matches && !inRun)
+                    {
+                        seeds.push_back({ x, y });
+                    }
+                    inRun = matches;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Copies a rectangle out of the tiles into row major pixels with the given row stride
+    void ReadRegion(int left, int top, int regionWidth, int regionHeight, Pixel* pixels, int stride) const
+    {
+        for (int y = 0; y < regionHeight; ++y)
+        {
+            for (int x = 0; x < regionWidth;)
+            {
+                int count = std::min(regionWidth - x, TileSize - ((left + x) & (TileSize - 1)));
+                const Pixel* source = Address(left + x, top + y);
+                std::copy(source, source + count, pixels + static_cast<std::size_t>(y) * stride + x);
+                x += count;
+            }
+        }
+    }
+
+    void WriteRegion(int left, int top, int regionWidth, int regionHeight, const Pixel* pixels, int stride)
+    {
+        for (int y = 0; y < regionHeight; ++y)
+        {
+            for (int x = 0; x < regionWidth;)
+            {
+                int count = std::min(regionWidth - x, TileSize - ((left + x) & (TileSize - 1)));
+                const Pixel* source = pixels + static_cast<std::size_t>(y) * stride + x;
+                std::copy(source, source + count, Address(left + x, top + y));
+                MarkTileDirty(left + x, top + y);
+                x += count;
+            }
+        }
+    }
+
+    std::uint64_t DirtyTileCount() const
+    {
+        std::uint64_t count = 0;
+        for (auto word : dirtyTiles)
+        {
+            count += std::popcount(word);
+        }
+        return count;
+    }
+
+    // Writes the tiles changed since the last flush to disk and waits for them, adjacent tiles go out as one range.
+    // Returns the bytes flushed.
+    std::uint64_t Flush()
+    {
+        std::uint64_t flushed = 0;
+        std::uint64_t tileCount = dirtyTiles.size() * 64;
+        std::uint64_t tile = 0;
+        while (tile < tileCount)
+        {
+            if (!IsTileDirty(tile))
+            {
+                // Skip clean words whole
+                tile = (dirtyTiles[tile >> 6] >> (tile & 63)) == 0 ? (tile | 63) + 1 : tile + 1;
+                continue;
+            }
+            std::uint64_t first = tile;
+            while (tile < tileCount && IsTileDirty(tile))
+            {
+                dirtyTiles[tile >> 6] &= ~(std::uint64_t{ 1 } << (tile & 63));
+                ++tile;
+            }
+            std::uint64_t bytes = (tile - first) * TileBytes;
+            FlushRange(data + PayloadOffset + first * TileBytes, bytes);
+            flushed += bytes;
+        }
+        if (flushed > 0)
+        {
+            FlushFile();
+        }
+        return flushed;
+    }
+
+private:
+    static constexpr char Magic[4] = { 'L', '1', 'C', 'V' };
+    static constexpr std::uint32_t Version = 1;
+
+    static_assert(sizeof(CanvasFileHeader) == 32 && PayloadOffset % 4096 == 0 && TileBytes % 4096 == 0, "tiles must start on page boundaries");
+
+    int tilesX = 0;
+    char* data = nullptr;
+    std::uint64_t size = 0;
+    // One bit per tile
+    std::vector<std::uint64_t> dirtyTiles;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+#endif
+
+    void SetSize(int canvasWidth, int canvasHeight)
+    {
+        width = canvasWidth;
+        height = canvasHeight;
+        tilesX = (width + TileSize - 1) / TileSize;
+        std::uint64_t tilesY = (height + TileSize - 1) / TileSize;
+        dirtyTiles.assign((tilesX * tilesY + 63) / 64, 0);
+    }
+
+    std::uint64_t TileIndex(int x, int y) const
+    {
+        return static_cast<std::uint64_t>(y >> TileShift) * tilesX + (x >> TileShift);
+    }
+
+    Pixel* Address(int x, int y) const
+    {
+        std::uint64_t offset = PayloadOffset + TileIndex(x, y) * TileBytes + ((y & (TileSize - 1)) * TileSize + (x & (TileSize - 1))) * sizeof(Pixel);
+        return reinterpret_cast<Pixel*>(data + offset);
+    }
+
+    bool IsTileDirty(std::uint64_t tile) const
+    {
+        return (dirtyTiles[tile >> 6] >> (tile & 63)) & 1;
+    }
+
+    void MarkTileDirty(int x, int y)
+    {
+        std::uint64_t tile = TileIndex(x, y);
+        dirtyTiles[tile >> 6] |= std::uint64_t{ 1 } << (tile & 63);
+    }
+
+    // [left, right) of row y, one run per tile
+    void FillSpan(int y, int left, int right, Pixel pixel)
+    {
+        while (left < right)
+        {
+            int count = std::min(right - left, TileSize - (left & (TileSize - 1)));
+            Pixel* destination = Address(left, y);
+            std::fill(destination, destination + count, pixel);
+            MarkTileDirty(left, y);
+            left += count;
+        }
+    }
+
+    // fileSize 0 maps the file as it is, otherwise the file is created with that size
+    bool Map(const char* path, std::uint64_t fileSize, bool create)
+    {
+#ifdef _WIN32
+        file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, create ? CREATE_ALWAYS : OPEN_EXISTING,
+            FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        if (!create)
+        {
+            LARGE_INTEGER existingSize;
+            fileSize = GetFileSizeEx(file, &existingSize) ? static_cast<std::uint64_t>(existingSize.QuadPart) : 0;
+        }
+        HANDLE mapping = fileSize > 0
+            ? CreateFileMappingA(file, nullptr, PAGE_READWRITE, static_cast<DWORD>(fileSize >> 32), static_cast<DWORD>(fileSize), nullptr)
+            : nullptr;
+        if (mapping != nullptr)
+        {
+            data = static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0));
+            CloseHandle(mapping);
+        }
+        if (data == nullptr)
+        {
+            CloseHandle(file);
+            file = INVALID_HANDLE_VALUE;
+            return false;
+        }
+#else
+        int descriptor = open(path, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+        if (descriptor < 0)
+        {
+            return false;
+        }
+        struct stat fileStat;
+        bool sized = create ? ftruncate(descriptor, static_cast<off_t>(fileSize)) == 0
+                            : fstat(descriptor, &fileStat) == 0 && (fileSize = static_cast<std::uint64_t>(fileStat.st_size)) > 0;
+        void* mapping = sized ? mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0) : MAP_FAILED;
+        close(descriptor);
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+        data = static_cast<char*>(mapping);
+#endif
+        size = fileSize;
+        return true;
+    }
+
+    void FlushRange(char* begin, std::uint64_t bytes)
+    {
+#ifdef _WIN32
+        FlushViewOfFile(begin, static_cast<SIZE_T>(bytes));
+#else
+        msync(begin, bytes, MS_SYNC);
+#endif
+    }
+
+    // The header page only changes at creation, syncing it when clean costs nothing
+    void FlushFile()
+    {
+#ifdef _WIN32
+        FlushViewOfFile(data, PayloadOffset);
+        FlushFileBuffers(file);
+#else
+        msync(data, PayloadOffset, MS_SYNC);
+#endif
+    }
+};
+
+}
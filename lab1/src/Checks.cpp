@@ -0,0 +1,1029 @@
+#include <vector>
+#include <array>
+#include <utility>
+#include <string>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "SFML/Graphics.hpp"
+
+#include "Checks.h"
+#include "Bitmap.h"
+#include "Canvas.h"
+#include "InputJournal.h"
+#include "CanvasFile.h"
+#include "Palette.h"
+#include "Patterns.h"
+#include "../../common/SnapshotExport.h"
+#include "../../common/SelfCheck.h"
+
+using namespace std;
+using namespace sf;
+using namespace lab1;
+
+// True when rgba holds exactly the pixels of bitmap
+bool SamePixelBytes(const vector<uint8_t>& rgba, const Bitmap& bitmap)
+{
+    return rgba.size() == bitmap.pixels.size() * sizeof(Pixel) && memcmp(rgba.data(), bitmap.pixels.data(), rgba.size()) == 0;
+}
+
+// lab1 --check-compositing, the SIMD blend against the scalar one and dirty tile compositing against a full one
+int RunCompositingCheck()
+{
+    SelfCheck check("Compositing");
+
+    mt19937 random(1);
+    auto randomPremultiplied = [&random] {
+        uint8_t alpha = static_cast<uint8_t>(random() % 4 == 0 ? 255 : random() % 256);
+        auto channel = [&] { return static_cast<uint8_t>(random() % (alpha + 1)); };
+        return Pixel{ channel(), channel(), channel(), alpha };
+    };
+
+    for (BlendMode mode : { BlendMode::Normal, BlendMode::Multiply, BlendMode::Screen, BlendMode::Add })
+    {
+        for (uint8_t opacity : { 0, 1, 77, 128, 254, 255 })
+        {
+            // Odd lengths leave a scalar tail after the SIMD part
+            int count = 37 + static_cast<int>(random() % 64);
+            vector<Pixel> source(count), destination(count);
+            for (int i = 0; i < count; ++i)
+            {
+                source[i] = randomPremultiplied();
+                destination[i] = { static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), 255 };
+            }
+            vector<Pixel> expected = destination;
+            Compositor::BlendRowScalar(expected.data(), source.data(), count, opacity, mode);
+            Compositor::BlendRow(destination.data(), source.data(), count, opacity, mode);
+            if (destination != expected)
+            {
+                check.Fail("SIMD blend differs from the scalar blend");
+            }
+            if (any_of(destination.begin(), destination.end(), [](const Pixel& p) { return p.a != 255; }))
+            {
+                check.Fail("blend left the destination translucent");
+            }
+        }
+    }
+
+    // Random strokes and fills on all layers, composited incrementally every few edits
+    const int width = 203;
+    const int height = 117;
+    Canvas canvas = Canvas::New(width, height, 4);
+    const BlendMode modes[4] = { BlendMode::Normal, BlendMode::Multiply, BlendMode::Screen, BlendMode::Add };
+    for (int i = 0; i < 4; ++i)
+    {
+        canvas.layers[i].blendMode = modes[i];
+        canvas.layers[i].opacity = static_cast<uint8_t>(255 - 50 * i);
+    }
+    for (int edit = 0; edit < 3000 && check.passed; ++edit)
+    {
+        canvas.activeLayer = static_cast<int>(random() % canvas.layers.size());
+        Vector2i position = { static_cast<int>(random() % (width + 20)) - 10, static_cast<int>(random() % (height + 20)) - 10 };
+        if (edit % 500 == 499)
+        {
+            canvas.FillShape(position, randomPremultiplied(), edit % 1000 == 999 ? FillSource::Composite : FillSource::ActiveLayer);
+        }
+        else
+        {
+            canvas.SetPixel(position, randomPremultiplied());
+        }
+
+        if (edit % 7 == 0)
+        {
+            canvas.Composite();
+            Canvas full = canvas;
+            full.MarkAllDirty();
+            full.Composite();
+            if (full.composite.pixels != canvas.composite.pixels)
+            {
+                check.Fail("dirty tile composite differs from a full composite");
+            }
+        }
+    }
+
+    // Flags left over from one fill must not stop the next
+    Canvas refill = Canvas::New(40, 30, 1);
+    const Pixel red = { 255, 0, 0, 255 };
+    const Pixel green = { 0, 255, 0, 255 };
+    refill.FillShape({ 5, 5 }, red, FillSource::ActiveLayer);
+    refill.FillShape({ 30, 20 }, green, FillSource::ActiveLayer);
+    const vector<Pixel>& refilled = refill.layers[0].bitmap.pixels;
+    if (any_of(refilled.begin(), refilled.end(), [&](const Pixel& p) { return p != green; }))
+    {
+        check.Fail("second fill stopped at pixels the first one visited");
+    }
+
+    if (check.passed)
+    {
+        cout << "Compositing check passed, " << Compositor::Width << " pixels per SIMD step" << endl;
+    }
+    return check.ExitCode();
+}
+
+// lab1 --check-selection, the word and SIMD selection operations against per pixel references
+int RunSelectionCheck()
+{
+    SelfCheck check("Selection");
+
+    mt19937 random(1);
+
+    // Tolerance matching, row lengths leave partial words and scalar tails
+    for (int i = 0; i < 200; ++i)
+    {
+        int count = 1 + static_cast<int>(random() % 300);
+        Pixel reference = { static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), static_cast<uint8_t>(random()) };
+        uint8_t tolerance = static_cast<uint8_t>(i % 4 == 0 ? 0 : random() % 64);
+        vector<Pixel> row(count);
+        for (auto& pixel : row)
+        {
+            // Mostly near the reference so both sides of the tolerance are hit
+            auto nearby = [&](uint8_t channel) { return static_cast<uint8_t>(clamp(channel + static_cast<int>(random() % 97) - 48, 0, 255)); };
+            pixel = { nearby(reference.r), nearby(reference.g), nearby(reference.b), nearby(reference.a) };
+        }
+        vector<uint64_t> expected((count + 63) / 64), actual((count + 63) / 64, ~0ull);
+        ColorSelect::MatchRowScalar(row.data(), count, reference, tolerance, expected.data());
+        ColorSelect::MatchRow(row.data(), count, reference, tolerance, actual.data());
+        if (actual != expected)
+        {
+            check.Fail("SIMD tolerance match differs from the scalar one");
+            break;
+        }
+    }
+
+    // Magic wand against a breadth first search with the same predicate
+    const int width = 131;
+    const int height = 77;
+    vector<Bitmap> patterns = { CreateMazeBitmap(width, height, 1), CreateRingsBitmap(width, height, 3), CreateNoiseBitmap(width, height, 45, 3),
+        CreateCheckerboardBitmap(width, height, 5) };
+    for (auto& bitmap : patterns)
+    {
+        for (auto& pixel : bitmap.pixels)
+        {
+            pixel.r = static_cast<uint8_t>(pixel.r ^ (random() % 24));
+        }
+        for (int i = 0; i < 20; ++i)
+        {
+            Vector2i start = { static_cast<int>(random() % width), static_cast<int>(random() % height) };
+            uint8_t tolerance = static_cast<uint8_t>(random() % 32);
+            SelectionMask selection = ColorSelect::Contiguous(bitmap, start, tolerance);
+
+            Pixel reference = bitmap.GetPixelAt(start);
+            vector<uint8_t> expected(width * height, 0);
+            queue<Vector2i> queue;
+            queue.push(start);
+            expected[start.y * width + start.x] = 1;
+            while (!queue.empty())
+            {
+                Vector2i position = queue.front();
+                queue.pop();
+                for (Vector2i next : { Vector2i{ position.x + 1, position.y }, Vector2i{ position.x - 1, position.y },
+                    Vector2i{ position.x, position.y + 1 }, Vector2i{ position.x, position.y - 1 } })
+                {
+                    if (bitmap.Contains(next) && !expected[next.y * width + next.x] && ColorSelect::Matches(bitmap.GetPixelAt(next), reference, tolerance))
+                    {
+                        expected[next.y * width + next.x] = 1;
+                        queue.push(next);
+                    }
+                }
+            }
+
+            size_t expectedCount = 0;
+            for (int y = 0; y < height; ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    expectedCount += expected[y * width + x];
+                    if (selection.Contains({ x, y }) != static_cast<bool>(expected[y * width + x]))
+                    {
+                        check.Fail("magic wand region differs from a breadth first search");
+                        y = height;
+                        break;
+                    }
+                }
+            }
+            if (selection.Count() != expectedCount)
+            {
+                check.Fail("selected pixel count");
+            }
+        }
+    }
+
+    // Word operations against per pixel ones on random masks
+    auto randomMask = [&](int density) {
+        SelectionMask mask = SelectionMask::New(width, height);
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                mask.Set({ x, y }, static_cast<int>(random() % 100) < density);
+            }
+        }
+        return mask;
+    };
+    auto selected = [&](const SelectionMask& mask, int x, int y) {
+        return x >= 0 && y >= 0 && x < width && y < height && mask.Contains({ x, y });
+    };
+    for (int density : { 3, 50, 97 })
+    {
+        SelectionMask a = randomMask(density);
+        SelectionMask b = randomMask(50);
+        SelectionMask united = a, intersected = a, subtracted = a, inverted = a, grown = a, shrunk = a;
+        united.Union(b);
+        intersected.Intersect(b);
+        subtracted.Subtract(b);
+        inverted.Invert();
+        grown.Grow(2);
+        shrunk.Shrink(1);
+
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                bool inA = selected(a, x, y);
+                bool inB = selected(b, x, y);
+                bool nearA = false;
+                bool shrinkKeeps = inA;
+                for (int dy = -2; dy <= 2; ++dy)
+                {
+                    for (int dx = -2; dx <= 2; ++dx)
+                    {
+                        int distance = abs(dx) + abs(dy);
+                        nearA = nearA || (distance <= 2 && selected(a, x + dx, y + dy));
+                        bool inside = x + dx >= 0 && y + dy >= 0 && x + dx < width && y + dy < height;
+                        shrinkKeeps = shrinkKeeps && !(distance == 1 && inside && !selected(a, x + dx, y + dy));
+                    }
+                }
+                if (united.Contains({ x, y }) != (inA || inB) || intersected.Contains({ x, y }) != (inA && inB)
+                    || subtracted.Contains({ x, y }) != (inA && !inB) || inverted.Contains({ x, y }) == inA)
+                {
+                    check.Fail("union, intersection, subtraction or inversion");
+                    y = height;
+                    break;
+                }
+                if (grown.Contains({ x, y }) != nearA || shrunk.Contains({ x, y }) != shrinkKeeps)
+                {
+                    check.Fail("grow or shrink");
+                    y = height;
+                    break;
+                }
+            }
+        }
+        if (inverted.Count() != static_cast<size_t>(width * height) - a.Count())
+        {
+            check.Fail("inversion set padding bits");
+        }
+
+        // Filling through the mask touches exactly the selected pixels
+        Bitmap bitmap = Bitmap::New(width, height);
+        a.Fill(bitmap, { 1, 2, 3, 4 });
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                if ((bitmap.GetPixelAt({ x, y }) == Pixel{ 1, 2, 3, 4 }) != selected(a, x, y))
+                {
+                    check.Fail("masked fill");
+                    y = height;
+                    break;
+                }
+            }
+        }
+    }
+
+    if (check.passed)
+    {
+        SelectionMask mask = SelectionMask::New(800, 600);
+        cout << "Selection check passed, an 800x600 selection takes " << mask.words.size() * sizeof(uint64_t) << " bytes for "
+            << 800 * 600 * sizeof(Pixel) << " bytes of pixels" << endl;
+    }
+    return check.ExitCode();
+}
+
+// lab1 --check-canvas-file, edits a mapped canvas file and an in memory bitmap the same way and compares them,
+// also after closing and reopening the file
+int RunCanvasFileCheck()
+{
+    SelfCheck check("Canvas file");
+
+    // Sizes that do not divide into tiles
+    const int width = 1000;
+    const int height = 700;
+    string path = (filesystem::temp_directory_path() / "lab1_check.l1c").string();
+    Bitmap reference = Bitmap::New(width, height);
+    reference.pixels.assign(reference.pixels.size(), TransparentPixel);
+    auto compare = [&](const MappedCanvas& canvas, string_view what) {
+        vector<Pixel> pixels(width * height);
+        canvas.ReadRegion(0, 0, width, height, pixels.data(), width);
+        if (pixels != reference.pixels)
+        {
+            check.Fail(what);
+        }
+    };
+
+    {
+        MappedCanvas canvas = MappedCanvas::Create(path.c_str(), width, height);
+        if (!canvas.IsOpen())
+        {
+            cerr << "Unable to create " << path << endl;
+            return 1;
+        }
+        compare(canvas, "new canvas is not transparent");
+
+        // Walls of random rectangles outlines, then fills of the open areas and of walls
+        mt19937 random(1);
+        for (int i = 0; i < 300; ++i)
+        {
+            int left = static_cast<int>(random() % width) - 20;
+            int top = static_cast<int>(random() % height) - 20;
+            int right = left + static_cast<int>(random() % 200);
+            int bottom = top + static_cast<int>(random() % 200);
+            for (int x = left; x <= right; ++x)
+            {
+                for (int y : { top, bottom })
+                {
+                    canvas.SetPixel({ x, y }, WallPixel);
+                    reference.SetPixel({ x, y }, WallPixel);
+                }
+            }
+            for (int y = top; y <= bottom; ++y)
+            {
+                for (int x : { left, right })
+                {
+                    canvas.SetPixel({ x, y }, WallPixel);
+                    reference.SetPixel({ x, y }, WallPixel);
+                }
+            }
+        }
+        compare(canvas, "set pixel");
+
+        for (int i = 0; i < 40; ++i)
+        {
+            Vector2i start = { static_cast<int>(random() % width), static_cast<int>(random() % height) };
+            Pixel pixel = { static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), 255 };
+            canvas.FillShape(start, pixel);
+            reference.FillShape(start, pixel);
+        }
+        compare(canvas, "scanline fill differs from the bitmap fill");
+
+        uint64_t dirtyTiles = canvas.DirtyTileCount();
+        uint64_t flushed = canvas.Flush();
+        if (flushed != dirtyTiles * MappedCanvas::TileBytes || canvas.Flush() != 0)
+        {
+            check.Fail("flush did not write exactly the dirty tiles");
+        }
+
+        // A small edit dirties only the tiles it touches
+        vector<Pixel> patch(70 * 3, Pixel{ 9, 8, 7, 255 });
+        canvas.WriteRegion(60, 62, 70, 3, patch.data(), 70);
+        for (int y = 62; y < 65; ++y)
+        {
+            for (int x = 60; x < 130; ++x)
+            {
+                reference.SetPixel({ x, y }, patch[0]);
+            }
+        }
+        if (canvas.DirtyTileCount() != 6 || canvas.Flush() != 6 * MappedCanvas::TileBytes)
+        {
+            check.Fail("region write dirtied other tiles");
+        }
+    }
+
+    {
+        MappedCanvas canvas = MappedCanvas::Open(path.c_str());
+        if (!canvas.IsOpen() || canvas.width != width || canvas.height != height)
+        {
+            check.Fail("reopening the file");
+        }
+        else
+        {
+            compare(canvas, "reopened canvas differs");
+        }
+    }
+
+    // Header sizes whose tile math would overflow or not fit in int are rejected before anything is computed from them
+    for (uint32_t badSize : { 0u, static_cast<uint32_t>(MappedCanvas::MaxSize) + 1, 0x80000000u, 0xFFFFFFFFu })
+    {
+        {
+            fstream file(path, ios::binary | ios::in | ios::out);
+            file.seekp(offsetof(CanvasFileHeader, width));
+            file.write(reinterpret_cast<const char*>(&badSize), sizeof(badSize));
+        }
+        if (MappedCanvas::Open(path.c_str()).IsOpen())
+        {
+            check.Fail("canvas with a width of " + to_string(badSize) + " opened");
+        }
+    }
+
+    error_code error;
+    filesystem::remove(path, error);
+    if (check.passed)
+    {
+        cout << "Canvas file check passed" << endl;
+    }
+    return check.ExitCode();
+}
+
+// lab1 --check-strokes, brush spans against a per pixel coverage test, connected strokes from motion events and the
+// dirty region they leave
+int RunStrokeCheck()
+{
+    SelfCheck check("Stroke");
+
+    const int width = 100;
+    const int height = 75;
+    mt19937 random(11);
+    vector<StrokeSpan> spans;
+
+    // Distance from the pixel center to the segment, Euclidean for round brushes and Chebyshev for square ones
+    auto distance = [](Vector2i from, Vector2i to, BrushShape shape, Vector2i position) {
+        auto at = [&](double t) {
+            double x = position.x - (from.x + t * (to.x - from.x));
+            double y = position.y - (from.y + t * (to.y - from.y));
+            return shape == BrushShape::Round ? sqrt(x * x + y * y) : max(abs(x), abs(y));
+        };
+        if (shape == BrushShape::Round)
+        {
+            double dx = to.x - from.x;
+            double dy = to.y - from.y;
+            double lengthSquared = dx * dx + dy * dy;
+            return at(lengthSquared > 0.0 ? clamp(((position.x - from.x) * dx + (position.y - from.y) * dy) / lengthSquared, 0.0, 1.0) : 0.0);
+        }
+        double low = 0.0;
+        double high = 1.0;
+        for (int i = 0; i < 60; ++i)
+        {
+            double first = low + (high - low) / 3.0;
+            double second = high - (high - low) / 3.0;
+            if (at(first) < at(second))
+            {
+                high = second;
+            }
+            else
+            {
+                low = first;
+            }
+        }
+        return at((low + high) / 2.0);
+    };
+
+    for (int i = 0; i < 3000; ++i)
+    {
+        Brush brush = { i % 2 ? BrushShape::Square : BrushShape::Round, static_cast<int>(random() % (i % 10 == 0 ? 40 : 9)) };
+        Vector2i from = { static_cast<int>(random() % (width + 60)) - 30, static_cast<int>(random() % (height + 60)) - 30 };
+        Vector2i to = random() % 4 == 0 ? from : Vector2i{ from.x + static_cast<int>(random() % 81) - 40, from.y + static_cast<int>(random() % 81) - 40 };
+        StrokeRasterizer::SegmentSpans(from, to, brush, width, height, spans);
+
+        vector<uint8_t> covered(width * height, 0);
+        for (size_t s = 0; s < spans.size(); ++s)
+        {
+            auto& span = spans[s];
+            if (span.left >= span.right || span.left < 0 || span.right > width || span.y < 0 || span.y >= height || (s > 0 && spans[s - 1].y >= span.y))
+            {
+                check.Fail("spans are not one sorted run per row inside the canvas");
+                break;
+            }
+            fill(covered.begin() + span.y * width + span.left, covered.begin() + span.y * width + span.right, 1);
+            // Consecutive rows touch at least diagonally, so thin strokes have no gaps
+            if (s > 0 && (spans[s - 1].y + 1 != span.y || spans[s - 1].left > span.right || span.left > spans[s - 1].right)
+                && span.y > 0 && spans[s - 1].y < height - 1)
+            {
+                check.Fail("stroke has a gap");
+            }
+        }
+
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                bool exact = StrokeRasterizer::Covers(from, to, brush, { x, y });
+                if (exact != static_cast<bool>(covered[y * width + x]))
+                {
+                    check.Fail("spans differ from the coverage test");
+                    y = height;
+                    break;
+                }
+                // Pixels further than that from both ends cannot be close to the brush
+                int reach = brush.radius + 2;
+                if (x < min(from.x, to.x) - reach || x > max(from.x, to.x) + reach || y < min(from.y, to.y) - reach || y > max(from.y, to.y) + reach)
+                {
+                    continue;
+                }
+                double margin = distance(from, to, brush.shape, { x, y }) - (brush.radius + 0.5);
+                if (abs(margin) > 1e-6 && exact != (margin < 0.0))
+                {
+                    check.Fail("coverage test differs from the brush geometry");
+                    y = height;
+                    break;
+                }
+            }
+        }
+    }
+
+    // A dab is a disc or a square of the brush's radius
+    for (int radius = 0; radius < 6; ++radius)
+    {
+        for (auto shape : { BrushShape::Round, BrushShape::Square })
+        {
+            Vector2i center = { 50, 30 };
+            StrokeRasterizer::SegmentSpans(center, center, { shape, radius }, width, height, spans);
+            int count = 0;
+            for (auto& span : spans)
+            {
+                count += span.right - span.left;
+            }
+            int expected = 0;
+            for (int y = -radius; y <= radius; ++y)
+            {
+                for (int x = -radius; x <= radius; ++x)
+                {
+                    expected += shape == BrushShape::Square || 4 * (x * x + y * y) < (2 * radius + 1) * (2 * radius + 1);
+                }
+            }
+            if (count != expected)
+            {
+                check.Fail("dab size");
+            }
+        }
+    }
+
+    // Samples arriving as motion events within one frame paint what the same samples do as separate frames
+    {
+        vector<Pixel> palette = PaletteToPixels(CreatePalette());
+        PaintSession batched = PaintSession::New(width, height, 2, palette);
+        PaintSession polled = PaintSession::New(width, height, 2, palette);
+        InputEvent brushChange;
+        brushChange.type = InputEventType::Brush;
+        brushChange.x = static_cast<int16_t>(BrushShape::Round);
+        brushChange.y = 2;
+        vector<InputEvent> events = { brushChange };
+        polled.brush = { BrushShape::Round, 2 };
+        for (int i = 0; i < 12; ++i)
+        {
+            InputEvent motion;
+            motion.x = static_cast<int16_t>(5 + i * 8);
+            motion.y = static_cast<int16_t>(10 + (i * 37) % 50);
+            events.push_back(motion);
+            polled.Apply({ motion.x, motion.y, LeftButton });
+        }
+        batched.Apply({ 95, 70, LeftButton }, events);
+        polled.Apply({ 95, 70, LeftButton });
+        batched.Composite();
+        polled.Composite();
+        if (batched.canvas.composite.pixels != polled.canvas.composite.pixels)
+        {
+            check.Fail("motion events paint differently from polled samples");
+        }
+
+        // A drag across the canvas in two frames leaves no gap
+        PaintSession drag = PaintSession::New(width, height, 1, palette);
+        drag.Apply({ 2, 40, LeftButton });
+        drag.Apply({ 97, 40, LeftButton });
+        drag.Composite();
+        for (int x = 2; x <= 97; ++x)
+        {
+            if (drag.canvas.composite.GetPixelAt({ x, 40 }) != palette[0])
+            {
+                check.Fail("two frame drag has a gap");
+                break;
+            }
+        }
+
+        // Version 1 journals replay one dab per frame
+        PaintSession dabs = PaintSession::New(width, height, 1, palette);
+        dabs.joinStrokes = false;
+        dabs.Apply({ 2, 40, LeftButton });
+        dabs.Apply({ 97, 40, LeftButton });
+        dabs.Composite();
+        if (count(dabs.canvas.composite.pixels.begin(), dabs.canvas.composite.pixels.end(), palette[0]) != 2)
+        {
+            check.Fail("unjoined samples should paint two dabs");
+        }
+
+        // Only the tiles under the stroke are composited and uploaded
+        drag.Apply({ 0, 0, 0 });
+        drag.Apply({ 40, 20, LeftButton });
+        drag.Apply({ 44, 23, LeftButton });
+        CanvasRect changed = drag.Composite();
+        const int tile = Canvas::TileSize;
+        if (changed.left != 2 * tile || changed.top != tile || changed.right != 3 * tile || changed.bottom != 2 * tile)
+        {
+            check.Fail("stroke dirtied more than the tile under it");
+        }
+
+        // Selections mask the brush pixel by pixel
+        PaintSession masked = PaintSession::New(width, height, 1, palette);
+        masked.brush = { BrushShape::Square, 4 };
+        masked.selection.SetSpan(30, 20, 25);
+        masked.Apply({ 22, 30, LeftButton });
+        masked.Composite();
+        int painted = 0;
+        for (auto& pixel : masked.canvas.composite.pixels)
+        {
+            painted += pixel == palette[0];
+        }
+        if (painted != 5)
+        {
+            check.Fail("brush painted outside the selection");
+        }
+
+        InputJournal journal = { width, height, 2, { { 1, 2, LeftButton }, { 3, 4, 0 } }, events };
+        for (size_t i = 3; i < journal.events.size(); ++i)
+        {
+            journal.events[i].frame = 1;
+        }
+        string path = (filesystem::temp_directory_path() / "lab1_check.l1ij").string();
+        InputJournal loaded;
+        if (!journal.Save(path) || !InputJournal::Load(path, loaded) || loaded.frames != journal.frames || loaded.events.size() != events.size()
+            || memcmp(loaded.events.data(), journal.events.data(), events.size() * sizeof(InputEvent)) != 0)
+        {
+            check.Fail("journal events round trip");
+        }
+        InputJournal old = journal;
+        old.version = 1;
+        if (old.Save(path))
+        {
+            check.Fail("version 1 journal saved as the current version");
+        }
+
+        // Damaged counts, the header's run count is at byte 16 and the first run's frame count at byte 30
+        auto loadPatched = [&](streamoff offset, auto value) {
+            journal.Save(path);
+            {
+                fstream file(path, ios::binary | ios::in | ios::out);
+                file.seekp(offset);
+                file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+            }
+            InputJournal damaged;
+            return InputJournal::Load(path, damaged);
+        };
+        if (loadPatched(16, uint32_t{ 0x10000000 }))
+        {
+            check.Fail("journal with more runs than the file holds loaded");
+        }
+        if (loadPatched(30, uint16_t{ 0xFFFF }))
+        {
+            check.Fail("journal runs longer than its frame count loaded");
+        }
+        error_code error;
+        filesystem::remove(path, error);
+    }
+
+    if (check.passed)
+    {
+        cout << "Stroke check passed" << endl;
+    }
+    return check.ExitCode();
+}
+
+// lab1 --check-export, QOI round trips, PNG chunk checksums and the exporter dropping rather than queueing a burst
+int RunExportCheck()
+{
+    SelfCheck check("Export");
+
+    Bitmap gradient = Bitmap::New(301, 7);
+    for (int y = 0; y < gradient.height; ++y)
+    {
+        for (int x = 0; x < gradient.width; ++x)
+        {
+            gradient.pixels[y * gradient.width + x] = { static_cast<uint8_t>(x), static_cast<uint8_t>(x * 3 + y), static_cast<uint8_t>(y * 40),
+                static_cast<uint8_t>(x % 5 == 0 ? 255 - x : 255) };
+        }
+    }
+    // Walls, noise, long runs and every QOI operation
+    vector<Bitmap> images = { Bitmap::New(1, 1), Bitmap::New(1000, 3), CreateCheckerboardBitmap(100, 75, 4), CreateRingsBitmap(257, 130, 3),
+        CreateNoiseBitmap(640, 480, 40, 3), CreateMazeBitmap(99, 77, 5), gradient };
+    mt19937 random(5);
+    Bitmap noise = Bitmap::New(123, 45);
+    for (auto& pixel : noise.pixels)
+    {
+        pixel = { static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), static_cast<uint8_t>(random()) };
+    }
+    images.push_back(noise);
+
+    vector<uint8_t> encoded;
+    for (auto& image : images)
+    {
+        ImageEncoder::EncodeQoi(PixelBytes(image), image.width, image.height, encoded);
+        vector<uint8_t> decoded;
+        int decodedWidth = 0;
+        int decodedHeight = 0;
+        if (!ImageEncoder::DecodeQoi(encoded.data(), encoded.size(), decoded, decodedWidth, decodedHeight) || decodedWidth != image.width
+            || decodedHeight != image.height || !SamePixelBytes(decoded, image))
+        {
+            check.Fail("QOI round trip of a " + to_string(image.width) + "x" + to_string(image.height) + " image");
+        }
+
+        ImageEncoder::EncodePng(PixelBytes(image), image.width, image.height, encoded);
+        size_t position = 8;
+        int chunks = 0;
+        while (position + 12 <= encoded.size())
+        {
+            uint32_t length = static_cast<uint32_t>(encoded[position]) << 24 | encoded[position + 1] << 16 | encoded[position + 2] << 8 | encoded[position + 3];
+            const uint8_t* crc = encoded.data() + position + 8 + length;
+            if (position + 12 + length > encoded.size()
+                || ImageEncoder::Crc32(encoded.data() + position + 4, length + 4) != (static_cast<uint32_t>(crc[0]) << 24 | crc[1] << 16 | crc[2] << 8 | crc[3]))
+            {
+                break;
+            }
+            position += 12 + length;
+            ++chunks;
+        }
+        if (memcmp(encoded.data(), "\x89PNG", 4) != 0 || chunks != 3 || position != encoded.size())
+        {
+            check.Fail("PNG chunks of a " + to_string(image.width) + "x" + to_string(image.height) + " image");
+        }
+    }
+
+    // Every snapshot of a burst is either encoded or dropped, and the files decode to the submitted frame
+    Bitmap frame = CreateNoiseBitmap(1024, 768, 30, 9);
+    string directory = filesystem::temp_directory_path().string();
+    SnapshotExporter exporter;
+    exporter.Start(2);
+    int accepted = 0;
+    for (int i = 0; i < 16; ++i)
+    {
+        accepted += exporter.Submit(PixelBytes(frame), frame.width, frame.height, i % 2 ? SnapshotFormat::Png : SnapshotFormat::Qoi, i < 2 ? directory + "/lab1_check_" + to_string(i) : "");
+    }
+    exporter.Wait();
+    SnapshotStats stats = exporter.Stats();
+    if (accepted < 2 || stats.exported != accepted || stats.dropped != 16 - accepted || stats.failed != 0)
+    {
+        check.Fail("burst export bookkeeping");
+    }
+    exporter.Stop();
+
+    for (auto& result : exporter.TakeResults())
+    {
+        if (result.path.empty())
+        {
+            continue;
+        }
+        ifstream file(result.path, ios::binary);
+        vector<uint8_t> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        vector<uint8_t> decoded;
+        int decodedWidth = 0;
+        int decodedHeight = 0;
+        if (result.format == SnapshotFormat::Qoi
+            && (!ImageEncoder::DecodeQoi(data.data(), data.size(), decoded, decodedWidth, decodedHeight) || !SamePixelBytes(decoded, frame)))
+        {
+            check.Fail("written QOI snapshot differs");
+        }
+        if (data.size() != result.encodedBytes)
+        {
+            check.Fail("snapshot file size");
+        }
+        error_code error;
+        filesystem::remove(result.path, error);
+    }
+
+    for (auto format : { SnapshotFormat::Qoi, SnapshotFormat::Png })
+    {
+        SnapshotStats formatStats;
+        auto start = chrono::steady_clock::now();
+        while (chrono::steady_clock::now() - start < chrono::milliseconds(300))
+        {
+            auto encodeStart = chrono::steady_clock::now();
+            ImageEncoder::Encode(format, PixelBytes(frame), frame.width, frame.height, encoded);
+            formatStats.encodeSeconds += chrono::duration<double>(chrono::steady_clock::now() - encodeStart).count();
+            formatStats.rawBytes += frame.pixels.size() * sizeof(Pixel);
+            formatStats.encodedBytes += encoded.size();
+        }
+        printf("%s: %.1f MB/s, %.1f%% of raw size\n", format == SnapshotFormat::Qoi ? "QOI" : "PNG", formatStats.MegabytesPerSecond(),
+            100.0 * formatStats.encodedBytes / formatStats.rawBytes);
+    }
+
+    if (check.passed)
+    {
+        cout << "Export check passed, " << accepted << " of 16 burst snapshots encoded" << endl;
+    }
+    return check.ExitCode();
+}
+
+// lab1 --check-indexed, the index scans against plain loops and palette indexed sessions against RGBA ones
+int RunIndexedCheck()
+{
+    SelfCheck check("Indexed");
+
+    mt19937 random(13);
+
+    // Short rows of long runs, every begin and end so the SIMD steps and their tails are both covered
+    for (int i = 0; i < 60 && check.passed; ++i)
+    {
+        int length = 1 + static_cast<int>(random() % 100);
+        vector<uint8_t> row(length);
+        uint8_t value = 0;
+        for (auto& index : row)
+        {
+            if (random() % 12 == 0)
+            {
+                value = static_cast<uint8_t>(random() % 3);
+            }
+            index = value;
+        }
+        for (int begin = 0; begin <= length; ++begin)
+        {
+            for (int end = begin; end <= length; ++end)
+            {
+                for (uint8_t index = 0; index < 3; ++index)
+                {
+                    int found = begin;
+                    while (found < end && row[found] != index)
+                    {
+                        ++found;
+                    }
+                    int runEnd = begin;
+                    while (runEnd < end && row[runEnd] == index)
+                    {
+                        ++runEnd;
+                    }
+                    int runBegin = end;
+                    while (runBegin > 0 && row[runBegin - 1] == index)
+                    {
+                        --runBegin;
+                    }
+                    if (IndexedBitmap::Find(row.data(), begin, end, index) != found || IndexedBitmap::RunEnd(row.data(), begin, end, index) != runEnd
+                        || (begin == 0 && IndexedBitmap::RunBegin(row.data(), end, index) != runBegin))
+                    {
+                        check.Fail("SIMD index scan differs from the scalar loop");
+                        begin = end = length + 1;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    vector<Pixel> table(256);
+    for (auto& pixel : table)
+    {
+        pixel = { static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), static_cast<uint8_t>(random()), static_cast<uint8_t>(random()) };
+    }
+    for (int count = 0; count < 100; ++count)
+    {
+        vector<uint8_t> indices(count);
+        for (auto& index : indices)
+        {
+            index = static_cast<uint8_t>(random());
+        }
+        vector<Pixel> expected(count), expanded(count);
+        IndexedBitmap::ExpandIndicesScalar(indices.data(), count, table.data(), expected.data());
+        IndexedBitmap::ExpandIndices(indices.data(), count, table.data(), expanded.data());
+        if (expanded != expected)
+        {
+            check.Fail("SIMD expansion differs from the table lookup");
+            break;
+        }
+    }
+
+    const int width = 203;
+    const int height = 117;
+
+    // Matching the palette once selects what matching every pixel does, on more than 64 colors close enough for the tolerance
+    {
+        Bitmap shades = Bitmap::New(width, height);
+        for (auto& pixel : shades.pixels)
+        {
+            uint8_t shade = static_cast<uint8_t>(100 + random() % 120);
+            pixel = { shade, static_cast<uint8_t>(shade / 2), 0, 255 };
+        }
+        IndexedBitmap indexedShades;
+        IndexedBitmap::FromBitmap(shades, indexedShades);
+        for (uint8_t tolerance : { 0, 5, 32 })
+        {
+            Vector2i start = { static_cast<int>(random() % width), static_cast<int>(random() % height) };
+            if (ColorSelect::ByColor(indexedShades, shades.pixels[7], tolerance).words != ColorSelect::ByColor(shades, shades.pixels[7], tolerance).words
+                || ColorSelect::Contiguous(indexedShades, start, tolerance).words != ColorSelect::Contiguous(shades, start, tolerance).words)
+            {
+                check.Fail("palette match differs from the pixel match");
+            }
+        }
+    }
+
+    // The scanline fill paints what the RGBA flood fill does and reports the bounds of what it changed
+    const Pixel fillPixel = { 0, 255, 0, 255 };
+    const Bitmap patterns[4] = { CreateCheckerboardBitmap(width, height, 8), CreateRingsBitmap(width, height, 4), CreateMazeBitmap(width, height, 1),
+        CreateNoiseBitmap(width, height, 40, 7) };
+    for (auto& pattern : patterns)
+    {
+        for (int i = 0; i < 20; ++i)
+        {
+            Vector2i start = { static_cast<int>(random() % width), static_cast<int>(random() % height) };
+            Pixel pixel = i % 5 == 4 ? WallPixel : fillPixel;
+            Bitmap expected = pattern;
+            expected.FillShape(start, pixel);
+
+            IndexedBitmap indexed;
+            if (!IndexedBitmap::FromBitmap(pattern, indexed))
+            {
+                check.Fail("pattern has too many colors");
+                break;
+            }
+            CanvasRect bounds;
+            indexed.FillShape(start, static_cast<uint8_t>(indexed.PaletteIndex(pixel)), bounds.left, bounds.top, bounds.right, bounds.bottom);
+            if (indexed.ToBitmap().pixels != expected.pixels)
+            {
+                check.Fail("indexed fill differs from the RGBA fill");
+                break;
+            }
+
+            CanvasRect changed = { width, height, 0, 0 };
+            for (int y = 0; y < height; ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    if (pattern.GetPixelAt({ x, y }) != expected.GetPixelAt({ x, y }))
+                    {
+                        changed = { min(changed.left, x), min(changed.top, y), max(changed.right, x + 1), max(changed.bottom, y + 1) };
+                    }
+                }
+            }
+            if (!changed.IsEmpty() && (changed.left != bounds.left || changed.top != bounds.top || changed.right != bounds.right || changed.bottom != bounds.bottom))
+            {
+                check.Fail("indexed fill bounds");
+                break;
+            }
+        }
+    }
+
+    // Random input played on both storages, including strokes, both fill sources, the wand, selection and layer keys
+    vector<Pixel> palette = PaletteToPixels(CreatePalette());
+    PaintSession rgba = PaintSession::New(100, 75, 3, palette);
+    PaintSession indexed = PaintSession::New(100, 75, 3, palette, LayerStorage::Indexed);
+    const uint16_t keys[] = { RightButton, ShiftKey, SpaceKey, TabKey, OpacityKey, BlendModeKey, HideKey, FillSourceKey, ControlKey, GrowKey,
+        ShrinkKey, InvertKey, FillSelectionKey, ClearSelectionKey, DeselectKey };
+    Vector2i cursor = { 50, 37 };
+    for (int frame = 0; frame < 3000 && check.passed; ++frame)
+    {
+        cursor.x = clamp(cursor.x + static_cast<int>(random() % 13) - 6, -5, 104);
+        cursor.y = clamp(cursor.y + static_cast<int>(random() % 13) - 6, -5, 79);
+        uint16_t buttons = random() % 2 ? LeftButton : 0;
+        for (uint16_t key : keys)
+        {
+            buttons |= random() % (key == SpaceKey ? 200 : 25) == 0 ? key : 0;
+        }
+        vector<InputEvent> events;
+        if (random() % 50 == 0)
+        {
+            InputEvent brushChange;
+            brushChange.type = InputEventType::Brush;
+            brushChange.x = static_cast<int16_t>(random() % 2);
+            brushChange.y = static_cast<int16_t>(random() % 6);
+            events.push_back(brushChange);
+        }
+
+        InputFrame input = { static_cast<int16_t>(cursor.x), static_cast<int16_t>(cursor.y), buttons };
+        rgba.Apply(input, events);
+        indexed.Apply(input, events);
+        rgba.Composite();
+        indexed.Composite();
+        if (indexed.canvas.composite.pixels != rgba.canvas.composite.pixels)
+        {
+            check.Fail("indexed session differs from the RGBA session");
+        }
+        if (indexed.selection.words != rgba.selection.words)
+        {
+            check.Fail("indexed wand differs from the RGBA wand");
+        }
+    }
+
+    // Colors beyond the 256th are refused rather than aliased
+    Canvas canvas = Canvas::New(16, 16, 1, LayerStorage::Indexed);
+    int accepted = 0;
+    for (int i = 0; i < 256; ++i)
+    {
+        accepted += canvas.SetPixel({ i % 16, i / 16 }, { static_cast<uint8_t>(i), 1, 2, 255 });
+    }
+    if (accepted != 254 || canvas.layers[0].indexed.palette.size() != IndexedBitmap::MaxColors || !canvas.SetPixel({ 0, 0 }, Canvas::BackgroundPixel))
+    {
+        check.Fail("full palette");
+    }
+
+    if (check.passed)
+    {
+        cout << "Indexed check passed, " << rgba.canvas.LayerBytes() << " bytes of RGBA layers against " << indexed.canvas.LayerBytes() << " indexed" << endl;
+    }
+    return check.ExitCode();
+}
+
+const SelfCheckMode CheckModes[] = {
+    { "--check-compositing", RunCompositingCheck },
+    { "--check-selection", RunSelectionCheck },
+    { "--check-canvas-file", RunCanvasFileCheck },
+    { "--check-strokes", RunStrokeCheck },
+    { "--check-export", RunExportCheck },
+    { "--check-indexed", RunIndexedCheck },
+};
+
+bool RunCheck(string_view flag, int& exitCode)
+{
+    return RunSelfCheck(CheckModes, flag, exitCode);
+}
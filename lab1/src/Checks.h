@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string_view>
+
+// Self checks run by "lab1 --check-*", defined in Checks.cpp.
+// Runs the check named by flag and stores its exit code, false when flag names no check.
+bool RunCheck(std::string_view flag, int& exitCode);
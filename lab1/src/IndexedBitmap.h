@@ -0,0 +1,295 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <bit>
+#include <utility>
+#include <vector>
+
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "SFML/System/Vector2.hpp"
+
+#include "Bitmap.h"
+
+namespace lab1
+{
+
+// One byte per pixel naming an entry of a palette of up to 256 colors. Painting, filling and comparing work on the
+// indices, a quarter of the memory traffic of RGBA pixels, and rows are expanded to RGBA only for compositing.
+struct IndexedBitmap
+{
+    static constexpr std::size_t MaxColors = 256;
+
+    std::vector<std::uint8_t> indices;
+    std::vector<Pixel> palette;
+    int width = 0;
+    int height = 0;
+
+    static IndexedBitmap New(int pixelWidth, int pixelHeight, std::vector<Pixel> palette, std::uint8_t fillIndex = 0)
+    {
+        IndexedBitmap result;
+        result.width = pixelWidth;
+        result.height = pixelHeight;
+        result.palette = std::move(palette);
+        result.indices.assign(static_cast<std::size_t>(pixelWidth) * pixelHeight, fillIndex);
+        return result;
+    }
+
+    // False when the bitmap has more than 256 colors
+    static bool FromBitmap(const Bitmap& bitmap, IndexedBitmap& result)
+    {
+        result = New(bitmap.width, bitmap.height, {});
+        for (std::size_t i = 0; i < bitmap.pixels.size(); ++i)
+        {
+            // Neighbours usually share a color, so the palette search is skipped for them
+            if (i > 0 && bitmap.pixels[i] == bitmap.pixels[i - 1])
+            {
+                result.indices[i] = result.indices[i - 1];
+                continue;
+            }
+            int index = result.PaletteIndex(bitmap.pixels[i]);
+            if (index < 0)
+            {
+                return false;
+            }
+            result.indices[i] = static_cast<std::uint8_t>(index);
+        }
+        return true;
+    }
+
+    bool Contains(sf::Vector2i position) const
+    {
+        return position.x >= 0 && position.y >= 0 && position.x < width && position.y < height;
+    }
+
+    // Index of pixel in the palette, which grows to hold new colors. -1 once all 256 entries are taken.
+    int PaletteIndex(Pixel pixel)
+    {
+        auto found = std::find(palette.begin(), palette.end(), pixel);
+        if (found != palette.end())
+        {
+            return static_cast<int>(found - palette.begin());
+        }
+        if (palette.size() >= MaxColors)
+        {
+            return -1;
+        }
+        palette.push_back(pixel);
+        return static_cast<int>(palette.size()) - 1;
+    }
+
+    bool SetPixel(sf::Vector2i position, std::uint8_t index)
+    {
+        if (!Contains(position))
+        {
+            return false;
+        }
+        indices[static_cast<std::size_t>(position.y) * width + position.x] = index;
+        return true;
+    }
+
+    std::uint8_t GetIndexAt(sf::Vector2i position) const
+    {
+        if (!Contains(position))
+        {
+            return 0;
+        }
+        return indices[static_cast<std::size_t>(position.y) * width + position.x];
+    }
+
+    Pixel GetPixelAt(sf::Vector2i position) const
+    {
+        if (!Contains(position))
+        {
+            return Pixel{ 0, 0, 0, 0 };
+        }
+        return palette[GetIndexAt(position)];
+    }
+
+    void Clear(std::uint8_t index)
+    {
+        std::fill(indices.begin(), indices.end(), index);
+    }
+
+    bool FillShape(sf::Vector2i start, std::uint8_t fillIndex)
+    {
+        int left, top, right, bottom;
+        return FillShape(start, fillIndex, left, top, right, bottom);
+    }
+
+    // Scanline fill of the 4-connected region with the start pixel's index, the runs are found 16 or 32 indices at a
+    // time. The half open bounds of the filled pixels are returned for dirty tracking.
+    bool FillShape(sf::Vector2i start, std::uint8_t fillIndex, int& left, int& top, int& right, int& bottom)
+    {
+        left = top = right = bottom = 0;
+        if (!Contains(start))
+        {
+            return false;
+        }
+        const std::uint8_t initialIndex = GetIndexAt(start);
+        if (initialIndex == fillIndex)
+        {
+            return true;
+        }
+        left = right = start.x;
+        top = bottom = start.y;
+
+        std::vector<sf::Vector2i> seeds = { start };
+        while (!seeds.empty())
+        {
+            sf::Vector2i seed = seeds.back();
+            seeds.pop_back();
+            std::uint8_t* row = indices.data() + static_cast<std::size_t>(seed.y) * width;
+            if (row[seed.x] != initialIndex)
+            {
+                continue;
+            }
+
+            int spanBegin = RunBegin(row, seed.x + 1, initialIndex);
+            int spanEnd = RunEnd(row, seed.x, width, initialIndex);
+            std::fill(row + spanBegin, row + spanEnd, fillIndex);
+            left = std::min(left, spanBegin);
+            right = std::max(right, spanEnd);
+            top = std::min(top, seed.y);
+            bottom = std::max(bottom, seed.y + 1);
+
+            for (int y : { seed.y - 1, seed.y + 1 })
+            {
+                if (y < 0 || y >= height)
+                {
+                    continue;
+                }
+                const std::uint8_t* neighbour = indices.data() + static_cast<std::size_t>(y) * width;
+                // One seed per run of the initial index next to the span
+                int x = Find(neighbour, spanBegin, spanEnd, initialIndex);
+                while (x < spanEnd)
+                {
+                    seeds.push_back({ x, y });
+                    x = Find(neighbour, RunEnd(neighbour, x, spanEnd, initialIndex), spanEnd, initialIndex);
+                }
+            }
+        }
+        return true;
+    }
+
+    // Writes count RGBA pixels of row y starting at x
+    void ExpandRow(int x, int y, int count, Pixel* output) const
+    {
+        ExpandIndices(indices.data() + static_cast<std::size_t>(y) * width + x, count, palette.data(), output);
+    }
+
+    Bitmap ToBitmap() const
+    {
+        Bitmap result = Bitmap::New(width, height);
+        ExpandIndices(indices.data(), static_cast<int>(indices.size()), palette.data(), result.pixels.data());
+        return result;
+    }
+
+    static void ExpandIndicesScalar(const std::uint8_t* source, int count, const Pixel* table, Pixel* output)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            output[i] = table[source[i]];
+        }
+    }
+
+    // Table lookup 8 indices at a time with a gather. SSE2 has neither a gather nor a byte shuffle, so a build without
+    // AVX2 looks pixels up one at a time, lab1 and bench build with /arch:AVX2.
+    static void ExpandIndices(const std::uint8_t* source, int count, const Pixel* table, Pixel* output)
+    {
+        int i = 0;
+#if defined(__AVX2__)
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source + i)));
+            __m256i pixels = _mm256_i32gather_epi32(reinterpret_cast<const int*>(table), lanes, sizeof(Pixel));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + i), pixels);
+        }
+#endif
+        ExpandIndicesScalar(source + i, count - i, table, output + i);
+    }
+
+    // First x in [begin, end) whose index is value, end when there is none
+    static int Find(const std::uint8_t* row, int begin, int end, std::uint8_t value)
+    {
+        const Int broadcast = Broadcast8(value);
+        int x = begin;
+        for (; x + Width <= end; x += Width)
+        {
+            unsigned mask = EqualMask(Load(row + x), broadcast);
+            if (mask != 0)
+            {
+                return x + std::countr_zero(mask);
+            }
+        }
+        while (x < end && row[x] != value)
+        {
+            ++x;
+        }
+        return x;
+    }
+
+    // First x >= begin whose index is not value, end when the run reaches it
+    static int RunEnd(const std::uint8_t* row, int begin, int end, std::uint8_t value)
+    {
+        const Int broadcast = Broadcast8(value);
+        int x = begin;
+        for (; x + Width <= end; x += Width)
+        {
+            unsigned mask = ~EqualMask(Load(row + x), broadcast) & AllLanes;
+            if (mask != 0)
+            {
+                return x + std::countr_zero(mask);
+            }
+        }
+        while (x < end && row[x] == value)
+        {
+            ++x;
+        }
+        return x;
+    }
+
+    // First x of the run of value that ends at end - 1, the row starts at 0
+    static int RunBegin(const std::uint8_t* row, int end, std::uint8_t value)
+    {
+        const Int broadcast = Broadcast8(value);
+        int x = end;
+        for (; x - Width >= 0; x -= Width)
+        {
+            unsigned mask = ~EqualMask(Load(row + x - Width), broadcast) & AllLanes;
+            if (mask != 0)
+            {
+                return x - std::countl_zero(mask << (32 - Width));
+            }
+        }
+        while (x > 0 && row[x - 1] == value)
+        {
+            --x;
+        }
+        return x;
+    }
+
+private:
+#if defined(__AVX2__)
+    static constexpr int Width = 32;
+    static constexpr unsigned AllLanes = 0xffffffffu;
+    using Int = __m256i;
+    static Int Load(const std::uint8_t* bytes) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes)); }
+    static Int Broadcast8(std::uint8_t value) { return _mm256_set1_epi8(static_cast<char>(value)); }
+    static unsigned EqualMask(Int a, Int b) { return static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b))); }
+#else
+    static constexpr int Width = 16;
+    static constexpr unsigned AllLanes = 0xffffu;
+    using Int = __m128i;
+    static Int Load(const std::uint8_t* bytes) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes)); }
+    static Int Broadcast8(std::uint8_t value) { return _mm_set1_epi8(static_cast<char>(value)); }
+    static unsigned EqualMask(Int a, Int b) { return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(a, b))); }
+#endif
+};
+
+}
@@ -0,0 +1,483 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "SFML/System/Vector2.hpp"
+
+#include "Bitmap.h"
+#include "Canvas.h"
+#include "Selection.h"
+#include "Stroke.h"
+
+namespace lab1
+{
+
+enum InputButton : std::uint16_t
+{
+    LeftButton = 1 << 0,
+    RightButton = 1 << 1,
+    ShiftKey = 1 << 2,
+    SpaceKey = 1 << 3,
+    TabKey = 1 << 4,
+    OpacityKey = 1 << 5,
+    BlendModeKey = 1 << 6,
+    HideKey = 1 << 7,
+    FillSourceKey = 1 << 8,
+    ControlKey = 1 << 9,
+    GrowKey = 1 << 10,
+    ShrinkKey = 1 << 11,
+    InvertKey = 1 << 12,
+    FillSelectionKey = 1 << 13,
+    ClearSelectionKey = 1 << 14,
+    DeselectKey = 1 << 15,
+};
+
+// Everything one frame of lab1 reads from the mouse and keyboard. The cursor is in bitmap pixels and only kept while
+// a mouse button is down, so idle frames are all equal and collapse in the journal.
+struct InputFrame
+{
+    std::int16_t x = 0;
+    std::int16_t y = 0;
+    std::uint16_t buttons = 0;
+
+    friend bool operator==(const InputFrame& lhs, const InputFrame& rhs)
+    {
+        return lhs.x == rhs.x && lhs.y == rhs.y && lhs.buttons == rhs.buttons;
+    }
+
+    friend bool operator!=(const InputFrame& lhs, const InputFrame& rhs)
+    {
+        return !(lhs == rhs);
+    }
+};
+
+enum class InputEventType : std::uint16_t
+{
+    // A cursor sample between two frames while the left button is down, in bitmap pixels
+    Motion,
+    // x is the new BrushShape and y the new radius
+    Brush,
+};
+
+// What happens within a frame, in the order it happened, on top of the state polled once per frame
+struct InputEvent
+{
+    std::uint32_t frame = 0;
+    InputEventType type = InputEventType::Motion;
+    std::int16_t x = 0;
+    std::int16_t y = 0;
+    std::uint16_t reserved = 0;
+};
+
+// Per frame input of a session and the canvas it was painted on. On disk it is a header followed by runs of
+// identical frames, 8 bytes per run, then the events, 12 bytes each.
+struct InputJournal
+{
+    int width = 0;
+    int height = 0;
+    int layerCount = 0;
+    std::vector<InputFrame> frames;
+    // Sorted by frame
+    std::vector<InputEvent> events;
+    // Version 1 sessions painted one dab per frame, later ones join the cursor samples of a stroke
+    std::uint16_t version = Version;
+
+    bool JoinsStrokes() const
+    {
+        return version >= 2;
+    }
+
+    // The events of one frame, the next frame's start at end
+    std::span<const InputEvent> FrameEvents(std::size_t frame, std::size_t& begin) const
+    {
+        std::size_t end = begin;
+        while (end < events.size() && events[end].frame == frame)
+        {
+            ++end;
+        }
+        std::span<const InputEvent> result(events.data() + begin, end - begin);
+        begin = end;
+        return result;
+    }
+
+    // Always writes the current version, a version 1 journal would replay differently after saving
+    bool Save(const std::string& path) const
+    {
+        if (version != Version)
+        {
+            return false;
+        }
+
+        std::vector<Run> runs;
+        for (auto& frame : frames)
+        {
+            if (!runs.empty() && runs.back().frame == frame && runs.back().count < UINT16_MAX)
+            {
+                ++runs.back().count;
+            }
+            else
+            {
+                runs.push_back({ frame, 1 });
+            }
+        }
+
+        Header header;
+        std::memcpy(header.magic, Magic, sizeof(header.magic));
+        header.width = static_cast<std::uint16_t>(width);
+        header.height = static_cast<std::uint16_t>(height);
+        header.layerCount = static_cast<std::uint16_t>(layerCount);
+        header.frameCount = static_cast<std::uint32_t>(frames.size());
+        header.runCount = static_cast<std::uint32_t>(runs.size());
+        const auto eventCount = static_cast<std::uint32_t>(events.size());
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open())
+        {
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(&eventCount), sizeof(eventCount));
+        file.write(reinterpret_cast<const char*>(runs.data()), runs.size() * sizeof(Run));
+        file.write(reinterpret_cast<const char*>(events.data()), events.size() * sizeof(InputEvent));
+        return file.good();
+    }
+
+    static bool Load(const std::string& path, InputJournal& journal)
+    {
+        std::ifstream file(path, std::ios::binary);
+        Header header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, Magic, sizeof(header.magic)) != 0
+            || header.version < 1 || header.version > Version)
+        {
+            return false;
+        }
+        // Version 1 journals have no events
+        std::uint32_t eventCount = 0;
+        if (header.version >= 2 && !file.read(reinterpret_cast<char*>(&eventCount), sizeof(eventCount)))
+        {
+            return false;
+        }
+
+        // The counts come from the file, a damaged one must not size anything past what it holds
+        if (std::uint64_t{ header.runCount } * sizeof(Run) + std::uint64_t{ eventCount } * sizeof(InputEvent) > RemainingBytes(file))
+        {
+            return false;
+        }
+        std::vector<Run> runs(header.runCount);
+        journal.events.resize(eventCount);
+        if (!file.read(reinterpret_cast<char*>(runs.data()), runs.size() * sizeof(Run))
+            || !file.read(reinterpret_cast<char*>(journal.events.data()), journal.events.size() * sizeof(InputEvent)))
+        {
+            return false;
+        }
+
+        std::uint64_t frameCount = 0;
+        for (auto& run : runs)
+        {
+            frameCount += run.count;
+            if (frameCount > header.frameCount)
+            {
+                return false;
+            }
+        }
+        if (frameCount != header.frameCount)
+        {
+            return false;
+        }
+
+        journal.version = header.version;
+        journal.width = header.width;
+        journal.height = header.height;
+        journal.layerCount = header.layerCount;
+        journal.frames.clear();
+        journal.frames.reserve(header.frameCount);
+        for (auto& run : runs)
+        {
+            journal.frames.insert(journal.frames.end(), run.count, run.frame);
+        }
+        return true;
+    }
+
+private:
+    static constexpr char Magic[4] = { 'L', '1', 'I', 'J' };
+    static constexpr std::uint16_t Version = 2;
+
+    struct Header
+    {
+        char magic[4];
+        std::uint16_t version = Version;
+        std::uint16_t width;
+        std::uint16_t height;
+        std::uint16_t layerCount;
+        std::uint32_t frameCount;
+        std::uint32_t runCount;
+    };
+
+    struct Run
+    {
+        InputFrame frame;
+        std::uint16_t count;
+    };
+
+    static std::uint64_t RemainingBytes(std::ifstream& file)
+    {
+        std::streampos position = file.tellg();
+        file.seekg(0, std::ios::end);
+        std::streampos end = file.tellg();
+        file.seekg(position);
+        return position >= 0 && end > position ? static_cast<std::uint64_t>(end - position) : 0;
+    }
+
+    static_assert(sizeof(Header) == 20 && sizeof(Run) == 8 && sizeof(InputEvent) == 12, "journal layout is part of the file format");
+};
+
+enum class PaintOperation
+{
+    Paint,
+    Fill,
+    Clear,
+    Layer,
+    Select,
+    Composite,
+    Count,
+};
+
+struct OperationTimings
+{
+    static constexpr const char* Names[static_cast<int>(PaintOperation::Count)] = { "paint", "fill", "clear", "layer", "select", "composite" };
+
+    std::array<double, static_cast<int>(PaintOperation::Count)> nanoseconds = {};
+    std::array<std::uint64_t, static_cast<int>(PaintOperation::Count)> counts = {};
+
+    void Add(PaintOperation operation, std::chrono::steady_clock::time_point start)
+    {
+        auto index = static_cast<int>(operation);
+        nanoseconds[index] += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        ++counts[index];
+    }
+};
+
+// What lab1 does with one frame of input, shared by the window and the headless replay so a journal replays
+// exactly what was painted
+struct PaintSession
+{
+    Canvas canvas;
+    std::vector<Pixel> palette;
+    int selectedColor = 0;
+    Brush brush;
+    FillSource fillSource = FillSource::ActiveLayer;
+    // Painting stays inside the selection unless it is empty
+    SelectionMask selection;
+    OperationTimings timings;
+    // Prints layer and fill source changes
+    bool verbose = false;
+    // Off to replay version 1 journals, each sample is then painted as a single dab
+    bool joinStrokes = true;
+
+    static PaintSession New(int width, int height, int layerCount, std::vector<Pixel> palette, LayerStorage storage = LayerStorage::Rgba)
+    {
+        PaintSession result;
+        result.canvas = Canvas::New(width, height, layerCount, storage);
+        result.palette = std::move(palette);
+        result.selection = SelectionMask::New(width, height);
+        return result;
+    }
+
+    Pixel SelectedPixel() const
+    {
+        return palette[selectedColor];
+    }
+
+    // While the left button is down the cursor samples of the frame's motion events and then the frame's own cursor
+    // are joined into one stroke
+    void Apply(const InputFrame& frame, std::span<const InputEvent> events = {})
+    {
+        const std::uint16_t pressedOnce = frame.buttons & ~previousButtons;
+        previousButtons = frame.buttons;
+        const sf::Vector2i cursor = { frame.x, frame.y };
+
+        for (auto& event : events)
+        {
+            if (event.type == InputEventType::Brush)
+            {
+                brush = { static_cast<BrushShape>(event.x), event.y };
+                if (verbose)
+                {
+                    std::cout << (brush.shape == BrushShape::Round ? "Round" : "Square") << " brush, radius " << brush.radius << std::endl;
+                }
+            }
+            else if (frame.buttons & LeftButton)
+            {
+                StrokeTo({ event.x, event.y });
+            }
+        }
+        if (frame.buttons & LeftButton)
+        {
+            StrokeTo(cursor);
+        }
+        else
+        {
+            stroking = false;
+        }
+        if ((frame.buttons & RightButton) && (frame.buttons & ControlKey))
+        {
+            if (pressedOnce & RightButton)
+            {
+                auto start = std::chrono::steady_clock::now();
+                selection = canvas.SelectContiguous(cursor, WandTolerance, fillSource);
+                timings.Add(PaintOperation::Select, start);
+            }
+        }
+        else if (frame.buttons & RightButton)
+        {
+            auto start = std::chrono::steady_clock::now();
+            canvas.FillShape(cursor, SelectedPixel(), fillSource);
+            timings.Add(PaintOperation::Fill, start);
+        }
+        if (frame.buttons & SpaceKey)
+        {
+            auto start = std::chrono::steady_clock::now();
+            canvas.ClearActiveLayer();
+            timings.Add(PaintOperation::Clear, start);
+        }
+
+        if (pressedOnce & (TabKey | OpacityKey | BlendModeKey | HideKey))
+        {
+            auto start = std::chrono::steady_clock::now();
+            ApplyLayerKeys(pressedOnce);
+            timings.Add(PaintOperation::Layer, start);
+        }
+        if (pressedOnce & (GrowKey | ShrinkKey | InvertKey | DeselectKey))
+        {
+            auto start = std::chrono::steady_clock::now();
+            ApplySelectionKeys(pressedOnce);
+            timings.Add(PaintOperation::Select, start);
+        }
+        if (pressedOnce & FillSelectionKey)
+        {
+            auto start = std::chrono::steady_clock::now();
+            canvas.FillSelection(selection, SelectedPixel());
+            timings.Add(PaintOperation::Fill, start);
+        }
+        if (pressedOnce & ClearSelectionKey)
+        {
+            auto start = std::chrono::steady_clock::now();
+            canvas.ClearSelection(selection);
+            timings.Add(PaintOperation::Clear, start);
+        }
+        if (pressedOnce & FillSourceKey)
+        {
+            fillSource = fillSource == FillSource::ActiveLayer ? FillSource::Composite : FillSource::ActiveLayer;
+            if (verbose)
+            {
+                std::cout << "Flood fill looks at the " << (fillSource == FillSource::ActiveLayer ? "active layer" : "composited image") << std::endl;
+            }
+        }
+        if (pressedOnce & ShiftKey)
+        {
+            selectedColor = (selectedColor + 1) % static_cast<int>(palette.size());
+        }
+    }
+
+    // Returns what changed for the texture upload
+    CanvasRect Composite()
+    {
+        auto start = std::chrono::steady_clock::now();
+        CanvasRect changed = canvas.Composite();
+        timings.Add(PaintOperation::Composite, start);
+        return changed;
+    }
+
+private:
+    static constexpr std::uint8_t WandTolerance = 32;
+    static constexpr std::uint8_t Opacities[4] = { 255, 192, 128, 64 };
+    static constexpr const char* BlendModeNames[4] = { "normal", "multiply", "screen", "add" };
+
+    std::uint16_t previousButtons = 0;
+    bool stroking = false;
+    sf::Vector2i strokeEnd;
+
+    // The first sample of a stroke is a single dab, the others connect to the one before unless joinStrokes is off
+    void StrokeTo(sf::Vector2i position)
+    {
+        if (stroking && position == strokeEnd)
+        {
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        canvas.PaintSegment(stroking && joinStrokes ? strokeEnd : position, position, brush, SelectedPixel(), selection);
+        timings.Add(PaintOperation::Paint, start);
+        stroking = true;
+        strokeEnd = position;
+    }
+
+    // G grows the selection by a pixel, K shrinks it, I inverts it and D drops it
+    void ApplySelectionKeys(std::uint16_t pressedOnce)
+    {
+        if (pressedOnce & GrowKey)
+        {
+            selection.Grow(1);
+        }
+        if (pressedOnce & ShrinkKey)
+        {
+            selection.Shrink(1);
+        }
+        if (pressedOnce & InvertKey)
+        {
+            selection.Invert();
+        }
+        if (pressedOnce & DeselectKey)
+        {
+            selection.Clear();
+        }
+        if (verbose)
+        {
+            std::cout << "Selection: " << selection.Count() << " pixels" << std::endl;
+        }
+    }
+
+    // Tab picks the layer, O its opacity, B its blend mode, H hides it
+    void ApplyLayerKeys(std::uint16_t pressedOnce)
+    {
+        if (pressedOnce & TabKey)
+        {
+            canvas.activeLayer = (canvas.activeLayer + 1) % static_cast<int>(canvas.layers.size());
+        }
+        Layer& layer = canvas.ActiveLayer();
+        if (pressedOnce & OpacityKey)
+        {
+            auto index = std::find(std::begin(Opacities), std::end(Opacities), layer.opacity) - std::begin(Opacities);
+            layer.opacity = Opacities[(index + 1) % 4];
+        }
+        if (pressedOnce & BlendModeKey)
+        {
+            layer.blendMode = static_cast<BlendMode>((static_cast<int>(layer.blendMode) + 1) % 4);
+        }
+        if (pressedOnce & HideKey)
+        {
+            layer.visible = !layer.visible;
+        }
+        if (pressedOnce & (OpacityKey | BlendModeKey | HideKey))
+        {
+            canvas.MarkAllDirty();
+        }
+
+        if (verbose)
+        {
+            std::cout << "Layer " << canvas.activeLayer << ": opacity " << static_cast<int>(layer.opacity) << ", "
+                << BlendModeNames[static_cast<int>(layer.blendMode)] << (layer.visible ? "" : ", hidden") << std::endl;
+        }
+    }
+};
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include "SFML/Graphics/Color.hpp"
+
+#include "Bitmap.h"
+
+namespace lab1
+{
+
+// Shift cycles through these, recorded journals depend on the order
+inline std::vector<sf::Color> CreatePalette()
+{
+    return { sf::Color::Red, sf::Color::Green, sf::Color::Blue, sf::Color::Yellow, sf::Color::Cyan };
+}
+
+inline Pixel ColorToPixel(const sf::Color& color)
+{
+    return { color.r, color.g, color.b, 255 };
+}
+
+inline std::vector<Pixel> PaletteToPixels(const std::vector<sf::Color>& palette)
+{
+    std::vector<Pixel> pixels;
+    for (auto& color : palette)
+    {
+        pixels.push_back(ColorToPixel(color));
+    }
+    return pixels;
+}
+
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <array>
+#include <utility>
+
+#include "Bitmap.h"
+
+namespace lab1
+{
+
+// Deterministic test canvases, walls are WallPixel and open areas are black
+inline const Pixel WallPixel = { 255, 255, 255, 255 };
+
+// Small deterministic generator so patterns are identical on every platform
+struct PatternRandom
+{
+    std::uint32_t state;
+
+    std::uint32_t Next()
+    {
+        state = state * 1664525u + 1013904223u;
+        return state >> 8;
+    }
+};
+
+inline Bitmap CreateCheckerboardBitmap(int width, int height, int cellSize)
+{
+    Bitmap bitmap = Bitmap::New(width, height);
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            if (((x / cellSize) + (y / cellSize)) % 2 == 1)
+            {
+                bitmap.SetPixel({ x, y }, WallPixel);
+            }
+        }
+    }
+    return bitmap;
+}
+
+inline Bitmap CreateRingsBitmap(int width, int height, int spacing)
+{
+    Bitmap bitmap = Bitmap::New(width, height);
+    float cx = width / 2.0f;
+    float cy = height / 2.0f;
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            int distance = static_cast<int>(std::sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy)));
+            // Every ring has a gap on the right so the fill spirals outwards
+            if (distance % spacing == spacing / 2 && !(x > cx && std::abs(y - cy) < 1.0f))
+            {
+                bitmap.SetPixel({ x, y }, WallPixel);
+            }
+        }
+    }
+    return bitmap;
+}
+
+inline Bitmap CreateNoiseBitmap(int width, int height, int wallPercent, std::uint32_t seed)
+{
+    Bitmap bitmap = Bitmap::New(width, height);
+    PatternRandom random{ seed };
+    for (auto& pixel : bitmap.pixels)
+    {
+        if (static_cast<int>(random.Next() % 100) < wallPercent)
+        {
+            pixel = WallPixel;
+        }
+    }
+    return bitmap;
+}
+
+// Perfect maze with 1 pixel corridors carved by a depth-first search, corridors are at odd coordinates
+inline Bitmap CreateMazeBitmap(int width, int height, std::uint32_t seed)
+{
+    Bitmap bitmap = Bitmap::New(width, height);
+    for (auto& pixel : bitmap.pixels)
+    {
+        pixel = WallPixel;
+    }
+
+    int cellsX = (width - 1) / 2;
+    int cellsY = (height - 1) / 2;
+    if (cellsX <= 0 || cellsY <= 0)
+    {
+        return bitmap;
+    }
+
+    PatternRandom random{ seed };
+    std::vector<bool> visited(cellsX * cellsY, false);
+    std::vector<sf::Vector2i> stack = { { 0, 0 } };
+    visited[0] = true;
+    bitmap.SetPixel({ 1, 1 }, { 0, 0, 0, 255 });
+
+    constexpr std::array<std::pair<int, int>, 4> directions = {{ { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } }};
+
+    while (!stack.empty())
+    {
+        sf::Vector2i cell = stack.back();
+        std::array<sf::Vector2i, 4> candidates;
+        int candidateCount = 0;
+        for (auto& [dx, dy] : directions)
+        {
+            sf::Vector2i next = { cell.x + dx, cell.y + dy };
+            if (next.x >= 0 && next.y >= 0 && next.x < cellsX && next.y < cellsY && !visited[next.y * cellsX + next.x])
+            {
+                candidates[candidateCount++] = next;
+            }
+        }
+
+        if (candidateCount == 0)
+        {
+            stack.pop_back();
+            continue;
+        }
+
+        sf::Vector2i next = candidates[random.Next() % candidateCount];
+        visited[next.y * cellsX + next.x] = true;
+        bitmap.SetPixel({ cell.x + next.x + 1, cell.y + next.y + 1 }, { 0, 0, 0, 255 });
+        bitmap.SetPixel({ next.x * 2 + 1, next.y * 2 + 1 }, { 0, 0, 0, 255 });
+        stack.push_back(next);
+    }
+
+    return bitmap;
+}
+
+}
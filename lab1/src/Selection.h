@@ -0,0 +1,482 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <bit>
+#include <vector>
+
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "SFML/System/Vector2.hpp"
+
+#include "Bitmap.h"
+#include "IndexedBitmap.h"
+
+namespace lab1
+{
+
+// One bit per pixel, 1/32 of the RGBA image. Rows are padded to whole 64 bit words so every operation works on 64
+// pixels at a time, the padding bits are always zero.
+struct SelectionMask
+{
+    int width = 0;
+    int height = 0;
+    int wordsPerRow = 0;
+    std::vector<std::uint64_t> words;
+
+    static SelectionMask New(int width, int height)
+    {
+        SelectionMask result;
+        result.width = width;
+        result.height = height;
+        result.wordsPerRow = (width + 63) / 64;
+        result.words.assign(static_cast<std::size_t>(result.wordsPerRow) * height, 0);
+        return result;
+    }
+
+    std::uint64_t* Row(int y)
+    {
+        return words.data() + static_cast<std::size_t>(y) * wordsPerRow;
+    }
+
+    const std::uint64_t* Row(int y) const
+    {
+        return words.data() + static_cast<std::size_t>(y) * wordsPerRow;
+    }
+
+    bool Contains(sf::Vector2i position) const
+    {
+        int x = position.x;
+        int y = position.y;
+        if (x < 0 || y < 0 || x >= width || y >= height)
+        {
+            return false;
+        }
+        return (Row(y)[x >> 6] >> (x & 63)) & 1;
+    }
+
+    void Set(sf::Vector2i position, bool selected)
+    {
+        int x = position.x;
+        int y = position.y;
+        if (x < 0 || y < 0 || x >= width || y >= height)
+        {
+            return;
+        }
+        std::uint64_t bit = std::uint64_t{ 1 } << (x & 63);
+        std::uint64_t& word = Row(y)[x >> 6];
+        word = selected ? word | bit : word & ~bit;
+    }
+
+    // Selects [begin, end) of row y
+    void SetSpan(int y, int begin, int end)
+    {
+        std::uint64_t* row = Row(y);
+        while (begin < end)
+        {
+            int offset = begin & 63;
+            int count = std::min(64 - offset, end - begin);
+            std::uint64_t bits = count == 64 ? ~std::uint64_t{ 0 } : ((std::uint64_t{ 1 } << count) - 1) << offset;
+            row[begin >> 6] |= bits;
+            begin += count;
+        }
+    }
+
+    bool IsEmpty() const
+    {
+        return std::all_of(words.begin(), words.end(), [](std::uint64_t word) { return word == 0; });
+    }
+
+    std::size_t Count() const
+    {
+        std::size_t count = 0;
+        for (auto word : words)
+        {
+            count += std::popcount(word);
+        }
+        return count;
+    }
+
+    void Clear()
+    {
+        std::fill(words.begin(), words.end(), 0);
+    }
+
+    void Invert()
+    {
+        for (auto& word : words)
+        {
+            word = ~word;
+        }
+        ClearPadding();
+    }
+
+    // The combining operations expect a mask of the same size
+    void Union(const SelectionMask& other)
+    {
+        for (std::size_t i = 0; i < words.size(); ++i)
+        {
+            words[i] |= other.words[i];
+        }
+    }
+
+    void Intersect(const SelectionMask& other)
+    {
+        for (std::size_t i = 0; i < words.size(); ++i)
+        {
+            words[i] &= other.words[i];
+        }
+    }
+
+    void Subtract(const SelectionMask& other)
+    {
+        for (std::size_t i = 0; i < words.size(); ++i)
+        {
+            words[i] &= ~other.words[i];
+        }
+    }
+
+    // Adds every pixel within the given 4-connected distance of the selection
+    void Grow(int pixels)
+    {
+        std::vector<std::uint64_t> source;
+        for (int i = 0; i < pixels; ++i)
+        {
+            source = words;
+            GrowOnce(source);
+        }
+    }
+
+    // Removes every pixel within the given distance of an unselected one, the canvas edge does not count as unselected
+    void Shrink(int pixels)
+    {
+        Invert();
+        Grow(pixels);
+        Invert();
+    }
+
+    // Half open bounds of the selected pixels, false when nothing is selected
+    bool Bounds(int& left, int& top, int& right, int& bottom) const
+    {
+        left = width;
+        top = height;
+        right = 0;
+        bottom = 0;
+        for (int y = 0; y < height; ++y)
+        {
+            const std::uint64_t* row = Row(y);
+            for (int i = 0; i < wordsPerRow; ++i)
+            {
+                if (row[i] == 0)
+                {
+                    continue;
+                }
+                left = std::min(left, i * 64 + std::countr_zero(row[i]));
+                right = std::max(right, i * 64 + 64 - std::countl_zero(row[i]));
+                top = std::min(top, y);
+                bottom = y + 1;
+            }
+        }
+        return left < right;
+    }
+
+    // Writes pixel to the selected pixels of bitmap, whole words of selection are filled at once
+    void Fill(Bitmap& bitmap, Pixel pixel) const
+    {
+        for (int y = 0; y < height; ++y)
+        {
+            const std::uint64_t* row = Row(y);
+            Pixel* pixels = bitmap.pixels.data() + static_cast<std::size_t>(y) * width;
+            for (int i = 0; i < wordsPerRow; ++i)
+            {
+                std::uint64_t word = row[i];
+                if (word == ~std::uint64_t{ 0 })
+                {
+                    std::fill(pixels + i * 64, pixels + i * 64 + 64, pixel);
+                    continue;
+                }
+                while (word != 0)
+                {
+                    pixels[i * 64 + std::countr_zero(word)] = pixel;
+                    word &= word - 1;
+                }
+            }
+        }
+    }
+
+    void Fill(IndexedBitmap& bitmap, std::uint8_t index) const
+    {
+        for (int y = 0; y < height; ++y)
+        {
+            const std::uint64_t* row = Row(y);
+            std::uint8_t* indices = bitmap.indices.data() + static_cast<std::size_t>(y) * width;
+            for (int i = 0; i < wordsPerRow; ++i)
+            {
+                std::uint64_t word = row[i];
+                if (word == ~std::uint64_t{ 0 })
+                {
+                    std::fill(indices + i * 64, indices + i * 64 + 64, index);
+                    continue;
+                }
+                while (word != 0)
+                {
+                    indices[i * 64 + std::countr_zero(word)] = index;
+                    word &= word - 1;
+                }
+            }
+        }
+    }
+
+    // First x >= begin whose bit is clear, width when the run reaches the end of the row
+    int RunEnd(int y, int begin) const
+    {
+        const std::uint64_t* row = Row(y);
+        int x = begin;
+        while (x < width)
+        {
+            int offset = x & 63;
+            int ones = std::countr_one(row[x >> 6] >> offset);
+            x += ones;
+            if (ones < 64 - offset)
+            {
+                break;
+            }
+        }
+        return std::min(x, width);
+    }
+
+    // First x of the run of set bits that contains end - 1
+    int RunBegin(int y, int end) const
+    {
+        const std::uint64_t* row = Row(y);
+        int x = end - 1;
+        while (x >= 0)
+        {
+            int offset = x & 63;
+            int ones = std::countl_one(row[x >> 6] << (63 - offset));
+            x -= ones;
+            if (ones < offset + 1)
+            {
+                break;
+            }
+        }
+        return x + 1;
+    }
+
+private:
+    void ClearPadding()
+    {
+        if (width % 64 == 0)
+        {
+            return;
+        }
+        std::uint64_t lastWordMask = (std::uint64_t{ 1 } << (width % 64)) - 1;
+        for (int y = 0; y < height; ++y)
+        {
+            Row(y)[wordsPerRow - 1] &= lastWordMask;
+        }
+    }
+
+    void GrowOnce(const std::vector<std::uint64_t>& source)
+    {
+        for (int y = 0; y < height; ++y)
+        {
+            const std::uint64_t* row = source.data() + static_cast<std::size_t>(y) * wordsPerRow;
+            const std::uint64_t* above = y > 0 ? row - wordsPerRow : nullptr;
+            const std::uint64_t* below = y + 1 < height ? row + wordsPerRow : nullptr;
+            std::uint64_t* destination = Row(y);
+            for (int i = 0; i < wordsPerRow; ++i)
+            {
+                // Bit x is also set when bit x + 1 or x - 1 is, carrying across the word boundaries
+                std::uint64_t fromRight = (row[i] >> 1) | (i + 1 < wordsPerRow ? row[i + 1] << 63 : 0);
+                std::uint64_t fromLeft = (row[i] << 1) | (i > 0 ? row[i - 1] >> 63 : 0);
+                std::uint64_t vertical = (above ? above[i] : 0) | (below ? below[i] : 0);
+                destination[i] = row[i] | fromRight | fromLeft | vertical;
+            }
+        }
+        ClearPadding();
+    }
+};
+
+// Magic wand: a pixel matches when no channel, alpha included, differs from the reference by more than the tolerance
+struct ColorSelect
+{
+#if defined(__AVX2__)
+    static constexpr int Width = 8;
+#else
+    static constexpr int Width = 4;
+#endif
+
+    static bool Matches(Pixel pixel, Pixel reference, std::uint8_t tolerance)
+    {
+        auto difference = [](std::uint8_t a, std::uint8_t b) { return a > b ? a - b : b - a; };
+        return difference(pixel.r, reference.r) <= tolerance && difference(pixel.g, reference.g) <= tolerance
+            && difference(pixel.b, reference.b) <= tolerance && difference(pixel.a, reference.a) <= tolerance;
+    }
+
+    // Overwrites the (count + 63) / 64 words of bits with the matches of row
+    static void MatchRowScalar(const Pixel* row, int count, Pixel reference, std::uint8_t tolerance, std::uint64_t* bits)
+    {
+        std::fill(bits, bits + (count + 63) / 64, 0);
+        for (int x = 0; x < count; ++x)
+        {
+            bits[x >> 6] |= static_cast<std::uint64_t>(Matches(row[x], reference, tolerance)) << (x & 63);
+        }
+    }
+
+    static void MatchRow(const Pixel* row, int count, Pixel reference, std::uint8_t tolerance, std::uint64_t* bits)
+    {
+        std::fill(bits, bits + (count + 63) / 64, 0);
+        std::uint32_t referenceBits;
+        std::memcpy(&referenceBits, &reference, sizeof(referenceBits));
+        const Int referenceVector = Broadcast32(referenceBits);
+        const Int toleranceVector = Broadcast8(tolerance);
+
+        // Width divides 64, so the lanes of one step always land in the same word
+        const int simdEnd = count / Width * Width;
+        for (int x = 0; x < simdEnd; x += Width)
+        {
+            Int pixels = Load(row + x);
+            Int difference = Or(SubSaturate(pixels, referenceVector), SubSaturate(referenceVector, pixels));
+            int matches = MoveMask(EqualZero32(SubSaturate(difference, toleranceVector)));
+            bits[x >> 6] |= static_cast<std::uint64_t>(matches) << (x & 63);
+        }
+        for (int x = simdEnd; x < count; ++x)
+        {
+            bits[x >> 6] |= static_cast<std::uint64_t>(Matches(row[x], reference, tolerance)) << (x & 63);
+        }
+    }
+
+    // Every pixel of the bitmap that matches, connected or not
+    static SelectionMask ByColor(const Bitmap& bitmap, Pixel reference, std::uint8_t tolerance)
+    {
+        SelectionMask mask = SelectionMask::New(bitmap.width, bitmap.height);
+        for (int y = 0; y < bitmap.height; ++y)
+        {
+            MatchRow(bitmap.pixels.data() + static_cast<std::size_t>(y) * bitmap.width, bitmap.width, reference, tolerance, mask.Row(y));
+        }
+        return mask;
+    }
+
+    // Each palette entry is matched once, pixels then only look up their index
+    static SelectionMask ByColor(const IndexedBitmap& bitmap, Pixel reference, std::uint8_t tolerance)
+    {
+        std::uint64_t matchingIndices[4] = {};
+        for (std::size_t i = 0; i < bitmap.palette.size(); ++i)
+        {
+            matchingIndices[i >> 6] |= static_cast<std::uint64_t>(Matches(bitmap.palette[i], reference, tolerance)) << (i & 63);
+        }
+
+        SelectionMask mask = SelectionMask::New(bitmap.width, bitmap.height);
+        for (int y = 0; y < bitmap.height; ++y)
+        {
+            const std::uint8_t* indices = bitmap.indices.data() + static_cast<std::size_t>(y) * bitmap.width;
+            std::uint64_t* bits = mask.Row(y);
+            for (int x = 0; x < bitmap.width; ++x)
+            {
+                bits[x >> 6] |= (matchingIndices[indices[x] >> 6] >> (indices[x] & 63) & 1) << (x & 63);
+            }
+        }
+        return mask;
+    }
+
+    // The 4-connected region of pixels that match the start pixel. Matching is done for whole rows up front, the
+    // region then grows a span at a time with the runs found by bit scans.
+    static SelectionMask Contiguous(const Bitmap& bitmap, sf::Vector2i start, std::uint8_t tolerance)
+    {
+        if (!bitmap.Contains(start))
+        {
+            return SelectionMask::New(bitmap.width, bitmap.height);
+        }
+        return ContiguousMatches(ByColor(bitmap, bitmap.GetPixelAt(start), tolerance), start);
+    }
+
+    static SelectionMask Contiguous(const IndexedBitmap& bitmap, sf::Vector2i start, std::uint8_t tolerance)
+    {
+        if (!bitmap.Contains(start))
+        {
+            return SelectionMask::New(bitmap.width, bitmap.height);
+        }
+        return ContiguousMatches(ByColor(bitmap, bitmap.GetPixelAt(start), tolerance), start);
+    }
+
+    // The 4-connected region of matches around start, which must be inside the mask
+    static SelectionMask ContiguousMatches(const SelectionMask& matches, sf::Vector2i start)
+    {
+        SelectionMask result = SelectionMask::New(matches.width, matches.height);
+
+        std::vector<sf::Vector2i> seeds = { start };
+        while (!seeds.empty())
+        {
+            sf::Vector2i seed = seeds.back();
+            seeds.pop_back();
+            if (result.Contains(seed))
+            {
+                continue;
+            }
+
+            // A selected neighbour would have put the seed into its span, so the matching run is all new
+            int begin = matches.RunBegin(seed.y, seed.x + 1);
+            int end = matches.RunEnd(seed.y, seed.x);
+            result.SetSpan(seed.y, begin, end);
+
+            for (int y : { seed.y - 1, seed.y + 1 })
+            {
+                if (y < 0 || y >= matches.height)
+                {
+                    continue;
+                }
+                const std::uint64_t* matchRow = matches.Row(y);
+                const std::uint64_t* resultRow = result.Row(y);
+                for (int i = begin >> 6; i <= (end - 1) >> 6; ++i)
+                {
+                    std::uint64_t range = ~std::uint64_t{ 0 };
+                    if (i == begin >> 6)
+                    {
+                        range &= ~std::uint64_t{ 0 } << (begin & 63);
+                    }
+                    if (i == (end - 1) >> 6 && (end & 63) != 0)
+                    {
+                        range &= (std::uint64_t{ 1 } << (end & 63)) - 1;
+                    }
+                    // One seed per run of open pixels next to the span, clearing the lowest run each time
+                    std::uint64_t open = matchRow[i] & ~resultRow[i] & range;
+                    while (open != 0)
+                    {
+                        seeds.push_back({ i * 64 + std::countr_zero(open), y });
+                        open &= open + (open & (~open + 1));
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+private:
+#if defined(__AVX2__)
+    using Int = __m256i;
+    static Int Load(const Pixel* pixels) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels)); }
+    static Int Broadcast32(std::uint32_t value) { return _mm256_set1_epi32(static_cast<int>(value)); }
+    static Int Broadcast8(std::uint8_t value) { return _mm256_set1_epi8(static_cast<char>(value)); }
+    static Int Or(Int a, Int b) { return _mm256_or_si256(a, b); }
+    static Int SubSaturate(Int a, Int b) { return _mm256_subs_epu8(a, b); }
+    static Int EqualZero32(Int a) { return _mm256_cmpeq_epi32(a, _mm256_setzero_si256()); }
+    static int MoveMask(Int a) { return _mm256_movemask_ps(_mm256_castsi256_ps(a)); }
+#else
+    using Int = __m128i;
+    static Int Load(const Pixel* pixels) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels)); }
+    static Int Broadcast32(std::uint32_t value) { return _mm_set1_epi32(static_cast<int>(value)); }
+    static Int Broadcast8(std::uint8_t value) { return _mm_set1_epi8(static_cast<char>(value)); }
+    static Int Or(Int a, Int b) { return _mm_or_si128(a, b); }
+    static Int SubSaturate(Int a, Int b) { return _mm_subs_epu8(a, b); }
+    static Int EqualZero32(Int a) { return _mm_cmpeq_epi32(a, _mm_setzero_si128()); }
+    static int MoveMask(Int a) { return _mm_movemask_ps(_mm_castsi128_ps(a)); }
+#endif
+};
+
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+
+#include "SFML/System/Vector2.hpp"
+
+namespace lab1
+{
+
+enum class BrushShape
+{
+    Round,
+    Square,
+};
+
+struct Brush
+{
+    BrushShape shape = BrushShape::Round;
+    // Radius 0 paints single pixels. A round brush covers the pixels whose center is closer than radius + 0.5 to the
+    // brush center, a square one the (2 * radius + 1)^2 pixels around it.
+    int radius = 0;
+};
+
+// Half open run [left, right) of row y
+struct StrokeSpan
+{
+    int y;
+    int left;
+    int right;
+};
+
+// Rasterizes a brush swept along a segment between two cursor samples. The swept shape is convex, so it is one span
+// per row and every pixel of a segment is written once however wide the brush is and however far the cursor moved.
+struct StrokeRasterizer
+{
+    // Keeps the exact coverage test within 64 bit integers, far outside any canvas
+    static constexpr int MaxCoordinate = 8192;
+    static constexpr int MaxRadius = 4096;
+
+    // Replaces spans with the pixels of a width x height canvas covered by brush moving from one sample to the next
+    static void SegmentSpans(sf::Vector2i from, sf::Vector2i to, Brush brush, int width, int height, std::vector<StrokeSpan>& spans)
+    {
+        spans.clear();
+        from = Clamp(from);
+        to = Clamp(to);
+        brush.radius = std::clamp(brush.radius, 0, MaxRadius);
+
+        const int top = std::max(std::min(from.y, to.y) - brush.radius, 0);
+        const int bottom = std::min(std::max(from.y, to.y) + brush.radius + 1, height);
+        for (int y = top; y < bottom; ++y)
+        {
+            double left;
+            double right;
+            if (!ApproximateRow(from, to, brush, y, left, right))
+            {
+                continue;
+            }
+
+            // The floating point bounds are only a starting point, the exact test decides the edge pixels
+            int x0 = static_cast<int>(std::floor(left - 1e-6));
+            int x1 = static_cast<int>(std::ceil(right + 1e-6));
+            while (x0 <= x1 && !Covers(from, to, brush, { x0, y }))
+            {
+                ++x0;
+            }
+            while (x1 >= x0 && !Covers(from, to, brush, { x1, y }))
+            {
+                --x1;
+            }
+            if (x0 > x1)
+            {
+                continue;
+            }
+            while (Covers(from, to, brush, { x0 - 1, y }))
+            {
+                --x0;
+            }
+            while (Covers(from, to, brush, { x1 + 1, y }))
+            {
+                ++x1;
+            }
+
+            x0 = std::max(x0, 0);
+            x1 = std::min(x1, width - 1);
+            if (x0 <= x1)
+            {
+                spans.push_back({ y, x0, x1 + 1 });
+            }
+        }
+    }
+
+    // Whether the brush covers position anywhere between from and to, in integers so ties cannot go either way
+    static bool Covers(sf::Vector2i from, sf::Vector2i to, Brush brush, sf::Vector2i position)
+    {
+        const std::int64_t px = position.x - from.x;
+        const std::int64_t py = position.y - from.y;
+        const std::int64_t dx = to.x - from.x;
+        const std::int64_t dy = to.y - from.y;
+        // Everything is doubled so the half pixel in the brush extent becomes an integer
+        const std::int64_t extent = 2 * static_cast<std::int64_t>(brush.radius) + 1;
+
+        if (brush.shape == BrushShape::Round)
+        {
+            const std::int64_t dot = px * dx + py * dy;
+            const std::int64_t lengthSquared = dx * dx + dy * dy;
+            if (dot <= 0)
+            {
+                return 4 * (px * px + py * py) < extent * extent;
+            }
+            if (dot >= lengthSquared)
+            {
+                return 4 * ((px - dx) * (px - dx) + (py - dy) * (py - dy)) < extent * extent;
+            }
+            const std::int64_t cross = px * dy - py * dx;
+            return 4 * cross * cross < extent * extent * lengthSquared;
+        }
+
+        // Some t in [0, 1] must put the square's center within half its extent on both axes
+        Fraction lower = { 0, 1 };
+        Fraction upper = { 1, 1 };
+        bool lowerOpen = false;
+        bool upperOpen = false;
+        for (auto [p, d] : { std::pair{ px, dx }, std::pair{ py, dy } })
+        {
+            if (d == 0)
+            {
+                if (4 * p * p >= extent * extent)
+                {
+                    return false;
+                }
+                continue;
+            }
+            // 2p - extent < 2td < 2p + extent
+            Fraction begin = d > 0 ? Fraction{ 2 * p - extent, 2 * d } : Fraction{ -2 * p - extent, -2 * d };
+            Fraction end = d > 0 ? Fraction{ 2 * p + extent, 2 * d } : Fraction{ -2 * p + extent, -2 * d };
+            if (!(begin < lower))
+            {
+                lower = begin;
+                lowerOpen = true;
+            }
+            if (!(upper < end))
+            {
+                upper = end;
+                upperOpen = true;
+            }
+        }
+        return lower < upper || (!(upper < lower) && !lowerOpen && !upperOpen);
+    }
+
+private:
+    struct Fraction
+    {
+        // The denominator is always positive
+        std::int64_t numerator;
+        std::int64_t denominator;
+
+        friend bool operator<(const Fraction& lhs, const Fraction& rhs)
+        {
+            return lhs.numerator * rhs.denominator < rhs.numerator * lhs.denominator;
+        }
+    };
+
+    static sf::Vector2i Clamp(sf::Vector2i position)
+    {
+        return { std::clamp(position.x, -MaxCoordinate, MaxCoordinate), std::clamp(position.y, -MaxCoordinate, MaxCoordinate) };
+    }
+
+    // Narrows [left, right] to the x where lower <= a * x + b <= upper
+    static void ClipLinear(double a, double b, double lower, double upper, double& left, double& right)
+    {
+        if (a == 0.0)
+        {
+            if (b < lower || b > upper)
+            {
+                left = 1.0;
+                right = 0.0;
+            }
+            return;
+        }
+        double first = (lower - b) / a;
+        double second = (upper - b) / a;
+        left = std::max(left, std::min(first, second));
+        right = std::min(right, std::max(first, second));
+    }
+
+    // Close bounds of the covered x in row y, false when the row is missed entirely
+    static bool ApproximateRow(sf::Vector2i from, sf::Vector2i to, Brush brush, int y, double& left, double& right)
+    {
+        const double extent = brush.radius + 0.5;
+        const double py = y - from.y;
+        const double dx = to.x - from.x;
+        const double dy = to.y - from.y;
+        left = HUGE_VAL;
+        right = -HUGE_VAL;
+
+        if (brush.shape == BrushShape::Square)
+        {
+            // The range of t whose square reaches row y, then the squares' horizontal extent over that range
+            double first = 0.0;
+            double last = 1.0;
+            ClipLinear(dy, -py, -extent, extent, first, last);
+            if (first > last)
+            {
+                return false;
+            }
+            left = from.x + std::min(first * dx, last * dx) - extent;
+            right = from.x + std::max(first * dx, last * dx) + extent;
+            return true;
+        }
+
+        // Union of the discs at both ends and the band between them
+        for (double center : { 0.0, 1.0 })
+        {
+            double rowOffset = py - center * dy;
+            double halfChord = extent * extent - rowOffset * rowOffset;
+            if (halfChord >= 0.0)
+            {
+                halfChord = std::sqrt(halfChord);
+                left = std::min(left, from.x + center * dx - halfChord);
+                right = std::max(right, from.x + center * dx + halfChord);
+            }
+        }
+        const double lengthSquared = dx * dx + dy * dy;
+        if (lengthSquared > 0.0)
+        {
+            double bandLeft = -HUGE_VAL;
+            double bandRight = HUGE_VAL;
+            // Projection onto the segment within it, distance from its line below the extent
+            ClipLinear(dx, py * dy, 0.0, lengthSquared, bandLeft, bandRight);
+            double reach = extent * std::sqrt(lengthSquared);
+            ClipLinear(dy, -py * dx, -reach, reach, bandLeft, bandRight);
+            if (bandLeft <= bandRight)
+            {
+                left = std::min(left, from.x + bandLeft);
+                right = std::max(right, from.x + bandRight);
+            }
+        }
+        return left <= right;
+    }
+};
+
+}
@@ -2,147 +2,324 @@
 #include <queue>
 #include <array>
 #include <utility>
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <random>
 
 #include "SFML/Graphics.hpp"
 
+#include "Bitmap.h"
+#include "Canvas.h"
+#include "Checks.h"
+#include "InputJournal.h"
+#include "CanvasFile.h"
+#include "../../common/SnapshotExport.h"
+#include "Palette.h"
+#include "Patterns.h"
+#include "../../common/Regression.h"
+
 using namespace std;
 using namespace sf;
+using namespace lab1;
 
-struct Pixel
+// Uploads only what the last composite changed, the rectangle is packed into scratch first
+void UpdateTextureFromCanvas(Texture& texture, const Canvas& canvas, CanvasRect changed, vector<Pixel>& scratch)
 {
-    uint8_t r, g, b, a;
-
-    friend bool operator==(const Pixel& lhs, const Pixel& rhs)
+    if (changed.IsEmpty())
     {
-        return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b && lhs.a == rhs.a;
+        return;
     }
-
-    friend bool operator!=(const Pixel& lhs, const Pixel& rhs)
+    int width = changed.right - changed.left;
+    int height = changed.bottom - changed.top;
+    if (width == canvas.Width())
+    {
+        texture.update(reinterpret_cast<const Uint8*>(canvas.composite.pixels.data() + changed.top * width), width, height, 0, changed.top);
+        return;
+    }
+    scratch.resize(width * height);
+    for (int y = 0; y < height; ++y)
     {
-        return !(lhs == rhs);
+        const Pixel* row = canvas.composite.pixels.data() + (changed.top + y) * canvas.Width() + changed.left;
+        copy(row, row + width, scratch.data() + y * width);
     }
-};
+    texture.update(reinterpret_cast<const Uint8*>(scratch.data()), width, height, changed.left, changed.top);
+}
 
-struct Bitmap
+Vector2i GetBitmapCursorPostion(const Window& window, float screenPixelToBitmapPixelRatio)
 {
-    vector<Pixel> pixels;
-    int width;
-    int height;
+    Vector2i cursorPosition = Mouse::getPosition(window);
+    return Vector2i(
+        static_cast<int>(cursorPosition.x / screenPixelToBitmapPixelRatio),
+        static_cast<int>(cursorPosition.y / screenPixelToBitmapPixelRatio)
+    );
+}
 
-    static Bitmap New(int pixelWidth, int pixelHeight)
+InputFrame SampleInput(const Window& window, float screenPixelToBitmapPixelRatio)
+{
+    const pair<Keyboard::Key, InputButton> keys[] = { { Keyboard::LShift, ShiftKey }, { Keyboard::Space, SpaceKey }, { Keyboard::Tab, TabKey },
+        { Keyboard::O, OpacityKey }, { Keyboard::B, BlendModeKey }, { Keyboard::H, HideKey }, { Keyboard::F, FillSourceKey },
+        { Keyboard::LControl, ControlKey }, { Keyboard::G, GrowKey }, { Keyboard::K, ShrinkKey }, { Keyboard::I, InvertKey },
+        { Keyboard::Enter, FillSelectionKey }, { Keyboard::X, ClearSelectionKey }, { Keyboard::D, DeselectKey } };
+
+    InputFrame frame;
+    frame.buttons |= Mouse::isButtonPressed(Mouse::Button::Left) ? LeftButton : 0;
+    frame.buttons |= Mouse::isButtonPressed(Mouse::Button::Right) ? RightButton : 0;
+    for (auto [key, button] : keys)
+    {
+        frame.buttons |= Keyboard::isKeyPressed(key) ? button : 0;
+    }
+    if (frame.buttons & (LeftButton | RightButton))
     {
-        Bitmap result;
-        result.width = pixelWidth;
-        result.height = pixelHeight;
-        result.pixels.assign(pixelWidth * pixelHeight, { 0, 0, 0, 255 });
-        return result;
+        Vector2i cursor = GetBitmapCursorPostion(window, screenPixelToBitmapPixelRatio);
+        frame.x = static_cast<int16_t>(clamp(cursor.x, -32768, 32767));
+        frame.y = static_cast<int16_t>(clamp(cursor.y, -32768, 32767));
     }
+    return frame;
+}
 
-    bool Contains(Vector2i position) const
+uint64_t HashPixels(const vector<Pixel>& pixels)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const auto* bytes = reinterpret_cast<const uint8_t*>(pixels.data());
+    for (size_t i = 0; i < pixels.size() * sizeof(Pixel); ++i)
     {
-        int x = position.x;
-        int y = position.y;
-        return x >= 0 && y >= 0 && x < width && y < height;
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
     }
+    return hash;
+}
 
-    bool SetPixel(Vector2i position, Pixel pixel)
+// lab1 --replay <journal> [repeats] [rgba], runs a recorded session without a window as fast as it goes. Layers are
+// palette indexed like in the window unless rgba is given.
+int RunReplay(const string& path, int repeats, LayerStorage storage)
+{
+    InputJournal journal;
+    if (!InputJournal::Load(path, journal))
     {
-        int x = position.x;
-        int y = position.y;
-        if (!Contains(position))
-        {
-            return false;
-        }
-        pixels[y * width + x] = pixel;
-        return true;
+        cerr << "Unable to load input journal " << path << endl;
+        return 1;
     }
 
-    Pixel GetPixelAt(Vector2i position) const
+    OperationTimings total;
+    vector<double> milliseconds;
+    uint64_t hash = 0;
+    for (int repeat = 0; repeat < repeats; ++repeat)
     {
-        if (!Contains(position))
+        PaintSession session = PaintSession::New(journal.width, journal.height, journal.layerCount, PaletteToPixels(CreatePalette()), storage);
+        session.joinStrokes = journal.JoinsStrokes();
+        auto start = chrono::steady_clock::now();
+        size_t nextEvent = 0;
+        for (size_t frame = 0; frame < journal.frames.size(); ++frame)
         {
-            return Pixel{ 0, 0, 0, 0 };
+            session.Apply(journal.frames[frame], journal.FrameEvents(frame, nextEvent));
+            session.Composite();
         }
-        return pixels[position.y * width + position.x];
-    }
+        milliseconds.push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
 
-    void Clear()
-    {
-        for (auto& p : pixels)
+        uint64_t replayHash = HashPixels(session.canvas.composite.pixels);
+        if (repeat > 0 && replayHash != hash)
         {
-            p = { 0, 0, 0, 255 };
+            cerr << "Replay " << repeat << " produced a different image, the session is not deterministic" << endl;
+            return 1;
+        }
+        hash = replayHash;
+        for (size_t i = 0; i < total.nanoseconds.size(); ++i)
+        {
+            total.nanoseconds[i] += session.timings.nanoseconds[i];
+            total.counts[i] += session.timings.counts[i];
         }
     }
 
-    bool FillShape(Vector2i start, Pixel fillPixel)
+    sort(milliseconds.begin(), milliseconds.end());
+    printf("%zu frames on a %dx%d canvas with %d %s layers, median replay %.3f ms over %d runs\n", journal.frames.size(), journal.width,
+        journal.height, journal.layerCount, storage == LayerStorage::Indexed ? "indexed" : "RGBA", milliseconds[milliseconds.size() / 2], repeats);
+    printf("%-10s %10s %12s %12s\n", "operation", "count", "ms per run", "us per op");
+    for (size_t i = 0; i < total.nanoseconds.size(); ++i)
     {
-        if (!Contains(start))
+        if (total.counts[i] == 0)
         {
-            return false;
+            continue;
         }
+        printf("%-10s %10llu %12.3f %12.3f\n", OperationTimings::Names[i], static_cast<unsigned long long>(total.counts[i] / repeats),
+            total.nanoseconds[i] / 1e6 / repeats, total.nanoseconds[i] / 1e3 / total.counts[i]);
+    }
+    printf("image hash %016llx\n", static_cast<unsigned long long>(hash));
+    return 0;
+}
+
+RegressionImage CaptureBitmap(const Bitmap& bitmap)
+{
+    RegressionImage image;
+    image.width = bitmap.width;
+    image.height = bitmap.height;
+    image.pixels.resize(bitmap.pixels.size() * sizeof(Pixel));
+    memcpy(image.pixels.data(), bitmap.pixels.data(), image.pixels.size());
+    return image;
+}
 
-        Pixel initialPixel = GetPixelAt(start);
+// lab1 --regression record|check <directory> ...
+int RunRegression(int argc, char* argv[])
+{
+    RegressionSettings settings;
+    if (!Regression::ParseArguments(argc, argv, settings))
+    {
+        cerr << "Usage: lab1 " << Regression::Usage << endl;
+        return 1;
+    }
 
-        if (initialPixel == fillPixel)
-        {
-            return true;
-        }
+    // Same canvas size as the interactive window
+    int width = 100;
+    int height = 75;
+    Bitmap bitmap = Bitmap::New(width, height);
+    auto capture = [&] { return CaptureBitmap(bitmap); };
 
-        SetPixel(start, fillPixel);
+    struct FillCase
+    {
+        string name;
+        Bitmap pattern;
+        Vector2i start;
+    };
 
-        queue<Vector2i> queue;
-        queue.push(start);
+    vector<FillCase> fillCases = {
+        { "fill_empty", Bitmap::New(width, height), { width / 2, height / 2 } },
+        { "fill_checkerboard", CreateCheckerboardBitmap(width, height, 4), { 1, 1 } },
+        { "fill_checkerboard_walls", CreateCheckerboardBitmap(width, height, 4), { 5, 1 } },
+        { "fill_rings", CreateRingsBitmap(width, height, 4), { width / 2, height / 2 + 1 } },
+        { "fill_maze", CreateMazeBitmap(width, height, 1), { 1, 1 } },
+        { "fill_noise", CreateNoiseBitmap(width, height, 40, 7), { width / 2, height / 2 } },
+    };
 
-        constexpr array<pair<int, int>, 4> searchDirections = {{ { 0, -1 }, { 1, 0 }, { 0, 1 }, { -1, 0 } }};
+    vector<RegressionScene> scenes;
+    for (auto& fillCase : fillCases)
+    {
+        scenes.push_back({ fillCase.name, [&bitmap, &fillCase] {
+            bitmap = fillCase.pattern;
+            bitmap.FillShape(fillCase.start, { 0, 255, 0, 255 });
+        }, capture });
+    }
 
-        while (!queue.empty())
+    scenes.push_back({ "layers_composite", [&] {
+        Canvas canvas = Canvas::New(width, height, 4);
+        canvas.layers[0].bitmap = CreateRingsBitmap(width, height, 4);
+        const BlendMode modes[3] = { BlendMode::Normal, BlendMode::Multiply, BlendMode::Screen };
+        const Pixel colors[3] = { { 255, 0, 0, 255 }, { 0, 255, 255, 255 }, { 0, 0, 128, 128 } };
+        for (int i = 1; i < 4; ++i)
         {
-            Vector2i currentPosition = queue.front();
-            queue.pop();
-
-            for (auto& [dx, dy] : searchDirections)
+            canvas.activeLayer = i;
+            canvas.layers[i].blendMode = modes[i - 1];
+            canvas.layers[i].opacity = static_cast<uint8_t>(255 - 60 * (i - 1));
+            for (int y = 0; y < height; ++y)
             {
-                Vector2i nextPosition = { currentPosition.x + dx, currentPosition.y + dy };
-                if (!Contains(nextPosition))
+                for (int x = (y * i) % 11; x < width; x += 3 + i)
                 {
-                    continue;
+                    canvas.SetPixel({ x, y }, colors[i - 1]);
                 }
-                Pixel currentPixel = GetPixelAt(nextPosition);
-                if (currentPixel != initialPixel)
-                {
-                    continue;
-                }
-                SetPixel(nextPosition, fillPixel);
-                queue.push(nextPosition);
             }
         }
+        canvas.activeLayer = 3;
+        canvas.FillShape({ width / 2, height / 2 + 1 }, { 0, 96, 0, 96 }, FillSource::Composite);
+        canvas.Composite();
+        bitmap = canvas.composite;
+    }, capture });
+
+    scenes.push_back({ "set_pixel_strokes", [&] {
+        bitmap.Clear();
+        for (int i = 0; i < 2000; ++i)
+        {
+            bitmap.SetPixel({ (i * 7) % (width + 10) - 5, (i * 13) % (height + 10) - 5 }, { 255, 0, 0, 255 });
+        }
+    }, capture });
 
-        return true;
-    }
-};
-
-void UpdateTextureFromBitmap(Texture& texture, const Bitmap& bitmap)
-{
-    texture.update(reinterpret_cast<const Uint8*>(bitmap.pixels.data()));
+    return Regression::Run(scenes, settings);
 }
 
-Vector2i GetBitmapCursorPostion(const Window& window, float screenPixelToBitmapPixelRatio)
+// lab1 --canvas-create <file> <width> <height>
+int RunCanvasCreate(const char* path, int width, int height)
 {
-    Vector2i cursorPosition = Mouse::getPosition(window);
-    return Vector2i(
-        static_cast<int>(cursorPosition.x / screenPixelToBitmapPixelRatio),
-        static_cast<int>(cursorPosition.y / screenPixelToBitmapPixelRatio)
-    );
+    auto start = chrono::steady_clock::now();
+    MappedCanvas canvas = MappedCanvas::Create(path, width, height);
+    if (!canvas.IsOpen())
+    {
+        cerr << "Unable to create a " << width << "x" << height << " canvas in " << path << endl;
+        return 1;
+    }
+    printf("Created %dx%d canvas (%.1f MB of pixels) in %.3f ms\n", width, height, 4.0 * width * height / (1024.0 * 1024.0),
+        chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    return 0;
 }
 
-Pixel ColorToPixel(const Color& color)
+// lab1 --canvas-fill <file> <x> <y> [color], flood fills a canvas file in place, whatever its size
+int RunCanvasFill(const char* path, Vector2i start, int color)
 {
-    return { color.r, color.g, color.b, 255 };
+    auto openStart = chrono::steady_clock::now();
+    MappedCanvas canvas = MappedCanvas::Open(path);
+    if (!canvas.IsOpen())
+    {
+        cerr << "Unable to open canvas file " << path << endl;
+        return 1;
+    }
+    double openMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - openStart).count();
+
+    vector<Pixel> palette = PaletteToPixels(CreatePalette());
+    auto fillStart = chrono::steady_clock::now();
+    if (!canvas.FillShape(start, palette[color % palette.size()]))
+    {
+        cerr << "Fill start is outside the " << canvas.width << "x" << canvas.height << " canvas" << endl;
+        return 1;
+    }
+    double fillMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - fillStart).count();
+    uint64_t dirtyTiles = canvas.DirtyTileCount();
+
+    auto flushStart = chrono::steady_clock::now();
+    uint64_t flushed = canvas.Flush();
+    double flushMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - flushStart).count();
+
+    printf("%dx%d canvas: open %.3f ms, fill %.1f ms touching %llu tiles, flush %.1f MB in %.1f ms\n", canvas.width, canvas.height,
+        openMilliseconds, fillMilliseconds, static_cast<unsigned long long>(dirtyTiles), flushed / (1024.0 * 1024.0), flushMilliseconds);
+    return 0;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
-    vector<Color> pallete = { Color::Red, Color::Green, Color::Blue, Color::Yellow, Color::Cyan };
+    int checkExitCode;
+    if (argc > 1 && RunCheck(argv[1], checkExitCode))
+    {
+        return checkExitCode;
+    }
+    if (argc > 1 && string_view{ argv[1] } == "--regression")
+    {
+        return RunRegression(argc - 2, argv + 2);
+    }
+    if (argc > 2 && string_view{ argv[1] } == "--replay")
+    {
+        bool rgba = argc > 4 && string_view{ argv[4] } == "rgba";
+        return RunReplay(argv[2], argc > 3 ? max(1, atoi(argv[3])) : 1, rgba ? LayerStorage::Rgba : LayerStorage::Indexed);
+    }
+
+    if (argc > 4 && string_view{ argv[1] } == "--canvas-create")
+    {
+        return RunCanvasCreate(argv[2], atoi(argv[3]), atoi(argv[4]));
+    }
+    if (argc > 4 && string_view{ argv[1] } == "--canvas-fill")
+    {
+        return RunCanvasFill(argv[2], { atoi(argv[3]), atoi(argv[4]) }, argc > 5 ? max(0, atoi(argv[5])) : 0);
+    }
+
+    // lab1 --record <journal> saves the session's input when the window closes
+    string journalPath = argc > 2 && string_view{ argv[1] } == "--record" ? argv[2] : "";
+    // lab1 --canvas <file> [left top] paints on that part of a canvas file, created when missing, and flushes it on exit
+    string canvasPath = argc > 2 && string_view{ argv[1] } == "--canvas" ? argv[2] : "";
+
+    vector<Color> pallete = CreatePalette();
     vector<RectangleShape> colorMenu;
     float wigetBorder = 30.0f;
     float wigetOffset = 10.0f;
@@ -162,14 +339,12 @@ int main()
     selectionWiget.setSize({ wigetBorder + selectionWigetOverflow, wigetBorder + selectionWigetOverflow });
     selectionWiget.setFillColor(Color::White);
 
-    Pixel selectedPixel;
     int selectedColor = 0;
 
     auto adjustSelectionWiget = [&]()
     {
         auto pos = colorMenu[selectedColor].getPosition();
         selectionWiget.setPosition({ pos.x - selectionWigetOverflow / 2.0f, pos.y - selectionWigetOverflow / 2.0f });
-        selectedPixel = ColorToPixel(pallete[selectedColor]);
     };
 
     adjustSelectionWiget();
@@ -178,22 +353,71 @@ int main()
 
     Vector2f windowSize = window.getView().getSize();
     float screenPixelToBitmapPixelRatio = 8;
-    Bitmap bitmap = Bitmap::New(
+    PaintSession session = PaintSession::New(
         static_cast<int>(windowSize.x / screenPixelToBitmapPixelRatio),
-        static_cast<int>(windowSize.y / screenPixelToBitmapPixelRatio)
+        static_cast<int>(windowSize.y / screenPixelToBitmapPixelRatio),
+        3,
+        PaletteToPixels(pallete),
+        // Canvas files hold any color, their window is painted on RGBA layers
+        canvasPath.empty() ? LayerStorage::Indexed : LayerStorage::Rgba
     );
+    session.verbose = true;
+
+    MappedCanvas canvasFile;
+    Vector2i canvasFileOrigin = { 0, 0 };
+    Vector2i canvasFileView = { 0, 0 };
+    if (!canvasPath.empty())
+    {
+        canvasFile = filesystem::exists(canvasPath) ? MappedCanvas::Open(canvasPath.c_str())
+                                                    : MappedCanvas::Create(canvasPath.c_str(), session.canvas.Width(), session.canvas.Height());
+        if (!canvasFile.IsOpen())
+        {
+            cerr << "Unable to open canvas file " << canvasPath << endl;
+            return 1;
+        }
+        canvasFileOrigin.x = clamp(argc > 4 ? atoi(argv[3]) : 0, 0, canvasFile.width - 1);
+        canvasFileOrigin.y = clamp(argc > 4 ? atoi(argv[4]) : 0, 0, canvasFile.height - 1);
+        canvasFileView.x = min(session.canvas.Width(), canvasFile.width - canvasFileOrigin.x);
+        canvasFileView.y = min(session.canvas.Height(), canvasFile.height - canvasFileOrigin.y);
+        // The file's pixels become the bottom layer, transparent shows the same black background
+        canvasFile.ReadRegion(canvasFileOrigin.x, canvasFileOrigin.y, canvasFileView.x, canvasFileView.y,
+            session.canvas.layers[0].bitmap.pixels.data(), session.canvas.Width());
+        session.canvas.MarkAllDirty();
+    }
+    InputJournal journal;
+    journal.width = session.canvas.Width();
+    journal.height = session.canvas.Height();
+    journal.layerCount = static_cast<int>(session.canvas.layers.size());
+    vector<Pixel> uploadScratch;
+
+    SnapshotExporter snapshots;
+    snapshots.Start();
+    int snapshotCount = 0;
+    bool qWasPressed = false;
+    bool eWasPressed = false;
+
+    uint32_t frameIndex = 0;
+    vector<InputEvent> frameEvents;
+    bool leftHeld = false;
+    bool rWasPressed = false;
+    int brushDigitWasPressed = -1;
 
     Texture texture;
-    texture.create(bitmap.width, bitmap.height);
+    texture.create(session.canvas.Width(), session.canvas.Height());
 
     RectangleShape screen;
     screen.setSize(windowSize);
     screen.setTexture(&texture, false);
 
-    bool shiftWasPressed = false;
-
+    // Left paints, right fills, space clears the layer, shift picks the next color.
+    // Tab picks the layer, O its opacity, B its blend mode, H hides it, F switches what flood fill looks at.
+    // Control and right click selects the region around the cursor, painting then stays inside it. G grows the
+    // selection, K shrinks it, I inverts it, D drops it, Enter fills it with the color and X clears it.
+    // Q saves the image as QOI and E as PNG, both encoded in the background.
+    // 1 to 9 pick the brush radius from 0 to 8 and R switches between round and square brushes.
     while (window.isOpen())
     {
+        // Every cursor move of the frame, so fast strokes stay connected however long the frame took
         Event event;
         while (window.pollEvent(event))
         {
@@ -201,35 +425,94 @@ int main()
             {
                 window.close();
             }
+            else if (event.type == Event::MouseButtonPressed && event.mouseButton.button == Mouse::Left)
+            {
+                leftHeld = true;
+            }
+            else if (event.type == Event::MouseButtonReleased && event.mouseButton.button == Mouse::Left)
+            {
+                leftHeld = false;
+            }
+            else if (event.type == Event::MouseMoved && leftHeld)
+            {
+                InputEvent motion;
+                motion.frame = frameIndex;
+                motion.type = InputEventType::Motion;
+                motion.x = static_cast<int16_t>(clamp(static_cast<int>(event.mouseMove.x / screenPixelToBitmapPixelRatio), -32768, 32767));
+                motion.y = static_cast<int16_t>(clamp(static_cast<int>(event.mouseMove.y / screenPixelToBitmapPixelRatio), -32768, 32767));
+                frameEvents.push_back(motion);
+            }
         }
-       
-        if (Mouse::isButtonPressed(Mouse::Button::Left))
-        {
-            bitmap.SetPixel(GetBitmapCursorPostion(window, screenPixelToBitmapPixelRatio), selectedPixel);
-        }
-        if (Mouse::isButtonPressed(Mouse::Button::Right))
+
+        bool rIsPressed = Keyboard::isKeyPressed(Keyboard::R);
+        int brushDigit = -1;
+        for (int digit = 0; digit < 9; ++digit)
         {
-            bitmap.FillShape(GetBitmapCursorPostion(window, screenPixelToBitmapPixelRatio), selectedPixel);
+            brushDigit = Keyboard::isKeyPressed(static_cast<Keyboard::Key>(Keyboard::Num1 + digit)) ? digit : brushDigit;
         }
-        if (Keyboard::isKeyPressed(Keyboard::Space))
+        if ((rIsPressed && !rWasPressed) || (brushDigit >= 0 && brushDigit != brushDigitWasPressed))
         {
-            bitmap.Clear();
+            InputEvent brushChange;
+            brushChange.frame = frameIndex;
+            brushChange.type = InputEventType::Brush;
+            BrushShape shape = session.brush.shape;
+            if (rIsPressed && !rWasPressed)
+            {
+                shape = shape == BrushShape::Round ? BrushShape::Square : BrushShape::Round;
+            }
+            brushChange.x = static_cast<int16_t>(shape);
+            brushChange.y = static_cast<int16_t>(brushDigit >= 0 ? brushDigit : session.brush.radius);
+            frameEvents.push_back(brushChange);
         }
+        rWasPressed = rIsPressed;
+        brushDigitWasPressed = brushDigit;
 
-        bool shiftIsPressed = Keyboard::isKeyPressed(Keyboard::LShift);
-        if (shiftIsPressed && !shiftWasPressed)
+        InputFrame input = SampleInput(window, screenPixelToBitmapPixelRatio);
+        if (!journalPath.empty())
         {
-            shiftWasPressed = true;
-            selectedColor = (selectedColor + 1) % pallete.size();
-            adjustSelectionWiget();
+            journal.frames.push_back(input);
+            journal.events.insert(journal.events.end(), frameEvents.begin(), frameEvents.end());
         }
-        else if (!shiftIsPressed && shiftWasPressed)
+        session.Apply(input, frameEvents);
+        frameEvents.clear();
+        ++frameIndex;
+        if (session.selectedColor != selectedColor)
         {
-            shiftWasPressed = false;
+            selectedColor = session.selectedColor;
+            adjustSelectionWiget();
         }
 
         window.clear();
-        UpdateTextureFromBitmap(texture, bitmap);
+        UpdateTextureFromCanvas(texture, session.canvas, session.Composite(), uploadScratch);
+
+        bool qIsPressed = Keyboard::isKeyPressed(Keyboard::Q);
+        bool eIsPressed = Keyboard::isKeyPressed(Keyboard::E);
+        if ((qIsPressed && !qWasPressed) || (eIsPressed && !eWasPressed))
+        {
+            SnapshotFormat format = qIsPressed && !qWasPressed ? SnapshotFormat::Qoi : SnapshotFormat::Png;
+            string path = "snapshot_" + to_string(snapshotCount) + ImageEncoder::Extension(format);
+            if (snapshots.Submit(PixelBytes(session.canvas.composite), session.canvas.Width(), session.canvas.Height(), format, path))
+            {
+                ++snapshotCount;
+            }
+            else
+            {
+                cout << "Snapshot dropped, the exporter is busy" << endl;
+            }
+        }
+        qWasPressed = qIsPressed;
+        eWasPressed = eIsPressed;
+        for (auto& result : snapshots.TakeResults())
+        {
+            if (result.written)
+            {
+                printf("Saved %s, %zu KB in %.2f ms\n", result.path.c_str(), result.encodedBytes / 1024, result.encodeSeconds * 1000.0);
+            }
+            else
+            {
+                cerr << "Unable to write " << result.path << endl;
+            }
+        }
         window.draw(screen);
         window.draw(selectionWiget);
         for (auto& wiget : colorMenu)
@@ -239,5 +522,29 @@ int main()
         window.display();
     }
 
+    snapshots.Stop();
+    SnapshotStats snapshotStats = snapshots.Stats();
+    if (snapshotStats.exported + snapshotStats.dropped > 0)
+    {
+        printf("Snapshots: %d saved, %d dropped, encoding %.1f MB/s\n", snapshotStats.exported, snapshotStats.dropped, snapshotStats.MegabytesPerSecond());
+    }
+
+    if (canvasFile.IsOpen())
+    {
+        canvasFile.WriteRegion(canvasFileOrigin.x, canvasFileOrigin.y, canvasFileView.x, canvasFileView.y,
+            session.canvas.layers[0].bitmap.pixels.data(), session.canvas.Width());
+        cout << "Saved " << canvasFile.Flush() / 1024 << " KB of changed tiles to " << canvasPath << endl;
+    }
+
+    if (!journalPath.empty())
+    {
+        if (!journal.Save(journalPath))
+        {
+            cerr << "Unable to save input journal " << journalPath << endl;
+            return 1;
+        }
+        cout << "Recorded " << journal.frames.size() << " frames to " << journalPath << endl;
+    }
+
     return 0;
 }
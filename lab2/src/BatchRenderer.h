@@ -0,0 +1,203 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Bitmap.h"
+
+enum class FrameFormat
+{
+    Y4M,
+    PPM
+};
+
+struct BatchRenderSettings
+{
+    int width = 160;
+    int height = 120;
+    int frameCount = 120;
+    int framesPerSecond = 30;
+    // 0 uses every hardware thread
+    int threadCount = 0;
+    FrameFormat format = FrameFormat::Y4M;
+};
+
+struct BatchRenderStats
+{
+    int frames = 0;
+    int threads = 0;
+    double seconds = 0.0;
+
+    double FramesPerSecond() const
+    {
+        return seconds > 0.0 ? frames / seconds : 0.0;
+    }
+};
+
+// Renders independent frames on a pool of worker threads and writes them to the output strictly in
+// frame order. Workers render at most two frames per thread ahead of the writer, so memory stays
+// bounded however long the sequence is.
+struct BatchRenderer
+{
+    // Called concurrently from worker threads, the bitmap is owned by the worker and must be fully redrawn
+    using RenderFunction = std::function<void(int frame, int worker, Bitmap& bitmap)>;
+
+    static int ResolveThreadCount(int requested)
+    {
+        return requested > 0 ? requested : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    }
+
+    // output may be nullptr to render without writing anything, e.g. for benchmarking
+    static bool Render(const BatchRenderSettings& settings, std::FILE* output, const RenderFunction& renderFrame, BatchRenderStats* stats = nullptr)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        int threadCount = std::min(ResolveThreadCount(settings.threadCount), std::max(settings.frameCount, 1));
+        int slotCount = threadCount * 2;
+
+        std::vector<std::vector<std::uint8_t>> slots(slotCount);
+        std::vector<int> slotFrames(slotCount, -1);
+        std::mutex mutex;
+        std::condition_variable frameReady;
+        std::condition_variable slotFreed;
+        int nextFrame = 0;
+        int nextFrameToWrite = 0;
+        bool failed = false;
+
+        if (output != nullptr && settings.format == FrameFormat::Y4M)
+        {
+            std::string header = "YUV4MPEG2 W" + std::to_string(settings.width) + " H" + std::to_string(settings.height)
+                + " F" + std::to_string(settings.framesPerSecond) + ":1 Ip A1:1 C444\n";
+            failed = std::fwrite(header.data(), 1, header.size(), output) != header.size();
+        }
+
+        auto worker = [&](int workerIndex) {
+            Bitmap bitmap = Bitmap::New(settings.width, settings.height);
+            while (true)
+            {
+                int frame;
+                {
+                    std::unique_lock lock(mutex);
+                    slotFreed.wait(lock, [&] { return failed || nextFrame >= settings.frameCount || nextFrame < nextFrameToWrite + slotCount; });
+                    if (failed || nextFrame >= settings.frameCount)
+                    {
+                        return;
+                    }
+                    frame = nextFrame++;
+                }
+
+                renderFrame(frame, workerIndex, bitmap);
+
+                // The slot is free: the frame that used it last has already been written
+                auto& encoded = slots[frame % slotCount];
+                encoded.clear();
+                if (settings.format == FrameFormat::Y4M)
+                {
+                    AppendY4mFrame(bitmap, encoded);
+                }
+                else
+                {
+                    AppendPpmFrame(bitmap, encoded);
+                }
+
+                {
+                    std::lock_guard lock(mutex);
+                    slotFrames[frame % slotCount] = frame;
+                }
+                frameReady.notify_one();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threadCount; ++i)
+        {
+            workers.emplace_back(worker, i);
+        }
+
+        for (int frame = 0; frame < settings.frameCount && !failed; ++frame)
+        {
+            int slot = frame % slotCount;
+            {
+                std::unique_lock lock(mutex);
+                frameReady.wait(lock, [&] { return slotFrames[slot] == frame; });
+            }
+
+            bool written = output == nullptr || std::fwrite(slots[slot].data(), 1, slots[slot].size(), output) == slots[slot].size();
+
+            {
+                std::lock_guard lock(mutex);
+                slotFrames[slot] = -1;
+                nextFrameToWrite = frame + 1;
+                failed = !written;
+            }
+            slotFreed.notify_all();
+        }
+
+        for (auto& thread : workers)
+        {
+            thread.join();
+        }
+
+        if (output != nullptr)
+        {
+            failed = std::fflush(output) != 0 || failed;
+        }
+
+        if (stats != nullptr)
+        {
+            stats->frames = nextFrameToWrite;
+            stats->threads = threadCount;
+            stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        return !failed;
+    }
+
+    static void AppendPpmFrame(const Bitmap& bitmap, std::vector<std::uint8_t>& output)
+    {
+        std::string header = "P6\n" + std::to_string(bitmap.width) + " " + std::to_string(bitmap.height) + "\n255\n";
+        output.insert(output.end(), header.begin(), header.end());
+
+        std::size_t offset = output.size();
+        output.resize(offset + bitmap.pixels.size() * 3);
+        std::uint8_t* rgb = output.data() + offset;
+        for (auto& pixel : bitmap.pixels)
+        {
+            *rgb++ = pixel.r;
+            *rgb++ = pixel.g;
+            *rgb++ = pixel.b;
+        }
+    }
+
+    // Full resolution (4:4:4) BT.601 studio range planes
+    static void AppendY4mFrame(const Bitmap& bitmap, std::vector<std::uint8_t>& output)
+    {
+        static constexpr char FrameHeader[] = "FRAME\n";
+        output.insert(output.end(), FrameHeader, FrameHeader + sizeof(FrameHeader) - 1);
+
+        std::size_t planeSize = bitmap.pixels.size();
+        std::size_t offset = output.size();
+        output.resize(offset + planeSize * 3);
+        std::uint8_t* y = output.data() + offset;
+        std::uint8_t* u = y + planeSize;
+        std::uint8_t* v = u + planeSize;
+
+        for (std::size_t i = 0; i < planeSize; ++i)
+        {
+            int r = bitmap.pixels[i].r;
+            int g = bitmap.pixels[i].g;
+            int b = bitmap.pixels[i].b;
+            y[i] = static_cast<std::uint8_t>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            u[i] = static_cast<std::uint8_t>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            v[i] = static_cast<std::uint8_t>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+};
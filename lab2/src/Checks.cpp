@@ -0,0 +1,97 @@
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "Checks.h"
+#include "Model.h"
+#include "MeshImporter.h"
+#include "../../common/SelfCheck.h"
+
+using namespace std;
+
+// lab2 --check-import, loads small meshes from the temp directory. Malformed ones must be rejected without reading
+// outside the vertex list
+int RunImportCheck()
+{
+    SelfCheck check("Import");
+
+    auto load = [](string_view name, string_view contents, Model& model) {
+        string path = (filesystem::temp_directory_path() / name).string();
+        {
+            ofstream file{ path, ios::binary };
+            file.write(contents.data(), contents.size());
+        }
+        bool loaded = MeshImporter::Load(path, model);
+        filesystem::remove(path);
+        return loaded;
+    };
+
+    const string_view square = "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n";
+
+    Model model;
+    if (!load("lab2_check.obj", string{ square } + "vt 0 0\nvn 0 0 1\nf 1/1/1 2/1/1 3/1/1 4/1/1\nf -4//1 -2//1 -1\n", model))
+    {
+        check.Fail("valid obj not loaded");
+    }
+    else if (model.triangles.size() != 3)
+    {
+        check.Fail("quad and triangle should give 3 triangles");
+    }
+    else if (model.triangles[2].vertices[1].x != 1.0f || model.triangles[2].vertices[1].y != 1.0f)
+    {
+        check.Fail("negative index resolved to the wrong vertex");
+    }
+
+    const pair<string_view, string> invalidObjs[] = {
+        { "faces without vertices", "f 1 2 3\n" },
+        { "index past the last vertex", string{ square } + "f 1 2 5\n" },
+        { "index zero", string{ square } + "f 0 1 2\n" },
+        { "negative index before the first vertex", string{ square } + "f -5 -1 -2\n" },
+        { "vertex defined after the face", "v 0 0 0\nv 1 0 0\nf 1 2 3\nv 1 1 0\n" },
+    };
+    for (const auto& [what, contents] : invalidObjs)
+    {
+        Model rejected;
+        if (load("lab2_check.obj", contents, rejected))
+        {
+            check.Fail(what);
+        }
+    }
+
+    // Binary STL, 80 byte header, count, then normal, three vertices and attribute bytes per triangle
+    string stl(84 + 50, '\0');
+    const uint32_t stlTriangleCount = 1;
+    const float stlValues[12] = { 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0 };
+    memcpy(stl.data() + 80, &stlTriangleCount, sizeof(stlTriangleCount));
+    memcpy(stl.data() + 84, stlValues, sizeof(stlValues));
+    Model stlModel;
+    if (!load("lab2_check.stl", stl, stlModel) || stlModel.triangles.size() != 1)
+    {
+        check.Fail("binary stl");
+    }
+    Model truncated;
+    if (load("lab2_check.stl", stl.substr(0, stl.size() - 1), truncated))
+    {
+        check.Fail("truncated stl accepted");
+    }
+
+    if (check.passed)
+    {
+        cout << "Import check passed" << endl;
+    }
+    return check.ExitCode();
+}
+
+const SelfCheckMode CheckModes[] = {
+    { "--check-import", RunImportCheck },
+};
+
+bool RunCheck(string_view flag, int& exitCode)
+{
+    return RunSelfCheck(CheckModes, flag, exitCode);
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+#include "Model.h"
+
+enum class DepthSortMode
+{
+    Comparison,
+    Radix,
+    Incremental
+};
+
+inline const char* GetDepthSortModeName(DepthSortMode mode)
+{
+    switch (mode)
+    {
+    case DepthSortMode::Comparison: return "comparison";
+    case DepthSortMode::Radix: return "radix";
+    case DepthSortMode::Incremental: return "incremental";
+    }
+    return "unknown";
+}
+
+// Builds back-to-front (painter's) draw order for NDC space triangles.
+// Radix and Incremental modes compute a quantized depth key once per triangle, Comparison mode
+// recomputes the average depth inside the comparator and is kept as a reference.
+struct DepthSorter
+{
+    static constexpr int RadixBits = 8;
+    static constexpr int BucketCount = 1 << RadixBits;
+    static constexpr float MaxKey = 65535.0f;
+
+    DepthSortMode mode = DepthSortMode::Radix;
+
+    // Incremental mode gives up on repairing the previous order and radix sorts instead
+    // once insertion sort has moved more than this many elements per triangle
+    int maxShiftsPerTriangle = 4;
+
+    // Statistics of the last Sort call
+    bool lastSortWasRepaired = false;
+    std::size_t lastShiftCount = 0;
+
+    const std::vector<std::uint32_t>& Sort(const std::vector<Triangle>& triangles)
+    {
+        lastSortWasRepaired = false;
+        lastShiftCount = 0;
+
+        bool orderIsReusable = order.size() == triangles.size();
+        if (!orderIsReusable || mode != DepthSortMode::Incremental)
+        {
+            order.resize(triangles.size());
+            std::iota(order.begin(), order.end(), 0);
+        }
+
+        switch (mode)
+        {
+        case DepthSortMode::Comparison:
+        {
+            std::sort(order.begin(), order.end(), [&](std::uint32_t i1, std::uint32_t i2) {
+                return AverageDepth(triangles[i1]) > AverageDepth(triangles[i2]);
+            });
+            break;
+        }
+        case DepthSortMode::Radix:
+        {
+            BuildKeys(triangles);
+            RadixSort();
+            break;
+        }
+        case DepthSortMode::Incremental:
+        {
+            BuildKeys(triangles);
+            if (!orderIsReusable || !RepairOrder())
+            {
+                RadixSort();
+            }
+            break;
+        }
+        }
+
+        return order;
+    }
+
+    void Reset()
+    {
+        order.clear();
+    }
+
+    static float AverageDepth(const Triangle& triangle)
+    {
+        return (triangle.vertices[0].z + triangle.vertices[1].z + triangle.vertices[2].z) / 3.0f;
+    }
+
+private:
+    std::vector<std::uint32_t> order;
+    std::vector<std::uint16_t> keys;
+    std::vector<std::uint16_t> sortedKeys;
+    std::vector<std::uint16_t> scratchKeys;
+    std::vector<std::uint32_t> scratchOrder;
+    std::vector<float> depths;
+
+    void BuildKeys(const std::vector<Triangle>& triangles)
+    {
+        keys.resize(triangles.size());
+        if (triangles.empty())
+        {
+            return;
+        }
+
+        depths.resize(triangles.size());
+
+        float minDepth = AverageDepth(triangles[0]);
+        float maxDepth = minDepth;
+        for (std::size_t i = 0; i < triangles.size(); ++i)
+        {
+            float depth = AverageDepth(triangles[i]);
+            depths[i] = depth;
+            minDepth = std::min(minDepth, depth);
+            maxDepth = std::max(maxDepth, depth);
+        }
+
+        // Farthest triangle gets key 0, so ascending key order is back-to-front
+        float scale = maxDepth > minDepth ? MaxKey / (maxDepth - minDepth) : 0.0f;
+        for (std::size_t i = 0; i < depths.size(); ++i)
+        {
+            float key = std::clamp((maxDepth - depths[i]) * scale, 0.0f, MaxKey);
+            keys[i] = static_cast<std::uint16_t>(key);
+        }
+    }
+
+    // LSD radix sort of the current order by 16-bit keys, two stable 8-bit passes
+    void RadixSort()
+    {
+        std::size_t size = order.size();
+        if (size == 0)
+        {
+            return;
+        }
+
+        sortedKeys.resize(size);
+        scratchKeys.resize(size);
+        scratchOrder.resize(size);
+
+        std::size_t histograms[2][BucketCount] = {};
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            std::uint16_t key = keys[order[i]];
+            sortedKeys[i] = key;
+            ++histograms[0][key & (BucketCount - 1)];
+            ++histograms[1][key >> RadixBits];
+        }
+
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            auto& histogram = histograms[pass];
+            int shift = pass * RadixBits;
+
+            // Every key has the same digit, this pass would not change anything
+            if (histogram[(sortedKeys[0] >> shift) & (BucketCount - 1)] == size)
+            {
+                continue;
+            }
+
+            std::size_t offset = 0;
+            for (auto& count : histogram)
+            {
+                std::size_t bucketSize = count;
+                count = offset;
+                offset += bucketSize;
+            }
+
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                std::uint16_t key = sortedKeys[i];
+                std::size_t destination = histogram[(key >> shift) & (BucketCount - 1)]++;
+                scratchKeys[destination] = key;
+                scratchOrder[destination] = order[i];
+            }
+
+            std::swap(sortedKeys, scratchKeys);
+            std::swap(order, scratchOrder);
+        }
+    }
+
+    // Insertion sort starting from the previous frame's order, cheap when only a few triangles swapped places
+    bool RepairOrder()
+    {
+        std::size_t size = order.size();
+        std::size_t maxShifts = size * maxShiftsPerTriangle;
+
+        sortedKeys.resize(size);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            sortedKeys[i] = keys[order[i]];
+        }
+
+        std::size_t shifts = 0;
+        for (std::size_t i = 1; i < size; ++i)
+        {
+            std::uint16_t key = sortedKeys[i];
+            std::uint32_t index = order[i];
+
+            std::size_t j = i;
+            while (j > 0 && sortedKeys[j - 1] > key)
+            {
+                sortedKeys[j] = sortedKeys[j - 1];
+                order[j] = order[j - 1];
+                --j;
+            }
+            sortedKeys[j] = key;
+            order[j] = index;
+
+            shifts += i - j;
+            if (shifts > maxShifts)
+            {
+                lastShiftCount = shifts;
+                return false;
+            }
+        }
+
+        lastShiftCount = shifts;
+        lastSortWasRepaired = true;
+        return true;
+    }
+};
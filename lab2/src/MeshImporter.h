@@ -0,0 +1,468 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cctype>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "Model.h"
+#include "../../common/MappedFile.h"
+
+struct MeshImportStats
+{
+    std::size_t bytes = 0;
+    std::size_t triangles = 0;
+    double seconds = 0.0;
+
+    double MegabytesPerSecond() const
+    {
+        return seconds > 0.0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0;
+    }
+
+    double TrianglesPerSecond() const
+    {
+        return seconds > 0.0 ? triangles / seconds : 0.0;
+    }
+};
+
+// Loads Wavefront OBJ (positions and faces only, polygons are triangulated as fans) and binary STL.
+// The file is memory-mapped and parsed in parallel chunks straight into Model::triangles, normals
+// are computed the same way as Model::SetNormals.
+struct MeshImporter
+{
+    static bool Load(std::string_view path, Model& model, MeshImportStats* stats = nullptr)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        MappedFile file = MappedFile::Open(std::string{ path }.c_str());
+        if (!file.IsOpen())
+        {
+            return false;
+        }
+
+        model.triangles.clear();
+
+        bool loaded = false;
+        if (HasExtension(path, ".stl"))
+        {
+            loaded = LoadBinaryStl(file.data, file.size, model);
+        }
+        else if (HasExtension(path, ".obj"))
+        {
+            loaded = LoadObj(file.data, file.size, model);
+        }
+
+        if (loaded && stats != nullptr)
+        {
+            stats->bytes = file.size;
+            stats->triangles = model.triangles.size();
+            stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        return loaded;
+    }
+
+private:
+    struct ObjChunk
+    {
+        const char* begin;
+        const char* end;
+        std::size_t vertexCount = 0;
+        std::size_t triangleCount = 0;
+        std::size_t vertexOffset = 0;
+        std::size_t triangleOffset = 0;
+    };
+
+    static constexpr std::size_t StlHeaderSize = 84;
+    static constexpr std::size_t StlTriangleSize = 50;
+    static constexpr std::size_t MinChunkSize = 1 << 20;
+
+    static bool HasExtension(std::string_view path, std::string_view extension)
+    {
+        if (path.size() < extension.size())
+        {
+            return false;
+        }
+        auto suffix = path.substr(path.size() - extension.size());
+        return std::equal(suffix.begin(), suffix.end(), extension.begin(), [](char a, char b) {
+            return std::tolower(static_cast<unsigned char>(a)) == b;
+        });
+    }
+
+    static int ThreadCount(std::size_t workSize, std::size_t minWorkPerThread)
+    {
+        std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        return static_cast<int>(std::clamp<std::size_t>(workSize / minWorkPerThread, 1, threads));
+    }
+
+    template<typename Function>
+    static void ParallelFor(int count, const Function& function)
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(count > 0 ? count - 1 : 0);
+        for (int i = 1; i < count; ++i)
+        {
+            threads.emplace_back(function, i);
+        }
+        if (count > 0)
+        {
+            function(0);
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    static void SetTriangle(Triangle& triangle, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    {
+        triangle.vertices[0] = glm::vec4{ a, 1.0f };
+        triangle.vertices[1] = glm::vec4{ b, 1.0f };
+        triangle.vertices[2] = glm::vec4{ c, 1.0f };
+        triangle.normal = glm::cross(b - a, c - a);
+    }
+
+    static bool LoadBinaryStl(const char* data, std::size_t size, Model& model)
+    {
+        if (size < StlHeaderSize)
+        {
+            return false;
+        }
+
+        std::uint32_t triangleCount;
+        std::memcpy(&triangleCount, data + 80, sizeof(triangleCount));
+        if (size != StlHeaderSize + static_cast<std::size_t>(triangleCount) * StlTriangleSize)
+        {
+            // ASCII STL or a truncated file
+            return false;
+        }
+
+        model.triangles.resize(triangleCount);
+
+        int threadCount = ThreadCount(size, MinChunkSize);
+        ParallelFor(threadCount, [&](int thread) {
+            std::size_t first = static_cast<std::size_t>(triangleCount) * thread / threadCount;
+            std::size_t last = static_cast<std::size_t>(triangleCount) * (thread + 1) / threadCount;
+
+            for (std::size_t i = first; i < last; ++i)
+            {
+                // Normal followed by three vertices, the stored normal is often zero so it is recomputed
+                float values[12];
+                std::memcpy(values, data + StlHeaderSize + i * StlTriangleSize, sizeof(values));
+                SetTriangle(
+                    model.triangles[i],
+                    { values[3], values[4], values[5] },
+                    { values[6], values[7], values[8] },
+                    { values[9], values[10], values[11] }
+                );
+            }
+        });
+
+        return true;
+    }
+
+    static bool LoadObj(const char* data, std::size_t size, Model& model)
+    {
+        int chunkCount = ThreadCount(size, MinChunkSize);
+        std::vector<ObjChunk> chunks(chunkCount);
+
+        // Chunks are split on line boundaries
+        const char* end = data + size;
+        const char* chunkBegin = data;
+        for (int i = 0; i < chunkCount; ++i)
+        {
+            const char* chunkEnd = i == chunkCount - 1 ? end : std::max(chunkBegin, data + size * (i + 1) / chunkCount);
+            if (chunkEnd != end)
+            {
+                auto* newline = static_cast<const char*>(std::memchr(chunkEnd, '\n', end - chunkEnd));
+                chunkEnd = newline != nullptr ? newline + 1 : end;
+            }
+            chunks[i].begin = chunkBegin;
+            chunks[i].end = chunkEnd;
+            chunkBegin = chunkEnd;
+        }
+
+        ParallelFor(chunkCount, [&](int i) {
+            CountObjChunk(chunks[i]);
+        });
+
+        std::size_t vertexCount = 0;
+        std::size_t triangleCount = 0;
+        for (auto& chunk : chunks)
+        {
+            chunk.vertexOffset = vertexCount;
+            chunk.triangleOffset = triangleCount;
+            vertexCount += chunk.vertexCount;
+            triangleCount += chunk.triangleCount;
+        }
+
+        // Faces may reference vertices from any earlier chunk, so all positions are parsed first
+        std::vector<glm::vec3> positions(vertexCount);
+        ParallelFor(chunkCount, [&](int i) {
+            ParseObjPositions(chunks[i], positions);
+        });
+
+        model.triangles.resize(triangleCount);
+        std::atomic<bool> indicesAreValid = true;
+        ParallelFor(chunkCount, [&](int i) {
+            if (!ParseObjFaces(chunks[i], positions, model.triangles))
+            {
+                indicesAreValid = false;
+            }
+        });
+
+        return indicesAreValid;
+    }
+
+    template<typename Function>
+    static void ForEachLine(const char* begin, const char* end, const Function& function)
+    {
+        while (begin < end)
+        {
+            auto* newline = static_cast<const char*>(std::memchr(begin, '\n', end - begin));
+            const char* lineEnd = newline != nullptr ? newline : end;
+            function(begin, lineEnd);
+            begin = lineEnd + 1;
+        }
+    }
+
+    static bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    static const char* SkipSpaces(const char* p, const char* end)
+    {
+        while (p < end && IsSpace(*p))
+        {
+            ++p;
+        }
+        return p;
+    }
+
+    static bool IsPositionLine(const char* p, const char* end)
+    {
+        return end - p > 1 && p[0] == 'v' && IsSpace(p[1]);
+    }
+
+    static bool IsFaceLine(const char* p, const char* end)
+    {
+        return end - p > 1 && p[0] == 'f' && IsSpace(p[1]);
+    }
+
+    static void CountObjChunk(ObjChunk& chunk)
+    {
+        ForEachLine(chunk.begin, chunk.end, [&](const char* p, const char* end) {
+            p = SkipSpaces(p, end);
+            if (IsPositionLine(p, end))
+            {
+                ++chunk.vertexCount;
+            }
+            else if (IsFaceLine(p, end))
+            {
+                int faceVertices = 0;
+                p += 1;
+                while (true)
+                {
+                    p = SkipSpaces(p, end);
+                    if (p >= end || *p == '#')
+                    {
+                        break;
+                    }
+                    ++faceVertices;
+                    while (p < end && !IsSpace(*p))
+                    {
+                        ++p;
+                    }
+                }
+                chunk.triangleCount += std::max(faceVertices - 2, 0);
+            }
+        });
+    }
+
+    static void ParseObjPositions(const ObjChunk& chunk, std::vector<glm::vec3>& positions)
+    {
+        std::size_t vertex = chunk.vertexOffset;
+        ForEachLine(chunk.begin, chunk.end, [&](const char* p, const char* end) {
+            p = SkipSpaces(p, end);
+            if (IsPositionLine(p, end))
+            {
+                glm::vec3& position = positions[vertex++];
+                p = ParseFloat(p + 1, end, position.x);
+                p = ParseFloat(p, end, position.y);
+                ParseFloat(p, end, position.z);
+            }
+        });
+    }
+
+    static bool ParseObjFaces(const ObjChunk& chunk, const std::vector<glm::vec3>& positions, std::vector<Triangle>& triangles)
+    {
+        // Negative indices are relative to the number of vertices defined so far
+        std::size_t definedVertices = chunk.vertexOffset;
+        std::size_t triangle = chunk.triangleOffset;
+        bool valid = true;
+
+        ForEachLine(chunk.begin, chunk.end, [&](const char* p, const char* end) {
+            // The file is rejected after the first bad index, the rest of the chunk is not worth parsing
+            if (!valid)
+            {
+                return;
+            }
+            p = SkipSpaces(p, end);
+            if (IsPositionLine(p, end))
+            {
+                ++definedVertices;
+                return;
+            }
+            if (!IsFaceLine(p, end))
+            {
+                return;
+            }
+
+            p += 1;
+            std::size_t first = 0;
+            std::size_t previous = 0;
+            int faceVertices = 0;
+            while (true)
+            {
+                p = SkipSpaces(p, end);
+                if (p >= end || *p == '#')
+                {
+                    break;
+                }
+
+                long long index = 0;
+                p = ParseInteger(p, end, index);
+                // Texture coordinate and normal indices are not used
+                while (p < end && !IsSpace(*p))
+                {
+                    ++p;
+                }
+
+                long long resolved = index > 0 ? index - 1 : static_cast<long long>(definedVertices) + index;
+                // Also catches faces before any v line, positions may even be empty
+                if (index == 0 || resolved < 0 || resolved >= static_cast<long long>(definedVertices))
+                {
+                    valid = false;
+                    return;
+                }
+                std::size_t current = static_cast<std::size_t>(resolved);
+
+                if (faceVertices == 0)
+                {
+                    first = current;
+                }
+                else if (faceVertices >= 2)
+                {
+                    SetTriangle(triangles[triangle++], positions[first], positions[previous], positions[current]);
+                }
+                previous = current;
+                ++faceVertices;
+            }
+        });
+
+        return valid;
+    }
+
+    static const char* ParseInteger(const char* p, const char* end, long long& value)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+        value = 0;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            value = value * 10 + (*p - '0');
+            ++p;
+        }
+        if (negative)
+        {
+            value = -value;
+        }
+        return p;
+    }
+
+    static const char* ParseFloat(const char* p, const char* end, float& value)
+    {
+        static constexpr double PowersOf10[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+            1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+        constexpr int MaxExactPower = 22;
+        constexpr int MaxMantissaDigits = 19;
+
+        p = SkipSpaces(p, end);
+
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            negative = *p == '-';
+            ++p;
+        }
+
+        std::uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            if (digits < MaxMantissaDigits)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0 ? 1 : 0;
+            }
+            else
+            {
+                ++exponent;
+            }
+            ++p;
+        }
+
+        if (p < end && *p == '.')
+        {
+            ++p;
+            while (p < end && *p >= '0' && *p <= '9')
+            {
+                if (digits < MaxMantissaDigits)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits += mantissa != 0 ? 1 : 0;
+                    --exponent;
+                }
+                ++p;
+            }
+        }
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            long long explicitExponent = 0;
+            p = ParseInteger(p + 1, end, explicitExponent);
+            exponent += static_cast<int>(std::clamp(explicitExponent, -1000LL, 1000LL));
+        }
+
+        double result = static_cast<double>(mantissa);
+        if (exponent < 0)
+        {
+            result = -exponent <= MaxExactPower ? result / PowersOf10[-exponent] : result * std::pow(10.0, exponent);
+        }
+        else if (exponent > 0)
+        {
+            result = exponent <= MaxExactPower ? result * PowersOf10[exponent] : result * std::pow(10.0, exponent);
+        }
+
+        value = static_cast<float>(negative ? -result : result);
+        return p;
+    }
+};
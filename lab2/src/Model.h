@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+
+#include "glm/glm.hpp"
+
+struct Light
+{
+    glm::vec3 direction;
+    glm::vec4 color;
+};
+
+struct Triangle
+{
+    glm::vec4 vertices[3];
+    glm::vec3 normal;
+};
+
+struct Model
+{
+    std::vector<Triangle> triangles;
+    glm::mat4 modelToWorldTransform;
+    glm::vec4 diffuseColor;
+    // Where FitModelToView placed the model, modelToWorldTransform starts as translate(0, 0, -4) * scale(fitScale) *
+    // translate(-center) so rotations can be applied about the center
+    glm::vec3 center = glm::vec3{ 0.0f };
+    float fitScale = 1.0f;
+
+    void SetNormals()
+    {
+        for (auto& triangle : triangles)
+        {
+            auto ab = glm::vec3{ triangle.vertices[1] - triangle.vertices[0] };
+            auto ac = glm::vec3{ triangle.vertices[2] - triangle.vertices[0] };
+            triangle.normal = glm::cross(ab, ac);
+        }
+    }
+};
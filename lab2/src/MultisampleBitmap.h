@@ -0,0 +1,459 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <emmintrin.h>
+
+#include "Bitmap.h"
+
+struct SubpixelPoint
+{
+    float x, y;
+};
+
+// 4x multisampled render target. Coverage is tested at 4 sample positions but every triangle is
+// shaded once per pixel. A pixel whose samples are all equal (the common case inside triangles)
+// is stored as a single color, only pixels on triangle edges get 4 separate samples. Besides the
+// expanded samples that costs one bit per pixel over a plain bitmap.
+struct MultisampleBitmap
+{
+    static constexpr int SampleCount = 4;
+    static constexpr int TileSize = 8;
+
+    // Rotated grid pattern, offsets from the pixel's top left corner
+    static constexpr float SampleOffsetsX[SampleCount] = { 0.375f, 0.875f, 0.125f, 0.625f };
+    static constexpr float SampleOffsetsY[SampleCount] = { 0.125f, 0.375f, 0.625f, 0.875f };
+
+    using Samples = std::array<Pixel, SampleCount>;
+
+    // Color of compressed pixels, an expanded pixel holds the index of its samples in expandedSamples instead
+    std::vector<Pixel> pixels;
+    std::vector<Samples> expandedSamples;
+    std::vector<std::uint32_t> freeSlots;
+    // Per tile one bit per pixel, row major, set while the pixel is expanded. Tiles and tile rows without
+    // any are resolved with a plain copy.
+    std::vector<std::uint64_t> tileExpandedMasks;
+    int width;
+    int height;
+    int tilesPerRow;
+
+    static MultisampleBitmap New(int pixelWidth, int pixelHeight)
+    {
+        MultisampleBitmap result;
+        result.width = pixelWidth;
+        result.height = pixelHeight;
+        result.tilesPerRow = (pixelWidth + TileSize - 1) / TileSize;
+        int tilesPerColumn = (pixelHeight + TileSize - 1) / TileSize;
+        result.pixels.assign(pixelWidth * pixelHeight, { 0, 0, 0, 255 });
+        result.tileExpandedMasks.assign(result.tilesPerRow * tilesPerColumn, 0);
+        return result;
+    }
+
+    void Clear()
+    {
+        std::fill(pixels.begin(), pixels.end(), Pixel{ 0, 0, 0, 255 });
+        std::fill(tileExpandedMasks.begin(), tileExpandedMasks.end(), 0);
+        expandedSamples.clear();
+        freeSlots.clear();
+    }
+
+    std::size_t ExpandedPixelCount() const
+    {
+        return expandedSamples.size() - freeSlots.size();
+    }
+
+    std::size_t MemoryUsage() const
+    {
+        return pixels.capacity() * sizeof(Pixel)
+            + expandedSamples.capacity() * sizeof(Samples)
+            + freeSlots.capacity() * sizeof(std::uint32_t)
+            + tileExpandedMasks.capacity() * sizeof(std::uint64_t);
+    }
+
+    void DrawPixel(const Point& p, const Pixel& pixel)
+    {
+        if (p.x >= 0 && p.y >= 0 && p.x < width && p.y < height)
+        {
+            WriteSamples(p.x, p.y, 0xF, pixel);
+        }
+    }
+
+    void DrawLine(const Point& p1, const Point& p2, const Pixel& pixel)
+    {
+        int dx = std::abs(p2.x - p1.x);
+        int dy = -std::abs(p2.y - p1.y);
+        int sx = p1.x < p2.x ? 1 : -1;
+        int sy = p1.y < p2.y ? 1 : -1;
+        int error = dx + dy;
+
+        Point p = p1;
+        while (true)
+        {
+            DrawPixel(p, pixel);
+            if (p.x == p2.x && p.y == p2.y)
+            {
+                break;
+            }
+            int e2 = 2 * error;
+            if (e2 >= dy)
+            {
+                error += dy;
+                p.x += sx;
+            }
+            if (e2 <= dx)
+            {
+                error += dx;
+                p.y += sy;
+            }
+        }
+    }
+
+    void DrawTriangle(const Point& p1, const Point& p2, const Point& p3, const Pixel& pixel)
+    {
+        DrawLine(p1, p2, pixel);
+        DrawLine(p2, p3, pixel);
+        DrawLine(p3, p1, pixel);
+    }
+
+    void FillTriangle(SubpixelPoint p1, SubpixelPoint p2, SubpixelPoint p3, const Pixel& pixel)
+    {
+        float area = (p2.x - p1.x) * (p3.y - p1.y) - (p2.y - p1.y) * (p3.x - p1.x);
+        if (area == 0.0f)
+        {
+            return;
+        }
+        if (area < 0.0f)
+        {
+            std::swap(p2, p3);
+        }
+
+        int minX = std::max(static_cast<int>(std::floor(std::min({ p1.x, p2.x, p3.x }))), 0);
+        int minY = std::max(static_cast<int>(std::floor(std::min({ p1.y, p2.y, p3.y }))), 0);
+        int maxX = std::min(static_cast<int>(std::ceil(std::max({ p1.x, p2.x, p3.x }))), width - 1);
+        int maxY = std::min(static_cast<int>(std::ceil(std::max({ p1.y, p2.y, p3.y }))), height - 1);
+        if (minX > maxX || minY > maxY)
+        {
+            return;
+        }
+
+        // Edge functions are evaluated for all 4 samples of a pixel at once, one SSE lane per sample
+        const __m128 sampleX = _mm_loadu_ps(SampleOffsetsX);
+        const __m128 sampleY = _mm_loadu_ps(SampleOffsetsY);
+        const SubpixelPoint edgeStarts[3] = { p1, p2, p3 };
+        const SubpixelPoint edgeEnds[3] = { p2, p3, p1 };
+
+        __m128 stepX[3];
+        __m128 rowStart[3];
+        __m128 stepY[3];
+        // Reciprocals of the x steps, 0 for edges parallel to x. Every sample moves by the same step, so the
+        // smallest and largest sample values of a row are stepped along without looking at the lanes again.
+        float inverseStepX[3];
+        float stepYScalar[3];
+        float rowMin[3];
+        float rowMax[3];
+        float maxEdgeLengthSquared = 0.0f;
+        for (int i = 0; i < 3; ++i)
+        {
+            float a = edgeStarts[i].y - edgeEnds[i].y;
+            float b = edgeEnds[i].x - edgeStarts[i].x;
+            maxEdgeLengthSquared = std::max(maxEdgeLengthSquared, a * a + b * b);
+            float c = edgeStarts[i].x * edgeEnds[i].y - edgeStarts[i].y * edgeEnds[i].x;
+            inverseStepX[i] = a != 0.0f ? 1.0f / a : 0.0f;
+            stepX[i] = _mm_set1_ps(a);
+            stepY[i] = _mm_set1_ps(b);
+            __m128 x = _mm_add_ps(_mm_set1_ps(static_cast<float>(minX)), sampleX);
+            __m128 y = _mm_add_ps(_mm_set1_ps(static_cast<float>(minY)), sampleY);
+            rowStart[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(stepX[i], x), _mm_mul_ps(stepY[i], y)), _mm_set1_ps(c));
+            stepYScalar[i] = b;
+            rowMin[i] = HorizontalMin(rowStart[i]);
+            rowMax[i] = HorizontalMax(rowStart[i]);
+        }
+
+        // The smallest height of the triangle is |area| over its longest edge, slivers have no interior worth finding
+        const bool hasInterior = area * area >= MinInteriorHeight * MinInteriorHeight * maxEdgeLengthSquared;
+
+        // Pixel offsets are clamped before the conversion, edges close to horizontal give huge quotients
+        const float maxOffset = static_cast<float>(maxX - minX + 2);
+        auto toOffset = [maxOffset](float value) { return static_cast<int>(std::clamp(value, -2.0f, maxOffset)); };
+        const __m128 zero = _mm_setzero_ps();
+
+        for (int y = minY; y <= maxY; ++y)
+        {
+            // Conservative span of pixels where at least one sample can be inside every edge,
+            // widened by a pixel on both sides to absorb rounding
+            int spanStart = minX;
+            int spanEnd = maxX;
+            for (int i = 0; i < 3; ++i)
+            {
+                if (inverseStepX[i] > 0.0f && rowMax[i] < 0.0f)
+                {
+                    spanStart = std::max(spanStart, minX + toOffset(-rowMax[i] * inverseStepX[i]) - 1);
+                }
+                else if (inverseStepX[i] < 0.0f)
+                {
+                    spanEnd = std::min(spanEnd, minX + toOffset(-std::max(rowMax[i], 0.0f) * inverseStepX[i]) + 1);
+                }
+                else if (inverseStepX[i] == 0.0f && rowMax[i] < 0.0f)
+                {
+                    spanEnd = spanStart - 1;
+                }
+            }
+
+            // Pixels in between have all samples inside every edge, narrowed by a pixel on both sides to absorb rounding.
+            // Only those already expanded need their samples touched there.
+            int interiorStart = spanStart;
+            int interiorEnd = hasInterior ? spanEnd : spanStart - 1;
+            for (int i = 0; i < 3 && interiorStart <= interiorEnd; ++i)
+            {
+                if (inverseStepX[i] > 0.0f)
+                {
+                    interiorStart = std::max(interiorStart, minX + toOffset(-rowMin[i] * inverseStepX[i]) + 1);
+                }
+                else if (inverseStepX[i] < 0.0f)
+                {
+                    interiorEnd = std::min(interiorEnd, minX + toOffset(-rowMin[i] * inverseStepX[i]) - 1);
+                }
+                else if (rowMin[i] < 0.0f)
+                {
+                    interiorEnd = interiorStart - 1;
+                }
+            }
+
+            // Expanded masks of the tiles this row crosses
+            const std::uint64_t* tileMasks = &tileExpandedMasks[(y / TileSize) * tilesPerRow];
+            const int rowShift = (y % TileSize) * TileSize;
+
+            // Pixels on the edges, coverage is tested per sample
+            auto fillEdgePixels = [&](int start, int end) {
+                __m128 offset = _mm_set1_ps(static_cast<float>(start - minX));
+                __m128 e0 = _mm_add_ps(rowStart[0], _mm_mul_ps(stepX[0], offset));
+                __m128 e1 = _mm_add_ps(rowStart[1], _mm_mul_ps(stepX[1], offset));
+                __m128 e2 = _mm_add_ps(rowStart[2], _mm_mul_ps(stepX[2], offset));
+
+                int index = y * width + start;
+                for (int x = start; x <= end; ++x, ++index)
+                {
+                    __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+                    int coverage = _mm_movemask_ps(inside);
+                    if (coverage == 0xF && ((tileMasks[x / TileSize] >> (rowShift + x % TileSize)) & 1) == 0)
+                    {
+                        pixels[index] = pixel;
+                    }
+                    else if (coverage != 0)
+                    {
+                        WriteSamples(x, y, coverage, pixel);
+                    }
+
+                    e0 = _mm_add_ps(e0, stepX[0]);
+                    e1 = _mm_add_ps(e1, stepX[1]);
+                    e2 = _mm_add_ps(e2, stepX[2]);
+                }
+            };
+
+            if (interiorEnd - interiorStart < MinInteriorRun)
+            {
+                fillEdgePixels(spanStart, spanEnd);
+            }
+            else
+            {
+                fillEdgePixels(spanStart, interiorStart - 1);
+
+                // Tile by tile, a run of compressed pixels is a plain fill
+                for (int x = interiorStart; x <= interiorEnd;)
+                {
+                    int runEnd = std::min(interiorEnd, (x / TileSize + 1) * TileSize - 1);
+                    unsigned runMask = static_cast<unsigned>(tileMasks[x / TileSize] >> (rowShift + x % TileSize)) & ((2u << (runEnd - x)) - 1);
+                    if (runMask == 0)
+                    {
+                        std::fill_n(&pixels[y * width + x], runEnd - x + 1, pixel);
+                    }
+                    else
+                    {
+                        for (int runX = x; runX <= runEnd; ++runX)
+                        {
+                            WriteSamples(runX, y, 0xF, pixel);
+                        }
+                    }
+                    x = runEnd + 1;
+                }
+
+                fillEdgePixels(interiorEnd + 1, spanEnd);
+            }
+
+            for (int i = 0; i < 3; ++i)
+            {
+                rowStart[i] = _mm_add_ps(rowStart[i], stepY[i]);
+                rowMin[i] += stepYScalar[i];
+                rowMax[i] += stepYScalar[i];
+            }
+        }
+    }
+
+    // Box filters the samples into the target, which is resized to match first if needed
+    void Resolve(Bitmap& target) const
+    {
+        if (target.width != width || target.height != height || target.pixels.size() != pixels.size())
+        {
+            target = Bitmap::New(width, height);
+        }
+
+        for (int tileY = 0; tileY * TileSize < height; ++tileY)
+        {
+            int y0 = tileY * TileSize;
+            int y1 = std::min(y0 + TileSize, height);
+
+            for (int tileX = 0; tileX < tilesPerRow; ++tileX)
+            {
+                int x0 = tileX * TileSize;
+                int x1 = std::min(x0 + TileSize, width);
+
+                std::uint64_t mask = tileExpandedMasks[tileY * tilesPerRow + tileX];
+                for (int y = y0; y < y1; ++y)
+                {
+                    unsigned rowMask = static_cast<unsigned>(mask >> ((y - y0) * TileSize)) & 0xFF;
+                    if (rowMask == 0)
+                    {
+                        std::memcpy(&target.pixels[y * width + x0], &pixels[y * width + x0], (x1 - x0) * sizeof(Pixel));
+                        continue;
+                    }
+                    for (int x = x0; x < x1; ++x)
+                    {
+                        int index = y * width + x;
+                        bool expanded = (rowMask >> (x - x0)) & 1;
+                        target.pixels[index] = expanded ? AverageSamples(expandedSamples[PixelBits(pixels[index])]) : pixels[index];
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    // Below these the interior is left to the edge loop, finding and filling it would cost more than testing its samples
+    static constexpr float MinInteriorHeight = 4.0f;
+    static constexpr int MinInteriorRun = 8;
+
+    static_assert(TileSize * TileSize == 64, "a tile's expanded pixels are one 64 bit mask");
+
+    static float HorizontalMin(__m128 v)
+    {
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_cvtss_f32(v);
+    }
+
+    static float HorizontalMax(__m128 v)
+    {
+        v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_cvtss_f32(v);
+    }
+
+    static Pixel AverageSamples(const Samples& samples)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples.data()));
+        // 16-bit channels of samples 0+2 and 1+3, then fold the upper half onto the lower one
+        __m128i sum = _mm_add_epi16(_mm_unpacklo_epi8(packed, zero), _mm_unpackhi_epi8(packed, zero));
+        sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+        sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(SampleCount / 2)), 2);
+        std::uint32_t value = static_cast<std::uint32_t>(_mm_cvtsi128_si32(_mm_packus_epi16(sum, zero)));
+
+        Pixel result;
+        std::memcpy(&result, &value, sizeof(result));
+        return result;
+    }
+
+    static std::uint32_t PixelBits(const Pixel& pixel)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &pixel, sizeof(bits));
+        return bits;
+    }
+
+    static Pixel BitsPixel(std::uint32_t bits)
+    {
+        Pixel pixel;
+        std::memcpy(&pixel, &bits, sizeof(pixel));
+        return pixel;
+    }
+
+    std::uint64_t& TileExpandedMask(int x, int y)
+    {
+        return tileExpandedMasks[(y / TileSize) * tilesPerRow + x / TileSize];
+    }
+
+    static std::uint64_t TileBit(int x, int y)
+    {
+        return std::uint64_t(1) << ((y % TileSize) * TileSize + x % TileSize);
+    }
+
+    void WriteSamples(int x, int y, int coverage, const Pixel& pixel)
+    {
+        int index = y * width + x;
+        std::uint64_t& mask = TileExpandedMask(x, y);
+        const std::uint64_t bit = TileBit(x, y);
+
+        if (coverage == 0xF)
+        {
+            if (mask & bit)
+            {
+                freeSlots.push_back(PixelBits(pixels[index]));
+                mask &= ~bit;
+            }
+            pixels[index] = pixel;
+            return;
+        }
+
+        std::uint32_t color = PixelBits(pixel);
+        std::uint32_t slot;
+        __m128i samples;
+
+        if ((mask & bit) == 0)
+        {
+            std::uint32_t previousColor = PixelBits(pixels[index]);
+            if (previousColor == color)
+            {
+                return;
+            }
+
+            if (freeSlots.empty())
+            {
+                slot = static_cast<std::uint32_t>(expandedSamples.size());
+                expandedSamples.emplace_back();
+            }
+            else
+            {
+                slot = freeSlots.back();
+                freeSlots.pop_back();
+            }
+            mask |= bit;
+            pixels[index] = BitsPixel(slot);
+            samples = _mm_set1_epi32(static_cast<int>(previousColor));
+        }
+        else
+        {
+            slot = PixelBits(pixels[index]);
+            samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(expandedSamples[slot].data()));
+        }
+
+        const __m128i sampleBits = _mm_setr_epi32(1, 2, 4, 8);
+        __m128i covered = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(coverage), sampleBits), sampleBits);
+        samples = _mm_or_si128(_mm_and_si128(covered, _mm_set1_epi32(static_cast<int>(color))), _mm_andnot_si128(covered, samples));
+
+        // The remaining samples were covered earlier by the same color, the pixel can be compressed again
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(samples, _mm_shuffle_epi32(samples, 0))) == 0xFFFF)
+        {
+            pixels[index] = pixel;
+            freeSlots.push_back(slot);
+            mask &= ~bit;
+            return;
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(expandedSamples[slot].data()), samples);
+    }
+};
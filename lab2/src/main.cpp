@@ -3,12 +3,34 @@
 #include <array>
 #include <utility>
 #include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string_view>
+#include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
 #include "SFML/Graphics.hpp"
 #include "glm/glm.hpp"
 #include "glm/ext/matrix_transform.hpp"
 
 #include "Bitmap.h"
+#include "Checks.h"
+#include "Model.h"
+#include "DepthSort.h"
+#include "MultisampleBitmap.h"
+#include "MeshImporter.h"
+#include "BatchRenderer.h"
+#include "../../common/SnapshotExport.h"
+#include "../../common/Regression.h"
 
 using namespace std;
 using namespace sf;
@@ -19,35 +41,6 @@ mat4 PerspectiveProjectionMatrix{ 0.0f };
 mat4 OrthographicProjectionMatrix{ 0.0f };
 const Pixel DebugColor = { 255, 0, 0, 255 };
 
-struct Light
-{
-    vec3 direction;
-    vec4 color;
-};
-
-struct Triangle
-{
-    vec4 vertices[3];
-    vec3 normal;
-};
-
-struct Model
-{
-    vector<Triangle> triangles;
-    mat4 modelToWorldTransform;
-    vec4 diffuseColor;
-
-    void SetNormals()
-    {
-        for (auto& triangle : triangles)
-        {
-            auto ab = vec3{ triangle.vertices[1] - triangle.vertices[0] };
-            auto ac = vec3{ triangle.vertices[2] - triangle.vertices[0] };
-            triangle.normal = cross(ab, ac);
-        }
-    }
-};
-
 vec4 DivideByW(const vec4& vertex)
 {
     return {
@@ -69,18 +62,29 @@ Point NdcToScreenSpace(const Bitmap& bitmap, const vec3& vertex)
     };
 }
 
-void DrawModel(Bitmap& bitmap, const Model& model, const vector<Light>& lights, const mat4& projectionMatrix, bool showWireframe = false)
+SubpixelPoint NdcToSubpixelScreenSpace(int width, int height, const vec3& vertex)
+{
+    return {
+        (vertex.x + 1.0f) * 0.5f * width,
+        (vertex.y - 1.0f) * -0.5f * height
+    };
+}
+
+vector<Triangle> ProjectModel(const Model& model, const mat4& modelToWorldTransform, const mat4& projectionMatrix)
 {
     vector<Triangle> visibleTriangles;
+    visibleTriangles.reserve(model.triangles.size());
+
+    auto normalTransform = transpose(inverse(mat3{ modelToWorldTransform }));
 
     for (auto& triangle : model.triangles)
     {
         auto worldSpaceTriangle = Triangle{
-            model.modelToWorldTransform * triangle.vertices[0],
-            model.modelToWorldTransform * triangle.vertices[1],
-            model.modelToWorldTransform * triangle.vertices[2]
+            modelToWorldTransform * triangle.vertices[0],
+            modelToWorldTransform * triangle.vertices[1],
+            modelToWorldTransform * triangle.vertices[2]
         };
-        worldSpaceTriangle.normal = transpose(inverse(mat3{ model.modelToWorldTransform })) * triangle.normal;
+        worldSpaceTriangle.normal = normalTransform * triangle.normal;
 
         if (dot(worldSpaceTriangle.normal, vec3{ worldSpaceTriangle.vertices[0] }) >= 0.0f)
         {
@@ -99,55 +103,92 @@ void DrawModel(Bitmap& bitmap, const Model& model, const vector<Light>& lights,
         visibleTriangles.push_back(ndcSpaceTriangle);
     }
 
-    std::sort(visibleTriangles.begin(), visibleTriangles.end(), [](const auto& t1, const auto& t2) {
-        float z1 = (t1.vertices[0].z + t1.vertices[1].z + t1.vertices[2].z) / 3.0f;
-        float z2 = (t2.vertices[0].z + t2.vertices[1].z + t2.vertices[2].z) / 3.0f;
-        return z1 > z2;
-    });
+    return visibleTriangles;
+}
+
+Pixel ShadeTriangle(const Triangle& triangle, const vec4& diffuseColor, const vector<Light>& lights)
+{
+    auto color = vec4{ 0.0f, 0.0f, 0.0f, 0.0f };
+    float ambientIntensity = 0.15f;
+    float directLightIntensity = 1.0f - ambientIntensity;
+    float perLightIntensity = lights.empty() ? 0.0f : directLightIntensity / lights.size();
 
-    for (auto& triangle : visibleTriangles)
+    color += diffuseColor * ambientIntensity;
+
+    for (auto& light : lights)
     {
+        float cosAngIncidence = dot(normalize(triangle.normal), -normalize(light.direction));
+        if (cosAngIncidence < 0.0f)
+        {
+            cosAngIncidence = 0.0f;
+        }
+        else if (cosAngIncidence > 1.0f)
+        {
+            cosAngIncidence = 1.0f;
+        }
+        color += cosAngIncidence * perLightIntensity * light.color;
+    }
+
+    return Pixel{
+        static_cast<uint8_t>(255 * color.x),
+        static_cast<uint8_t>(255 * color.y),
+        static_cast<uint8_t>(255 * color.z),
+        255
+    };
+}
+
+void DrawTriangles(Bitmap& bitmap, const vector<Triangle>& visibleTriangles, const vec4& diffuseColor, const vector<Light>& lights, DepthSorter& depthSorter, bool showWireframe)
+{
+    const auto& drawOrder = depthSorter.Sort(visibleTriangles);
+
+    for (auto triangleIndex : drawOrder)
+    {
+        auto& triangle = visibleTriangles[triangleIndex];
         auto p1 = NdcToScreenSpace(bitmap, triangle.vertices[0]);
         auto p2 = NdcToScreenSpace(bitmap, triangle.vertices[1]);
         auto p3 = NdcToScreenSpace(bitmap, triangle.vertices[2]);
 
-        auto color = vec4{ 0.0f, 0.0f, 0.0f, 0.0f };
-        float ambientIntensity = 0.15f;
-        float directLightIntensity = 1.0f - ambientIntensity;
-        float perLightIntensity = lights.empty() ? 0.0f : directLightIntensity / lights.size();
+        auto pixel = ShadeTriangle(triangle, diffuseColor, lights);
 
-        color += model.diffuseColor * ambientIntensity;
+        bitmap.FillTriangle(p1, p2, p3, pixel);
 
-        for (auto& light : lights)
+        if (showWireframe)
         {
-            float cosAngIncidence = dot(normalize(triangle.normal), -normalize(light.direction));
-            if (cosAngIncidence < 0.0f)
-            {
-                cosAngIncidence = 0.0f;
-            }
-            else if (cosAngIncidence > 1.0f)
-            {
-                cosAngIncidence = 1.0f;
-            }
-            color += cosAngIncidence * perLightIntensity * light.color;
+            bitmap.DrawTriangle(p1, p2, p3, DebugColor);
         }
+    }
+}
 
-        auto pixel = Pixel{
-            static_cast<uint8_t>(255 * color.x),
-            static_cast<uint8_t>(255 * color.y),
-            static_cast<uint8_t>(255 * color.z),
-            255
-        };
+void DrawTriangles(MultisampleBitmap& bitmap, const vector<Triangle>& visibleTriangles, const vec4& diffuseColor, const vector<Light>& lights, DepthSorter& depthSorter, bool showWireframe)
+{
+    const auto& drawOrder = depthSorter.Sort(visibleTriangles);
+
+    for (auto triangleIndex : drawOrder)
+    {
+        auto& triangle = visibleTriangles[triangleIndex];
+        auto p1 = NdcToSubpixelScreenSpace(bitmap.width, bitmap.height, triangle.vertices[0]);
+        auto p2 = NdcToSubpixelScreenSpace(bitmap.width, bitmap.height, triangle.vertices[1]);
+        auto p3 = NdcToSubpixelScreenSpace(bitmap.width, bitmap.height, triangle.vertices[2]);
+
+        auto pixel = ShadeTriangle(triangle, diffuseColor, lights);
 
         bitmap.FillTriangle(p1, p2, p3, pixel);
 
         if (showWireframe)
         {
-            bitmap.DrawTriangle(p1, p2, p3, DebugColor);
+            auto toPoint = [](const SubpixelPoint& p) { return Point{ static_cast<int>(p.x), static_cast<int>(p.y) }; };
+            bitmap.DrawTriangle(toPoint(p1), toPoint(p2), toPoint(p3), DebugColor);
         }
     }
 }
 
+template<typename RenderTarget>
+void DrawModel(RenderTarget& bitmap, const Model& model, const vector<Light>& lights, const mat4& projectionMatrix, DepthSorter& depthSorter, bool showWireframe = false)
+{
+    vector<Triangle> visibleTriangles = ProjectModel(model, model.modelToWorldTransform, projectionMatrix);
+    DrawTriangles(bitmap, visibleTriangles, model.diffuseColor, lights, depthSorter, showWireframe);
+}
+
 void BuildPrejectionMatrix(const Bitmap& bitmap)
 {
     float r = tan(radians(FovDegrees / 2.0f));
@@ -167,6 +208,12 @@ void BuildPrejectionMatrix(const Bitmap& bitmap)
     OrthographicProjectionMatrix[3][3] = 1.0f;
 }
 
+// Rows of RGBA bytes, as the snapshot encoders take them
+const uint8_t* PixelBytes(const Bitmap& bitmap)
+{
+    return reinterpret_cast<const uint8_t*>(bitmap.pixels.data());
+}
+
 void UpdateTextureFromBitmap(Texture& texture, const Bitmap& bitmap)
 {
     texture.update(reinterpret_cast<const Uint8*>(bitmap.pixels.data()));
@@ -244,8 +291,590 @@ Model GenerateCylinder(int steps, float height, float radius)
     return result;
 }
 
-int main()
+vector<Light> CreateDefaultLights()
+{
+    vector<Light> lights;
+    lights.push_back({ { 1.0f, -0.25f, -1.0f }, { 1.0f, 0.0f, 0.0f, 1.0f } });
+    lights.push_back({ { -1.0f, -0.25f, -1.0f }, { 0.0f, 0.0f, 1.0f, 1.0f } });
+    lights.push_back({ { 0.0f, 0.25f, -1.0f }, { 0.0f, 1.0f, 0.0f, 1.0f } });
+    return lights;
+}
+
+Model CreateDefaultModel()
+{
+    Model model = GenerateCylinder(13, 2, 1);
+    model.modelToWorldTransform = mat4{ 1.0f };
+    model.modelToWorldTransform[3] = { 0.0f, 0.0f, -4.0f, 1.0f };
+    model.diffuseColor = { 1.0f, 1.0f, 1.0f, 1.0f };
+    model.SetNormals();
+    return model;
+}
+
+// Centers the model in front of the camera and scales it to fit a unit sphere
+void FitModelToView(Model& model)
+{
+    if (model.triangles.empty())
+    {
+        model.modelToWorldTransform = mat4{ 1.0f };
+        model.center = vec3{ 0.0f };
+        model.fitScale = 1.0f;
+        return;
+    }
+
+    vec3 minCorner = vec3{ model.triangles[0].vertices[0] };
+    vec3 maxCorner = minCorner;
+    for (auto& triangle : model.triangles)
+    {
+        for (auto& vertex : triangle.vertices)
+        {
+            minCorner = min(minCorner, vec3{ vertex });
+            maxCorner = max(maxCorner, vec3{ vertex });
+        }
+    }
+
+    float radius = length(maxCorner - minCorner) * 0.5f;
+    model.center = (minCorner + maxCorner) * 0.5f;
+    model.fitScale = radius > 0.0f ? 1.0f / radius : 1.0f;
+
+    model.modelToWorldTransform = translate(mat4{ 1.0f }, vec3{ 0.0f, 0.0f, -4.0f });
+    model.modelToWorldTransform = scale(model.modelToWorldTransform, vec3{ model.fitScale });
+    model.modelToWorldTransform = translate(model.modelToWorldTransform, -model.center);
+}
+
+void PrintImportStats(ostream& output, string_view path, const MeshImportStats& stats)
+{
+    output << path << ": " << stats.triangles << " triangles, " << stats.bytes << " bytes in " << stats.seconds * 1000.0 << " ms, "
+        << stats.MegabytesPerSecond() << " MB/s, " << stats.TrianglesPerSecond() / 1e6 << " Mtri/s" << endl;
+}
+
+bool LoadModel(string_view path, Model& model)
+{
+    MeshImportStats stats;
+    if (!MeshImporter::Load(path, model, &stats))
+    {
+        cerr << "Unable to load mesh \"" << path << "\"" << endl;
+        return false;
+    }
+    // Batch rendering may stream frames to stdout, so statistics go to stderr
+    PrintImportStats(cerr, path, stats);
+    FitModelToView(model);
+    return true;
+}
+
+// Renders a full turn around the Y axis, projection and shading are the same as in the interactive viewer.
+// Every batch worker gets its own depth sorter and multisample target.
+struct TurntableRenderer
+{
+    const Model& model;
+    const vector<Light>& lights;
+    int frameCount;
+    bool useMultisampling;
+    vector<DepthSorter> depthSorters;
+    vector<MultisampleBitmap> multisampleBitmaps;
+
+    TurntableRenderer(const Model& model, const vector<Light>& lights, const BatchRenderSettings& settings, bool useMultisampling)
+        : model(model), lights(lights), frameCount(settings.frameCount), useMultisampling(useMultisampling)
+    {
+        int workerCount = BatchRenderer::ResolveThreadCount(settings.threadCount);
+        depthSorters.resize(workerCount);
+        if (useMultisampling)
+        {
+            multisampleBitmaps.assign(workerCount, MultisampleBitmap::New(settings.width, settings.height));
+        }
+    }
+
+    void RenderFrame(int frame, int worker, Bitmap& bitmap)
+    {
+        float angle = 360.0f * frame / frameCount;
+        // The turn goes between the fit and the centering, so meshes spin about their center rather than their origin
+        mat4 transform = translate(mat4{ 1.0f }, vec3{ 0.0f, 0.0f, -4.0f });
+        transform = scale(transform, vec3{ model.fitScale });
+        transform = rotate(transform, radians(angle), vec3{ 0.0f, 1.0f, 0.0f });
+        transform = translate(transform, -model.center);
+        vector<Triangle> visibleTriangles = ProjectModel(model, transform, PerspectiveProjectionMatrix);
+
+        if (useMultisampling)
+        {
+            auto& multisampleBitmap = multisampleBitmaps[worker];
+            multisampleBitmap.Clear();
+            DrawTriangles(multisampleBitmap, visibleTriangles, model.diffuseColor, lights, depthSorters[worker], false);
+            multisampleBitmap.Resolve(bitmap);
+        }
+        else
+        {
+            bitmap.Clear();
+            DrawTriangles(bitmap, visibleTriangles, model.diffuseColor, lights, depthSorters[worker], false);
+        }
+    }
+};
+
+// lab2 --batch <output file or - for stdout> [--frames N] [--threads N] [--format y4m|ppm] [--size W H] [--msaa] [--mesh path]
+int RunBatchRender(int argc, char* argv[])
+{
+    if (argc < 1)
+    {
+        cerr << "Usage: lab2 --batch <output|-> [--frames N] [--threads N] [--format y4m|ppm] [--size W H] [--msaa] [--mesh path]" << endl;
+        return 1;
+    }
+
+    string outputPath = argv[0];
+    BatchRenderSettings settings;
+    bool useMultisampling = false;
+    Model model = CreateDefaultModel();
+
+    settings.format = outputPath.size() >= 4 && outputPath.substr(outputPath.size() - 4) == ".ppm" ? FrameFormat::PPM : FrameFormat::Y4M;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        string_view argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--frames" && hasValue)
+        {
+            settings.frameCount = atoi(argv[++i]);
+        }
+        else if (argument == "--threads" && hasValue)
+        {
+            settings.threadCount = atoi(argv[++i]);
+        }
+        else if (argument == "--format" && hasValue)
+        {
+            settings.format = string_view{ argv[++i] } == "ppm" ? FrameFormat::PPM : FrameFormat::Y4M;
+        }
+        else if (argument == "--size" && i + 2 < argc)
+        {
+            settings.width = atoi(argv[++i]);
+            settings.height = atoi(argv[++i]);
+        }
+        else if (argument == "--msaa")
+        {
+            useMultisampling = true;
+        }
+        else if (argument == "--mesh" && hasValue)
+        {
+            if (!LoadModel(argv[++i], model))
+            {
+                return 1;
+            }
+        }
+        else
+        {
+            cerr << "Unknown argument \"" << argument << "\"" << endl;
+            return 1;
+        }
+    }
+
+    if (settings.width <= 0 || settings.height <= 0 || settings.frameCount <= 0)
+    {
+        cerr << "Invalid frame size or count" << endl;
+        return 1;
+    }
+
+    FILE* output = stdout;
+    if (outputPath == "-")
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+    else
+    {
+        output = fopen(outputPath.c_str(), "wb");
+        if (output == nullptr)
+        {
+            cerr << "Unable to open \"" << outputPath << "\"" << endl;
+            return 1;
+        }
+    }
+
+    BuildPrejectionMatrix(Bitmap::New(settings.width, settings.height));
+    vector<Light> lights = CreateDefaultLights();
+
+    TurntableRenderer turntable(model, lights, settings, useMultisampling);
+
+    BatchRenderStats stats;
+    bool written = BatchRenderer::Render(settings, output, [&](int frame, int worker, Bitmap& bitmap) {
+        turntable.RenderFrame(frame, worker, bitmap);
+    }, &stats);
+
+    if (output != stdout)
+    {
+        written = fclose(output) == 0 && written;
+    }
+
+    cerr << stats.frames << " frames on " << stats.threads << " threads in " << stats.seconds << " s, " << stats.FramesPerSecond() << " fps" << endl;
+    if (!written)
+    {
+        cerr << "Unable to write frames to \"" << outputPath << "\"" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+void RunBatchBenchmark(int frameCount)
+{
+    Model model = GenerateCylinder(2000, 2, 1);
+    model.modelToWorldTransform = mat4{ 1.0f };
+    model.modelToWorldTransform[3] = { 0.0f, 0.0f, -4.0f, 1.0f };
+    model.diffuseColor = { 1.0f, 1.0f, 1.0f, 1.0f };
+    model.SetNormals();
+
+    BatchRenderSettings settings;
+    settings.width = 640;
+    settings.height = 480;
+    settings.frameCount = frameCount;
+    BuildPrejectionMatrix(Bitmap::New(settings.width, settings.height));
+    vector<Light> lights = CreateDefaultLights();
+
+    int maxThreads = BatchRenderer::ResolveThreadCount(0);
+    cout << "Batch render benchmark, " << model.triangles.size() << " triangles, " << settings.width << "x" << settings.height
+        << ", " << frameCount << " frames encoded to Y4M and discarded" << endl;
+
+    double singleThreadFps = 0.0;
+    for (int threads = 1; ; threads = min(threads * 2, maxThreads))
+    {
+        settings.threadCount = threads;
+        TurntableRenderer turntable(model, lights, settings, false);
+
+        BatchRenderStats stats;
+        BatchRenderer::Render(settings, nullptr, [&](int frame, int worker, Bitmap& bitmap) {
+            turntable.RenderFrame(frame, worker, bitmap);
+        }, &stats);
+        if (threads == 1)
+        {
+            singleThreadFps = stats.FramesPerSecond();
+        }
+        cout << "  " << threads << " threads: " << stats.FramesPerSecond() << " fps (x" << stats.FramesPerSecond() / singleThreadFps << ")" << endl;
+
+        if (threads == maxThreads)
+        {
+            break;
+        }
+    }
+}
+
+// Renders a turntable and snapshots every frame, the main thread only pays for copying the pixels
+void RunExportBenchmark(int frameCount)
+{
+    Model model = GenerateCylinder(2000, 2, 1);
+    model.modelToWorldTransform = mat4{ 1.0f };
+    model.modelToWorldTransform[3] = { 0.0f, 0.0f, -4.0f, 1.0f };
+    model.diffuseColor = { 1.0f, 1.0f, 1.0f, 1.0f };
+    model.SetNormals();
+
+    BatchRenderSettings settings;
+    settings.width = 640;
+    settings.height = 480;
+    settings.frameCount = frameCount;
+    settings.threadCount = 1;
+    Bitmap bitmap = Bitmap::New(settings.width, settings.height);
+    BuildPrejectionMatrix(bitmap);
+    vector<Light> lights = CreateDefaultLights();
+    TurntableRenderer turntable(model, lights, settings, false);
+
+    cout << "Snapshot export benchmark, " << settings.width << "x" << settings.height << ", every one of " << frameCount
+        << " frames exported and discarded" << endl;
+
+    for (auto format : { SnapshotFormat::Qoi, SnapshotFormat::Png })
+    {
+        vector<uint8_t> encoded;
+        auto syncStart = chrono::steady_clock::now();
+        turntable.RenderFrame(0, 0, bitmap);
+        ImageEncoder::Encode(format, PixelBytes(bitmap), bitmap.width, bitmap.height, encoded);
+        double syncMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - syncStart).count();
+
+        SnapshotExporter exporter;
+        exporter.Start();
+        double maxSubmitMilliseconds = 0.0;
+        double totalSubmitMilliseconds = 0.0;
+        auto start = chrono::steady_clock::now();
+        for (int frame = 0; frame < frameCount; ++frame)
+        {
+            turntable.RenderFrame(frame, 0, bitmap);
+            auto submitStart = chrono::steady_clock::now();
+            exporter.Submit(PixelBytes(bitmap), bitmap.width, bitmap.height, format, "");
+            double submitMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - submitStart).count();
+            maxSubmitMilliseconds = max(maxSubmitMilliseconds, submitMilliseconds);
+            totalSubmitMilliseconds += submitMilliseconds;
+            exporter.TakeResults();
+        }
+        double frameMilliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / frameCount;
+        exporter.Stop();
+
+        SnapshotStats stats = exporter.Stats();
+        cout << "  " << (format == SnapshotFormat::Qoi ? "QOI" : "PNG") << ": " << stats.MegabytesPerSecond() << " MB/s, "
+            << 100.0 * stats.encodedBytes / max<uint64_t>(stats.rawBytes, 1) << "% of raw size, " << stats.exported << " exported, "
+            << stats.dropped << " dropped, " << frameMilliseconds << " ms/frame, submit " << totalSubmitMilliseconds / frameCount
+            << " ms avg " << maxSubmitMilliseconds << " ms max vs " << syncMilliseconds << " ms rendering and encoding in the frame" << endl;
+    }
+}
+
+RegressionImage CaptureBitmap(const Bitmap& bitmap)
+{
+    RegressionImage image;
+    image.width = bitmap.width;
+    image.height = bitmap.height;
+    image.pixels.resize(bitmap.pixels.size() * sizeof(Pixel));
+    memcpy(image.pixels.data(), bitmap.pixels.data(), image.pixels.size());
+    return image;
+}
+
+// lab2 --regression record|check <directory> ...
+int RunRegression(int argc, char* argv[])
+{
+    RegressionSettings settings;
+    if (!Regression::ParseArguments(argc, argv, settings))
+    {
+        cerr << "Usage: lab2 " << Regression::Usage << endl;
+        return 1;
+    }
+
+    Bitmap bitmap = Bitmap::New(160, 120);
+    MultisampleBitmap multisampleBitmap = MultisampleBitmap::New(bitmap.width, bitmap.height);
+    BuildPrejectionMatrix(bitmap);
+    vector<Light> lights = CreateDefaultLights();
+    DepthSorter depthSorter;
+    Model cylinder = CreateDefaultModel();
+
+    auto capture = [&] { return CaptureBitmap(bitmap); };
+    vector<RegressionScene> scenes;
+
+    for (float angle : { 0.0f, 35.0f, 90.0f, 160.0f })
+    {
+        Model model = cylinder;
+        model.modelToWorldTransform = rotate(model.modelToWorldTransform, radians(angle), vec3{ 1.0f, 1.0f, 0.0f });
+
+        for (bool useOrtho : { false, true })
+        {
+            for (bool showWireframe : { false, true })
+            {
+                string name = string{ "cylinder_" } + (useOrtho ? "ortho_" : "perspective_") + to_string(static_cast<int>(angle)) + (showWireframe ? "_wireframe" : "");
+                const mat4* projectionMatrix = useOrtho ? &OrthographicProjectionMatrix : &PerspectiveProjectionMatrix;
+                scenes.push_back({ name, [&, model, projectionMatrix, showWireframe] {
+                    bitmap.Clear();
+                    DrawModel(bitmap, model, lights, *projectionMatrix, depthSorter, showWireframe);
+                }, capture });
+            }
+        }
+
+        scenes.push_back({ "cylinder_msaa_" + to_string(static_cast<int>(angle)), [&, model] {
+            multisampleBitmap.Clear();
+            DrawModel(multisampleBitmap, model, lights, PerspectiveProjectionMatrix, depthSorter);
+            multisampleBitmap.Resolve(bitmap);
+        }, capture });
+    }
+
+    // Every octant and a range of lengths, including degenerate single pixel lines
+    scenes.push_back({ "lines", [&] {
+        bitmap.Clear();
+        Point center = { bitmap.width / 2, bitmap.height / 2 };
+        for (int i = 0; i < 64; ++i)
+        {
+            float angle = radians(i * 360.0f / 64.0f);
+            float length = 5.0f + (i % 8) * 9.0f;
+            Point end = { center.x + static_cast<int>(cos(angle) * length), center.y + static_cast<int>(sin(angle) * length) };
+            bitmap.DrawLine(center, end, Pixel{ static_cast<uint8_t>(i * 4), 255, static_cast<uint8_t>(255 - i * 4), 255 });
+        }
+        bitmap.DrawLine({ 3, 3 }, { 3, 3 }, DebugColor);
+    }, capture });
+
+    // Flat top, flat bottom, general, thin and partially off-screen triangles
+    scenes.push_back({ "triangles", [&] {
+        bitmap.Clear();
+        bitmap.FillTriangle({ 10, 10 }, { 40, 10 }, { 25, 40 }, { 255, 0, 0, 255 });
+        bitmap.FillTriangle({ 50, 40 }, { 80, 40 }, { 65, 10 }, { 0, 255, 0, 255 });
+        bitmap.FillTriangle({ 90, 5 }, { 150, 30 }, { 100, 60 }, { 0, 0, 255, 255 });
+        bitmap.FillTriangle({ 5, 60 }, { 155, 62 }, { 80, 64 }, { 255, 255, 0, 255 });
+        bitmap.FillTriangle({ -30, 80 }, { 60, 130 }, { 40, 70 }, { 0, 255, 255, 255 });
+        bitmap.FillTriangle({ 120, 70 }, { 200, 90 }, { 130, 150 }, { 255, 0, 255, 255 });
+        bitmap.DrawTriangle({ 70, 75 }, { 110, 85 }, { 90, 115 }, { 255, 255, 255, 255 });
+    }, capture });
+
+    return Regression::Run(scenes, settings);
+}
+
+void RunImportBenchmark(string_view path, int repeatCount)
+{
+    MeshImportStats total;
+    for (int i = 0; i < repeatCount; ++i)
+    {
+        Model model;
+        MeshImportStats stats;
+        if (!MeshImporter::Load(path, model, &stats))
+        {
+            cout << "Unable to load mesh \"" << path << "\"" << endl;
+            return;
+        }
+        PrintImportStats(cout, path, stats);
+        total.bytes += stats.bytes;
+        total.triangles += stats.triangles;
+        total.seconds += stats.seconds;
+    }
+    cout << "Average: " << total.MegabytesPerSecond() << " MB/s, " << total.TrianglesPerSecond() / 1e6 << " Mtri/s" << endl;
+}
+
+void RunDepthSortBenchmark(int triangleCount, int frameCount)
+{
+    Bitmap bitmap = Bitmap::New(160, 120);
+    BuildPrejectionMatrix(bitmap);
+
+    Model model = GenerateCylinder(triangleCount / 4, 2, 1);
+    model.SetNormals();
+
+    cout << "Depth sort benchmark, " << model.triangles.size() << " triangles, " << frameCount << " frames" << endl;
+
+    for (float degreesPerFrame : { 0.01f, 0.1f, 15.0f })
+    {
+        for (auto mode : { DepthSortMode::Comparison, DepthSortMode::Radix, DepthSortMode::Incremental })
+        {
+            model.modelToWorldTransform = mat4{ 1.0f };
+            model.modelToWorldTransform[3] = { 0.0f, 0.0f, -4.0f, 1.0f };
+
+            DepthSorter depthSorter;
+            depthSorter.mode = mode;
+
+            double totalSeconds = 0.0;
+            int repairedFrames = 0;
+
+            for (int frame = 0; frame < frameCount; ++frame)
+            {
+                model.modelToWorldTransform = rotate(model.modelToWorldTransform, radians(degreesPerFrame), vec3{ 1.0f, 1.0f, 0.0f });
+                auto triangles = ProjectModel(model, model.modelToWorldTransform, PerspectiveProjectionMatrix);
+
+                auto start = chrono::steady_clock::now();
+                depthSorter.Sort(triangles);
+                auto end = chrono::steady_clock::now();
+
+                totalSeconds += chrono::duration<double>(end - start).count();
+                repairedFrames += depthSorter.lastSortWasRepaired ? 1 : 0;
+            }
+
+            double msPerFrame = totalSeconds * 1000.0 / frameCount;
+            double trianglesPerSecond = model.triangles.size() * frameCount / totalSeconds;
+
+            cout << "  " << degreesPerFrame << " deg/frame, " << GetDepthSortModeName(mode) << ": "
+                << msPerFrame << " ms/frame, " << trianglesPerSecond / 1e6 << " Mtri/s";
+            if (mode == DepthSortMode::Incremental)
+            {
+                cout << ", repaired " << repairedFrames << "/" << frameCount << " frames";
+            }
+            cout << endl;
+        }
+    }
+}
+
+void RunMultisampleBenchmark(int frameCount)
 {
+    Bitmap bitmap = Bitmap::New(160, 120);
+    MultisampleBitmap multisampleBitmap = MultisampleBitmap::New(bitmap.width, bitmap.height);
+    BuildPrejectionMatrix(bitmap);
+
+    vector<Light> lights;
+    lights.push_back({ { 1.0f, -0.25f, -1.0f }, { 1.0f, 0.0f, 0.0f, 1.0f } });
+    lights.push_back({ { -1.0f, -0.25f, -1.0f }, { 0.0f, 0.0f, 1.0f, 1.0f } });
+
+    cout << "Multisample benchmark, " << bitmap.width << "x" << bitmap.height << ", " << frameCount << " frames" << endl;
+
+    for (int steps : { 13, 100, 1000 })
+    {
+        Model model = GenerateCylinder(steps, 2, 1);
+        model.diffuseColor = { 1.0f, 1.0f, 1.0f, 1.0f };
+        model.SetNormals();
+
+        double seconds[2] = {};
+        size_t maxExpandedPixels = 0;
+        size_t maxMemoryUsage = 0;
+
+        for (int multisample = 0; multisample < 2; ++multisample)
+        {
+            model.modelToWorldTransform = mat4{ 1.0f };
+            model.modelToWorldTransform[3] = { 0.0f, 0.0f, -4.0f, 1.0f };
+            DepthSorter depthSorter;
+
+            auto start = chrono::steady_clock::now();
+            for (int frame = 0; frame < frameCount; ++frame)
+            {
+                model.modelToWorldTransform = rotate(model.modelToWorldTransform, radians(1.0f), vec3{ 1.0f, 1.0f, 0.0f });
+                if (multisample)
+                {
+                    multisampleBitmap.Clear();
+                    DrawModel(multisampleBitmap, model, lights, PerspectiveProjectionMatrix, depthSorter);
+                    multisampleBitmap.Resolve(bitmap);
+                    maxExpandedPixels = max(maxExpandedPixels, multisampleBitmap.ExpandedPixelCount());
+                    maxMemoryUsage = max(maxMemoryUsage, multisampleBitmap.MemoryUsage());
+                }
+                else
+                {
+                    bitmap.Clear();
+                    DrawModel(bitmap, model, lights, PerspectiveProjectionMatrix, depthSorter);
+                }
+            }
+            auto end = chrono::steady_clock::now();
+            seconds[multisample] = chrono::duration<double>(end - start).count();
+        }
+
+        size_t bitmapBytes = bitmap.pixels.size() * sizeof(Pixel);
+        size_t supersampledBytes = bitmapBytes * MultisampleBitmap::SampleCount;
+
+        cout << "  " << model.triangles.size() << " triangles: no AA " << seconds[0] * 1000.0 / frameCount << " ms/frame, "
+            << "4x MSAA " << seconds[1] * 1000.0 / frameCount << " ms/frame (x" << seconds[1] / seconds[0] << "), "
+            << "memory " << maxMemoryUsage << " bytes vs " << bitmapBytes << " no AA and " << supersampledBytes << " uncompressed 4x, "
+            << "up to " << maxExpandedPixels << "/" << bitmap.pixels.size() << " expanded pixels" << endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int checkExitCode;
+    if (argc > 1 && RunCheck(argv[1], checkExitCode))
+    {
+        return checkExitCode;
+    }
+    if (argc > 1 && string_view{ argv[1] } == "--bench-sort")
+    {
+        int triangleCount = argc > 2 ? atoi(argv[2]) : 200000;
+        RunDepthSortBenchmark(triangleCount, 100);
+        return 0;
+    }
+    if (argc > 1 && string_view{ argv[1] } == "--bench-msaa")
+    {
+        RunMultisampleBenchmark(1000);
+        return 0;
+    }
+    if (argc > 2 && string_view{ argv[1] } == "--bench-import")
+    {
+        int repeatCount = argc > 3 ? atoi(argv[3]) : 5;
+        RunImportBenchmark(argv[2], repeatCount);
+        return 0;
+    }
+
+    if (argc > 1 && string_view{ argv[1] } == "--batch")
+    {
+        return RunBatchRender(argc - 2, argv + 2);
+    }
+    if (argc > 1 && string_view{ argv[1] } == "--regression")
+    {
+        return RunRegression(argc - 2, argv + 2);
+    }
+    if (argc > 1 && string_view{ argv[1] } == "--bench-batch")
+    {
+        int frameCount = argc > 2 ? atoi(argv[2]) : 240;
+        RunBatchBenchmark(frameCount);
+        return 0;
+    }
+    if (argc > 1 && string_view{ argv[1] } == "--bench-export")
+    {
+        int frameCount = argc > 2 ? atoi(argv[2]) : 240;
+        RunExportBenchmark(frameCount);
+        return 0;
+    }
+
+    // An OBJ or binary STL mesh can be passed instead of the generated cylinder
+    Model model = CreateDefaultModel();
+    if (argc > 1 && !LoadModel(argv[1], model))
+    {
+        return 1;
+    }
+
     RenderWindow window(VideoMode(800, 600), "Software renderer");
 
     Vector2f windowSize = window.getView().getSize();
@@ -255,6 +884,8 @@ int main()
         static_cast<int>(windowSize.y / screenPixelToBitmapPixelRatio)
     );
 
+    MultisampleBitmap multisampleBitmap = MultisampleBitmap::New(bitmap.width, bitmap.height);
+
     Texture texture;
     texture.create(bitmap.width, bitmap.height);
 
@@ -264,22 +895,22 @@ int main()
 
     BuildPrejectionMatrix(bitmap);
 
-    Model model = GenerateCylinder(13, 2, 1);
-    model.modelToWorldTransform = mat4{ 1.0f };
-    model.modelToWorldTransform[3] = { 0.0f, 0.0f, -4.0f, 1.0f };
-    model.diffuseColor = { 1.0f, 1.0f, 1.0f, 1.0f };
-    model.SetNormals();
-
     Clock clock;
     float rotationSpeed = 30.0f;
 
-    vector<Light> lights;
-    lights.push_back({ { 1.0f, -0.25f, -1.0f }, { 1.0f, 0.0f, 0.0f, 1.0f } });
-    lights.push_back({ { -1.0f, -0.25f, -1.0f }, { 0.0f, 0.0f, 1.0f, 1.0f } });
-    lights.push_back({ { 0.0f, 0.25f, -1.0f }, { 0.0f, 1.0f, 0.0f, 1.0f } });
+    vector<Light> lights = CreateDefaultLights();
 
     bool useOrtho = false; bool pWasPressed = false;
     bool drawWireframe = false; bool wWasPressed = false;
+    DepthSorter depthSorter; bool sWasPressed = false;
+    bool useMultisampling = false; bool mWasPressed = false;
+
+    // Q saves the frame as QOI and E as PNG, both encoded in the background
+    SnapshotExporter snapshots;
+    snapshots.Start();
+    int snapshotCount = 0;
+    bool qWasPressed = false;
+    bool eWasPressed = false;
 
     while (window.isOpen())
     {
@@ -330,15 +961,85 @@ int main()
             wWasPressed = false;
         }
 
-        bitmap.Clear();
+        bool sIsPressed = Keyboard::isKeyPressed(Keyboard::S);
+        if (!sWasPressed && sIsPressed)
+        {
+            depthSorter.mode = static_cast<DepthSortMode>((static_cast<int>(depthSorter.mode) + 1) % 3);
+            sWasPressed = true;
+        }
+        else if (sWasPressed && !sIsPressed)
+        {
+            sWasPressed = false;
+        }
+
+        bool mIsPressed = Keyboard::isKeyPressed(Keyboard::M);
+        if (!mWasPressed && mIsPressed)
+        {
+            useMultisampling = !useMultisampling;
+            mWasPressed = true;
+        }
+        else if (mWasPressed && !mIsPressed)
+        {
+            mWasPressed = false;
+        }
+
         window.clear();
 
-        DrawModel(bitmap, model, lights, useOrtho ? OrthographicProjectionMatrix : PerspectiveProjectionMatrix, drawWireframe);
+        const mat4& projectionMatrix = useOrtho ? OrthographicProjectionMatrix : PerspectiveProjectionMatrix;
+        if (useMultisampling)
+        {
+            multisampleBitmap.Clear();
+            DrawModel(multisampleBitmap, model, lights, projectionMatrix, depthSorter, drawWireframe);
+            multisampleBitmap.Resolve(bitmap);
+        }
+        else
+        {
+            bitmap.Clear();
+            DrawModel(bitmap, model, lights, projectionMatrix, depthSorter, drawWireframe);
+        }
 
         UpdateTextureFromBitmap(texture, bitmap);
+
+        bool qIsPressed = Keyboard::isKeyPressed(Keyboard::Q);
+        bool eIsPressed = Keyboard::isKeyPressed(Keyboard::E);
+        if ((qIsPressed && !qWasPressed) || (eIsPressed && !eWasPressed))
+        {
+            SnapshotFormat format = qIsPressed && !qWasPressed ? SnapshotFormat::Qoi : SnapshotFormat::Png;
+            string path = "snapshot_" + to_string(snapshotCount) + ImageEncoder::Extension(format);
+            if (snapshots.Submit(PixelBytes(bitmap), bitmap.width, bitmap.height, format, path))
+            {
+                ++snapshotCount;
+            }
+            else
+            {
+                cout << "Snapshot dropped, the exporter is busy" << endl;
+            }
+        }
+        qWasPressed = qIsPressed;
+        eWasPressed = eIsPressed;
+        for (auto& result : snapshots.TakeResults())
+        {
+            if (result.written)
+            {
+                cout << "Saved " << result.path << ", " << result.encodedBytes / 1024 << " KB in " << result.encodeSeconds * 1000.0 << " ms" << endl;
+            }
+            else
+            {
+                cerr << "Unable to write " << result.path << endl;
+            }
+        }
+
         window.draw(screen);
         window.display();
     }
 
+    snapshots.Stop();
+    SnapshotStats snapshotStats = snapshots.Stats();
+    if (snapshotStats.exported + snapshotStats.dropped > 0)
+    {
+        cout << "Snapshots: " << snapshotStats.exported << " saved, " << snapshotStats.dropped << " dropped, encoding "
+            << snapshotStats.MegabytesPerSecond() << " MB/s" << endl;
+    }
+
     return 0;
 }
@@ -0,0 +1,23 @@
+#version 330
+
+uniform sampler2DArray colorTextures;
+
+layout(std140) uniform FrameUniforms
+{
+	mat4 worldToCameraMatrix;
+	mat4 projectionMatrix;
+	vec3 lightDirection;
+};
+
+in vec3 worldSpaceNormal;
+in vec3 textureCoordinates;
+
+out vec4 color;
+
+void main()
+{
+	vec4 baseColor = texture(colorTextures, textureCoordinates);
+	float cos = dot(normalize(worldSpaceNormal), -normalize(lightDirection));
+	cos = clamp(cos, 0.0, 1.0);
+	color = (0.95 * cos * baseColor) + (0.05 * baseColor);
+}
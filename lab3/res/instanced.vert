@@ -0,0 +1,26 @@
+#version 330
+
+layout(location = 0) in vec4 in_modelSpacePosition;
+layout(location = 1) in vec3 in_modelSpaceNormal;
+layout(location = 2) in vec2 in_textureCoordinates;
+// Per instance, see InstanceData in MeshBatch.h
+layout(location = 3) in mat4 in_modelMatrix;
+layout(location = 7) in float in_textureLayer;
+
+layout(std140) uniform FrameUniforms
+{
+	mat4 worldToCameraMatrix;
+	mat4 projectionMatrix;
+	vec3 lightDirection;
+};
+
+out vec3 worldSpaceNormal;
+out vec3 textureCoordinates;
+
+void main()
+{
+	// Instances are only rotated and uniformly scaled, so the model matrix also transforms normals
+	worldSpaceNormal = mat3(in_modelMatrix) * in_modelSpaceNormal;
+	textureCoordinates = vec3(in_textureCoordinates, in_textureLayer);
+	gl_Position = projectionMatrix * worldToCameraMatrix * in_modelMatrix * vec4(in_modelSpacePosition.xyz, 1.0);
+}
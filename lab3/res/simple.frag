@@ -1,7 +1,13 @@
 #version 330
 
 uniform sampler2D colorTexture;
-uniform vec3 lightDirection;
+
+layout(std140) uniform FrameUniforms
+{
+	mat4 worldToCameraMatrix;
+	mat4 projectionMatrix;
+	vec3 lightDirection;
+};
 
 in vec3 worldSpaceNormal;
 in vec2 textureCoordinates;
@@ -4,15 +4,38 @@ layout(location = 0) in vec4 in_worldSpacePosition;
 layout(location = 1) in vec3 in_worldSpaceNormal;
 layout(location = 2) in vec2 in_textureCoordinates;
 
-uniform mat4 worldToCameraMatrix;
-uniform mat4 projectionMatrix;
+// Written once per frame into a ring buffer, matches FrameUniforms in RenderQueue.h
+layout(std140) uniform FrameUniforms
+{
+	mat4 worldToCameraMatrix;
+	mat4 projectionMatrix;
+	vec3 lightDirection;
+};
+
+// Compressed meshes store positions and texture coordinates as [0, 1] fractions of their range
+// and the normal octahedral encoded in the first two components
+uniform bool compressedVertices;
+uniform vec3 positionOffset = vec3(0.0);
+uniform vec3 positionScale = vec3(1.0);
+uniform vec2 textureCoordinatesOffset = vec2(0.0);
+uniform vec2 textureCoordinatesScale = vec2(1.0);
 
 out vec3 worldSpaceNormal;
 out vec2 textureCoordinates;
 
+vec3 DecodeOctahedral(vec2 encoded)
+{
+	vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float t = max(-normal.z, 0.0);
+	normal.x += normal.x >= 0.0 ? -t : t;
+	normal.y += normal.y >= 0.0 ? -t : t;
+	return normalize(normal);
+}
+
 void main()
 {
-	worldSpaceNormal = in_worldSpaceNormal;
-	textureCoordinates = in_textureCoordinates;
-	gl_Position = projectionMatrix * worldToCameraMatrix * in_worldSpacePosition;
+	worldSpaceNormal = compressedVertices ? DecodeOctahedral(in_worldSpaceNormal.xy) : in_worldSpaceNormal;
+	textureCoordinates = textureCoordinatesOffset + in_textureCoordinates * textureCoordinatesScale;
+	vec4 worldSpacePosition = vec4(positionOffset + in_worldSpacePosition.xyz * positionScale, 1.0);
+	gl_Position = projectionMatrix * worldToCameraMatrix * worldSpacePosition;
 }
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../../common/MappedFile.h"
+#include "Mesh.h"
+
+// Binary pack of ready to upload assets:
+//   AssetPackHeader, AssetPackEntry[entryCount], payloads aligned to AssetPack::PayloadAlignment.
+// Meshes store Vertex[vertexCount] followed by unsigned int[indexCount], textures store tightly packed
+// RGBA8 rows already flipped for OpenGL, shader sources store the text without a terminator.
+// Entries named after a file record its size and write time, a pack entry is only used while the file is unchanged.
+// Generated assets have no file, Version is bumped whenever they or the layout change.
+enum class AssetType : std::uint32_t
+{
+    Mesh = 1,
+    Texture = 2,
+    ShaderSource = 3
+};
+
+struct AssetPackHeader
+{
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t entryCount;
+    // Layout guard, a pack written with a different Vertex is rejected
+    std::uint32_t vertexSize;
+};
+
+struct AssetPackEntry
+{
+    char name[48];
+    AssetType type;
+    std::uint32_t vertexCount;
+    std::uint32_t indexCount;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t reserved;
+    std::uint64_t offset;
+    std::uint64_t size;
+    // Both zero for generated assets
+    std::uint64_t sourceSize;
+    std::int64_t sourceTime;
+};
+
+static_assert(sizeof(AssetPackHeader) == 16);
+static_assert(sizeof(AssetPackEntry) == 104);
+
+struct AssetPack
+{
+    static constexpr char Magic[4] = { 'C', 'G', 'A', 'P' };
+    static constexpr std::uint32_t Version = 2;
+    static constexpr std::size_t PayloadAlignment = 64;
+
+    MappedFile file;
+    const AssetPackEntry* entries = nullptr;
+    std::uint32_t entryCount = 0;
+
+    bool IsOpen() const
+    {
+        return entries != nullptr;
+    }
+
+    static AssetPack Open(const char* path)
+    {
+        AssetPack result;
+        result.file = MappedFile::Open(path);
+        if (!result.file.IsOpen() || result.file.size < sizeof(AssetPackHeader))
+        {
+            return result;
+        }
+
+        auto header = reinterpret_cast<const AssetPackHeader*>(result.file.data);
+        if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 || header->version != Version || header->vertexSize != sizeof(Vertex))
+        {
+            return result;
+        }
+
+        std::uint64_t tableEnd = sizeof(AssetPackHeader) + static_cast<std::uint64_t>(header->entryCount) * sizeof(AssetPackEntry);
+        if (tableEnd > result.file.size)
+        {
+            return result;
+        }
+
+        auto entries = reinterpret_cast<const AssetPackEntry*>(result.file.data + sizeof(AssetPackHeader));
+        for (std::uint32_t i = 0; i < header->entryCount; ++i)
+        {
+            if (entries[i].offset < tableEnd || entries[i].offset > result.file.size || entries[i].size > result.file.size - entries[i].offset
+                || entries[i].name[sizeof(entries[i].name) - 1] != '\0' || !HasExpectedSize(entries[i]))
+            {
+                return result;
+            }
+        }
+
+        result.entries = entries;
+        result.entryCount = header->entryCount;
+        return result;
+    }
+
+    const AssetPackEntry* Find(std::string_view name, AssetType type) const
+    {
+        for (std::uint32_t i = 0; i < entryCount; ++i)
+        {
+            if (entries[i].type == type && name == entries[i].name)
+            {
+                return &entries[i];
+            }
+        }
+        return nullptr;
+    }
+
+    const void* Data(const AssetPackEntry& entry) const
+    {
+        return file.data + entry.offset;
+    }
+
+    const Vertex* Vertices(const AssetPackEntry& entry) const
+    {
+        return static_cast<const Vertex*>(Data(entry));
+    }
+
+    const unsigned int* Indices(const AssetPackEntry& entry) const
+    {
+        return reinterpret_cast<const unsigned int*>(Vertices(entry) + entry.vertexCount);
+    }
+
+    std::string_view ShaderSource(const AssetPackEntry& entry) const
+    {
+        return { static_cast<const char*>(Data(entry)), static_cast<std::size_t>(entry.size) };
+    }
+
+    // False once the file the entry was packed from has been edited, the file should be loaded instead
+    static bool IsCurrent(const AssetPackEntry& entry)
+    {
+        std::uint64_t size;
+        std::int64_t time;
+        return (entry.sourceSize == 0 && entry.sourceTime == 0)
+            || (ReadSourceStamp(entry.name, size, time) && size == entry.sourceSize && time == entry.sourceTime);
+    }
+
+    static bool ReadSourceStamp(const char* path, std::uint64_t& size, std::int64_t& time)
+    {
+        std::error_code error;
+        size = std::filesystem::file_size(path, error);
+        if (error)
+        {
+            return false;
+        }
+        time = static_cast<std::int64_t>(std::filesystem::last_write_time(path, error).time_since_epoch().count());
+        return !error;
+    }
+
+private:
+    static bool HasExpectedSize(const AssetPackEntry& entry)
+    {
+        switch (entry.type)
+        {
+        case AssetType::Mesh:
+            return entry.size == std::uint64_t(entry.vertexCount) * sizeof(Vertex) + std::uint64_t(entry.indexCount) * sizeof(unsigned int);
+        case AssetType::Texture:
+            return entry.size == std::uint64_t(entry.width) * entry.height * 4;
+        case AssetType::ShaderSource:
+            return true;
+        }
+        return false;
+    }
+};
+
+// Collects assets in memory and writes them as one pack, used offline by "lab3 --pack"
+struct AssetPackWriter
+{
+    std::vector<AssetPackEntry> entries;
+    std::vector<std::vector<std::uint8_t>> payloads;
+
+    bool AddMesh(std::string_view name, const ModelInfo& modelInfo)
+    {
+        AssetPackEntry* entry = AddEntry(name, AssetType::Mesh);
+        if (entry == nullptr)
+        {
+            return false;
+        }
+        entry->vertexCount = static_cast<std::uint32_t>(modelInfo.vertices.size());
+        entry->indexCount = static_cast<std::uint32_t>(modelInfo.indices.size());
+
+        auto& payload = payloads.back();
+        Append(payload, modelInfo.vertices.data(), modelInfo.vertices.size() * sizeof(Vertex));
+        Append(payload, modelInfo.indices.data(), modelInfo.indices.size() * sizeof(unsigned int));
+        return true;
+    }
+
+    // name is the path of the decoded file
+    bool AddTexture(std::string_view name, int width, int height, const std::uint8_t* rgba)
+    {
+        AssetPackEntry* entry = AddSourceEntry(name, AssetType::Texture);
+        if (entry == nullptr)
+        {
+            return false;
+        }
+        entry->width = static_cast<std::uint32_t>(width);
+        entry->height = static_cast<std::uint32_t>(height);
+        Append(payloads.back(), rgba, static_cast<std::size_t>(width) * height * 4);
+        return true;
+    }
+
+    // name is the path source was read from
+    bool AddShaderSource(std::string_view name, std::string_view source)
+    {
+        if (AddSourceEntry(name, AssetType::ShaderSource) == nullptr)
+        {
+            return false;
+        }
+        Append(payloads.back(), source.data(), source.size());
+        return true;
+    }
+
+    bool Write(const char* path)
+    {
+        AssetPackHeader header = {};
+        std::memcpy(header.magic, AssetPack::Magic, sizeof(header.magic));
+        header.version = AssetPack::Version;
+        header.entryCount = static_cast<std::uint32_t>(entries.size());
+        header.vertexSize = sizeof(Vertex);
+
+        std::uint64_t offset = sizeof(AssetPackHeader) + entries.size() * sizeof(AssetPackEntry);
+        for (std::size_t i = 0; i < entries.size(); ++i)
+        {
+            offset = AlignOffset(offset);
+            entries[i].offset = offset;
+            entries[i].size = payloads[i].size();
+            offset += payloads[i].size();
+        }
+
+        std::FILE* output = std::fopen(path, "wb");
+        if (output == nullptr)
+        {
+            return false;
+        }
+
+        bool written = std::fwrite(&header, sizeof(header), 1, output) == 1
+            && (entries.empty() || std::fwrite(entries.data(), sizeof(AssetPackEntry), entries.size(), output) == entries.size());
+
+        std::uint64_t position = sizeof(AssetPackHeader) + entries.size() * sizeof(AssetPackEntry);
+        static constexpr std::uint8_t Padding[AssetPack::PayloadAlignment] = {};
+        for (std::size_t i = 0; i < entries.size() && written; ++i)
+        {
+            std::size_t paddingSize = static_cast<std::size_t>(entries[i].offset - position);
+            written = std::fwrite(Padding, 1, paddingSize, output) == paddingSize
+                && std::fwrite(payloads[i].data(), 1, payloads[i].size(), output) == payloads[i].size();
+            position = entries[i].offset + entries[i].size;
+        }
+
+        return std::fclose(output) == 0 && written;
+    }
+
+private:
+    AssetPackEntry* AddEntry(std::string_view name, AssetType type)
+    {
+        AssetPackEntry entry = {};
+        if (name.size() >= sizeof(entry.name))
+        {
+            return nullptr;
+        }
+        std::memcpy(entry.name, name.data(), name.size());
+        entry.type = type;
+        entries.push_back(entry);
+        payloads.emplace_back();
+        return &entries.back();
+    }
+
+    AssetPackEntry* AddSourceEntry(std::string_view name, AssetType type)
+    {
+        AssetPackEntry* entry = AddEntry(name, type);
+        if (entry != nullptr && !AssetPack::ReadSourceStamp(entry->name, entry->sourceSize, entry->sourceTime))
+        {
+            entries.pop_back();
+            payloads.pop_back();
+            return nullptr;
+        }
+        return entry;
+    }
+
+    static void Append(std::vector<std::uint8_t>& payload, const void* data, std::size_t size)
+    {
+        auto bytes = static_cast<const std::uint8_t*>(data);
+        payload.insert(payload.end(), bytes, bytes + size);
+    }
+
+    static std::uint64_t AlignOffset(std::uint64_t offset)
+    {
+        return (offset + AssetPack::PayloadAlignment - 1) / AssetPack::PayloadAlignment * AssetPack::PayloadAlignment;
+    }
+};
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+
+// Fixed capacity queue without locks, any number of threads push and any number pop (Vyukov's bounded queue).
+// Every slot carries a sequence number telling whether it is free for the push of the current lap or holds the
+// value for the pop of the current lap, so producers never wait on each other and a full queue refuses the push.
+template<typename T>
+struct BoundedQueue
+{
+    // Rounded up to a power of two
+    explicit BoundedQueue(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+        mask = size - 1;
+        slots = std::make_unique<Slot[]>(size);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    std::size_t Capacity() const
+    {
+        return mask + 1;
+    }
+
+    // False when the queue is full
+    bool TryPush(const T& value)
+    {
+        std::size_t position = pushPosition.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot& slot = slots[position & mask];
+            std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (difference == 0)
+            {
+                if (pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    slot.value = value;
+                    slot.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = pushPosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // False when the queue is empty
+    bool TryPop(T& value)
+    {
+        std::size_t position = popPosition.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot& slot = slots[position & mask];
+            std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+            if (difference == 0)
+            {
+                if (popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = slot.value;
+                    slot.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = popPosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    static constexpr std::size_t CacheLineSize = 64;
+
+    struct Slot
+    {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    std::size_t mask = 0;
+    // Apart so pushing and popping threads do not invalidate each other's cache line
+    alignas(CacheLineSize) std::atomic<std::size_t> pushPosition{ 0 };
+    alignas(CacheLineSize) std::atomic<std::size_t> popPosition{ 0 };
+};
@@ -0,0 +1,668 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <chrono>
+#include <string_view>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <array>
+#include <thread>
+#include <tuple>
+#include <numeric>
+#include <vector>
+
+#include "GL/glew.h"
+#include "spdlog/spdlog.h"
+
+#include "Checks.h"
+#include "Camera.h"
+#include "Debug.h"
+#include "Mesh.h"
+#include "CompressedVertex.h"
+#include "RenderQueue.h"
+#include "RingBuffer.h"
+#include "FrustumCulling.h"
+#include "LatencyTracker.h"
+#include "../../common/SelfCheck.h"
+
+// Largest allowed normal error, 16-bit octahedral codes are worst near the middle of each octant at about 0.0074 degrees
+constexpr double MaxNormalErrorDegrees = 0.01;
+
+bool CheckVertexCompression(std::string_view name, const ModelInfo& modelInfo)
+{
+    CompressedModelInfo compressed = VertexCompression::Compress(modelInfo);
+    const VertexDecoding& decoding = compressed.decoding;
+
+    // Half a quantization step of the range plus float rounding of the decoded value
+    auto bound = [](float offset, float scale) {
+        return scale * 0.5 / VertexCompression::UnormMax + 1e-6 * std::max(std::abs(offset), std::abs(offset + scale));
+    };
+    const double positionBounds[3] = {
+        bound(decoding.positionOffset.x, decoding.positionScale.x),
+        bound(decoding.positionOffset.y, decoding.positionScale.y),
+        bound(decoding.positionOffset.z, decoding.positionScale.z),
+    };
+    const double textureCoordinatesBounds[2] = {
+        bound(decoding.textureCoordinatesOffset.x, decoding.textureCoordinatesScale.x),
+        bound(decoding.textureCoordinatesOffset.y, decoding.textureCoordinatesScale.y),
+    };
+
+    double positionError = 0.0;
+    double textureCoordinatesError = 0.0;
+    double normalErrorDegrees = 0.0;
+    bool withinBounds = compressed.indices == modelInfo.indices;
+
+    for (std::size_t i = 0; i < modelInfo.vertices.size(); ++i)
+    {
+        const Vertex& original = modelInfo.vertices[i];
+        Vertex decoded = VertexCompression::Decode(compressed.vertices[i], decoding);
+
+        const double positionErrors[3] = { std::abs(decoded.x - original.x), std::abs(decoded.y - original.y), std::abs(decoded.z - original.z) };
+        const double textureCoordinatesErrors[2] = { std::abs(decoded.tx - original.tx), std::abs(decoded.ty - original.ty) };
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            withinBounds = withinBounds && positionErrors[axis] <= positionBounds[axis];
+            positionError = std::max(positionError, positionErrors[axis]);
+        }
+        for (int axis = 0; axis < 2; ++axis)
+        {
+            withinBounds = withinBounds && textureCoordinatesErrors[axis] <= textureCoordinatesBounds[axis];
+            textureCoordinatesError = std::max(textureCoordinatesError, textureCoordinatesErrors[axis]);
+        }
+
+        // atan2 of the cross and dot products stays accurate for tiny angles, unlike acos
+        double nx = original.nx, ny = original.ny, nz = original.nz;
+        double cx = decoded.ny * nz - decoded.nz * ny;
+        double cy = decoded.nz * nx - decoded.nx * nz;
+        double cz = decoded.nx * ny - decoded.ny * nx;
+        double dot = decoded.nx * nx + decoded.ny * ny + decoded.nz * nz;
+        double angle = std::atan2(std::sqrt(cx * cx + cy * cy + cz * cz), dot) * 180.0 / 3.14159265358979323846;
+        withinBounds = withinBounds && angle <= MaxNormalErrorDegrees;
+        normalErrorDegrees = std::max(normalErrorDegrees, angle);
+    }
+
+    spdlog::log(withinBounds ? spdlog::level::info : spdlog::level::err, "{}: {} vertices, max position error {:.3g}, uv error {:.3g}, normal error {:.5f} deg, {} -> {} bytes",
+        name, modelInfo.vertices.size(), positionError, textureCoordinatesError, normalErrorDegrees,
+        modelInfo.vertices.size() * sizeof(Vertex), compressed.vertices.size() * sizeof(CompressedVertex));
+    return withinBounds;
+}
+
+// Random unit normals, positions in a lopsided box and tiled texture coordinates
+ModelInfo GenerateRandomVertices(int count, bool flat, unsigned int seed)
+{
+    std::mt19937 random(seed);
+    std::normal_distribution<float> gaussian;
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    ModelInfo info;
+    for (int i = 0; i < count; ++i)
+    {
+        float nx = gaussian(random), ny = gaussian(random), nz = gaussian(random);
+        float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+        Vertex vertex;
+        vertex.x = -50.0f + 170.0f * uniform(random);
+        vertex.y = flat ? 2.0f : -1.0f + 2.0f * uniform(random);
+        vertex.z = 1000.0f * uniform(random);
+        vertex.nx = nx / length;
+        vertex.ny = ny / length;
+        vertex.nz = nz / length;
+        vertex.tx = -2.0f + 5.0f * uniform(random);
+        vertex.ty = uniform(random);
+        info.vertices.push_back(vertex);
+        info.indices.push_back(i);
+    }
+
+    // Axis aligned normals sit on the octahedron's vertices and folds
+    const float axes[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    for (int i = 0; i < 6 && !info.vertices.empty(); ++i)
+    {
+        info.vertices[i].nx = axes[i][0];
+        info.vertices[i].ny = axes[i][1];
+        info.vertices[i].nz = axes[i][2];
+    }
+    return info;
+}
+
+// lab3 --check-vertex-compression, fails when a decoded attribute exceeds its error bound
+int RunVertexCompressionCheck()
+{
+    bool passed = CheckVertexCompression("pyramid", GeneratePyramid(5, 3, 8));
+    passed = CheckVertexCompression("random", GenerateRandomVertices(1'000'000, false, 1)) && passed;
+    passed = CheckVertexCompression("random flat", GenerateRandomVertices(10'000, true, 2)) && passed;
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Random frame of fake draws, names only matter to the recording backend
+std::vector<Mesh> GenerateRenderQueueFrame(RenderQueue& queue, int drawCount, unsigned int seed)
+{
+    constexpr std::array<GLuint, 4> Programs = { 7, 3, 11, 5 };
+    constexpr int TextureCount = 8;
+    constexpr int MeshCount = 16;
+
+    std::vector<Mesh> meshes(MeshCount);
+    for (int i = 0; i < MeshCount; ++i)
+    {
+        meshes[i].vao = 100 + i;
+        meshes[i].indicesSize = 36;
+        // Every other mesh is compressed and needs its own decoding uniforms
+        meshes[i].decoding.compressed = i % 2 == 1;
+        meshes[i].decoding.positionOffset = glm::vec3{ static_cast<float>(i % 2 == 1 ? i : 0) };
+    }
+
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> programDistribution(0, static_cast<int>(Programs.size()) - 1);
+    std::uniform_int_distribution<int> textureDistribution(0, TextureCount - 1);
+    std::uniform_int_distribution<int> meshDistribution(0, MeshCount - 1);
+    std::uniform_real_distribution<float> depthDistribution(0.0f, queue.maxDepth);
+
+    queue.Clear();
+    for (int i = 0; i < drawCount; ++i)
+    {
+        DrawCommand command;
+        command.program = Programs[programDistribution(random)];
+        command.texture = 200 + textureDistribution(random);
+        command.mesh = &meshes[meshDistribution(random)];
+        command.depth = depthDistribution(random);
+        queue.Submit(command);
+    }
+    return meshes;
+}
+
+// lab3 --check-render-queue, replays a frame through the recording backend and checks what reached it
+int RunRenderQueueCheck()
+{
+    constexpr int DrawCount = 2000;
+    SelfCheck check("Render queue");
+
+    RenderQueue queue;
+    std::vector<Mesh> meshes = GenerateRenderQueueFrame(queue, DrawCount, 1);
+
+    // Submission order with the same cache is the baseline the sorted frame is compared with
+    RecordingRenderBackend unsortedBackend;
+    RenderStateCache cache;
+    RenderStats unsortedStats = queue.Execute(unsortedBackend, cache);
+
+    queue.Sort();
+    RecordingRenderBackend backend;
+    cache.Reset();
+    RenderStats stats = queue.Execute(backend, cache);
+
+    for (std::size_t i = 1; i < queue.entries.size(); ++i)
+    {
+        const DrawCommand& previous = queue.commands[queue.entries[i - 1].command];
+        const DrawCommand& current = queue.commands[queue.entries[i].command];
+        if (previous.program == current.program && previous.texture == current.texture && previous.mesh == current.mesh
+            && previous.depth > current.depth)
+        {
+            check.Fail("draws with equal state are not front to back");
+            break;
+        }
+    }
+
+    std::size_t programBinds = 0;
+    std::size_t draws = 0;
+    std::array<std::uint32_t, 5> lastValue;
+    lastValue.fill(RenderStateCache::Unknown);
+    for (auto& call : backend.calls)
+    {
+        using CallType = RecordingRenderBackend::CallType;
+        programBinds += call.type == CallType::UseProgram;
+        draws += call.type == CallType::DrawElements;
+
+        bool isBind = call.type == CallType::UseProgram || call.type == CallType::BindVertexArray || call.type == CallType::BindTexture;
+        auto& last = lastValue[static_cast<std::size_t>(call.type)];
+        if (isBind && last == call.value)
+        {
+            check.Fail("redundant bind reached the backend");
+        }
+        last = call.value;
+    }
+
+    std::size_t stateCalls = backend.calls.size() - draws;
+    if (draws != DrawCount || stats.draws != DrawCount)
+    {
+        check.Fail("draw count does not match the submitted commands");
+    }
+    if (programBinds != 4)
+    {
+        check.Fail("programs are bound more than once per frame");
+    }
+    if (stats.callsIssued != backend.calls.size())
+    {
+        check.Fail("issued counter does not match the recorded calls");
+    }
+    if (stats.callsIssued >= unsortedStats.callsIssued)
+    {
+        check.Fail("sorting did not reduce the number of calls");
+    }
+
+    spdlog::info("{} draws: {} calls issued, {} skipped sorted ({} state changes), {} issued, {} skipped in submission order",
+        stats.draws, stats.callsIssued, stats.callsSkipped, stateCalls, unsortedStats.callsIssued, unsortedStats.callsSkipped);
+
+    // CPU cost of a large frame without GL: key building, sort and replay into the null backend
+    constexpr int TimedDrawCount = 100000;
+    constexpr int TimedFrames = 20;
+    std::vector<double> milliseconds;
+    NullRenderBackend nullBackend;
+    for (int frame = 0; frame < TimedFrames; ++frame)
+    {
+        RenderQueue timedQueue;
+        std::vector<Mesh> timedMeshes = GenerateRenderQueueFrame(timedQueue, TimedDrawCount, frame + 2);
+        auto submitted = std::chrono::steady_clock::now();
+        timedQueue.Sort();
+        cache.Reset();
+        timedQueue.Execute(nullBackend, cache);
+        auto end = std::chrono::steady_clock::now();
+        milliseconds.push_back(std::chrono::duration<double, std::milli>(end - submitted).count());
+    }
+    std::sort(milliseconds.begin(), milliseconds.end());
+    spdlog::info("{} draws: sort and replay median {:.3f} ms over {} frames", TimedDrawCount, milliseconds[milliseconds.size() / 2], TimedFrames);
+
+    return check.ExitCode();
+}
+
+// lab3 --check-ring-buffer, runs the allocator against fake fences with the GPU a few frames behind
+int RunRingBufferCheck()
+{
+    SelfCheck check("Ring buffer");
+
+    // Two 400 byte regions fill most of the ring, the next one wraps and has to wait for the first frame
+    {
+        RingAllocator<FakeFenceBackend> ring(1024);
+        std::uint64_t first, second, third;
+        bool allocated = ring.Allocate(400, 16, first) && ring.Allocate(400, 16, second);
+        ring.EndFrame();
+        allocated = allocated && ring.Allocate(400, 16, third);
+        if (!allocated || first != 0 || second != 400 || third != 0 || ring.stats.wraps != 1 || ring.fences.waits != 1)
+        {
+            check.Fail("wrap did not wait for the frame using the start of the ring");
+        }
+
+        std::uint64_t offset;
+        if (ring.Allocate(1000, 16, offset) || ring.Allocate(2048, 16, offset) || ring.stats.failures != 2)
+        {
+            check.Fail("allocation larger than the free ring succeeded");
+        }
+    }
+
+    // Random frames, every allocation is compared with the regions of frames whose fence has not signaled
+    constexpr std::uint64_t Capacity = 64 * 1024;
+    constexpr int Frames = 2000;
+    constexpr std::uint64_t GpuLatencyFrames = 2;
+
+    struct Region
+    {
+        std::uint64_t offset;
+        std::uint64_t size;
+        std::uint64_t fence;
+    };
+
+    RingAllocator<FakeFenceBackend> ring(Capacity);
+    std::vector<Region> regions;
+    std::mt19937 random(1);
+    std::uniform_int_distribution<std::uint64_t> sizeDistribution(1, 6000);
+    std::uniform_int_distribution<int> countDistribution(1, 6);
+    constexpr std::array<std::uint64_t, 3> Alignments = { 4, 32, 256 };
+
+    for (int frame = 0; frame < Frames && check.passed; ++frame)
+    {
+        FakeFenceBackend& fences = ring.fences;
+        fences.completed = std::max(fences.completed, fences.inserted > GpuLatencyFrames ? fences.inserted - GpuLatencyFrames : 0);
+
+        int count = countDistribution(random);
+        for (int i = 0; i < count; ++i)
+        {
+            std::uint64_t size = sizeDistribution(random);
+            std::uint64_t alignment = Alignments[random() % Alignments.size()];
+            std::uint64_t offset;
+            if (!ring.Allocate(size, alignment, offset))
+            {
+                check.Fail("allocation failed although a frame fits the ring");
+                break;
+            }
+            if (offset % alignment != 0 || offset + size > Capacity)
+            {
+                check.Fail("region is misaligned or crosses the end of the ring");
+            }
+
+            std::erase_if(regions, [&fences](const Region& region) { return region.fence <= fences.completed; });
+            for (auto& region : regions)
+            {
+                if (offset < region.offset + region.size && region.offset < offset + size)
+                {
+                    check.Fail("region overlaps one the GPU may still read");
+                    break;
+                }
+            }
+            regions.push_back({ offset, size, fences.inserted + 1 });
+        }
+        ring.EndFrame();
+    }
+
+    spdlog::info("{} frames: {} allocations, {:.1f} MB, {} wraps, {} stalls, {} fence waits", Frames, ring.stats.allocations,
+        ring.stats.allocatedBytes / (1024.0 * 1024.0), ring.stats.wraps, ring.stats.stalls, ring.fences.waits);
+    return check.ExitCode();
+}
+
+// lab3 --check-latency, percentiles of known samples and the tracker against fake fences with the GPU two frames behind
+int RunLatencyCheck()
+{
+    SelfCheck check("Latency");
+    auto matches = [](double a, double b) { return std::abs(a - b) < 1e-6; };
+
+    std::vector<double> samples(100);
+    std::iota(samples.begin(), samples.end(), 1.0);
+    std::shuffle(samples.begin(), samples.end(), std::mt19937(1));
+    auto percentiles = LatencyPercentiles::Compute(samples);
+    if (percentiles.count != 100 || percentiles.p50 != 50.0 || percentiles.p90 != 90.0 || percentiles.p99 != 99.0 || percentiles.max != 100.0)
+    {
+        check.Fail("percentiles of 1 to 100 are not their nearest ranks");
+    }
+    auto single = LatencyPercentiles::Compute({ 7.0 });
+    if (single.p50 != 7.0 || single.p99 != 7.0 || single.max != 7.0 || LatencyPercentiles::Compute({}).count != 0)
+    {
+        check.Fail("percentiles of one or no sample");
+    }
+
+    // 60 Hz frames, the input is sampled 4 ms in, swap returns at the end of the frame and the GPU is two frames behind,
+    // so a frame's fence is first seen signaled at the start of the third frame after it
+    constexpr int Frames = 300;
+    constexpr double FrameSeconds = 1.0 / 60.0;
+    constexpr double InputOffsetSeconds = 0.004;
+    constexpr std::uint64_t GpuLatencyFrames = 2;
+    LatencyTracker<FakeFenceBackend> tracker;
+    for (int frame = 0; frame < Frames; ++frame)
+    {
+        double frameStart = frame * FrameSeconds;
+        FakeFenceBackend& fences = tracker.fences;
+        fences.completed = fences.inserted > GpuLatencyFrames ? fences.inserted - GpuLatencyFrames : 0;
+        tracker.Poll(frameStart);
+        tracker.FramePresented(frameStart + InputOffsetSeconds, frameStart + FrameSeconds);
+    }
+    tracker.Release();
+
+    auto present = LatencyPercentiles::Compute(tracker.presentMilliseconds);
+    auto completion = LatencyPercentiles::Compute(tracker.completionMilliseconds);
+    const double expectedPresent = (FrameSeconds - InputOffsetSeconds) * 1000.0;
+    const double expectedCompletion = ((GpuLatencyFrames + 1) * FrameSeconds - InputOffsetSeconds) * 1000.0;
+    if (present.count != Frames || !matches(present.p50, expectedPresent) || !matches(present.max, expectedPresent))
+    {
+        check.Fail("input to present latency");
+    }
+    if (completion.count != Frames - GpuLatencyFrames - 1 || !matches(completion.p50, expectedCompletion) || !matches(completion.max, expectedCompletion))
+    {
+        check.Fail("input to GPU completion latency");
+    }
+
+    spdlog::info("{} frames: input to present p50 {:.2f} ms, input to GPU completion p50 {:.2f} ms over {} frames", Frames, present.p50,
+        completion.p50, completion.count);
+    return check.ExitCode();
+}
+
+// Camera of the default scene, looking down +z with the orthographic projection Camera builds
+Camera CreateCullingTestCamera()
+{
+    Camera camera;
+    camera.frustum.nearPlane = 0.1f;
+    camera.frustum.farPlane = 1000.0f;
+    camera.frustum.horizontalFovDegrees = 90.0f;
+    camera.position = glm::vec3{ 0.0f };
+    camera.pitchDegrees = 0.0f;
+    camera.yawDegrees = 90.0f;
+    camera.SyncDirectionVectors();
+    return camera;
+}
+
+// 90 degree perspective projection, Camera itself only builds orthographic ones
+glm::mat4 BuildCullingTestPerspective(float nearPlane, float farPlane)
+{
+    glm::mat4 result{ 0.0f };
+    result[0][0] = 1.0f;
+    result[1][1] = 1.0f;
+    result[2][2] = -(farPlane + nearPlane) / (farPlane - nearPlane);
+    result[3][2] = -2.0f * farPlane * nearPlane / (farPlane - nearPlane);
+    result[2][3] = -1.0f;
+    return result;
+}
+
+void GenerateRandomBounds(std::size_t count, unsigned int seed, BoundingSphereArray& spheres, BoundingBoxArray& boxes)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> lateral(-12.0f, 12.0f);
+    std::uniform_real_distribution<float> depth(-20.0f, 1020.0f);
+    std::uniform_real_distribution<float> size(0.01f, 2.0f);
+    spheres.Resize(count);
+    boxes.Resize(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        spheres.centerX[i] = boxes.centerX[i] = lateral(random);
+        spheres.centerY[i] = boxes.centerY[i] = lateral(random);
+        spheres.centerZ[i] = boxes.centerZ[i] = depth(random);
+        spheres.radius[i] = size(random);
+        boxes.extentX[i] = size(random);
+        boxes.extentY[i] = size(random);
+        boxes.extentZ[i] = size(random);
+    }
+}
+
+// lab3 --check-frustum-culling, hand placed objects against both projections, then SIMD and threaded culling
+// against the scalar reference on random objects
+int RunFrustumCullingCheck()
+{
+    SelfCheck check("Frustum culling");
+
+    struct KnownSphere
+    {
+        glm::vec3 center;
+        float radius;
+        bool visible;
+    };
+
+    Camera camera = CreateCullingTestCamera();
+    glm::mat4 worldToCamera = camera.BuildWorldToCameraMatrix();
+
+    // Orthographic: |x| <= 4 and |y| <= 3.2 at 1000x800, depth 0.1 to 1000 in front of the camera
+    FrustumPlanes orthographic = FrustumPlanes::FromMatrix(camera.BuildProjectionMatrix(1000, 800) * worldToCamera);
+    const KnownSphere orthographicCases[] = {
+        { { 0.0f, 0.0f, 10.0f }, 0.1f, true },
+        { { 0.0f, 0.0f, -10.0f }, 0.1f, false },
+        { { 5.0f, 0.0f, 10.0f }, 0.5f, false },
+        { { -4.3f, 0.0f, 10.0f }, 0.5f, true },
+        { { 0.0f, 3.5f, 10.0f }, 0.2f, false },
+        { { 0.0f, 0.0f, 1000.5f }, 1.0f, true },
+        { { 0.0f, 0.0f, 1002.0f }, 1.0f, false }
+    };
+
+    // Perspective: |x| <= depth and |y| <= depth, a sphere at x = 12, depth 10 is sqrt(2) away from the side plane
+    FrustumPlanes perspective = FrustumPlanes::FromMatrix(BuildCullingTestPerspective(0.1f, 1000.0f) * worldToCamera);
+    const KnownSphere perspectiveCases[] = {
+        { { 0.0f, 0.0f, 10.0f }, 0.1f, true },
+        { { 12.0f, 0.0f, 10.0f }, 1.0f, false },
+        { { 12.0f, 0.0f, 10.0f }, 1.5f, true },
+        { { 0.0f, -12.0f, 10.0f }, 1.0f, false },
+        { { 0.0f, 0.0f, 0.05f }, 0.01f, false },
+        { { 0.0f, 0.0f, -5.0f }, 1.0f, false }
+    };
+
+    for (auto [frustum, cases, caseCount] : { std::tuple{ &orthographic, orthographicCases, std::size(orthographicCases) },
+        std::tuple{ &perspective, perspectiveCases, std::size(perspectiveCases) } })
+    {
+        for (std::size_t c = 0; c < caseCount; ++c)
+        {
+            BoundingSphereArray spheres;
+            BoundingBoxArray boxes;
+            spheres.Resize(FrustumCulling::Width + 1);
+            boxes.Resize(FrustumCulling::Width + 1);
+            // Every lane and the scalar tail hold the same object
+            for (std::size_t i = 0; i < spheres.Size(); ++i)
+            {
+                spheres.centerX[i] = boxes.centerX[i] = cases[c].center.x;
+                spheres.centerY[i] = boxes.centerY[i] = cases[c].center.y;
+                spheres.centerZ[i] = boxes.centerZ[i] = cases[c].center.z;
+                spheres.radius[i] = cases[c].radius;
+                // Box inscribed in the sphere, it is visible whenever the sphere is for these cases
+                boxes.extentX[i] = boxes.extentY[i] = boxes.extentZ[i] = cases[c].radius / std::sqrt(3.0f);
+            }
+            std::vector<std::uint32_t> visible(spheres.Size());
+            std::size_t expected = cases[c].visible ? spheres.Size() : 0;
+            if (FrustumCulling::CullSpheres(*frustum, spheres, 0, spheres.Size(), visible.data()) != expected)
+            {
+                check.Fail(fmt::format("sphere at ({}, {}, {}) radius {}", cases[c].center.x, cases[c].center.y, cases[c].center.z, cases[c].radius));
+            }
+            if (!cases[c].visible && FrustumCulling::CullBoxes(*frustum, boxes, 0, boxes.Size(), visible.data()) != 0)
+            {
+                check.Fail(fmt::format("box at ({}, {}, {})", cases[c].center.x, cases[c].center.y, cases[c].center.z));
+            }
+        }
+    }
+
+    constexpr std::size_t RandomCount = 100003;
+    BoundingSphereArray spheres;
+    BoundingBoxArray boxes;
+    GenerateRandomBounds(RandomCount, 1, spheres, boxes);
+    // The same pool for every call, reused workers must see each new job
+    WorkerPool workers;
+    workers.Start(4);
+    for (const FrustumPlanes* frustum : { &orthographic, &perspective })
+    {
+        std::vector<std::uint32_t> reference(RandomCount);
+        std::vector<std::uint32_t> result(RandomCount);
+        reference.resize(FrustumCulling::CullSpheresScalar(*frustum, spheres, 0, RandomCount, reference.data()));
+        result.resize(FrustumCulling::CullSpheres(*frustum, spheres, 0, RandomCount, result.data()));
+        if (result != reference)
+        {
+            check.Fail("SIMD sphere culling differs from the scalar reference");
+        }
+        FrustumCulling::CullParallel(workers, *frustum, spheres, FrustumCulling::CullSpheres, result);
+        if (result != reference)
+        {
+            check.Fail("threaded sphere culling differs from the scalar reference");
+        }
+
+        reference.resize(RandomCount);
+        result.resize(RandomCount);
+        reference.resize(FrustumCulling::CullBoxesScalar(*frustum, boxes, 0, RandomCount, reference.data()));
+        result.resize(FrustumCulling::CullBoxes(*frustum, boxes, 0, RandomCount, result.data()));
+        if (result != reference)
+        {
+            check.Fail("SIMD box culling differs from the scalar reference");
+        }
+        FrustumCulling::CullParallel(workers, *frustum, boxes, FrustumCulling::CullBoxes, result);
+        if (result != reference)
+        {
+            check.Fail("threaded box culling differs from the scalar reference");
+        }
+        spdlog::info("{} of {} random boxes visible", reference.size(), RandomCount);
+    }
+
+    return check.ExitCode();
+}
+
+// lab3 --check-gl-debug, the queue under concurrent producers and the logger's accounting, without a context
+int RunGLDebugCheck()
+{
+    SelfCheck check("GL debug");
+
+    // Every producer's values come out complete and in its own order
+    constexpr int ProducerCount = 4;
+    constexpr std::uint32_t ValuesPerProducer = 200000;
+    BoundedQueue<std::uint32_t> queue(256);
+    std::vector<std::thread> producers;
+    for (std::uint32_t producer = 0; producer < ProducerCount; ++producer)
+    {
+        producers.emplace_back([&queue, producer] {
+            for (std::uint32_t value = 0; value < ValuesPerProducer; ++value)
+            {
+                while (!queue.TryPush(producer << 24 | value))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    std::array<std::uint32_t, ProducerCount> expected = {};
+    for (std::uint64_t popped = 0; popped < std::uint64_t(ProducerCount) * ValuesPerProducer;)
+    {
+        std::uint32_t value;
+        if (!queue.TryPop(value))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        std::uint32_t producer = value >> 24;
+        if (producer >= ProducerCount || (value & 0xffffff) != expected[producer])
+        {
+            check.Fail(fmt::format("queue returned {:08x} out of order", value));
+            break;
+        }
+        ++expected[producer];
+        ++popped;
+    }
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+
+    // A flood of few distinct messages from several threads, most are rate limited and some may be dropped,
+    // but every one is accounted for
+    constexpr int MessageIdCount = 8;
+    constexpr int MessagesPerThread = 20000;
+    GLDebugOutputStats stats;
+    auto start = std::chrono::steady_clock::now();
+    {
+        GLDebugOutput output;
+        output.StartLogger();
+        std::vector<std::thread> threads;
+        for (int thread = 0; thread < ProducerCount; ++thread)
+        {
+            threads.emplace_back([&output] {
+                for (int i = 0; i < MessagesPerThread; ++i)
+                {
+                    GLDebugOutput::Enqueue(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_PERFORMANCE, i % MessageIdCount, GL_DEBUG_SEVERITY_LOW, -1,
+                        "check message", &output);
+                    GLDebugOutput::Enqueue(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_OTHER, 0, GL_DEBUG_SEVERITY_NOTIFICATION, -1,
+                        "notification", &output);
+                }
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        output.StopLogger();
+        stats = output.Stats();
+    }
+    double elapsedWindows = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / GLDebugSettings{}.window.count() * 1000.0;
+
+    if (stats.received != std::uint64_t(ProducerCount) * MessagesPerThread)
+    {
+        check.Fail(fmt::format("{} messages received, notifications must not be queued", stats.received));
+    }
+    if (stats.logged + stats.suppressed + stats.dropped != stats.received)
+    {
+        check.Fail(fmt::format("{} logged, {} suppressed and {} dropped do not add up to {} received", stats.logged, stats.suppressed, stats.dropped,
+            stats.received));
+    }
+    if (stats.logged > MessageIdCount * GLDebugSettings{}.messagesPerWindow * (static_cast<std::uint64_t>(elapsedWindows) + 1))
+    {
+        check.Fail(fmt::format("{} messages logged, the rate limit lets far fewer through", stats.logged));
+    }
+    spdlog::info("{} messages: {} logged, {} suppressed, {} dropped", stats.received, stats.logged, stats.suppressed, stats.dropped);
+    return check.ExitCode();
+}
+
+constexpr SelfCheckMode CheckModes[] = {
+    { "--check-vertex-compression", RunVertexCompressionCheck },
+    { "--check-render-queue", RunRenderQueueCheck },
+    { "--check-ring-buffer", RunRingBufferCheck },
+    { "--check-latency", RunLatencyCheck },
+    { "--check-frustum-culling", RunFrustumCullingCheck },
+    { "--check-gl-debug", RunGLDebugCheck },
+};
+
+bool RunCheck(std::string_view flag, int& exitCode)
+{
+    SelfCheck::Report = [](std::string_view message) { spdlog::error("{}", message); };
+    return RunSelfCheck(CheckModes, flag, exitCode);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+#include "glm/glm.hpp"
+
+#include "Camera.h"
+#include "FrustumCulling.h"
+
+// Self checks run by "lab3 --check-*", defined in Checks.cpp.
+// Runs the check named by flag and stores its exit code, false when flag names no check.
+bool RunCheck(std::string_view flag, int& exitCode);
+
+// Culling test scene, shared with lab3 --bench-frustum-culling
+Camera CreateCullingTestCamera();
+glm::mat4 BuildCullingTestPerspective(float nearPlane, float farPlane);
+void GenerateRandomBounds(std::size_t count, unsigned int seed, BoundingSphereArray& spheres, BoundingBoxArray& boxes);
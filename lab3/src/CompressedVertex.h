@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+
+#include "Mesh.h"
+
+// 16 byte alternative to Vertex: positions are 16-bit fractions of the mesh bounding box, normals are
+// octahedral encoded into two 16-bit snorms and texture coordinates are 16-bit fractions of their range.
+struct CompressedVertex
+{
+    std::uint16_t x, y, z, padding;
+    std::int16_t nx, ny;
+    std::uint16_t tx, ty;
+};
+
+static_assert(sizeof(CompressedVertex) == 16);
+
+struct CompressedModelInfo
+{
+    std::vector<CompressedVertex> vertices;
+    std::vector<unsigned int> indices;
+    VertexDecoding decoding;
+};
+
+struct VertexCompression
+{
+    static constexpr float UnormMax = 65535.0f;
+    static constexpr float SnormMax = 32767.0f;
+
+    static CompressedModelInfo Compress(const ModelInfo& modelInfo)
+    {
+        CompressedModelInfo result;
+        result.indices = modelInfo.indices;
+        result.decoding = ComputeDecoding(modelInfo.vertices);
+        result.vertices.reserve(modelInfo.vertices.size());
+        for (auto& vertex : modelInfo.vertices)
+        {
+            result.vertices.push_back(Encode(vertex, result.decoding));
+        }
+        return result;
+    }
+
+    static VertexDecoding ComputeDecoding(const std::vector<Vertex>& vertices)
+    {
+        VertexDecoding decoding;
+        decoding.compressed = true;
+        if (vertices.empty())
+        {
+            return decoding;
+        }
+
+        float minimum[5] = { vertices[0].x, vertices[0].y, vertices[0].z, vertices[0].tx, vertices[0].ty };
+        float maximum[5] = { vertices[0].x, vertices[0].y, vertices[0].z, vertices[0].tx, vertices[0].ty };
+        for (auto& vertex : vertices)
+        {
+            const float values[5] = { vertex.x, vertex.y, vertex.z, vertex.tx, vertex.ty };
+            for (int i = 0; i < 5; ++i)
+            {
+                minimum[i] = std::min(minimum[i], values[i]);
+                maximum[i] = std::max(maximum[i], values[i]);
+            }
+        }
+
+        decoding.positionOffset = { minimum[0], minimum[1], minimum[2] };
+        decoding.positionScale = { maximum[0] - minimum[0], maximum[1] - minimum[1], maximum[2] - minimum[2] };
+        decoding.textureCoordinatesOffset = { minimum[3], minimum[4] };
+        decoding.textureCoordinatesScale = { maximum[3] - minimum[3], maximum[4] - minimum[4] };
+        return decoding;
+    }
+
+    static CompressedVertex Encode(const Vertex& vertex, const VertexDecoding& decoding)
+    {
+        CompressedVertex result = {};
+        result.x = QuantizeUnorm(vertex.x, decoding.positionOffset.x, decoding.positionScale.x);
+        result.y = QuantizeUnorm(vertex.y, decoding.positionOffset.y, decoding.positionScale.y);
+        result.z = QuantizeUnorm(vertex.z, decoding.positionOffset.z, decoding.positionScale.z);
+        result.tx = QuantizeUnorm(vertex.tx, decoding.textureCoordinatesOffset.x, decoding.textureCoordinatesScale.x);
+        result.ty = QuantizeUnorm(vertex.ty, decoding.textureCoordinatesOffset.y, decoding.textureCoordinatesScale.y);
+        EncodeOctahedral(vertex.nx, vertex.ny, vertex.nz, result.nx, result.ny);
+        return result;
+    }
+
+    // Same math as simple.vert, the normal comes back unit length
+    static Vertex Decode(const CompressedVertex& vertex, const VertexDecoding& decoding)
+    {
+        Vertex result;
+        result.x = decoding.positionOffset.x + vertex.x / UnormMax * decoding.positionScale.x;
+        result.y = decoding.positionOffset.y + vertex.y / UnormMax * decoding.positionScale.y;
+        result.z = decoding.positionOffset.z + vertex.z / UnormMax * decoding.positionScale.z;
+        result.tx = decoding.textureCoordinatesOffset.x + vertex.tx / UnormMax * decoding.textureCoordinatesScale.x;
+        result.ty = decoding.textureCoordinatesOffset.y + vertex.ty / UnormMax * decoding.textureCoordinatesScale.y;
+        DecodeOctahedral(vertex.nx, vertex.ny, result.nx, result.ny, result.nz);
+        return result;
+    }
+
+    static void DecodeOctahedral(std::int16_t ex, std::int16_t ey, float& nx, float& ny, float& nz)
+    {
+        float x = std::max(ex / SnormMax, -1.0f);
+        float y = std::max(ey / SnormMax, -1.0f);
+        float z = 1.0f - std::abs(x) - std::abs(y);
+        float t = std::max(-z, 0.0f);
+        x += x >= 0.0f ? -t : t;
+        y += y >= 0.0f ? -t : t;
+        float length = std::sqrt(x * x + y * y + z * z);
+        nx = x / length;
+        ny = y / length;
+        nz = z / length;
+    }
+
+    // Projects onto the octahedron, folds the lower half over and then picks whichever of the four
+    // neighbouring 16-bit codes decodes closest to the input instead of plain rounding
+    static void EncodeOctahedral(float nx, float ny, float nz, std::int16_t& ex, std::int16_t& ey)
+    {
+        float length = std::abs(nx) + std::abs(ny) + std::abs(nz);
+        if (length == 0.0f)
+        {
+            ex = 0;
+            ey = static_cast<std::int16_t>(SnormMax);
+            return;
+        }
+
+        float x = nx / length;
+        float y = ny / length;
+        if (nz < 0.0f)
+        {
+            float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = foldedX;
+            y = foldedY;
+        }
+
+        // Candidates differ in the 8th decimal, so compare them in double precision
+        double bestDot = -2.0;
+        for (int i = 0; i < 4; ++i)
+        {
+            auto candidateX = static_cast<std::int16_t>(std::clamp((i & 1 ? std::ceil(x * SnormMax) : std::floor(x * SnormMax)), -SnormMax, SnormMax));
+            auto candidateY = static_cast<std::int16_t>(std::clamp((i & 2 ? std::ceil(y * SnormMax) : std::floor(y * SnormMax)), -SnormMax, SnormMax));
+            float dx, dy, dz;
+            DecodeOctahedral(candidateX, candidateY, dx, dy, dz);
+            double candidateDot = double(dx) * nx + double(dy) * ny + double(dz) * nz;
+            if (candidateDot > bestDot)
+            {
+                bestDot = candidateDot;
+                ex = candidateX;
+                ey = candidateY;
+            }
+        }
+    }
+
+private:
+    static std::uint16_t QuantizeUnorm(float value, float offset, float scale)
+    {
+        if (scale <= 0.0f)
+        {
+            return 0;
+        }
+        float normalized = std::clamp((value - offset) / scale, 0.0f, 1.0f);
+        return static_cast<std::uint16_t>(std::lround(normalized * UnormMax));
+    }
+};
+
+inline Mesh CreateMesh(const CompressedModelInfo& modelInfo)
+{
+    Mesh result;
+    result.indicesSize = static_cast<int>(modelInfo.indices.size());
+    result.decoding = modelInfo.decoding;
+
+    glCreateVertexArrays(1, &result.vao);
+    glBindVertexArray(result.vao);
+
+    glCreateBuffers(1, &result.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, result.vbo);
+    glBufferData(GL_ARRAY_BUFFER, modelInfo.vertices.size() * sizeof(CompressedVertex), modelInfo.vertices.data(), GL_STATIC_DRAW);
+
+    // Normalized integer attributes arrive in the shader as [0, 1] and [-1, 1] floats
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompressedVertex), (void*)offsetof(CompressedVertex, x));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompressedVertex), (void*)offsetof(CompressedVertex, nx));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompressedVertex), (void*)offsetof(CompressedVertex, tx));
+
+    glCreateBuffers(1, &result.ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, result.ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, modelInfo.indices.size() * sizeof(unsigned int), modelInfo.indices.data(), GL_STATIC_DRAW);
+
+    return result;
+}
@@ -1,10 +1,20 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <string_view>
+#include <thread>
+#include <unordered_map>
 
 #include "GL/glew.h"
 #include "spdlog/spdlog.h"
 
+#include "BoundedQueue.h"
+
 inline std::string_view GetGlErrorSource(GLenum code)
 {
     switch (code)
@@ -36,26 +46,33 @@ inline std::string_view GetGlErrorType(GLenum code)
     return "Type:Unknown";
 }
 
+// Formats on the driver's call stack and stops in the debugger on errors, only for GLDebugSettings::synchronous
 inline void GLDebugMessageCallback(GLenum source, GLenum type, unsigned int id, GLenum severity, GLsizei length, const char* message, const void* userParam)
 {
+    bool breakOnErrors = userParam != nullptr && *static_cast<const bool*>(userParam);
     switch (severity)
     {
     case GL_DEBUG_SEVERITY_HIGH:
     {
         spdlog::critical("GL ERROR [{}] {} {}: {}", id, GetGlErrorSource(source), GetGlErrorType(type), message);
-        __debugbreak();
+        if (breakOnErrors)
+        {
+            __debugbreak();
+        }
         break;
     }
     case GL_DEBUG_SEVERITY_MEDIUM:
     {
         spdlog::error("GL ERROR [{}] {} {}: {}", id, GetGlErrorSource(source), GetGlErrorType(type), message);
-        __debugbreak();
+        if (breakOnErrors)
+        {
+            __debugbreak();
+        }
         break;
     }
     case GL_DEBUG_SEVERITY_LOW:
     {
         spdlog::warn("GL WARN [{}] {} {}: {}", id, GetGlErrorSource(source), GetGlErrorType(type), message);
-        __debugbreak();
         break;
     }
     case GL_DEBUG_SEVERITY_NOTIFICATION:
@@ -65,3 +82,237 @@ inline void GLDebugMessageCallback(GLenum source, GLenum type, unsigned int id,
     }
     }
 }
+
+struct GLDebugSettings
+{
+    // Messages are logged on the driver's call stack in call order, so a breakpoint shows the offending GL call
+    bool synchronous = false;
+    // Synchronous only, HIGH and MEDIUM severity stop in the debugger
+    bool breakOnErrors = false;
+    // Per source, type and ID, the rest of the window is counted and reported as one line
+    int messagesPerWindow = 5;
+    std::chrono::milliseconds window{ 1000 };
+};
+
+// Fixed size so the driver thread only copies, messages are cut to fit
+struct GLDebugMessage
+{
+    static constexpr std::size_t MaxTextLength = 244;
+
+    std::uint32_t id;
+    std::uint16_t source;
+    std::uint16_t type;
+    std::uint16_t severity;
+    std::uint16_t length;
+    char text[MaxTextLength];
+};
+
+static_assert(sizeof(GLDebugMessage) == 256);
+
+struct GLDebugOutputStats
+{
+    std::uint64_t received = 0;
+    // The queue was full, the logger fell behind
+    std::uint64_t dropped = 0;
+    std::uint64_t logged = 0;
+    // Over the per window limit of their ID
+    std::uint64_t suppressed = 0;
+};
+
+// The callback copies each message into a lock-free queue and returns, a background thread drains it,
+// limits how often one message is repeated and does the formatting and logging. Notifications are dropped
+// in the callback like before.
+struct GLDebugOutput
+{
+    static constexpr std::size_t QueueCapacity = 1024;
+
+    GLDebugSettings settings;
+
+    GLDebugOutput() = default;
+
+    GLDebugOutput(const GLDebugOutput&) = delete;
+    GLDebugOutput& operator=(const GLDebugOutput&) = delete;
+
+    ~GLDebugOutput()
+    {
+        StopLogger();
+    }
+
+    // Needs a current context created with GLFW_OPENGL_DEBUG_CONTEXT
+    void Install(const GLDebugSettings& debugSettings)
+    {
+        settings = debugSettings;
+        glEnable(GL_DEBUG_OUTPUT);
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+        if (settings.synchronous)
+        {
+            glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+            glDebugMessageCallback(GLDebugMessageCallback, &settings.breakOnErrors);
+            return;
+        }
+        glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        StartLogger();
+        glDebugMessageCallback(Enqueue, this);
+    }
+
+    // Logs everything still queued
+    void Uninstall()
+    {
+        glDebugMessageCallback(nullptr, nullptr);
+        glDisable(GL_DEBUG_OUTPUT);
+        StopLogger();
+    }
+
+    void StartLogger()
+    {
+        stopRequested = false;
+        logger = std::thread([this] { Drain(); });
+    }
+
+    void StopLogger()
+    {
+        stopRequested = true;
+        if (logger.joinable())
+        {
+            logger.join();
+        }
+    }
+
+    // Called by the driver on any of its threads, also usable directly without a context
+    static void Enqueue(GLenum source, GLenum type, unsigned int id, GLenum severity, GLsizei length, const char* message, const void* userParam)
+    {
+        if (severity == GL_DEBUG_SEVERITY_NOTIFICATION)
+        {
+            return;
+        }
+        auto output = static_cast<GLDebugOutput*>(const_cast<void*>(userParam));
+        output->received.fetch_add(1, std::memory_order_relaxed);
+
+        GLDebugMessage record;
+        record.id = id;
+        record.source = static_cast<std::uint16_t>(source);
+        record.type = static_cast<std::uint16_t>(type);
+        record.severity = static_cast<std::uint16_t>(severity);
+        std::size_t textLength = length >= 0 ? static_cast<std::size_t>(length) : std::strlen(message);
+        record.length = static_cast<std::uint16_t>(std::min(textLength, GLDebugMessage::MaxTextLength));
+        std::memcpy(record.text, message, record.length);
+        if (!output->queue.TryPush(record))
+        {
+            output->dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Exact once the logger has stopped
+    GLDebugOutputStats Stats() const
+    {
+        GLDebugOutputStats result;
+        result.received = received.load(std::memory_order_relaxed);
+        result.dropped = dropped.load(std::memory_order_relaxed);
+        result.logged = logged.load(std::memory_order_relaxed);
+        result.suppressed = suppressed.load(std::memory_order_relaxed);
+        return result;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct RateLimit
+    {
+        Clock::time_point windowStart;
+        int count = 0;
+        std::uint64_t suppressed = 0;
+    };
+
+    BoundedQueue<GLDebugMessage> queue{ QueueCapacity };
+    std::atomic<std::uint64_t> received{ 0 };
+    std::atomic<std::uint64_t> dropped{ 0 };
+    std::atomic<std::uint64_t> logged{ 0 };
+    std::atomic<std::uint64_t> suppressed{ 0 };
+    std::atomic<bool> stopRequested{ false };
+    std::thread logger;
+    // Logger thread only
+    std::unordered_map<std::uint64_t, RateLimit> rateLimits;
+
+    void Drain()
+    {
+        constexpr auto IdleSleep = std::chrono::milliseconds(2);
+        GLDebugMessage message;
+        auto lastFlush = Clock::now();
+        for (;;)
+        {
+            // Read before popping, so nothing pushed before the stop request is left behind
+            bool stopping = stopRequested.load();
+            bool popped = false;
+            while (queue.TryPop(message))
+            {
+                Log(message, Clock::now());
+                popped = true;
+            }
+
+            auto now = Clock::now();
+            if (stopping || now - lastFlush >= settings.window)
+            {
+                FlushSuppressed(now, stopping);
+                lastFlush = now;
+            }
+            if (stopping)
+            {
+                return;
+            }
+            if (!popped)
+            {
+                std::this_thread::sleep_for(IdleSleep);
+            }
+        }
+    }
+
+    void Log(const GLDebugMessage& message, Clock::time_point now)
+    {
+        std::uint64_t key = static_cast<std::uint64_t>(message.id) << 32 | static_cast<std::uint64_t>(message.source) << 16 | message.type;
+        RateLimit& limit = rateLimits[key];
+        if (limit.count == 0 || now - limit.windowStart >= settings.window)
+        {
+            ReportSuppressed(message.id, limit);
+            limit.windowStart = now;
+            limit.count = 0;
+        }
+        if (++limit.count > settings.messagesPerWindow)
+        {
+            ++limit.suppressed;
+            suppressed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        std::string_view text{ message.text, message.length };
+        auto source = GetGlErrorSource(message.source);
+        auto type = GetGlErrorType(message.type);
+        switch (message.severity)
+        {
+        case GL_DEBUG_SEVERITY_HIGH: spdlog::critical("GL ERROR [{}] {} {}: {}", message.id, source, type, text); break;
+        case GL_DEBUG_SEVERITY_MEDIUM: spdlog::error("GL ERROR [{}] {} {}: {}", message.id, source, type, text); break;
+        default: spdlog::warn("GL WARN [{}] {} {}: {}", message.id, source, type, text); break;
+        }
+        logged.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Windows that ended, or all of them when stopping
+    void FlushSuppressed(Clock::time_point now, bool all)
+    {
+        for (auto& [key, limit] : rateLimits)
+        {
+            if (all || now - limit.windowStart >= settings.window)
+            {
+                ReportSuppressed(static_cast<std::uint32_t>(key >> 32), limit);
+            }
+        }
+    }
+
+    static void ReportSuppressed(std::uint32_t id, RateLimit& limit)
+    {
+        if (limit.suppressed > 0)
+        {
+            spdlog::warn("GL [{}] repeated {} more times", id, limit.suppressed);
+            limit.suppressed = 0;
+        }
+    }
+};
@@ -5,31 +5,17 @@
 #include "Camera.h"
 #include "WindowUtil.h"
 
+// One per camera, the cursor position of the previous sample is the controller's own
 struct FPSCameraController
 {
-    static void UpdateFPSCamera(Camera& camera, GLFWwindow* window, float dt)
-    {
-        static CursorPosition prev = CursorPosition::Current(window);
-        CursorPosition current = CursorPosition::Current(window);
-
-        float diffPitch = prev.y - current.y;
-        float diffYaw = current.x - prev.x;
+    float lookSpeed = 5.0f;
+    float moveSpeed = 5.0f;
 
-        float pitch = diffPitch * 5.0f * dt;
-        float yaw = diffYaw * 5.0f * dt;
-
-        camera.yawDegrees += yaw;
-        camera.pitchDegrees += pitch;
-        if (camera.pitchDegrees > 89.0f)
-        {
-            camera.pitchDegrees = 89.0f;
-        }
-        if (camera.pitchDegrees < -89.0f)
-        {
-            camera.pitchDegrees = -89.0f;
-        }
-
-        prev = current;
+    // Turns and moves the camera with this frame's input, returns when the cursor was sampled
+    double Update(Camera& camera, GLFWwindow* window, float dt)
+    {
+        frameDt = dt;
+        Look(camera, window);
 
         glm::vec3 moveVector{ 0 };
         if (GLFWKeyIsPressed(window, GLFW_KEY_W))
@@ -59,13 +45,58 @@ struct FPSCameraController
 
         if (!IsZeroLength(moveVector))
         {
-            camera.position += glm::normalize(moveVector) * 5.0f * dt;
+            camera.position += glm::normalize(moveVector) * moveSpeed * dt;
         }
 
         camera.SyncDirectionVectors();
+        return previous.time;
+    }
+
+    // Call right before the frame's view dependent work is submitted: pumps the events again and applies
+    // the cursor movement since Update, so the view matrix carries the newest input. Only looking is late
+    // latched, translation over a few milliseconds is not noticeable where rotation is.
+    double LateLatch(Camera& camera, GLFWwindow* window)
+    {
+        glfwPollEvents();
+        Look(camera, window);
+        camera.SyncDirectionVectors();
+        return previous.time;
     }
 
 private:
+    CursorPosition previous;
+    bool hasPrevious = false;
+    float frameDt = 0.0f;
+
+    void Look(Camera& camera, GLFWwindow* window)
+    {
+        CursorPosition current = CursorPosition::Current(window);
+        if (!hasPrevious)
+        {
+            previous = current;
+            hasPrevious = true;
+        }
+
+        float diffPitch = previous.y - current.y;
+        float diffYaw = current.x - previous.x;
+
+        float pitch = diffPitch * lookSpeed * frameDt;
+        float yaw = diffYaw * lookSpeed * frameDt;
+
+        camera.yawDegrees += yaw;
+        camera.pitchDegrees += pitch;
+        if (camera.pitchDegrees > 89.0f)
+        {
+            camera.pitchDegrees = 89.0f;
+        }
+        if (camera.pitchDegrees < -89.0f)
+        {
+            camera.pitchDegrees = -89.0f;
+        }
+
+        previous = current;
+    }
+
     static bool IsZeroLength(const glm::vec3& v)
     {
         return v.x == 0.0f && v.y == 0.0f && v.z == 0.0f;
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include <emmintrin.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include "glm/glm.hpp"
+
+#include "WorkerPool.h"
+
+// Planes point inwards, a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all six
+struct FrustumPlanes
+{
+    std::array<glm::vec4, 6> planes;
+
+    // Gribb and Hartmann: the planes are sums and differences of the rows of the clip matrix, which works for
+    // perspective and orthographic projections alike. Pass projection * worldToCamera to get world space planes.
+    static FrustumPlanes FromMatrix(const glm::mat4& matrix)
+    {
+        auto row = [&matrix](int i) {
+            return glm::vec4{ matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i] };
+        };
+
+        FrustumPlanes result;
+        result.planes = { row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(3) + row(2), row(3) - row(2) };
+        for (auto& plane : result.planes)
+        {
+            float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+            plane = plane * (1.0f / length);
+        }
+        return result;
+    }
+};
+
+// Structure of arrays so four or eight objects load with one instruction per component
+struct BoundingSphereArray
+{
+    std::vector<float> centerX, centerY, centerZ, radius;
+
+    std::size_t Size() const
+    {
+        return radius.size();
+    }
+
+    void Resize(std::size_t size)
+    {
+        centerX.resize(size);
+        centerY.resize(size);
+        centerZ.resize(size);
+        radius.resize(size);
+    }
+};
+
+// Axis aligned boxes as center and half extent
+struct BoundingBoxArray
+{
+    std::vector<float> centerX, centerY, centerZ, extentX, extentY, extentZ;
+
+    std::size_t Size() const
+    {
+        return centerX.size();
+    }
+
+    void Resize(std::size_t size)
+    {
+        centerX.resize(size);
+        centerY.resize(size);
+        centerZ.resize(size);
+        extentX.resize(size);
+        extentY.resize(size);
+        extentZ.resize(size);
+    }
+};
+
+// Writes the indices of the visible objects in ascending order and returns how many there are. The output must
+// have room for end - begin indices. Objects touching a plane count as visible.
+struct FrustumCulling
+{
+#if defined(__AVX__)
+    static constexpr int Width = 8;
+#else
+    static constexpr int Width = 4;
+#endif
+
+    // Same operation order as the SIMD paths, so both give identical results
+    static std::size_t CullSpheresScalar(const FrustumPlanes& frustum, const BoundingSphereArray& spheres, std::size_t begin, std::size_t end, std::uint32_t* visible)
+    {
+        std::size_t count = 0;
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            bool inside = true;
+            for (auto& plane : frustum.planes)
+            {
+                float distance = (plane.x * spheres.centerX[i] + plane.y * spheres.centerY[i]) + (plane.z * spheres.centerZ[i] + plane.w);
+                inside = inside && distance >= -spheres.radius[i];
+            }
+            if (inside)
+            {
+                visible[count++] = static_cast<std::uint32_t>(i);
+            }
+        }
+        return count;
+    }
+
+    static std::size_t CullBoxesScalar(const FrustumPlanes& frustum, const BoundingBoxArray& boxes, std::size_t begin, std::size_t end, std::uint32_t* visible)
+    {
+        std::size_t count = 0;
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            bool inside = true;
+            for (auto& plane : frustum.planes)
+            {
+                float distance = (plane.x * boxes.centerX[i] + plane.y * boxes.centerY[i]) + (plane.z * boxes.centerZ[i] + plane.w);
+                float projectedExtent = std::abs(plane.x) * boxes.extentX[i] + std::abs(plane.y) * boxes.extentY[i] + std::abs(plane.z) * boxes.extentZ[i];
+                inside = inside && distance >= -projectedExtent;
+            }
+            if (inside)
+            {
+                visible[count++] = static_cast<std::uint32_t>(i);
+            }
+        }
+        return count;
+    }
+
+    static std::size_t CullSpheres(const FrustumPlanes& frustum, const BoundingSphereArray& spheres, std::size_t begin, std::size_t end, std::uint32_t* visible)
+    {
+        const std::size_t simdEnd = begin + (end - begin) / Width * Width;
+        std::size_t count = 0;
+        for (std::size_t i = begin; i < simdEnd; i += Width)
+        {
+            Float x = Load(&spheres.centerX[i]);
+            Float y = Load(&spheres.centerY[i]);
+            Float z = Load(&spheres.centerZ[i]);
+            Float negativeRadius = Negate(Load(&spheres.radius[i]));
+
+            Float inside = AllOnes();
+            for (auto& plane : frustum.planes)
+            {
+                Float distance = Add(Add(Mul(Broadcast(plane.x), x), Mul(Broadcast(plane.y), y)), Add(Mul(Broadcast(plane.z), z), Broadcast(plane.w)));
+                inside = And(inside, GreaterEqual(distance, negativeRadius));
+            }
+            count += Compact(MoveMask(inside), i, visible + count);
+        }
+        return count + CullSpheresScalar(frustum, spheres, simdEnd, end, visible + count);
+    }
+
+    static std::size_t CullBoxes(const FrustumPlanes& frustum, const BoundingBoxArray& boxes, std::size_t begin, std::size_t end, std::uint32_t* visible)
+    {
+        const std::size_t simdEnd = begin + (end - begin) / Width * Width;
+        std::size_t count = 0;
+        for (std::size_t i = begin; i < simdEnd; i += Width)
+        {
+            Float x = Load(&boxes.centerX[i]);
+            Float y = Load(&boxes.centerY[i]);
+            Float z = Load(&boxes.centerZ[i]);
+            Float ex = Load(&boxes.extentX[i]);
+            Float ey = Load(&boxes.extentY[i]);
+            Float ez = Load(&boxes.extentZ[i]);
+
+            Float inside = AllOnes();
+            for (auto& plane : frustum.planes)
+            {
+                Float distance = Add(Add(Mul(Broadcast(plane.x), x), Mul(Broadcast(plane.y), y)), Add(Mul(Broadcast(plane.z), z), Broadcast(plane.w)));
+                Float projectedExtent = Add(Add(Mul(Broadcast(std::abs(plane.x)), ex), Mul(Broadcast(std::abs(plane.y)), ey)), Mul(Broadcast(std::abs(plane.z)), ez));
+                inside = And(inside, GreaterEqual(distance, Negate(projectedExtent)));
+            }
+            count += Compact(MoveMask(inside), i, visible + count);
+        }
+        return count + CullBoxesScalar(frustum, boxes, simdEnd, end, visible + count);
+    }
+
+    // Splits the array into one contiguous range per pool thread, the result keeps ascending order
+    template<typename Bounds, typename CullFunction>
+    static std::size_t CullParallel(WorkerPool& workers, const FrustumPlanes& frustum, const Bounds& bounds, CullFunction cull, std::vector<std::uint32_t>& visible)
+    {
+        const std::size_t size = bounds.Size();
+        visible.resize(size);
+        const int rangeCount = std::max(1, std::min<int>(workers.ThreadCount(), static_cast<int>(size / MinObjectsPerRange) + 1));
+        if (rangeCount == 1)
+        {
+            std::size_t count = cull(frustum, bounds, 0, size, visible.data());
+            visible.resize(count);
+            return count;
+        }
+
+        // Each range writes at its own start, then the ranges are moved together
+        std::vector<std::size_t> begins(rangeCount + 1);
+        for (int t = 0; t <= rangeCount; ++t)
+        {
+            begins[t] = size * t / rangeCount / Width * Width;
+        }
+        begins[rangeCount] = size;
+
+        std::vector<std::size_t> counts(rangeCount);
+        workers.ParallelFor(rangeCount, [&](std::size_t t) { counts[t] = cull(frustum, bounds, begins[t], begins[t + 1], visible.data() + begins[t]); });
+
+        std::size_t count = counts[0];
+        for (int t = 1; t < rangeCount; ++t)
+        {
+            // Ranges only move down, the destination may overlap the source but never starts inside it
+            if (count != begins[t])
+            {
+                std::copy(visible.begin() + begins[t], visible.begin() + begins[t] + counts[t], visible.begin() + count);
+            }
+            count += counts[t];
+        }
+        visible.resize(count);
+        return count;
+    }
+
+private:
+    // Below this handing a range to a worker costs more than it saves
+    static constexpr std::size_t MinObjectsPerRange = 16384;
+
+#if defined(__AVX__)
+    using Float = __m256;
+    static Float Load(const float* values) { return _mm256_loadu_ps(values); }
+    static Float Broadcast(float value) { return _mm256_set1_ps(value); }
+    static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static Float And(Float a, Float b) { return _mm256_and_ps(a, b); }
+    static Float Negate(Float a) { return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f)); }
+    static Float GreaterEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+    static Float AllOnes() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+    static int MoveMask(Float a) { return _mm256_movemask_ps(a); }
+#else
+    using Float = __m128;
+    static Float Load(const float* values) { return _mm_loadu_ps(values); }
+    static Float Broadcast(float value) { return _mm_set1_ps(value); }
+    static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+    static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    static Float And(Float a, Float b) { return _mm_and_ps(a, b); }
+    static Float Negate(Float a) { return _mm_xor_ps(a, _mm_set1_ps(-0.0f)); }
+    static Float GreaterEqual(Float a, Float b) { return _mm_cmpge_ps(a, b); }
+    static Float AllOnes() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+    static int MoveMask(Float a) { return _mm_movemask_ps(a); }
+#endif
+
+    static std::size_t Compact(int mask, std::size_t first, std::uint32_t* visible)
+    {
+        std::size_t count = 0;
+        for (int lane = 0; lane < Width; ++lane)
+        {
+            visible[count] = static_cast<std::uint32_t>(first + lane);
+            count += (mask >> lane) & 1;
+        }
+        return count;
+    }
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "RingBuffer.h"
+
+struct LatencyPercentiles
+{
+    std::size_t count = 0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+
+    // Nearest rank, every reported value is one that was measured
+    static LatencyPercentiles Compute(std::vector<double> samples)
+    {
+        LatencyPercentiles result;
+        result.count = samples.size();
+        if (samples.empty())
+        {
+            return result;
+        }
+        std::sort(samples.begin(), samples.end());
+        auto rank = [&samples](double percentile) {
+            auto index = static_cast<std::size_t>(std::ceil(percentile / 100.0 * samples.size()));
+            return samples[std::max<std::size_t>(index, 1) - 1];
+        };
+        result.p50 = rank(50.0);
+        result.p90 = rank(90.0);
+        result.p99 = rank(99.0);
+        result.max = samples.back();
+        return result;
+    }
+};
+
+// Milliseconds from the input a frame's view was built from to two points after it: swap buffers returning,
+// and the GPU having executed the frame. The second is a fence polled once per frame, so it is late by up to
+// one poll interval and an upper bound of when the image could be presented.
+template<typename FenceBackend>
+struct LatencyTracker
+{
+    using Fence = typename FenceBackend::Fence;
+
+    FenceBackend fences;
+    std::vector<double> presentMilliseconds;
+    std::vector<double> completionMilliseconds;
+
+    // Right after glfwSwapBuffers, times in seconds as glfwGetTime returns them
+    void FramePresented(double inputTime, double presentTime)
+    {
+        presentMilliseconds.push_back((presentTime - inputTime) * 1000.0);
+        pendingFrames.push_back({ inputTime, fences.Insert() });
+    }
+
+    // Once per frame, records every frame the GPU finished since the last poll
+    void Poll(double now)
+    {
+        while (!pendingFrames.empty() && fences.IsSignaled(pendingFrames.front().fence))
+        {
+            completionMilliseconds.push_back((now - pendingFrames.front().inputTime) * 1000.0);
+            fences.Delete(pendingFrames.front().fence);
+            pendingFrames.pop_front();
+        }
+    }
+
+    void Release()
+    {
+        for (auto& frame : pendingFrames)
+        {
+            fences.Delete(frame.fence);
+        }
+        pendingFrames.clear();
+    }
+
+private:
+    struct PendingFrame
+    {
+        double inputTime;
+        Fence fence;
+    };
+
+    std::deque<PendingFrame> pendingFrames;
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+#include <vector>
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+
+#include "Shader.h"
+
+struct Vertex
+{
+    float x, y, z;
+    float nx, ny, nz;
+    float tx, ty;
+};
+
+// How simple.vert turns the stored attributes back into positions, normals and texture coordinates
+struct VertexDecoding
+{
+    bool compressed = false;
+    glm::vec3 positionOffset{ 0.0f };
+    glm::vec3 positionScale{ 1.0f };
+    glm::vec2 textureCoordinatesOffset{ 0.0f };
+    glm::vec2 textureCoordinatesScale{ 1.0f };
+};
+
+struct Mesh
+{
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ibo = 0;
+    int indicesSize = 0;
+    VertexDecoding decoding;
+};
+
+struct ModelInfo
+{
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+};
+
+// Vertices and indices may point straight into a mapped asset pack, they are uploaded without a copy
+inline Mesh CreateMesh(const Vertex* vertices, std::size_t vertexCount, const unsigned int* indices, std::size_t indexCount)
+{
+    Mesh result;
+    result.indicesSize = static_cast<int>(indexCount);
+
+    glCreateVertexArrays(1, &result.vao);
+    glBindVertexArray(result.vao);
+
+    glCreateBuffers(1, &result.vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, result.vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices, GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(float) * 3));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(float) * 6));
+
+    glCreateBuffers(1, &result.ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, result.ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+
+    return result;
+}
+
+inline Mesh CreateMesh(const ModelInfo& modelInfo)
+{
+    return CreateMesh(modelInfo.vertices.data(), modelInfo.vertices.size(), modelInfo.indices.data(), modelInfo.indices.size());
+}
+
+inline void DestroyMesh(Mesh& mesh)
+{
+    glDeleteBuffers(1, &mesh.ibo);
+    glDeleteBuffers(1, &mesh.vbo);
+    glDeleteVertexArrays(1, &mesh.vao);
+    mesh = {};
+}
+
+inline ModelInfo GeneratePyramid(int height, int radius, int edges)
+{
+    ModelInfo info;
+    /*info.vertices.push_back({  0.0f,  1.0f, 3.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f });
+    info.vertices.push_back({ -1.0f, -1.0f, 3.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f });
+    info.vertices.push_back({  1.0f, -1.0f, 3.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f });
+    info.indices = { 0, 1, 2 };*/
+
+    std::vector<glm::vec3> circle;
+
+    float angleStep = 360.0f / edges;
+    for (float angle = 0.0f; angle < 360.0f; angle += angleStep)
+    {
+        float r = glm::radians(angle);
+        circle.push_back({ radius * cos(r), 0.0f, radius * sin(r) });
+    }
+
+    for (int i = 1; i < circle.size() - 1; ++i)
+    {
+        const auto& p1 = circle[0];
+        const auto& p2 = circle[i];
+        const auto& p3 = circle[i + 1];
+
+        const auto n = glm::cross(p2 - p1, p3 - p1);
+
+        int current = static_cast<int>(info.vertices.size());
+
+        info.vertices.push_back({ p1.x, -height / 2.0f, p1.z, n.x, n.y, n.z, 0.0f, 0.0f });
+        info.vertices.push_back({ p3.x, -height / 2.0f, p3.z, n.x, n.y, n.z, 1.0f, 1.0f });
+        info.vertices.push_back({ p2.x, -height / 2.0f, p2.z, n.x, n.y, n.z, 1.0f, 0.0f });
+
+        info.indices.push_back(current);
+        info.indices.push_back(current + 1);
+        info.indices.push_back(current + 2);
+    }
+
+    auto top = glm::vec3{ 0.0f, height / 2.0f, 0.0f };
+
+    auto addEdge = [&](int i, int j)
+    {
+        const auto& p2 = circle[i];
+        const auto& p3 = circle[j];
+
+        const auto n = glm::cross(p3 - top, p2 - top);
+
+        int current = static_cast<int>(info.vertices.size());
+
+        info.vertices.push_back({ top.x, top.y, top.z, n.x, n.y, n.z, 0.0f, 0.0f });
+        info.vertices.push_back({ p2.x, -height / 2.0f, p2.z, n.x, n.y, n.z, 1.0f, 0.0f });
+        info.vertices.push_back({ p3.x, -height / 2.0f, p3.z, n.x, n.y, n.z, 1.0f, 1.0f });
+
+        info.indices.push_back(current);
+        info.indices.push_back(current + 1);
+        info.indices.push_back(current + 2);
+    };
+
+    for (int i = 0; i < circle.size() - 1; ++i)
+    {
+        addEdge(i, i + 1);
+    }
+    addEdge(static_cast<int>(circle.size() - 1), 0);
+
+    return info;
+}
+
+// Runs for every draw, so the locations come from the table reflected at link time
+inline void SetVertexDecodingUniforms(const UniformTable& uniforms, const VertexDecoding& decoding)
+{
+    uniforms.Set("compressedVertices", decoding.compressed);
+    uniforms.Set("positionOffset", decoding.positionOffset);
+    uniforms.Set("positionScale", decoding.positionScale);
+    uniforms.Set("textureCoordinatesOffset", decoding.textureCoordinatesOffset);
+    uniforms.Set("textureCoordinatesScale", decoding.textureCoordinatesScale);
+}
+
+inline void DrawMesh(const Mesh& mesh)
+{
+    glBindVertexArray(mesh.vao);
+    glDrawElements(GL_TRIANGLES, mesh.indicesSize, GL_UNSIGNED_INT, nullptr);
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+
+#include "Mesh.h"
+#include "RingBuffer.h"
+
+// Per instance attributes read by instanced.vert, locations 3-6 are the matrix columns and 7 the texture layer
+struct InstanceData
+{
+    glm::mat4 modelMatrix;
+    // x is the texture array layer, the rest pads to 16 bytes
+    glm::vec4 textureLayer;
+};
+
+static_assert(sizeof(InstanceData) == 80);
+
+struct BatchInstance
+{
+    std::uint32_t mesh;
+    std::uint32_t textureLayer;
+    glm::mat4 modelMatrix;
+};
+
+// Layout glMultiDrawElementsIndirect reads
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+enum class BatchDrawMode
+{
+    // One glDrawElementsInstancedBaseVertexBaseInstance per mesh with visible instances
+    Instanced,
+    // One glMultiDrawElementsIndirect for the whole batch
+    MultiDrawIndirect
+};
+
+struct BatchStats
+{
+    std::uint64_t instances = 0;
+    std::uint64_t drawCalls = 0;
+};
+
+// Many meshes in one vertex and one index buffer, drawn with per instance transforms from a ring buffer.
+// Every mesh keeps its own index range and base vertex, so the only state shared by the whole batch is the
+// vertex array, the program and the texture array.
+struct MeshBatch
+{
+    static constexpr GLuint VertexBinding = 0;
+    static constexpr GLuint InstanceBinding = 1;
+
+    struct MeshRange
+    {
+        GLuint firstIndex;
+        GLuint indexCount;
+        GLint baseVertex;
+    };
+
+    GLuint vao = 0;
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    std::vector<MeshRange> meshes;
+
+    static MeshBatch Create(const std::vector<ModelInfo>& models)
+    {
+        MeshBatch result;
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        for (auto& model : models)
+        {
+            result.meshes.push_back({ static_cast<GLuint>(indices.size()), static_cast<GLuint>(model.indices.size()), static_cast<GLint>(vertices.size()) });
+            vertices.insert(vertices.end(), model.vertices.begin(), model.vertices.end());
+            indices.insert(indices.end(), model.indices.begin(), model.indices.end());
+        }
+
+        glCreateBuffers(1, &result.vertexBuffer);
+        glNamedBufferStorage(result.vertexBuffer, vertices.size() * sizeof(Vertex), vertices.data(), 0);
+        glCreateBuffers(1, &result.indexBuffer);
+        glNamedBufferStorage(result.indexBuffer, indices.size() * sizeof(unsigned int), indices.data(), 0);
+
+        glCreateVertexArrays(1, &result.vao);
+        glVertexArrayVertexBuffer(result.vao, VertexBinding, result.vertexBuffer, 0, sizeof(Vertex));
+        glVertexArrayElementBuffer(result.vao, result.indexBuffer);
+        const GLint sizes[3] = { 3, 3, 2 };
+        const GLuint offsets[3] = { offsetof(Vertex, x), offsetof(Vertex, nx), offsetof(Vertex, tx) };
+        for (GLuint attribute = 0; attribute < 3; ++attribute)
+        {
+            EnableAttribute(result.vao, attribute, sizes[attribute], offsets[attribute], VertexBinding);
+        }
+
+        // The instance buffer is bound per draw, it lives in the frame's ring buffer region
+        for (GLuint column = 0; column < 4; ++column)
+        {
+            EnableAttribute(result.vao, 3 + column, 4, static_cast<GLuint>(offsetof(InstanceData, modelMatrix) + column * sizeof(glm::vec4)), InstanceBinding);
+        }
+        EnableAttribute(result.vao, 7, 1, offsetof(InstanceData, textureLayer), InstanceBinding);
+        glVertexArrayBindingDivisor(result.vao, InstanceBinding, 1);
+        return result;
+    }
+
+    void Destroy()
+    {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vertexBuffer);
+        glDeleteBuffers(1, &indexBuffer);
+        *this = {};
+    }
+
+    // Groups the instances by mesh, writes them and the draw commands into the ring and issues the draws.
+    // The caller binds the program and the texture array.
+    bool Draw(PersistentRingBuffer& ring, const std::vector<BatchInstance>& instances, BatchDrawMode mode, BatchStats& stats)
+    {
+        if (instances.empty())
+        {
+            return true;
+        }
+
+        // Counting sort by mesh, instances of one mesh end up contiguous starting at their baseInstance
+        counts.assign(meshes.size(), 0);
+        for (auto& instance : instances)
+        {
+            ++counts[instance.mesh];
+        }
+        firstInstances.resize(meshes.size());
+        GLuint first = 0;
+        for (std::size_t mesh = 0; mesh < meshes.size(); ++mesh)
+        {
+            firstInstances[mesh] = first;
+            first += counts[mesh];
+        }
+
+        PersistentRingBuffer::Allocation instanceAllocation;
+        if (!ring.Allocate(instances.size() * sizeof(InstanceData), 16, instanceAllocation))
+        {
+            return false;
+        }
+        auto instanceData = static_cast<InstanceData*>(instanceAllocation.data);
+        cursors = firstInstances;
+        for (auto& instance : instances)
+        {
+            InstanceData& data = instanceData[cursors[instance.mesh]++];
+            data.modelMatrix = instance.modelMatrix;
+            data.textureLayer = glm::vec4(static_cast<float>(instance.textureLayer), 0.0f, 0.0f, 0.0f);
+        }
+
+        commands.clear();
+        for (std::size_t mesh = 0; mesh < meshes.size(); ++mesh)
+        {
+            if (counts[mesh] > 0)
+            {
+                commands.push_back({ meshes[mesh].indexCount, counts[mesh], meshes[mesh].firstIndex, meshes[mesh].baseVertex, firstInstances[mesh] });
+            }
+        }
+
+        glBindVertexArray(vao);
+        glVertexArrayVertexBuffer(vao, InstanceBinding, ring.buffer, instanceAllocation.offset, sizeof(InstanceData));
+
+        if (mode == BatchDrawMode::MultiDrawIndirect)
+        {
+            PersistentRingBuffer::Allocation commandAllocation;
+            if (!ring.Allocate(commands.size() * sizeof(DrawElementsIndirectCommand), sizeof(GLuint), commandAllocation))
+            {
+                return false;
+            }
+            std::memcpy(commandAllocation.data, commands.data(), commands.size() * sizeof(DrawElementsIndirectCommand));
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring.buffer);
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(commandAllocation.offset),
+                static_cast<GLsizei>(commands.size()), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            ++stats.drawCalls;
+        }
+        else
+        {
+            for (auto& command : commands)
+            {
+                glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, static_cast<GLsizei>(command.count), GL_UNSIGNED_INT,
+                    reinterpret_cast<const void*>(command.firstIndex * sizeof(unsigned int)), static_cast<GLsizei>(command.instanceCount),
+                    command.baseVertex, command.baseInstance);
+                ++stats.drawCalls;
+            }
+        }
+        stats.instances += instances.size();
+        return true;
+    }
+
+private:
+    // Scratch reused between frames
+    std::vector<GLuint> counts;
+    std::vector<GLuint> firstInstances;
+    std::vector<GLuint> cursors;
+    std::vector<DrawElementsIndirectCommand> commands;
+
+    static void EnableAttribute(GLuint vao, GLuint attribute, GLint size, GLuint offset, GLuint binding)
+    {
+        glEnableVertexArrayAttrib(vao, attribute);
+        glVertexArrayAttribFormat(vao, attribute, size, GL_FLOAT, GL_FALSE, offset);
+        glVertexArrayAttribBinding(vao, attribute, binding);
+    }
+};
+
+// Equally sized RGBA8 layers in one GL_TEXTURE_2D_ARRAY, so instances with different textures share a batch
+inline GLuint CreateTextureArray(int width, int height, const std::vector<const std::uint8_t*>& layers)
+{
+    GLint levels = 1;
+    for (int size = std::max(width, height); size > 1; size /= 2)
+    {
+        ++levels;
+    }
+
+    GLuint texture;
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &texture);
+    glTextureStorage3D(texture, levels, GL_RGBA8, width, height, static_cast<GLsizei>(layers.size()));
+    for (std::size_t layer = 0; layer < layers.size(); ++layer)
+    {
+        glTextureSubImage3D(texture, 0, 0, 0, static_cast<GLint>(layer), width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, layers[layer]);
+    }
+    glGenerateTextureMipmap(texture);
+    return texture;
+}
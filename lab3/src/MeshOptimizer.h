@@ -0,0 +1,235 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Mesh.h"
+
+struct MeshOptimizationStats
+{
+    std::size_t verticesBefore = 0;
+    std::size_t verticesAfter = 0;
+    std::size_t triangles = 0;
+    float acmrBefore = 0.0f;
+    float acmrAfter = 0.0f;
+};
+
+// Welds identical vertices, reorders triangles for the post-transform vertex cache (Tipsify) and then
+// reorders vertices into first use order so vertex fetch walks memory mostly forwards.
+struct MeshOptimizer
+{
+    // Typical post-transform cache size, also what ACMR is measured against
+    static constexpr int DefaultCacheSize = 16;
+
+    static MeshOptimizationStats Optimize(ModelInfo& modelInfo, int cacheSize = DefaultCacheSize)
+    {
+        MeshOptimizationStats stats;
+        stats.verticesBefore = modelInfo.vertices.size();
+        stats.triangles = modelInfo.indices.size() / 3;
+        stats.acmrBefore = ComputeAcmr(modelInfo.indices, modelInfo.vertices.size(), cacheSize);
+
+        WeldVertices(modelInfo);
+        OptimizeVertexCache(modelInfo.indices, modelInfo.vertices.size(), cacheSize);
+        OptimizeVertexFetch(modelInfo);
+
+        stats.verticesAfter = modelInfo.vertices.size();
+        stats.acmrAfter = ComputeAcmr(modelInfo.indices, modelInfo.vertices.size(), cacheSize);
+        return stats;
+    }
+
+    // Vertices are identical when all their bytes match, so 0.0 and -0.0 stay distinct
+    static void WeldVertices(ModelInfo& modelInfo)
+    {
+        struct VertexHash
+        {
+            std::size_t operator()(const Vertex& vertex) const
+            {
+                return std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char*>(&vertex), sizeof(Vertex)));
+            }
+        };
+        struct VertexEqual
+        {
+            bool operator()(const Vertex& lhs, const Vertex& rhs) const
+            {
+                return std::memcmp(&lhs, &rhs, sizeof(Vertex)) == 0;
+            }
+        };
+
+        std::unordered_map<Vertex, unsigned int, VertexHash, VertexEqual> uniqueVertices;
+        uniqueVertices.reserve(modelInfo.vertices.size());
+
+        std::vector<Vertex> welded;
+        std::vector<unsigned int> remap(modelInfo.vertices.size());
+        for (std::size_t i = 0; i < modelInfo.vertices.size(); ++i)
+        {
+            auto [found, inserted] = uniqueVertices.try_emplace(modelInfo.vertices[i], static_cast<unsigned int>(welded.size()));
+            if (inserted)
+            {
+                welded.push_back(modelInfo.vertices[i]);
+            }
+            remap[i] = found->second;
+        }
+
+        for (auto& index : modelInfo.indices)
+        {
+            index = remap[index];
+        }
+        modelInfo.vertices = std::move(welded);
+    }
+
+    // Tipsify (Sander, Nehab, Barczak 2007): fans around the most recently used vertex that will still be in the
+    // cache after its remaining triangles are emitted, falling back to recent dead ends and then input order
+    static void OptimizeVertexCache(std::vector<unsigned int>& indices, std::size_t vertexCount, int cacheSize)
+    {
+        std::size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+        {
+            return;
+        }
+
+        // Vertex to triangle adjacency in compressed rows
+        std::vector<std::uint32_t> liveTriangles(vertexCount, 0);
+        for (auto index : indices)
+        {
+            ++liveTriangles[index];
+        }
+        std::vector<std::uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+        for (std::size_t v = 0; v < vertexCount; ++v)
+        {
+            adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+        }
+        std::vector<std::uint32_t> adjacency(indices.size());
+        std::vector<std::uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            adjacency[fill[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+        }
+
+        std::vector<int> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<unsigned int> deadEnds;
+        std::vector<unsigned int> candidates;
+        std::vector<unsigned int> output;
+        output.reserve(indices.size());
+
+        int time = cacheSize + 1;
+        std::size_t cursor = 0;
+        long long fanningVertex = 0;
+
+        while (fanningVertex >= 0)
+        {
+            candidates.clear();
+            auto v = static_cast<std::size_t>(fanningVertex);
+            for (std::uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; ++a)
+            {
+                std::uint32_t triangle = adjacency[a];
+                if (emitted[triangle])
+                {
+                    continue;
+                }
+                emitted[triangle] = true;
+                for (int corner = 0; corner < 3; ++corner)
+                {
+                    unsigned int vertex = indices[triangle * 3 + corner];
+                    output.push_back(vertex);
+                    deadEnds.push_back(vertex);
+                    candidates.push_back(vertex);
+                    --liveTriangles[vertex];
+                    if (time - cacheTime[vertex] > cacheSize)
+                    {
+                        cacheTime[vertex] = time++;
+                    }
+                }
+            }
+
+            // Prefer the oldest candidate that stays cached while its remaining triangles are fanned
+            fanningVertex = -1;
+            int bestPriority = -1;
+            for (auto candidate : candidates)
+            {
+                if (liveTriangles[candidate] == 0)
+                {
+                    continue;
+                }
+                int priority = 0;
+                if (time - cacheTime[candidate] + 2 * static_cast<int>(liveTriangles[candidate]) <= cacheSize)
+                {
+                    priority = time - cacheTime[candidate];
+                }
+                if (priority > bestPriority)
+                {
+                    bestPriority = priority;
+                    fanningVertex = candidate;
+                }
+            }
+
+            while (fanningVertex < 0 && !deadEnds.empty())
+            {
+                unsigned int vertex = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveTriangles[vertex] > 0)
+                {
+                    fanningVertex = vertex;
+                }
+            }
+            while (fanningVertex < 0 && cursor < vertexCount)
+            {
+                if (liveTriangles[cursor] > 0)
+                {
+                    fanningVertex = static_cast<long long>(cursor);
+                }
+                ++cursor;
+            }
+        }
+
+        indices = std::move(output);
+    }
+
+    // Renumbers vertices in the order the index buffer first touches them, unreferenced vertices are dropped
+    static void OptimizeVertexFetch(ModelInfo& modelInfo)
+    {
+        constexpr unsigned int Unassigned = ~0u;
+        std::vector<unsigned int> remap(modelInfo.vertices.size(), Unassigned);
+        std::vector<Vertex> reordered;
+        reordered.reserve(modelInfo.vertices.size());
+
+        for (auto& index : modelInfo.indices)
+        {
+            if (remap[index] == Unassigned)
+            {
+                remap[index] = static_cast<unsigned int>(reordered.size());
+                reordered.push_back(modelInfo.vertices[index]);
+            }
+            index = remap[index];
+        }
+        modelInfo.vertices = std::move(reordered);
+    }
+
+    // Average cache miss ratio of a FIFO post-transform cache: transformed vertices per triangle, 0.5 is ideal
+    // for large regular meshes and 3.0 means no reuse at all
+    static float ComputeAcmr(const std::vector<unsigned int>& indices, std::size_t vertexCount, int cacheSize)
+    {
+        std::size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+        {
+            return 0.0f;
+        }
+
+        // A vertex is still cached while fewer than cacheSize misses happened since it was inserted
+        std::vector<long long> insertedAt(vertexCount, -static_cast<long long>(cacheSize) - 1);
+        long long misses = 0;
+        for (auto index : indices)
+        {
+            if (misses - insertedAt[index] > cacheSize)
+            {
+                insertedAt[index] = misses++;
+            }
+        }
+        return static_cast<float>(misses) / static_cast<float>(triangleCount);
+    }
+};
@@ -0,0 +1,294 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include "GL/glew.h"
+#include "glm/glm.hpp"
+
+#include "Mesh.h"
+#include "Shader.h"
+#include "ShaderRegistry.h"
+
+// std140 layout of the FrameUniforms block in simple.vert and simple.frag, written once per frame into a ring
+// buffer and bound to FrameUniforms::Binding so programs need no per frame uniform calls
+struct FrameUniforms
+{
+    static constexpr GLuint Binding = 0;
+
+    glm::mat4 worldToCameraMatrix{ 1.0f };
+    glm::mat4 projectionMatrix{ 1.0f };
+    // xyz, w is std140 padding
+    glm::vec4 lightDirection{ 0.0f, 0.0f, 1.0f, 0.0f };
+};
+
+static_assert(sizeof(FrameUniforms) == 144);
+
+struct DrawCommand
+{
+    GLuint program = Shader::InvalidProgram;
+    GLuint texture = 0;
+    const Mesh* mesh = nullptr;
+    // Where the indices and vertices start in the mesh's buffers, streamed geometry draws from a region of a ring buffer
+    GLintptr indexOffset = 0;
+    GLint baseVertex = 0;
+    // View space distance, draws with equal state are replayed front to back
+    float depth = 0.0f;
+};
+
+struct RenderStats
+{
+    std::uint64_t draws = 0;
+    std::uint64_t callsIssued = 0;
+    std::uint64_t callsSkipped = 0;
+
+    RenderStats& operator+=(const RenderStats& other)
+    {
+        draws += other.draws;
+        callsIssued += other.callsIssued;
+        callsSkipped += other.callsSkipped;
+        return *this;
+    }
+};
+
+// Last state handed to the backend, anything equal to it is not sent again
+struct RenderStateCache
+{
+    static constexpr GLuint Unknown = ~0u;
+
+    GLuint program = Unknown;
+    GLuint vertexArray = Unknown;
+    GLuint texture = Unknown;
+    const Mesh* decodingMesh = nullptr;
+
+    // Call at the start of a frame, or after anything else touched GL state
+    void Reset()
+    {
+        program = Unknown;
+        vertexArray = Unknown;
+        texture = Unknown;
+        decodingMesh = nullptr;
+    }
+};
+
+// Issues the real GL calls, uniform locations come from the registry's reflected tables
+struct GLRenderBackend
+{
+    const ShaderRegistry& shaders;
+
+    explicit GLRenderBackend(const ShaderRegistry& shaders)
+        : shaders(shaders)
+    {
+    }
+
+    void UseProgram(GLuint program)
+    {
+        glUseProgram(program);
+    }
+
+    void BindVertexArray(GLuint vertexArray)
+    {
+        glBindVertexArray(vertexArray);
+    }
+
+    void BindTexture(GLuint texture)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+
+    void SetVertexDecoding(GLuint program, const VertexDecoding& decoding)
+    {
+        SetVertexDecodingUniforms(shaders.Uniforms(program), decoding);
+    }
+
+    void DrawElements(int indexCount, GLintptr indexOffset, GLint baseVertex)
+    {
+        glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, reinterpret_cast<const void*>(indexOffset), baseVertex);
+    }
+};
+
+// Discards everything, measures the CPU side of sorting and state elimination alone
+struct NullRenderBackend
+{
+    void UseProgram(GLuint) {}
+    void BindVertexArray(GLuint) {}
+    void BindTexture(GLuint) {}
+    void SetVertexDecoding(GLuint, const VertexDecoding&) {}
+    void DrawElements(int, GLintptr, GLint) {}
+};
+
+// Keeps the call stream so it can be inspected without an OpenGL context
+struct RecordingRenderBackend
+{
+    enum class CallType
+    {
+        UseProgram,
+        BindVertexArray,
+        BindTexture,
+        SetVertexDecoding,
+        DrawElements
+    };
+
+    struct Call
+    {
+        CallType type;
+        // Object name, or the index count for draws
+        std::uint32_t value;
+    };
+
+    std::vector<Call> calls;
+
+    void UseProgram(GLuint program)
+    {
+        calls.push_back({ CallType::UseProgram, program });
+    }
+
+    void BindVertexArray(GLuint vertexArray)
+    {
+        calls.push_back({ CallType::BindVertexArray, vertexArray });
+    }
+
+    void BindTexture(GLuint texture)
+    {
+        calls.push_back({ CallType::BindTexture, texture });
+    }
+
+    void SetVertexDecoding(GLuint program, const VertexDecoding&)
+    {
+        calls.push_back({ CallType::SetVertexDecoding, program });
+    }
+
+    void DrawElements(int indexCount, GLintptr, GLint)
+    {
+        calls.push_back({ CallType::DrawElements, static_cast<std::uint32_t>(indexCount) });
+    }
+};
+
+// Collects a frame's draws, sorts them once by a packed key and replays them through a state cache.
+// Key layout from the most significant bit: program (12 bits), texture (12), mesh (16), depth (24),
+// so program switches are the rarest, then texture and vertex array switches.
+struct RenderQueue
+{
+    static constexpr int ProgramBits = 12;
+    static constexpr int TextureBits = 12;
+    static constexpr int MeshBits = 16;
+    static constexpr int DepthBits = 24;
+    static_assert(ProgramBits + TextureBits + MeshBits + DepthBits == 64);
+
+    struct SortEntry
+    {
+        std::uint64_t key;
+        std::uint32_t command;
+    };
+
+    std::vector<DrawCommand> commands;
+    std::vector<SortEntry> entries;
+    // Depth is quantized relative to this distance, usually the camera's far plane
+    float maxDepth = 1000.0f;
+
+    void Clear()
+    {
+        commands.clear();
+        entries.clear();
+    }
+
+    void Submit(const DrawCommand& command)
+    {
+        entries.push_back({ BuildSortKey(command), static_cast<std::uint32_t>(commands.size()) });
+        commands.push_back(command);
+    }
+
+    void Sort()
+    {
+        std::sort(entries.begin(), entries.end(), [](const SortEntry& lhs, const SortEntry& rhs) {
+            return lhs.key < rhs.key || (lhs.key == rhs.key && lhs.command < rhs.command);
+        });
+    }
+
+    // Replays sorted commands, frame uniforms come from the block bound once per frame
+    template<typename Backend>
+    RenderStats Execute(Backend& backend, RenderStateCache& cache) const
+    {
+        // Calls a draw would need with no state tracking at all: program, vertex array, texture,
+        // decoding uniforms and the draw itself
+        constexpr std::uint64_t CallsPerUncachedDraw = 5;
+
+        RenderStats stats;
+        for (auto& entry : entries)
+        {
+            const DrawCommand& command = commands[entry.command];
+            if (command.mesh == nullptr || command.mesh->indicesSize == 0)
+            {
+                continue;
+            }
+
+            if (cache.program != command.program)
+            {
+                backend.UseProgram(command.program);
+                cache.program = command.program;
+                cache.decodingMesh = nullptr;
+                ++stats.callsIssued;
+            }
+            if (cache.vertexArray != command.mesh->vao)
+            {
+                backend.BindVertexArray(command.mesh->vao);
+                cache.vertexArray = command.mesh->vao;
+                ++stats.callsIssued;
+            }
+            if (cache.texture != command.texture)
+            {
+                backend.BindTexture(command.texture);
+                cache.texture = command.texture;
+                ++stats.callsIssued;
+            }
+            if (cache.decodingMesh == nullptr || !SameDecoding(cache.decodingMesh->decoding, command.mesh->decoding))
+            {
+                backend.SetVertexDecoding(command.program, command.mesh->decoding);
+                ++stats.callsIssued;
+            }
+            cache.decodingMesh = command.mesh;
+
+            backend.DrawElements(command.mesh->indicesSize, command.indexOffset, command.baseVertex);
+            ++stats.callsIssued;
+            ++stats.draws;
+        }
+        stats.callsSkipped = stats.draws * CallsPerUncachedDraw - stats.callsIssued;
+        return stats;
+    }
+
+    std::uint64_t BuildSortKey(const DrawCommand& command)
+    {
+        std::uint64_t program = CompactId(programIds, command.program, ProgramBits);
+        std::uint64_t texture = CompactId(textureIds, command.texture, TextureBits);
+        std::uint64_t mesh = CompactId(meshIds, command.mesh != nullptr ? command.mesh->vao : 0, MeshBits);
+        constexpr std::uint64_t MaxDepthValue = (std::uint64_t(1) << DepthBits) - 1;
+        std::uint64_t depth = static_cast<std::uint64_t>(std::clamp(command.depth / maxDepth, 0.0f, 1.0f) * MaxDepthValue);
+        return (program << (TextureBits + MeshBits + DepthBits)) | (texture << (MeshBits + DepthBits)) | (mesh << DepthBits) | depth;
+    }
+
+private:
+    // GL names are not dense, so each object gets a small id the first time it is drawn
+    std::unordered_map<GLuint, std::uint32_t> programIds;
+    std::unordered_map<GLuint, std::uint32_t> textureIds;
+    std::unordered_map<GLuint, std::uint32_t> meshIds;
+
+    // Ids beyond the field width share the last value, those draws still render but sort less tightly
+    static std::uint64_t CompactId(std::unordered_map<GLuint, std::uint32_t>& ids, GLuint name, int bits)
+    {
+        auto [found, inserted] = ids.try_emplace(name, static_cast<std::uint32_t>(ids.size()));
+        std::uint64_t maxId = (std::uint64_t(1) << bits) - 1;
+        return std::min<std::uint64_t>(found->second, maxId);
+    }
+
+    static bool SameDecoding(const VertexDecoding& lhs, const VertexDecoding& rhs)
+    {
+        return lhs.compressed == rhs.compressed
+            && lhs.positionOffset.x == rhs.positionOffset.x && lhs.positionOffset.y == rhs.positionOffset.y && lhs.positionOffset.z == rhs.positionOffset.z
+            && lhs.positionScale.x == rhs.positionScale.x && lhs.positionScale.y == rhs.positionScale.y && lhs.positionScale.z == rhs.positionScale.z
+            && lhs.textureCoordinatesOffset.x == rhs.textureCoordinatesOffset.x && lhs.textureCoordinatesOffset.y == rhs.textureCoordinatesOffset.y
+            && lhs.textureCoordinatesScale.x == rhs.textureCoordinatesScale.x && lhs.textureCoordinatesScale.y == rhs.textureCoordinatesScale.y;
+    }
+};
@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <deque>
+
+#include "GL/glew.h"
+#include "spdlog/spdlog.h"
+
+// Fences straight from the driver
+struct GLFenceBackend
+{
+    using Fence = GLsync;
+
+    Fence Insert()
+    {
+        return glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    bool IsSignaled(Fence fence)
+    {
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        return result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED;
+    }
+
+    void Wait(Fence fence)
+    {
+        constexpr GLuint64 TimeoutNanoseconds = 1'000'000'000;
+        GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, TimeoutNanoseconds);
+        while (result == GL_TIMEOUT_EXPIRED)
+        {
+            result = glClientWaitSync(fence, 0, TimeoutNanoseconds);
+        }
+    }
+
+    void Delete(Fence fence)
+    {
+        glDeleteSync(fence);
+    }
+};
+
+// Fences are sequence numbers and the "GPU" finishes only when told to, so wrap and wait behaviour
+// can be checked without an OpenGL context
+struct FakeFenceBackend
+{
+    using Fence = std::uint64_t;
+
+    std::uint64_t inserted = 0;
+    std::uint64_t completed = 0;
+    std::uint64_t waits = 0;
+
+    Fence Insert()
+    {
+        return ++inserted;
+    }
+
+    bool IsSignaled(Fence fence)
+    {
+        return fence <= completed;
+    }
+
+    // Waiting stands for the GPU catching up to this fence
+    void Wait(Fence fence)
+    {
+        ++waits;
+        completed = std::max(completed, fence);
+    }
+
+    void Delete(Fence) {}
+};
+
+struct RingAllocatorStats
+{
+    std::uint64_t allocations = 0;
+    std::uint64_t allocatedBytes = 0;
+    std::uint64_t wraps = 0;
+    // Allocations that had to block until the GPU released older frames
+    std::uint64_t stalls = 0;
+    std::uint64_t failures = 0;
+};
+
+// Hands out regions of a fixed size ring. Positions grow forever and are taken modulo the capacity, every
+// frame's regions are protected by one fence, and a region is only reused after the fence of the frame that
+// last used it has signaled.
+template<typename FenceBackend>
+struct RingAllocator
+{
+    using Fence = typename FenceBackend::Fence;
+
+    struct FrameFence
+    {
+        // Position just past the frame's last allocation
+        std::uint64_t end;
+        Fence fence;
+    };
+
+    FenceBackend fences;
+    std::uint64_t capacity = 0;
+    std::uint64_t head = 0;
+    // Start of the oldest region the GPU may still read
+    std::uint64_t tail = 0;
+    std::deque<FrameFence> framesInFlight;
+    RingAllocatorStats stats;
+
+    explicit RingAllocator(std::uint64_t capacity = 0, FenceBackend fences = {})
+        : fences(fences)
+        , capacity(capacity)
+    {
+    }
+
+    // Offset into the ring, fails when the region does not fit even after every older frame finished
+    bool Allocate(std::uint64_t size, std::uint64_t alignment, std::uint64_t& offset)
+    {
+        if (size == 0 || size > capacity || alignment == 0 || capacity % alignment != 0)
+        {
+            ++stats.failures;
+            return false;
+        }
+        std::uint64_t start = (head + alignment - 1) / alignment * alignment;
+        // Regions never straddle the end, the skipped bytes belong to the current frame
+        if (start % capacity + size > capacity)
+        {
+            start = (start / capacity + 1) * capacity;
+            ++stats.wraps;
+        }
+        std::uint64_t end = start + size;
+
+        RetireSignaledFrames();
+        if (end - tail > capacity && !framesInFlight.empty())
+        {
+            ++stats.stalls;
+            while (end - tail > capacity && !framesInFlight.empty())
+            {
+                fences.Wait(framesInFlight.front().fence);
+                RetireFrontFrame();
+            }
+        }
+        if (end - tail > capacity)
+        {
+            // The current frame alone already needs more than the whole ring
+            ++stats.failures;
+            return false;
+        }
+
+        head = end;
+        offset = start % capacity;
+        ++stats.allocations;
+        stats.allocatedBytes += size;
+        return true;
+    }
+
+    // Call once the commands reading this frame's allocations have been submitted
+    void EndFrame()
+    {
+        if (framesInFlight.empty() ? head == tail : framesInFlight.back().end == head)
+        {
+            return;
+        }
+        framesInFlight.push_back({ head, fences.Insert() });
+    }
+
+    void Release()
+    {
+        for (auto& frame : framesInFlight)
+        {
+            fences.Delete(frame.fence);
+        }
+        framesInFlight.clear();
+        tail = head;
+    }
+
+private:
+    void RetireSignaledFrames()
+    {
+        while (!framesInFlight.empty() && fences.IsSignaled(framesInFlight.front().fence))
+        {
+            RetireFrontFrame();
+        }
+    }
+
+    void RetireFrontFrame()
+    {
+        tail = framesInFlight.front().end;
+        fences.Delete(framesInFlight.front().fence);
+        framesInFlight.pop_front();
+    }
+};
+
+// Buffer storage mapped once for the lifetime of the buffer (GL 4.4), written through the pointer and read by
+// the GPU while later frames keep writing other regions
+struct PersistentRingBuffer
+{
+    GLuint buffer = 0;
+    std::uint8_t* mapping = nullptr;
+    RingAllocator<GLFenceBackend> allocator;
+
+    struct Allocation
+    {
+        void* data = nullptr;
+        GLintptr offset = 0;
+    };
+
+    bool IsValid() const
+    {
+        return mapping != nullptr;
+    }
+
+    static PersistentRingBuffer Create(std::uint64_t capacity)
+    {
+        PersistentRingBuffer result;
+        constexpr GLbitfield Flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glCreateBuffers(1, &result.buffer);
+        glNamedBufferStorage(result.buffer, static_cast<GLsizeiptr>(capacity), nullptr, Flags);
+        result.mapping = static_cast<std::uint8_t*>(glMapNamedBufferRange(result.buffer, 0, static_cast<GLsizeiptr>(capacity), Flags));
+        if (result.mapping == nullptr)
+        {
+            spdlog::critical("Unable to map a {} byte ring buffer", capacity);
+            glDeleteBuffers(1, &result.buffer);
+            result.buffer = 0;
+            return result;
+        }
+        result.allocator = RingAllocator<GLFenceBackend>(capacity);
+        return result;
+    }
+
+    bool Allocate(std::uint64_t size, std::uint64_t alignment, Allocation& allocation)
+    {
+        std::uint64_t offset;
+        if (!allocator.Allocate(size, alignment, offset))
+        {
+            return false;
+        }
+        allocation.data = mapping + offset;
+        allocation.offset = static_cast<GLintptr>(offset);
+        return true;
+    }
+
+    void EndFrame()
+    {
+        allocator.EndFrame();
+    }
+
+    void Destroy()
+    {
+        allocator.Release();
+        if (buffer != 0)
+        {
+            glUnmapNamedBuffer(buffer);
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = 0;
+        mapping = nullptr;
+    }
+};
@@ -1,29 +1,167 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <string>
 #include <string_view>
+#include <vector>
 #include <fstream>
+#include <sstream>
 
 #include "GL/glew.h"
 #include "spdlog/spdlog.h"
 #include "glm/glm.hpp"
 
+// FNV-1a of a uniform name. String literals are hashed at compile time, so looking a uniform up costs a
+// binary search over a few integers instead of a glGetUniformLocation string compare in the driver.
+struct UniformName
+{
+    std::uint32_t hash;
+
+    template<std::size_t N>
+    consteval UniformName(const char (&name)[N])
+        : hash(Hash(std::string_view{ name, N - 1 }))
+    {
+    }
+
+    explicit constexpr UniformName(std::string_view name)
+        : hash(Hash(name))
+    {
+    }
+
+    static constexpr std::uint32_t Hash(std::string_view name)
+    {
+        std::uint32_t hash = 2166136261u;
+        for (char c : name)
+        {
+            hash = (hash ^ static_cast<std::uint8_t>(c)) * 16777619u;
+        }
+        return hash;
+    }
+};
+
+// Locations of a program's active uniforms, reflected once after linking. The setters write to the program
+// currently in use, like the Shader ones, and unknown names end up at location -1 which GL ignores.
+struct UniformTable
+{
+    struct Entry
+    {
+        std::uint32_t hash;
+        GLint location;
+    };
+
+    std::vector<Entry> entries;
+
+    static UniformTable Reflect(GLuint program)
+    {
+        UniformTable result;
+        GLint uniformCount = 0;
+        GLint maxNameLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+        std::string name(std::max(maxNameLength, 1), '\0');
+        for (GLint i = 0; i < uniformCount; ++i)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(program, static_cast<GLuint>(i), maxNameLength, &length, &size, &type, name.data());
+            std::string_view uniformName{ name.data(), static_cast<std::size_t>(length) };
+            // Members of uniform blocks have no location
+            GLint location = glGetUniformLocation(program, name.c_str());
+            if (location < 0)
+            {
+                continue;
+            }
+            // Arrays are reported as "name[0]", they are set through the location of the first element
+            if (uniformName.ends_with("[0]"))
+            {
+                uniformName.remove_suffix(3);
+            }
+            result.entries.push_back({ UniformName::Hash(uniformName), location });
+        }
+
+        std::sort(result.entries.begin(), result.entries.end(), [](const Entry& a, const Entry& b) { return a.hash < b.hash; });
+        auto duplicate = std::adjacent_find(result.entries.begin(), result.entries.end(), [](const Entry& a, const Entry& b) { return a.hash == b.hash; });
+        if (duplicate != result.entries.end())
+        {
+            spdlog::error("Program {} has two uniforms with the name hash {:08x}", program, duplicate->hash);
+        }
+        return result;
+    }
+
+    GLint Location(UniformName name) const
+    {
+        auto entry = std::lower_bound(entries.begin(), entries.end(), name.hash, [](const Entry& e, std::uint32_t hash) { return e.hash < hash; });
+        return entry != entries.end() && entry->hash == name.hash ? entry->location : -1;
+    }
+
+    void Set(UniformName name, const glm::mat4& value) const
+    {
+        glUniformMatrix4fv(Location(name), 1, GL_FALSE, &value[0][0]);
+    }
+
+    void Set(UniformName name, const glm::vec3& value) const
+    {
+        glUniform3fv(Location(name), 1, &value[0]);
+    }
+
+    void Set(UniformName name, const glm::vec2& value) const
+    {
+        glUniform2fv(Location(name), 1, &value[0]);
+    }
+
+    void Set(UniformName name, bool value) const
+    {
+        glUniform1i(Location(name), value ? 1 : 0);
+    }
+
+    void Set(UniformName name, GLint value) const
+    {
+        glUniform1i(Location(name), value);
+    }
+};
+
 struct Shader
 {
     static constexpr GLuint InvalidProgram = 0;
 
     static GLuint LoadProgram(std::string_view vertexShaderPath, std::string_view fragmentShaderPath)
     {
-        GLuint vertexShader = LoadShader(vertexShaderPath, GL_VERTEX_SHADER);
-        GLuint fragmentShader = LoadShader(fragmentShaderPath, GL_FRAGMENT_SHADER);
+        std::string vertexSource;
+        std::string fragmentSource;
+        if (!ReadFile(vertexShaderPath, vertexSource) || !ReadFile(fragmentShaderPath, fragmentSource))
+        {
+            return InvalidProgram;
+        }
+        return CreateProgram(vertexSource, fragmentSource, vertexShaderPath, fragmentShaderPath);
+    }
+
+    // Sources don't have to be null terminated, so they can point straight into a mapped file.
+    // retrievableBinary asks the driver to keep the linked binary around for glGetProgramBinary.
+    static GLuint CreateProgram(std::string_view vertexSource, std::string_view fragmentSource,
+        std::string_view vertexShaderName = "vertex shader", std::string_view fragmentShaderName = "fragment shader",
+        bool retrievableBinary = false)
+    {
+        GLuint vertexShader = CompileShader(vertexSource, GL_VERTEX_SHADER, vertexShaderName);
+        GLuint fragmentShader = CompileShader(fragmentSource, GL_FRAGMENT_SHADER, fragmentShaderName);
 
         if (vertexShader == 0 || fragmentShader == 0)
         {
-            return 0;
+            glDeleteShader(vertexShader);
+            glDeleteShader(fragmentShader);
+            return InvalidProgram;
         }
 
         GLuint program = glCreateProgram();
         glAttachShader(program, vertexShader);
         glAttachShader(program, fragmentShader);
+        if (retrievableBinary)
+        {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
 
         glLinkProgram(program);
 
@@ -67,29 +205,57 @@ struct Shader
         glUniform3fv(location, 1, &value[0]);
     }
 
+    static void SetVec2Uniform(GLuint program, std::string_view uniformName, const glm::vec2& value)
+    {
+        GLint location = glGetUniformLocation(program, uniformName.data());
+        glUniform2fv(location, 1, &value[0]);
+    }
+
+    static void SetBoolUniform(GLuint program, std::string_view uniformName, bool value)
+    {
+        GLint location = glGetUniformLocation(program, uniformName.data());
+        glUniform1i(location, value ? 1 : 0);
+    }
+
+    // Programs without the block are left alone
+    static void SetUniformBlockBinding(GLuint program, std::string_view blockName, GLuint binding)
+    {
+        GLuint index = glGetUniformBlockIndex(program, blockName.data());
+        if (index != GL_INVALID_INDEX)
+        {
+            glUniformBlockBinding(program, index, binding);
+        }
+    }
+
     static void SetTextureUniform(GLuint program, std::string_view uniformName, GLuint value)
     {
         GLint location = glGetUniformLocation(program, uniformName.data());
         glUniform1i(location, value);
     }
 
-private:
-    static GLuint LoadShader(std::string_view shaderPath, GLenum shaderType)
+    static bool ReadFile(std::string_view path, std::string& content)
     {
-        std::ifstream file(shaderPath.data());
+        std::ifstream file(path.data());
         if (!file.is_open())
         {
-            spdlog::critical("Unable to open file: \"{}\"", shaderPath);
-            return 0;
+            spdlog::critical("Unable to open file: \"{}\"", path);
+            return false;
         }
 
         std::stringstream buffer;
         buffer << file.rdbuf();
-        std::string fileContent = buffer.str();
-        const char* contentPtr = fileContent.c_str();
+        content = buffer.str();
+        return true;
+    }
+
+private:
+    static GLuint CompileShader(std::string_view source, GLenum shaderType, std::string_view shaderName)
+    {
+        const char* contentPtr = source.data();
+        GLint contentLength = static_cast<GLint>(source.size());
 
         GLuint shader = glCreateShader(shaderType);
-        glShaderSource(shader, 1, &contentPtr, nullptr);
+        glShaderSource(shader, 1, &contentPtr, &contentLength);
         glCompileShader(shader);
 
         GLint isCompiled = 0;
@@ -103,7 +269,7 @@ private:
             errorLog.resize(maxLength);
             glGetShaderInfoLog(shader, maxLength, &maxLength, &errorLog[0]);
 
-            spdlog::critical("Unable to compile shader \"{}\". {}", shaderPath, errorLog);
+            spdlog::critical("Unable to compile shader \"{}\". {}", shaderName, errorLog);
 
             glDeleteShader(shader);
             return 0;
@@ -0,0 +1,429 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "GL/glew.h"
+#include "spdlog/spdlog.h"
+
+#include "Shader.h"
+
+// Linked programs saved with glGetProgramBinary, one file per program named after a hash of both sources and
+// the driver strings. Binaries of another driver are never opened, and when the driver rejects one anyway
+// (same strings, different build) the program is compiled from source and the file replaced.
+struct ProgramBinaryCache
+{
+    std::filesystem::path directory;
+    std::uint64_t driverHash = 0;
+
+    bool IsEnabled() const
+    {
+        return !directory.empty();
+    }
+
+    // Needs a current context, fails when the driver offers no binary formats
+    bool Enable(const std::filesystem::path& cacheDirectory)
+    {
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        if (formatCount == 0)
+        {
+            spdlog::warn("Driver offers no program binary formats, shaders are always compiled from source");
+            return false;
+        }
+
+        std::error_code error;
+        std::filesystem::create_directories(cacheDirectory, error);
+        if (error)
+        {
+            spdlog::error("Unable to create shader cache directory \"{}\": {}", cacheDirectory.string(), error.message());
+            return false;
+        }
+
+        directory = cacheDirectory;
+        driverHash = HashOffset;
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+        {
+            auto value = reinterpret_cast<const char*>(glGetString(name));
+            driverHash = Hash(value != nullptr ? value : "", driverHash);
+        }
+        return true;
+    }
+
+    std::uint64_t Key(std::string_view vertexSource, std::string_view fragmentSource) const
+    {
+        // The length keeps "ab" + "c" apart from "a" + "bc"
+        std::uint64_t vertexSize = vertexSource.size();
+        std::uint64_t hash = Hash({ reinterpret_cast<const char*>(&vertexSize), sizeof(vertexSize) }, driverHash);
+        return Hash(fragmentSource, Hash(vertexSource, hash));
+    }
+
+    // InvalidProgram when there is no usable binary
+    GLuint Load(std::uint64_t key) const
+    {
+        std::ifstream file(PathOf(key), std::ios::binary);
+        FileHeader header;
+        if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, Magic, sizeof(Magic)) != 0
+            || header.key != key)
+        {
+            return Shader::InvalidProgram;
+        }
+        std::vector<char> binary(header.length);
+        if (!file.read(binary.data(), static_cast<std::streamsize>(binary.size())))
+        {
+            return Shader::InvalidProgram;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+        GLint isLinked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &isLinked);
+        if (isLinked == GL_FALSE)
+        {
+            spdlog::info("Driver rejected cached program binary {:016x}, compiling from source", key);
+            glDeleteProgram(program);
+            return Shader::InvalidProgram;
+        }
+        return program;
+    }
+
+    bool Store(std::uint64_t key, GLuint program) const
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+        {
+            return false;
+        }
+        std::vector<char> binary(length);
+        FileHeader header = {};
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.key = key;
+        glGetProgramBinary(program, length, &length, &header.format, binary.data());
+        header.length = static_cast<std::uint32_t>(length);
+
+        // Written under a temporary name first, a crash never leaves a truncated binary behind
+        std::filesystem::path path = PathOf(key);
+        std::filesystem::path temporaryPath = path;
+        temporaryPath += ".tmp";
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(binary.data(), header.length);
+            if (!file)
+            {
+                return false;
+            }
+        }
+        std::error_code error;
+        std::filesystem::rename(temporaryPath, path, error);
+        return !error;
+    }
+
+private:
+    static constexpr char Magic[4] = { 'C', 'G', 'P', 'B' };
+    static constexpr std::uint64_t HashOffset = 14695981039346656037ull;
+
+    struct FileHeader
+    {
+        char magic[4];
+        GLenum format;
+        std::uint64_t key;
+        std::uint32_t length;
+        std::uint32_t reserved;
+    };
+
+    static_assert(sizeof(FileHeader) == 24);
+
+    // FNV-1a, 64 bits so unrelated sources practically never share a file
+    static std::uint64_t Hash(std::string_view data, std::uint64_t hash)
+    {
+        for (char c : data)
+        {
+            hash = (hash ^ static_cast<std::uint8_t>(c)) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    std::filesystem::path PathOf(std::uint64_t key) const
+    {
+        return directory / fmt::format("{:016x}.bin", key);
+    }
+};
+
+struct ShaderProgram
+{
+    GLuint program = Shader::InvalidProgram;
+    UniformTable uniforms;
+    std::string vertexPath;
+    std::string fragmentPath;
+    // Setup that does not survive relinking, like uniform block bindings and sampler units. Runs after every link.
+    std::function<void(const ShaderProgram&)> configure;
+};
+
+struct ShaderRegistryStats
+{
+    std::uint64_t compiled = 0;
+    std::uint64_t cacheHits = 0;
+    std::uint64_t reloads = 0;
+    std::uint64_t failedReloads = 0;
+};
+
+// Owns the programs behind stable handles, the GL program of a handle changes when its sources are edited.
+// The watcher thread polls the modification times and reads the new sources, compiling and linking happen
+// in Update on the context's thread, and a build that fails keeps the previous program.
+struct ShaderRegistry
+{
+    using Handle = std::uint32_t;
+    static constexpr Handle InvalidHandle = ~Handle{ 0 };
+
+    ProgramBinaryCache binaryCache;
+    ShaderRegistryStats stats;
+
+    ShaderRegistry() = default;
+
+    ShaderRegistry(const ShaderRegistry&) = delete;
+    ShaderRegistry& operator=(const ShaderRegistry&) = delete;
+
+    ~ShaderRegistry()
+    {
+        StopWatching();
+    }
+
+    Handle Load(std::string_view vertexPath, std::string_view fragmentPath, std::function<void(const ShaderProgram&)> configure = {})
+    {
+        std::string vertexSource;
+        std::string fragmentSource;
+        if (!Shader::ReadFile(vertexPath, vertexSource) || !Shader::ReadFile(fragmentPath, fragmentSource))
+        {
+            return InvalidHandle;
+        }
+        return Create(vertexSource, fragmentSource, vertexPath, fragmentPath, std::move(configure));
+    }
+
+    // The paths are only watched, so a program built from a pack still reloads from the files it was packed from
+    Handle Create(std::string_view vertexSource, std::string_view fragmentSource, std::string_view vertexPath, std::string_view fragmentPath,
+        std::function<void(const ShaderProgram&)> configure = {})
+    {
+        GLuint program = Build(vertexSource, fragmentSource, vertexPath, fragmentPath);
+        if (program == Shader::InvalidProgram)
+        {
+            return InvalidHandle;
+        }
+
+        ShaderProgram entry;
+        entry.vertexPath = vertexPath;
+        entry.fragmentPath = fragmentPath;
+        entry.configure = std::move(configure);
+        Install(entry, program);
+        programs.push_back(std::move(entry));
+
+        std::lock_guard lock(mutex);
+        watchedSources.push_back({ std::string(vertexPath), std::string(fragmentPath), WriteTime(vertexPath), WriteTime(fragmentPath) });
+        return static_cast<Handle>(programs.size() - 1);
+    }
+
+    // The reference is invalidated by the next Create
+    const ShaderProgram& Get(Handle handle) const
+    {
+        return programs[handle];
+    }
+
+    // For code that only knows the GL name, a linear search since a scene has a handful of programs
+    const UniformTable& Uniforms(GLuint program) const
+    {
+        static const UniformTable Empty;
+        for (auto& entry : programs)
+        {
+            if (entry.program == program)
+            {
+                return entry.uniforms;
+            }
+        }
+        return Empty;
+    }
+
+    void StartWatching(std::chrono::milliseconds interval = std::chrono::milliseconds(250))
+    {
+        stopRequested = false;
+        watcher = std::thread([this, interval] { Watch(interval); });
+    }
+
+    void StopWatching()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopRequested = true;
+        }
+        wakeUp.notify_all();
+        if (watcher.joinable())
+        {
+            watcher.join();
+        }
+    }
+
+    // Call once per frame with the context current, returns how many programs were replaced
+    int Update()
+    {
+        std::vector<ChangedSources> changes;
+        {
+            std::lock_guard lock(mutex);
+            changes.swap(changedSources);
+        }
+
+        int replaced = 0;
+        for (auto& change : changes)
+        {
+            ShaderProgram& entry = programs[change.handle];
+            GLuint program = Build(change.vertexSource, change.fragmentSource, entry.vertexPath, entry.fragmentPath);
+            if (program == Shader::InvalidProgram)
+            {
+                ++stats.failedReloads;
+                spdlog::error("Keeping the previous build of \"{}\" and \"{}\"", entry.vertexPath, entry.fragmentPath);
+                continue;
+            }
+            glDeleteProgram(entry.program);
+            Install(entry, program);
+            ++stats.reloads;
+            ++replaced;
+            spdlog::info("Reloaded \"{}\" and \"{}\"", entry.vertexPath, entry.fragmentPath);
+        }
+        return replaced;
+    }
+
+    void Destroy()
+    {
+        StopWatching();
+        for (auto& entry : programs)
+        {
+            glDeleteProgram(entry.program);
+        }
+        programs.clear();
+        watchedSources.clear();
+        changedSources.clear();
+    }
+
+private:
+    struct WatchedSources
+    {
+        std::string vertexPath;
+        std::string fragmentPath;
+        std::filesystem::file_time_type vertexTime;
+        std::filesystem::file_time_type fragmentTime;
+    };
+
+    struct ChangedSources
+    {
+        Handle handle;
+        std::string vertexSource;
+        std::string fragmentSource;
+    };
+
+    std::vector<ShaderProgram> programs;
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopRequested = false;
+    std::vector<WatchedSources> watchedSources;
+    std::vector<ChangedSources> changedSources;
+    std::thread watcher;
+
+    GLuint Build(std::string_view vertexSource, std::string_view fragmentSource, std::string_view vertexName, std::string_view fragmentName)
+    {
+        std::uint64_t key = 0;
+        if (binaryCache.IsEnabled())
+        {
+            key = binaryCache.Key(vertexSource, fragmentSource);
+            GLuint program = binaryCache.Load(key);
+            if (program != Shader::InvalidProgram)
+            {
+                ++stats.cacheHits;
+                return program;
+            }
+        }
+
+        GLuint program = Shader::CreateProgram(vertexSource, fragmentSource, vertexName, fragmentName, binaryCache.IsEnabled());
+        if (program == Shader::InvalidProgram)
+        {
+            return program;
+        }
+        ++stats.compiled;
+        if (binaryCache.IsEnabled() && !binaryCache.Store(key, program))
+        {
+            spdlog::warn("Unable to cache the program binary of \"{}\" and \"{}\"", vertexName, fragmentName);
+        }
+        return program;
+    }
+
+    static void Install(ShaderProgram& entry, GLuint program)
+    {
+        entry.program = program;
+        entry.uniforms = UniformTable::Reflect(program);
+        if (entry.configure)
+        {
+            entry.configure(entry);
+        }
+    }
+
+    // min() for paths that do not exist, which then never change
+    static std::filesystem::file_time_type WriteTime(std::string_view path)
+    {
+        std::error_code error;
+        auto time = std::filesystem::last_write_time(std::filesystem::path(path), error);
+        return error ? std::filesystem::file_time_type::min() : time;
+    }
+
+    // Files are read without the lock, editors saving in several writes at worst cause one failed build
+    void Watch(std::chrono::milliseconds interval)
+    {
+        std::unique_lock lock(mutex);
+        while (!wakeUp.wait_for(lock, interval, [this] { return stopRequested; }))
+        {
+            std::vector<WatchedSources> sources = watchedSources;
+            lock.unlock();
+
+            std::vector<ChangedSources> changes;
+            for (std::size_t handle = 0; handle < sources.size(); ++handle)
+            {
+                auto vertexTime = WriteTime(sources[handle].vertexPath);
+                auto fragmentTime = WriteTime(sources[handle].fragmentPath);
+                if (vertexTime == sources[handle].vertexTime && fragmentTime == sources[handle].fragmentTime)
+                {
+                    continue;
+                }
+                sources[handle].vertexTime = vertexTime;
+                sources[handle].fragmentTime = fragmentTime;
+
+                ChangedSources change;
+                change.handle = static_cast<Handle>(handle);
+                if (Shader::ReadFile(sources[handle].vertexPath, change.vertexSource)
+                    && Shader::ReadFile(sources[handle].fragmentPath, change.fragmentSource))
+                {
+                    changes.push_back(std::move(change));
+                }
+            }
+
+            lock.lock();
+            for (std::size_t handle = 0; handle < sources.size(); ++handle)
+            {
+                watchedSources[handle].vertexTime = sources[handle].vertexTime;
+                watchedSources[handle].fragmentTime = sources[handle].fragmentTime;
+            }
+            for (auto& change : changes)
+            {
+                changedSources.push_back(std::move(change));
+            }
+        }
+    }
+};
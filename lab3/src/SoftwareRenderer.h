@@ -0,0 +1,534 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "Mesh.h"
+#include "RenderQueue.h"
+#include "WorkerPool.h"
+
+// RGBA8 image sampled like colorTexture in simple.frag: nearest texel of level 0, clamped to the edge.
+// Rows are bottom up, as stbi delivers them with vertical flipping on and as GL stores them.
+struct SoftwareTexture
+{
+    int width = 0;
+    int height = 0;
+    std::vector<std::uint8_t> rgba;
+
+    static SoftwareTexture FromRgba(int width, int height, const std::uint8_t* data)
+    {
+        SoftwareTexture result;
+        result.width = width;
+        result.height = height;
+        result.rgba.assign(data, data + static_cast<std::size_t>(width) * height * 4);
+        return result;
+    }
+
+    glm::vec4 Sample(glm::vec2 textureCoordinates) const
+    {
+        int x = std::clamp(static_cast<int>(std::floor(textureCoordinates.x * width)), 0, width - 1);
+        int y = std::clamp(static_cast<int>(std::floor(textureCoordinates.y * height)), 0, height - 1);
+        const std::uint8_t* texel = &rgba[(static_cast<std::size_t>(y) * width + x) * 4];
+        constexpr float Scale = 1.0f / 255.0f;
+        return { texel[0] * Scale, texel[1] * Scale, texel[2] * Scale, texel[3] * Scale };
+    }
+};
+
+// Color and depth of the window, bottom row first like glReadPixels returns it
+struct SoftwareFramebuffer
+{
+    int width = 0;
+    int height = 0;
+    std::vector<std::uint8_t> color;
+    std::vector<float> depth;
+
+    static SoftwareFramebuffer Create(int width, int height)
+    {
+        SoftwareFramebuffer result;
+        result.width = width;
+        result.height = height;
+        result.color.resize(static_cast<std::size_t>(width) * height * 4);
+        result.depth.resize(static_cast<std::size_t>(width) * height);
+        return result;
+    }
+};
+
+// Binary PPM of bottom up RGBA rows, alpha is dropped
+inline bool WritePpm(const char* path, int width, int height, const std::uint8_t* rgba)
+{
+    std::FILE* file = std::fopen(path, "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+    bool written = std::fwrite(header.data(), 1, header.size(), file) == header.size();
+    std::vector<std::uint8_t> row(static_cast<std::size_t>(width) * 3);
+    for (int y = height - 1; y >= 0 && written; --y)
+    {
+        const std::uint8_t* source = rgba + static_cast<std::size_t>(y) * width * 4;
+        for (int x = 0; x < width; ++x)
+        {
+            row[x * 3 + 0] = source[x * 4 + 0];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 2];
+        }
+        written = std::fwrite(row.data(), 1, row.size(), file) == row.size();
+    }
+    return std::fclose(file) == 0 && written;
+}
+
+// Uncompressed world space vertices, what simple.vert reads with the default VertexDecoding
+struct SoftwareDraw
+{
+    const Vertex* vertices = nullptr;
+    std::size_t vertexCount = 0;
+    const unsigned int* indices = nullptr;
+    std::size_t indexCount = 0;
+    const SoftwareTexture* texture = nullptr;
+
+    static SoftwareDraw FromModel(const ModelInfo& model, const SoftwareTexture& texture)
+    {
+        return { model.vertices.data(), model.vertices.size(), model.indices.data(), model.indices.size(), &texture };
+    }
+};
+
+struct SoftwareFrameStats
+{
+    std::uint64_t triangles = 0;
+    // Front facing and at least partly inside the frustum, after clipping
+    std::uint64_t rasterizedTriangles = 0;
+    std::uint64_t fragments = 0;
+    double vertexMilliseconds = 0.0;
+    double binMilliseconds = 0.0;
+    double rasterMilliseconds = 0.0;
+
+    double TotalMilliseconds() const
+    {
+        return vertexMilliseconds + binMilliseconds + rasterMilliseconds;
+    }
+};
+
+// Runs simple.vert and simple.frag on the CPU with the GL state lab3 sets: back faces culled with clockwise
+// front faces, depth tested with GL_LESS. Vertices are transformed in parallel, triangles are clipped, set up
+// and sorted into screen tiles by parallel chunks, and every tile is rasterized by one thread taking the
+// chunks in order, so the image does not depend on the thread count.
+struct SoftwareRenderer
+{
+    static constexpr int TileSize = 32;
+
+    // The thread calling Render works too, so threadCount - 1 workers are started
+    void Start(int threadCount)
+    {
+        workers.Start(threadCount);
+    }
+
+    void Stop()
+    {
+        workers.Stop();
+    }
+
+    int ThreadCount() const
+    {
+        return workers.ThreadCount();
+    }
+
+    SoftwareFrameStats Render(SoftwareFramebuffer& framebuffer, const FrameUniforms& uniforms, const std::vector<SoftwareDraw>& draws,
+        const glm::vec4& clearColor = glm::vec4{ 0.0f })
+    {
+        using Clock = std::chrono::steady_clock;
+        SoftwareFrameStats stats;
+        auto start = Clock::now();
+
+        // Vertex stage
+        const glm::mat4 worldToClip = uniforms.projectionMatrix * uniforms.worldToCameraMatrix;
+        vertexOffsets.clear();
+        std::size_t vertexCount = 0;
+        for (auto& draw : draws)
+        {
+            vertexOffsets.push_back(vertexCount);
+            vertexCount += draw.vertexCount;
+        }
+        shadedVertices.resize(vertexCount);
+        workers.ParallelFor((vertexCount + VertexChunkSize - 1) / VertexChunkSize, [&](std::size_t chunk) {
+            std::size_t begin = chunk * VertexChunkSize;
+            std::size_t end = std::min(begin + VertexChunkSize, vertexCount);
+            std::size_t draw = std::upper_bound(vertexOffsets.begin(), vertexOffsets.end(), begin) - vertexOffsets.begin() - 1;
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                while (i >= vertexOffsets[draw] + draws[draw].vertexCount)
+                {
+                    ++draw;
+                }
+                const Vertex& vertex = draws[draw].vertices[i - vertexOffsets[draw]];
+                ShadedVertex& shaded = shadedVertices[i];
+                shaded.position = worldToClip * glm::vec4{ vertex.x, vertex.y, vertex.z, 1.0f };
+                shaded.normal = { vertex.nx, vertex.ny, vertex.nz };
+                shaded.textureCoordinates = { vertex.tx, vertex.ty };
+            }
+        });
+        auto vertexEnd = Clock::now();
+
+        // Clipping, setup and binning
+        width = framebuffer.width;
+        height = framebuffer.height;
+        tilesX = (width + TileSize - 1) / TileSize;
+        tilesY = (height + TileSize - 1) / TileSize;
+        chunks.clear();
+        for (std::size_t draw = 0; draw < draws.size(); ++draw)
+        {
+            std::size_t triangleCount = draws[draw].indexCount / 3;
+            stats.triangles += triangleCount;
+            for (std::size_t first = 0; first < triangleCount; first += TriangleChunkSize)
+            {
+                chunks.push_back({ draw, first, std::min(first + TriangleChunkSize, triangleCount) });
+            }
+        }
+        if (chunkBins.size() < chunks.size())
+        {
+            chunkBins.resize(chunks.size());
+        }
+        workers.ParallelFor(chunks.size(), [&](std::size_t chunk) { SetupChunk(draws, chunks[chunk], chunkBins[chunk]); });
+        for (std::size_t chunk = 0; chunk < chunks.size(); ++chunk)
+        {
+            stats.rasterizedTriangles += chunkBins[chunk].triangles.size();
+        }
+        auto binEnd = Clock::now();
+
+        // Rasterization and fragment shading, one tile per job
+        lightDirection = -glm::normalize(glm::vec3(uniforms.lightDirection));
+        tileFragments.assign(static_cast<std::size_t>(tilesX) * tilesY, 0);
+        workers.ParallelFor(tileFragments.size(), [&](std::size_t tile) { RasterizeTile(framebuffer, draws, static_cast<int>(tile), clearColor); });
+        for (auto fragments : tileFragments)
+        {
+            stats.fragments += fragments;
+        }
+        auto rasterEnd = Clock::now();
+
+        stats.vertexMilliseconds = std::chrono::duration<double, std::milli>(vertexEnd - start).count();
+        stats.binMilliseconds = std::chrono::duration<double, std::milli>(binEnd - vertexEnd).count();
+        stats.rasterMilliseconds = std::chrono::duration<double, std::milli>(rasterEnd - binEnd).count();
+        return stats;
+    }
+
+private:
+    static constexpr std::size_t VertexChunkSize = 4096;
+    static constexpr std::size_t TriangleChunkSize = 4096;
+    // Window coordinates are snapped to 1/256 of a pixel, edge functions are exact in 64-bit integers
+    static constexpr int SubpixelBits = 8;
+    static constexpr std::int64_t SubpixelScale = 1 << SubpixelBits;
+
+    struct ShadedVertex
+    {
+        glm::vec4 position;
+        glm::vec3 normal;
+        glm::vec2 textureCoordinates;
+    };
+
+    struct TriangleChunk
+    {
+        std::size_t draw;
+        std::size_t firstTriangle;
+        std::size_t endTriangle;
+    };
+
+    // Attributes are premultiplied by 1 / w for perspective correct interpolation
+    struct SetupTriangle
+    {
+        std::int64_t x[3];
+        std::int64_t y[3];
+        std::int64_t area;
+        float depth[3];
+        float inverseW[3];
+        glm::vec3 normal[3];
+        glm::vec2 textureCoordinates[3];
+        int minX, minY, maxX, maxY;
+        std::uint32_t draw;
+    };
+
+    // Triangles of one chunk and their indices sorted by tile, tileStarts has one entry per tile plus one
+    struct ChunkBins
+    {
+        std::vector<SetupTriangle> triangles;
+        std::vector<std::uint32_t> tileStarts;
+        std::vector<std::uint32_t> tileTriangles;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> pairs;
+    };
+
+    int width = 0;
+    int height = 0;
+    int tilesX = 0;
+    int tilesY = 0;
+    glm::vec3 lightDirection{ 0.0f };
+    std::vector<std::size_t> vertexOffsets;
+    std::vector<ShadedVertex> shadedVertices;
+    std::vector<TriangleChunk> chunks;
+    std::vector<ChunkBins> chunkBins;
+    std::vector<std::uint64_t> tileFragments;
+
+    WorkerPool workers;
+
+    static ShadedVertex Lerp(const ShadedVertex& a, const ShadedVertex& b, float t)
+    {
+        return { a.position + (b.position - a.position) * t, a.normal + (b.normal - a.normal) * t,
+            a.textureCoordinates + (b.textureCoordinates - a.textureCoordinates) * t };
+    }
+
+    // Signed distance to the clip volume planes w + x, w - x, w + y, w - y, w + z and w - z
+    static float PlaneDistance(const glm::vec4& p, int plane)
+    {
+        float coordinate = p[plane / 2];
+        return plane % 2 == 0 ? p.w + coordinate : p.w - coordinate;
+    }
+
+    void SetupChunk(const std::vector<SoftwareDraw>& draws, const TriangleChunk& chunk, ChunkBins& bins)
+    {
+        bins.triangles.clear();
+        bins.pairs.clear();
+        const SoftwareDraw& draw = draws[chunk.draw];
+        const ShadedVertex* vertices = shadedVertices.data() + vertexOffsets[chunk.draw];
+
+        ShadedVertex polygon[9];
+        ShadedVertex clipped[9];
+        for (std::size_t triangle = chunk.firstTriangle; triangle < chunk.endTriangle; ++triangle)
+        {
+            polygon[0] = vertices[draw.indices[triangle * 3 + 0]];
+            polygon[1] = vertices[draw.indices[triangle * 3 + 1]];
+            polygon[2] = vertices[draw.indices[triangle * 3 + 2]];
+            int count = 3;
+
+            // Sutherland-Hodgman against the planes some vertex is outside of
+            for (int plane = 0; plane < 6 && count > 0; ++plane)
+            {
+                bool allInside = true;
+                for (int i = 0; i < count; ++i)
+                {
+                    allInside = allInside && PlaneDistance(polygon[i].position, plane) >= 0.0f;
+                }
+                if (allInside)
+                {
+                    continue;
+                }
+                int clippedCount = 0;
+                for (int i = 0; i < count; ++i)
+                {
+                    const ShadedVertex& a = polygon[i];
+                    const ShadedVertex& b = polygon[(i + 1) % count];
+                    float da = PlaneDistance(a.position, plane);
+                    float db = PlaneDistance(b.position, plane);
+                    if (da >= 0.0f)
+                    {
+                        clipped[clippedCount++] = a;
+                    }
+                    if ((da >= 0.0f) != (db >= 0.0f))
+                    {
+                        clipped[clippedCount++] = Lerp(a, b, da / (da - db));
+                    }
+                }
+                count = clippedCount;
+                std::copy(clipped, clipped + count, polygon);
+            }
+
+            for (int i = 1; i + 1 < count; ++i)
+            {
+                SetupTriangle setup;
+                if (Setup(polygon[0], polygon[i], polygon[i + 1], setup))
+                {
+                    setup.draw = static_cast<std::uint32_t>(chunk.draw);
+                    auto index = static_cast<std::uint32_t>(bins.triangles.size());
+                    bins.triangles.push_back(setup);
+                    for (int tileY = setup.minY / TileSize; tileY <= setup.maxY / TileSize; ++tileY)
+                    {
+                        for (int tileX = setup.minX / TileSize; tileX <= setup.maxX / TileSize; ++tileX)
+                        {
+                            bins.pairs.push_back({ static_cast<std::uint32_t>(tileY * tilesX + tileX), index });
+                        }
+                    }
+                }
+            }
+        }
+
+        // Counting sort by tile, triangles stay in submission order within a tile
+        std::size_t tileCount = static_cast<std::size_t>(tilesX) * tilesY;
+        bins.tileStarts.assign(tileCount + 1, 0);
+        for (auto& pair : bins.pairs)
+        {
+            ++bins.tileStarts[pair.first + 1];
+        }
+        for (std::size_t tile = 0; tile < tileCount; ++tile)
+        {
+            bins.tileStarts[tile + 1] += bins.tileStarts[tile];
+        }
+        bins.tileTriangles.resize(bins.pairs.size());
+        std::vector<std::uint32_t> cursors(bins.tileStarts.begin(), bins.tileStarts.end() - 1);
+        for (auto& pair : bins.pairs)
+        {
+            bins.tileTriangles[cursors[pair.first]++] = pair.second;
+        }
+    }
+
+    // False for back facing, degenerate and sample-free triangles
+    bool Setup(const ShadedVertex& v0, const ShadedVertex& v1, const ShadedVertex& v2, SetupTriangle& setup) const
+    {
+        // Counter clockwise in window coordinates is positive, lab3 draws clockwise front faces. Back faces are
+        // rejected before any attribute is touched.
+        const ShadedVertex* v[3] = { &v0, &v2, &v1 };
+        float inverseW[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            inverseW[i] = 1.0f / v[i]->position.w;
+            setup.x[i] = SnapToSubpixel((v[i]->position.x * inverseW[i] * 0.5f + 0.5f) * width);
+            setup.y[i] = SnapToSubpixel((v[i]->position.y * inverseW[i] * 0.5f + 0.5f) * height);
+        }
+        // Vertices 1 and 2 are swapped, so front faces come out counter clockwise and every edge function is
+        // positive inside
+        setup.area = (setup.x[1] - setup.x[0]) * (setup.y[2] - setup.y[0]) - (setup.y[1] - setup.y[0]) * (setup.x[2] - setup.x[0]);
+        if (setup.area <= 0)
+        {
+            return false;
+        }
+        for (int i = 0; i < 3; ++i)
+        {
+            setup.depth[i] = v[i]->position.z * inverseW[i] * 0.5f + 0.5f;
+            setup.inverseW[i] = inverseW[i];
+            setup.normal[i] = v[i]->normal * inverseW[i];
+            setup.textureCoordinates[i] = v[i]->textureCoordinates * inverseW[i];
+        }
+
+        // Pixels whose centers can be covered
+        constexpr std::int64_t Half = SubpixelScale / 2;
+        std::int64_t minX = std::min({ setup.x[0], setup.x[1], setup.x[2] });
+        std::int64_t maxX = std::max({ setup.x[0], setup.x[1], setup.x[2] });
+        std::int64_t minY = std::min({ setup.y[0], setup.y[1], setup.y[2] });
+        std::int64_t maxY = std::max({ setup.y[0], setup.y[1], setup.y[2] });
+        setup.minX = static_cast<int>(std::max<std::int64_t>(0, (minX - Half + SubpixelScale - 1) >> SubpixelBits));
+        setup.minY = static_cast<int>(std::max<std::int64_t>(0, (minY - Half + SubpixelScale - 1) >> SubpixelBits));
+        setup.maxX = static_cast<int>(std::min<std::int64_t>(width - 1, (maxX - Half) >> SubpixelBits));
+        setup.maxY = static_cast<int>(std::min<std::int64_t>(height - 1, (maxY - Half) >> SubpixelBits));
+        return setup.minX <= setup.maxX && setup.minY <= setup.maxY;
+    }
+
+    void RasterizeTile(SoftwareFramebuffer& framebuffer, const std::vector<SoftwareDraw>& draws, int tile, const glm::vec4& clearColor)
+    {
+        const int tileMinX = tile % tilesX * TileSize;
+        const int tileMinY = tile / tilesX * TileSize;
+        const int tileMaxX = std::min(tileMinX + TileSize, width) - 1;
+        const int tileMaxY = std::min(tileMinY + TileSize, height) - 1;
+
+        const std::uint8_t clear[4] = { ToUnorm8(clearColor.x), ToUnorm8(clearColor.y), ToUnorm8(clearColor.z), ToUnorm8(clearColor.w) };
+        for (int y = tileMinY; y <= tileMaxY; ++y)
+        {
+            for (int x = tileMinX; x <= tileMaxX; ++x)
+            {
+                std::size_t pixel = static_cast<std::size_t>(y) * width + x;
+                std::copy(clear, clear + 4, &framebuffer.color[pixel * 4]);
+                framebuffer.depth[pixel] = 1.0f;
+            }
+        }
+
+        std::uint64_t fragments = 0;
+        for (std::size_t chunk = 0; chunk < chunks.size(); ++chunk)
+        {
+            const ChunkBins& bins = chunkBins[chunk];
+            for (std::uint32_t i = bins.tileStarts[tile]; i < bins.tileStarts[tile + 1]; ++i)
+            {
+                const SetupTriangle& triangle = bins.triangles[bins.tileTriangles[i]];
+                fragments += RasterizeTriangle(framebuffer, *draws[triangle.draw].texture, triangle, std::max(tileMinX, triangle.minX),
+                    std::max(tileMinY, triangle.minY), std::min(tileMaxX, triangle.maxX), std::min(tileMaxY, triangle.maxY));
+            }
+        }
+        tileFragments[tile] = fragments;
+    }
+
+    std::uint64_t RasterizeTriangle(SoftwareFramebuffer& framebuffer, const SoftwareTexture& texture, const SetupTriangle& t,
+        int minX, int minY, int maxX, int maxY) const
+    {
+        // Edge i is opposite vertex i, e(p) = (b - a) x (p - a). Left and top edges own the samples on them.
+        struct Edge
+        {
+            std::int64_t stepX, stepY, value;
+        };
+        Edge edges[3];
+        const std::int64_t sampleX = static_cast<std::int64_t>(minX) * SubpixelScale + SubpixelScale / 2;
+        const std::int64_t sampleY = static_cast<std::int64_t>(minY) * SubpixelScale + SubpixelScale / 2;
+        for (int i = 0; i < 3; ++i)
+        {
+            int a = (i + 1) % 3;
+            int b = (i + 2) % 3;
+            std::int64_t dx = t.x[b] - t.x[a];
+            std::int64_t dy = t.y[b] - t.y[a];
+            bool isTopLeft = dy < 0 || (dy == 0 && dx < 0);
+            edges[i].stepX = -dy * SubpixelScale;
+            edges[i].stepY = dx * SubpixelScale;
+            edges[i].value = dx * (sampleY - t.y[a]) - dy * (sampleX - t.x[a]) - (isTopLeft ? 0 : 1);
+        }
+
+        const float inverseArea = 1.0f / static_cast<float>(t.area);
+        std::uint64_t fragments = 0;
+        for (int y = minY; y <= maxY; ++y)
+        {
+            std::int64_t e0 = edges[0].value;
+            std::int64_t e1 = edges[1].value;
+            std::int64_t e2 = edges[2].value;
+            for (int x = minX; x <= maxX; ++x)
+            {
+                if ((e0 | e1 | e2) >= 0)
+                {
+                    float l0 = static_cast<float>(e0) * inverseArea;
+                    float l1 = static_cast<float>(e1) * inverseArea;
+                    float l2 = 1.0f - l0 - l1;
+                    float depth = l0 * t.depth[0] + l1 * t.depth[1] + l2 * t.depth[2];
+                    std::size_t pixel = static_cast<std::size_t>(y) * width + x;
+                    if (depth < framebuffer.depth[pixel])
+                    {
+                        framebuffer.depth[pixel] = depth;
+                        float w = 1.0f / (l0 * t.inverseW[0] + l1 * t.inverseW[1] + l2 * t.inverseW[2]);
+                        glm::vec3 normal = (l0 * t.normal[0] + l1 * t.normal[1] + l2 * t.normal[2]) * w;
+                        glm::vec2 textureCoordinates = (l0 * t.textureCoordinates[0] + l1 * t.textureCoordinates[1] + l2 * t.textureCoordinates[2]) * w;
+                        glm::vec4 color = ShadeFragment(texture, normal, textureCoordinates);
+                        std::uint8_t* target = &framebuffer.color[pixel * 4];
+                        target[0] = ToUnorm8(color.x);
+                        target[1] = ToUnorm8(color.y);
+                        target[2] = ToUnorm8(color.z);
+                        target[3] = ToUnorm8(color.w);
+                        ++fragments;
+                    }
+                }
+                e0 += edges[0].stepX;
+                e1 += edges[1].stepX;
+                e2 += edges[2].stepX;
+            }
+            edges[0].value += edges[0].stepY;
+            edges[1].value += edges[1].stepY;
+            edges[2].value += edges[2].stepY;
+        }
+        return fragments;
+    }
+
+    // Clipped coordinates are never negative, so adding a half rounds. std::llround is a library call.
+    static std::int64_t SnapToSubpixel(float windowCoordinate)
+    {
+        return static_cast<std::int64_t>(windowCoordinate * SubpixelScale + 0.5f);
+    }
+
+    // simple.frag
+    glm::vec4 ShadeFragment(const SoftwareTexture& texture, const glm::vec3& normal, const glm::vec2& textureCoordinates) const
+    {
+        glm::vec4 baseColor = texture.Sample(textureCoordinates);
+        float cos = std::clamp(glm::dot(glm::normalize(normal), lightDirection), 0.0f, 1.0f);
+        return (0.95f * cos * baseColor) + (0.05f * baseColor);
+    }
+
+    static std::uint8_t ToUnorm8(float value)
+    {
+        return static_cast<std::uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+};
@@ -0,0 +1,441 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GL/glew.h"
+#include "spdlog/spdlog.h"
+#include "stb_image.h"
+
+struct MipLevel
+{
+    std::size_t offset;
+    int width;
+    int height;
+};
+
+// RGBA8 mip chains built on the CPU with a 2x2 box filter, odd edges repeat their last texel
+struct MipChain
+{
+    static int LevelCount(int width, int height)
+    {
+        int levels = 1;
+        while (width > 1 || height > 1)
+        {
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+            ++levels;
+        }
+        return levels;
+    }
+
+    static std::size_t ComputeLayout(int width, int height, std::vector<MipLevel>& levels)
+    {
+        levels.clear();
+        std::size_t size = 0;
+        for (int i = LevelCount(width, height); i > 0; --i)
+        {
+            levels.push_back({ size, width, height });
+            size += static_cast<std::size_t>(width) * height * 4;
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+        return size;
+    }
+
+    // Level 0 is already in place, every other level is filtered from the one above it
+    static void Generate(std::uint8_t* pixels, const std::vector<MipLevel>& levels)
+    {
+        for (std::size_t level = 1; level < levels.size(); ++level)
+        {
+            const MipLevel& source = levels[level - 1];
+            const MipLevel& target = levels[level];
+            const std::uint8_t* sourcePixels = pixels + source.offset;
+            std::uint8_t* targetPixels = pixels + target.offset;
+            for (int y = 0; y < target.height; ++y)
+            {
+                int y0 = std::min(y * 2, source.height - 1);
+                int y1 = std::min(y * 2 + 1, source.height - 1);
+                for (int x = 0; x < target.width; ++x)
+                {
+                    int x0 = std::min(x * 2, source.width - 1);
+                    int x1 = std::min(x * 2 + 1, source.width - 1);
+                    const std::uint8_t* texels[4] = {
+                        sourcePixels + (static_cast<std::size_t>(y0) * source.width + x0) * 4,
+                        sourcePixels + (static_cast<std::size_t>(y0) * source.width + x1) * 4,
+                        sourcePixels + (static_cast<std::size_t>(y1) * source.width + x0) * 4,
+                        sourcePixels + (static_cast<std::size_t>(y1) * source.width + x1) * 4
+                    };
+                    std::uint8_t* result = targetPixels + (static_cast<std::size_t>(y) * target.width + x) * 4;
+                    for (int channel = 0; channel < 4; ++channel)
+                    {
+                        result[channel] = static_cast<std::uint8_t>((texels[0][channel] + texels[1][channel] + texels[2][channel] + texels[3][channel] + 2) / 4);
+                    }
+                }
+            }
+        }
+    }
+};
+
+// Reuses decode buffers so steady streaming does not allocate, anything above the limit is freed on release
+struct StagingPool
+{
+    std::size_t maxPooledBytes = 64 * 1024 * 1024;
+
+    std::vector<std::uint8_t> Acquire(std::size_t size)
+    {
+        std::lock_guard lock(mutex);
+        auto best = freeBuffers.end();
+        for (auto it = freeBuffers.begin(); it != freeBuffers.end(); ++it)
+        {
+            if (it->capacity() >= size && (best == freeBuffers.end() || it->capacity() < best->capacity()))
+            {
+                best = it;
+            }
+        }
+        if (best == freeBuffers.end())
+        {
+            return std::vector<std::uint8_t>(size);
+        }
+
+        std::vector<std::uint8_t> buffer = std::move(*best);
+        freeBuffers.erase(best);
+        pooledBytes -= buffer.capacity();
+        buffer.resize(size);
+        return buffer;
+    }
+
+    void Release(std::vector<std::uint8_t>&& buffer)
+    {
+        std::lock_guard lock(mutex);
+        if (pooledBytes + buffer.capacity() <= maxPooledBytes)
+        {
+            pooledBytes += buffer.capacity();
+            freeBuffers.push_back(std::move(buffer));
+        }
+    }
+
+    std::size_t PooledBytes()
+    {
+        std::lock_guard lock(mutex);
+        return pooledBytes;
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::vector<std::uint8_t>> freeBuffers;
+    std::size_t pooledBytes = 0;
+};
+
+struct TextureStreamerStats
+{
+    std::size_t pendingDecodes = 0;
+    std::size_t pendingUploads = 0;
+    std::size_t uploadBudget = 0;
+    std::size_t uploadedBytesLastFrame = 0;
+    std::size_t texturesReady = 0;
+    std::size_t texturesFailed = 0;
+    std::size_t pooledStagingBytes = 0;
+};
+
+// Worker threads decode and build mip chains, the render thread uploads at most uploadBudget bytes per Update
+// (split at row granularity) and a texture is handed out only once every level is on the GPU. Until then Get
+// returns the placeholder.
+struct TextureStreamer
+{
+    using TextureId = std::size_t;
+
+    std::size_t uploadBudget = 4 * 1024 * 1024;
+
+    TextureStreamer() = default;
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    ~TextureStreamer()
+    {
+        Stop();
+    }
+
+    // Needs a current GL context for the placeholder
+    void Start(int workerCount)
+    {
+        // The flip flag is process wide in stb_image, set it before any worker decodes
+        stbi_set_flip_vertically_on_load(true);
+        placeholder = CreatePlaceholder();
+        stopping = false;
+        for (int i = 0; i < std::max(workerCount, 1); ++i)
+        {
+            workers.emplace_back([this] { DecodeLoop(); });
+        }
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wakeWorkers.notify_all();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        workers.clear();
+
+        // Nothing was created when Start never ran, and then there may be no GL context either
+        if (placeholder == 0)
+        {
+            return;
+        }
+        for (auto& texture : textures)
+        {
+            if (texture.texture != 0)
+            {
+                glDeleteTextures(1, &texture.texture);
+                texture.texture = 0;
+            }
+        }
+        if (upload.texture != 0)
+        {
+            glDeleteTextures(1, &upload.texture);
+        }
+        upload = {};
+        glDeleteTextures(1, &placeholder);
+        placeholder = 0;
+    }
+
+    TextureId Request(std::string path)
+    {
+        std::lock_guard lock(mutex);
+        TextureId id = textures.size();
+        textures.push_back({});
+        decodeQueue.push_back({ id, std::move(path) });
+        wakeWorkers.notify_one();
+        return id;
+    }
+
+    GLuint Get(TextureId id) const
+    {
+        return textures[id].texture != 0 ? textures[id].texture : placeholder;
+    }
+
+    bool IsReady(TextureId id) const
+    {
+        return textures[id].texture != 0;
+    }
+
+    // Render thread, once per frame
+    void Update()
+    {
+        std::size_t uploaded = 0;
+        while (uploaded < uploadBudget)
+        {
+            if (upload.pixels.empty() && !BeginNextUpload())
+            {
+                break;
+            }
+
+            const MipLevel& level = upload.levels[upload.level];
+            std::size_t rowSize = static_cast<std::size_t>(level.width) * 4;
+            int rows = static_cast<int>(std::min<std::size_t>((uploadBudget - uploaded) / rowSize, level.height - upload.row));
+            if (rows == 0)
+            {
+                // A row larger than what is left waits for the next frame, unless nothing was uploaded yet
+                if (uploaded > 0)
+                {
+                    break;
+                }
+                rows = 1;
+            }
+
+            glTextureSubImage2D(upload.texture, static_cast<GLint>(upload.level), 0, upload.row, level.width, rows, GL_RGBA, GL_UNSIGNED_BYTE,
+                upload.pixels.data() + level.offset + upload.row * rowSize);
+            uploaded += rows * rowSize;
+            upload.row += rows;
+
+            if (upload.row == level.height)
+            {
+                upload.row = 0;
+                if (++upload.level == upload.levels.size())
+                {
+                    textures[upload.id].texture = upload.texture;
+                    ++texturesReady;
+                    staging.Release(std::move(upload.pixels));
+                    upload = {};
+                }
+            }
+        }
+        uploadedBytesLastFrame = uploaded;
+    }
+
+    TextureStreamerStats Stats()
+    {
+        TextureStreamerStats stats;
+        {
+            std::lock_guard lock(mutex);
+            stats.pendingDecodes = decodeQueue.size() + busyWorkers;
+            stats.pendingUploads = uploadQueue.size() + (upload.pixels.empty() ? 0 : 1);
+            stats.texturesFailed = texturesFailed;
+        }
+        stats.uploadBudget = uploadBudget;
+        stats.uploadedBytesLastFrame = uploadedBytesLastFrame;
+        stats.texturesReady = texturesReady;
+        stats.pooledStagingBytes = staging.PooledBytes();
+        return stats;
+    }
+
+    bool IsIdle()
+    {
+        auto stats = Stats();
+        return stats.pendingDecodes == 0 && stats.pendingUploads == 0;
+    }
+
+private:
+    struct StreamedTexture
+    {
+        GLuint texture = 0;
+    };
+
+    struct DecodeJob
+    {
+        TextureId id;
+        std::string path;
+    };
+
+    struct DecodedTexture
+    {
+        TextureId id = 0;
+        std::vector<std::uint8_t> pixels;
+        std::vector<MipLevel> levels;
+    };
+
+    struct Upload : DecodedTexture
+    {
+        GLuint texture = 0;
+        std::size_t level = 0;
+        int row = 0;
+    };
+
+    std::vector<StreamedTexture> textures;
+    GLuint placeholder = 0;
+    StagingPool staging;
+    Upload upload;
+    std::size_t uploadedBytesLastFrame = 0;
+    std::size_t texturesReady = 0;
+
+    // Guarded by mutex
+    std::mutex mutex;
+    std::condition_variable wakeWorkers;
+    std::deque<DecodeJob> decodeQueue;
+    std::deque<DecodedTexture> uploadQueue;
+    std::size_t busyWorkers = 0;
+    std::size_t texturesFailed = 0;
+    bool stopping = false;
+
+    std::vector<std::thread> workers;
+
+    bool BeginNextUpload()
+    {
+        {
+            std::lock_guard lock(mutex);
+            if (uploadQueue.empty())
+            {
+                return false;
+            }
+            static_cast<DecodedTexture&>(upload) = std::move(uploadQueue.front());
+            uploadQueue.pop_front();
+        }
+
+        const MipLevel& base = upload.levels.front();
+        glCreateTextures(GL_TEXTURE_2D, 1, &upload.texture);
+        glTextureStorage2D(upload.texture, static_cast<GLsizei>(upload.levels.size()), GL_RGBA8, base.width, base.height);
+        upload.level = 0;
+        upload.row = 0;
+        return true;
+    }
+
+    void DecodeLoop()
+    {
+        while (true)
+        {
+            DecodeJob job;
+            {
+                std::unique_lock lock(mutex);
+                wakeWorkers.wait(lock, [this] { return stopping || !decodeQueue.empty(); });
+                if (stopping)
+                {
+                    return;
+                }
+                job = std::move(decodeQueue.front());
+                decodeQueue.pop_front();
+                ++busyWorkers;
+            }
+
+            DecodedTexture decoded;
+            bool succeeded = Decode(job, decoded);
+
+            std::lock_guard lock(mutex);
+            --busyWorkers;
+            if (succeeded)
+            {
+                uploadQueue.push_back(std::move(decoded));
+            }
+            else
+            {
+                ++texturesFailed;
+            }
+        }
+    }
+
+    // Always four channels, whatever the file stores
+    bool Decode(const DecodeJob& job, DecodedTexture& decoded)
+    {
+        int width, height, channels;
+        unsigned char* data = stbi_load(job.path.c_str(), &width, &height, &channels, 4);
+        if (data == nullptr)
+        {
+            spdlog::error("Unable to decode texture \"{}\"", job.path);
+            return false;
+        }
+
+        decoded.id = job.id;
+        decoded.pixels = staging.Acquire(MipChain::ComputeLayout(width, height, decoded.levels));
+        std::memcpy(decoded.pixels.data(), data, static_cast<std::size_t>(width) * height * 4);
+        stbi_image_free(data);
+        MipChain::Generate(decoded.pixels.data(), decoded.levels);
+        return true;
+    }
+
+    // Grey and magenta checkerboard, obviously not a finished texture
+    static GLuint CreatePlaceholder()
+    {
+        constexpr int Size = 8;
+        std::uint8_t pixels[Size * Size * 4];
+        for (int y = 0; y < Size; ++y)
+        {
+            for (int x = 0; x < Size; ++x)
+            {
+                bool odd = ((x / 2) + (y / 2)) % 2 == 1;
+                std::uint8_t* texel = pixels + (y * Size + x) * 4;
+                texel[0] = odd ? 255 : 128;
+                texel[1] = odd ? 0 : 128;
+                texel[2] = odd ? 255 : 128;
+                texel[3] = 255;
+            }
+        }
+
+        GLuint texture;
+        glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+        glTextureStorage2D(texture, 1, GL_RGBA8, Size, Size);
+        glTextureSubImage2D(texture, 0, 0, 0, Size, Size, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        return texture;
+    }
+};
@@ -6,12 +6,15 @@ struct CursorPosition
 {
     float x = 0.0f;
     float y = 0.0f;
+    // glfwGetTime when the position was read
+    double time = 0.0;
 
+    // With GLFW_CURSOR_DISABLED this is the position as of the last glfwPollEvents
     static CursorPosition Current(GLFWwindow* window)
     {
         double x, y;
         glfwGetCursorPos(window, &x, &y);
-        return { static_cast<float>(x), static_cast<float>(y) };
+        return { static_cast<float>(x), static_cast<float>(y), glfwGetTime() };
     }
 };
 
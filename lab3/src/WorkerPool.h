@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads parked between jobs, so work split per frame does not pay for starting threads every time.
+// ParallelFor hands the indices of a job to the workers and the calling thread and returns when all are done.
+struct WorkerPool
+{
+    WorkerPool() = default;
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool()
+    {
+        Stop();
+    }
+
+    // The thread calling ParallelFor works too, so threadCount - 1 workers are started
+    void Start(int threadCount)
+    {
+        stopRequested = false;
+        for (int i = 1; i < threadCount; ++i)
+        {
+            workers.emplace_back([this, generation = jobGeneration] { WorkerLoop(generation); });
+        }
+    }
+
+    void Stop()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopRequested = true;
+        }
+        jobStarted.notify_all();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+        workers.clear();
+    }
+
+    int ThreadCount() const
+    {
+        return static_cast<int>(workers.size()) + 1;
+    }
+
+    void ParallelFor(std::size_t count, const std::function<void(std::size_t)>& function)
+    {
+        {
+            std::lock_guard lock(mutex);
+            job = &function;
+            jobCount = count;
+            nextJobIndex = 0;
+            busyWorkers = static_cast<int>(workers.size());
+            ++jobGeneration;
+        }
+        jobStarted.notify_all();
+        RunJobs();
+        std::unique_lock lock(mutex);
+        jobFinished.wait(lock, [this] { return busyWorkers == 0; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable jobStarted;
+    std::condition_variable jobFinished;
+    bool stopRequested = false;
+    std::uint64_t jobGeneration = 0;
+    int busyWorkers = 0;
+    const std::function<void(std::size_t)>* job = nullptr;
+    std::size_t jobCount = 0;
+    std::atomic<std::size_t> nextJobIndex{ 0 };
+
+    void RunJobs()
+    {
+        for (std::size_t i = nextJobIndex++; i < jobCount; i = nextJobIndex++)
+        {
+            (*job)(i);
+        }
+    }
+
+    // seenGeneration is the last job started before this worker, it must not run that one
+    void WorkerLoop(std::uint64_t seenGeneration)
+    {
+        for (;;)
+        {
+            {
+                std::unique_lock lock(mutex);
+                jobStarted.wait(lock, [&] { return stopRequested || jobGeneration != seenGeneration; });
+                if (stopRequested)
+                {
+                    return;
+                }
+                seenGeneration = jobGeneration;
+            }
+            RunJobs();
+            {
+                std::lock_guard lock(mutex);
+                if (--busyWorkers == 0)
+                {
+                    jobFinished.notify_one();
+                }
+            }
+        }
+    }
+};
@@ -1,4 +1,16 @@
+#include <cctype>
 #include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <filesystem>
+#include <string_view>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <array>
+#include <tuple>
+#include <numeric>
 
 #include "vector"
 
@@ -9,145 +21,728 @@
 #include "spdlog/spdlog.h"
 
 #include "Camera.h"
+#include "Checks.h"
 #include "Clock.h"
 #include "WindowUtil.h"
 #include "FPSCameraController.h"
 #include "Debug.h"
 #include "Shader.h"
+#include "ShaderRegistry.h"
+#include "Mesh.h"
+#include "AssetPack.h"
+#include "CompressedVertex.h"
+#include "MeshOptimizer.h"
+#include "RenderQueue.h"
+#include "RingBuffer.h"
+#include "TextureStreamer.h"
+#include "MeshBatch.h"
+#include "FrustumCulling.h"
+#include "SoftwareRenderer.h"
+#include "LatencyTracker.h"
 
-struct Vertex
+constexpr const char* AssetPackPath = "res/assets.pack";
+constexpr const char* VertexShaderPath = "res/simple.vert";
+constexpr const char* FragmentShaderPath = "res/simple.frag";
+constexpr const char* TexturePath = "res/water.png";
+constexpr const char* InstancedVertexShaderPath = "res/instanced.vert";
+constexpr const char* InstancedFragmentShaderPath = "res/instanced.frag";
+constexpr const char* ShaderCacheDirectory = "shadercache";
+
+GLuint CreateTexture(int width, int height, const void* rgba)
 {
-    float x, y, z;
-    float nx, ny, nz;
-    float tx, ty;
-};
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
 
-struct Mesh
+// Synchronous, TextureStreamer does the same work off the render thread
+GLuint LoadTexture(std::string_view path)
 {
-    GLuint vao;
-    GLuint vbo;
-    GLuint ibo;
-    int indicesSize;
-};
+    // Always decoded to RGBA, CreateTexture has no idea how many channels the file stores
+    int width, height, bpp;
+    stbi_set_flip_vertically_on_load(true);
+    unsigned char* data = stbi_load(path.data(), &width, &height, &bpp, 4);
+    if (data == nullptr)
+    {
+        spdlog::critical("Unable to decode texture \"{}\"", path);
+        return 0;
+    }
+
+    GLuint texture = CreateTexture(width, height, data);
+
+    stbi_image_free(data);
+
+    return texture;
+}
 
-struct ModelInfo
+// The program belongs to the registry, it outlives the assets and may be rebuilt when its sources change
+struct SceneAssets
 {
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
+    Mesh mesh;
+    ShaderRegistry::Handle shader = ShaderRegistry::InvalidHandle;
+    GLuint texture = 0;
+
+    bool IsValid() const
+    {
+        return mesh.vao != 0 && shader != ShaderRegistry::InvalidHandle && texture != 0;
+    }
 };
 
-Mesh CreateMesh(const ModelInfo& modelInfo)
+void ConfigureSceneProgram(const ShaderProgram& program)
 {
-    Mesh result;
-    result.indicesSize = static_cast<int>(modelInfo.indices.size());
+    Shader::SetUniformBlockBinding(program.program, "FrameUniforms", FrameUniforms::Binding);
+    glProgramUniform1i(program.program, program.uniforms.Location("colorTexture"), 0);
+}
 
-    glCreateVertexArrays(1, &result.vao);
-    glBindVertexArray(result.vao);
+ModelInfo GenerateSceneModel()
+{
+    ModelInfo modelInfo = GeneratePyramid(5, 3, 8);
+    MeshOptimizer::Optimize(modelInfo);
+    return modelInfo;
+}
 
-    glCreateBuffers(1, &result.vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, result.vbo);
-    glBufferData(GL_ARRAY_BUFFER, modelInfo.vertices.size() * sizeof(modelInfo.vertices[0]), modelInfo.vertices.data(), GL_STATIC_DRAW);
+SceneAssets LoadSceneAssetsFromFiles(ShaderRegistry& shaders)
+{
+    SceneAssets assets;
+    assets.mesh = CreateMesh(GenerateSceneModel());
+    assets.shader = shaders.Load(VertexShaderPath, FragmentShaderPath, ConfigureSceneProgram);
+    assets.texture = LoadTexture(TexturePath);
+    return assets;
+}
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(float) * 3));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(float) * 6));
+// Everything is uploaded straight from the mapping, except sources edited since the pack was built. Those are loaded
+// from their files so the pack never hides an edit.
+SceneAssets LoadSceneAssetsFromPack(const AssetPack& pack, ShaderRegistry& shaders)
+{
+    SceneAssets assets;
+    auto mesh = pack.Find("pyramid", AssetType::Mesh);
+    auto vertexShader = pack.Find(VertexShaderPath, AssetType::ShaderSource);
+    auto fragmentShader = pack.Find(FragmentShaderPath, AssetType::ShaderSource);
+    auto texture = pack.Find(TexturePath, AssetType::Texture);
+    if (mesh == nullptr || vertexShader == nullptr || fragmentShader == nullptr || texture == nullptr)
+    {
+        spdlog::error("Asset pack is missing scene assets");
+        return assets;
+    }
 
-    glCreateBuffers(1, &result.ibo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, result.ibo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, modelInfo.indices.size() * sizeof(unsigned int), modelInfo.indices.data(), GL_STATIC_DRAW);
+    auto isCurrent = [](const AssetPackEntry* entry) {
+        if (AssetPack::IsCurrent(*entry))
+        {
+            return true;
+        }
+        spdlog::warn("\"{}\" changed since the asset pack was built, loading it from the file. Run \"lab3 --pack\" to update the pack", entry->name);
+        return false;
+    };
 
-    return result;
+    assets.mesh = CreateMesh(pack.Vertices(*mesh), mesh->vertexCount, pack.Indices(*mesh), mesh->indexCount);
+    // Both checks run so every stale source is reported
+    const bool vertexShaderCurrent = isCurrent(vertexShader);
+    const bool fragmentShaderCurrent = isCurrent(fragmentShader);
+    if (vertexShaderCurrent && fragmentShaderCurrent)
+    {
+        assets.shader = shaders.Create(pack.ShaderSource(*vertexShader), pack.ShaderSource(*fragmentShader), VertexShaderPath, FragmentShaderPath,
+            ConfigureSceneProgram);
+    }
+    else
+    {
+        assets.shader = shaders.Load(VertexShaderPath, FragmentShaderPath, ConfigureSceneProgram);
+    }
+    assets.texture = isCurrent(texture) ? CreateTexture(texture->width, texture->height, pack.Data(*texture)) : LoadTexture(TexturePath);
+    return assets;
 }
 
-ModelInfo GeneratePyramid(int height, int radius, int edges)
+void DestroySceneAssets(SceneAssets& assets)
 {
-    ModelInfo info;
-    /*info.vertices.push_back({  0.0f,  1.0f, 3.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f });
-    info.vertices.push_back({ -1.0f, -1.0f, 3.0f, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f });
-    info.vertices.push_back({  1.0f, -1.0f, 3.0f, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f });
-    info.indices = { 0, 1, 2 };*/
+    DestroyMesh(assets.mesh);
+    glDeleteTextures(1, &assets.texture);
+    assets = {};
+}
 
-    std::vector<glm::vec3> circle;
+// lab3 --pack [output], run from the lab3 directory so the res/ paths resolve
+int PackAssets(const char* outputPath)
+{
+    AssetPackWriter writer;
+    writer.AddMesh("pyramid", GenerateSceneModel());
 
-    float angleStep = 360.0f / edges;
-    for (float angle = 0.0f; angle < 360.0f; angle += angleStep)
+    for (const char* path : { VertexShaderPath, FragmentShaderPath })
     {
-        float r = glm::radians(angle);
-        circle.push_back({ radius * cos(r), 0.0f, radius * sin(r) });
+        std::string source;
+        if (!Shader::ReadFile(path, source))
+        {
+            return EXIT_FAILURE;
+        }
+        if (!writer.AddShaderSource(path, source))
+        {
+            spdlog::critical("Unable to pack \"{}\"", path);
+            return EXIT_FAILURE;
+        }
     }
 
-    for (int i = 1; i < circle.size() - 1; ++i)
+    // Decoded once here, always as RGBA so the loader never needs to know the source channel count
+    int width, height, bpp;
+    stbi_set_flip_vertically_on_load(true);
+    unsigned char* data = stbi_load(TexturePath, &width, &height, &bpp, 4);
+    if (data == nullptr)
     {
-        const auto& p1 = circle[0];
-        const auto& p2 = circle[i];
-        const auto& p3 = circle[i + 1];
+        spdlog::critical("Unable to decode texture \"{}\"", TexturePath);
+        return EXIT_FAILURE;
+    }
+    writer.AddTexture(TexturePath, width, height, data);
+    stbi_image_free(data);
 
-        const auto n = glm::cross(p2 - p1, p3 - p1);
+    if (!writer.Write(outputPath))
+    {
+        spdlog::critical("Unable to write asset pack \"{}\"", outputPath);
+        return EXIT_FAILURE;
+    }
+    spdlog::info("Wrote {} assets to \"{}\"", writer.entries.size(), outputPath);
+    return EXIT_SUCCESS;
+}
 
-        int current = static_cast<int>(info.vertices.size());
+enum class AssetSource
+{
+    Files,
+    Pack
+};
 
-        info.vertices.push_back({ p1.x, -height / 2.0f, p1.z, n.x, n.y, n.z, 0.0f, 0.0f });
-        info.vertices.push_back({ p3.x, -height / 2.0f, p3.z, n.x, n.y, n.z, 1.0f, 1.0f });
-        info.vertices.push_back({ p2.x, -height / 2.0f, p2.z, n.x, n.y, n.z, 1.0f, 0.0f });
+// Loads from the files when pack is null, includes waiting for the driver to finish the uploads
+SceneAssets LoadSceneAssets(const AssetPack* pack, ShaderRegistry& shaders, double& milliseconds)
+{
+    auto start = std::chrono::steady_clock::now();
+    SceneAssets assets = pack != nullptr ? LoadSceneAssetsFromPack(*pack, shaders) : LoadSceneAssetsFromFiles(shaders);
+    glFinish();
+    milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return assets;
+}
+
+// The first load in a process is the cold number: the driver and the file cache start empty for this process,
+// the OS page cache is not flushed, so drop it beforehand for a truly cold run. Later loads are warm. With the
+// shader cache every load after the very first launch reads program binaries instead of compiling.
+int RunStartupBenchmark(AssetSource source, bool useShaderCache, int repeatCount)
+{
+    const char* sourceName = source == AssetSource::Pack ? "asset pack" : "files";
+
+    ShaderRegistryStats shaderStats;
+    auto load = [&](double& milliseconds) {
+        ShaderRegistry shaders;
+        if (useShaderCache)
+        {
+            shaders.binaryCache.Enable(ShaderCacheDirectory);
+        }
+        // Mapping the pack is part of the startup cost
+        auto start = std::chrono::steady_clock::now();
+        AssetPack pack;
+        if (source == AssetSource::Pack)
+        {
+            pack = AssetPack::Open(AssetPackPath);
+            if (!pack.IsOpen())
+            {
+                spdlog::error("Unable to open asset pack \"{}\", run \"lab3 --pack\" first", AssetPackPath);
+                return false;
+            }
+        }
+        double openMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        SceneAssets assets = LoadSceneAssets(pack.IsOpen() ? &pack : nullptr, shaders, milliseconds);
+        milliseconds += openMilliseconds;
+        bool isValid = assets.IsValid();
+        DestroySceneAssets(assets);
+        shaders.Destroy();
+        shaderStats.compiled += shaders.stats.compiled;
+        shaderStats.cacheHits += shaders.stats.cacheHits;
+        return isValid;
+    };
+
+    double coldMilliseconds;
+    if (!load(coldMilliseconds))
+    {
+        return EXIT_FAILURE;
+    }
 
-        info.indices.push_back(current);
-        info.indices.push_back(current + 1);
-        info.indices.push_back(current + 2);
+    std::vector<double> warmMilliseconds;
+    for (int i = 0; i < repeatCount; ++i)
+    {
+        double milliseconds;
+        load(milliseconds);
+        warmMilliseconds.push_back(milliseconds);
     }
+    std::sort(warmMilliseconds.begin(), warmMilliseconds.end());
 
-    auto top = glm::vec3{ 0.0f, height / 2.0f, 0.0f };
+    spdlog::info("Startup from {}: cold {:.3f} ms, warm median {:.3f} ms (min {:.3f} ms, {} runs)", sourceName, coldMilliseconds,
+        warmMilliseconds.empty() ? 0.0 : warmMilliseconds[warmMilliseconds.size() / 2],
+        warmMilliseconds.empty() ? 0.0 : warmMilliseconds.front(), warmMilliseconds.size());
+    spdlog::info("Shader cache {}: {} programs compiled, {} loaded from binaries", useShaderCache ? "on" : "off", shaderStats.compiled,
+        shaderStats.cacheHits);
+    return EXIT_SUCCESS;
+}
 
-    auto addEdge = [&](int i, int j)
+// lab3 --bench-uniforms [iterations], the vertex decoding uniforms set once per draw through glGetUniformLocation
+// against the reflected table. The driver call itself is in both, the difference is the lookup.
+int RunUniformBenchmark(int iterations)
+{
+    ShaderRegistry shaders;
+    auto handle = shaders.Load(VertexShaderPath, FragmentShaderPath, ConfigureSceneProgram);
+    if (handle == ShaderRegistry::InvalidHandle)
     {
-        const auto& p2 = circle[i];
-        const auto& p3 = circle[j];
+        return EXIT_FAILURE;
+    }
+    const ShaderProgram& program = shaders.Get(handle);
+    glUseProgram(program.program);
 
-        const auto n = glm::cross(p3 - top, p2 - top);
+    VertexDecoding decoding;
+    auto measure = [iterations](auto setUniforms) {
+        glFinish();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            setUniforms();
+        }
+        glFinish();
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+    };
 
-        int current = static_cast<int>(info.vertices.size());
+    double byName = measure([&] {
+        Shader::SetBoolUniform(program.program, "compressedVertices", decoding.compressed);
+        Shader::SetVec3Uniform(program.program, "positionOffset", decoding.positionOffset);
+        Shader::SetVec3Uniform(program.program, "positionScale", decoding.positionScale);
+        Shader::SetVec2Uniform(program.program, "textureCoordinatesOffset", decoding.textureCoordinatesOffset);
+        Shader::SetVec2Uniform(program.program, "textureCoordinatesScale", decoding.textureCoordinatesScale);
+    });
+    double reflected = measure([&] { SetVertexDecodingUniforms(program.uniforms, decoding); });
 
-        info.vertices.push_back({ top.x, top.y, top.z, n.x, n.y, n.z, 0.0f, 0.0f });
-        info.vertices.push_back({ p2.x, -height / 2.0f, p2.z, n.x, n.y, n.z, 1.0f, 0.0f });
-        info.vertices.push_back({ p3.x, -height / 2.0f, p3.z, n.x, n.y, n.z, 1.0f, 1.0f });
+    spdlog::info("5 uniforms per draw, {} draws: glGetUniformLocation {:.1f} ns, reflected table {:.1f} ns per draw", iterations, byName, reflected);
+    shaders.Destroy();
+    return EXIT_SUCCESS;
+}
 
-        info.indices.push_back(current);
-        info.indices.push_back(current + 1);
-        info.indices.push_back(current + 2);
+// Heightfield emitted as a triangle soup in random order, what an unindexed exporter would produce
+ModelInfo GenerateTriangleSoupGrid(int size, unsigned int seed)
+{
+    auto gridVertex = [size](int x, int z) {
+        float height = 0.1f * std::sin(x * 0.3f) * std::cos(z * 0.2f);
+        return Vertex{ static_cast<float>(x), height, static_cast<float>(z), 0.0f, 1.0f, 0.0f,
+            static_cast<float>(x) / size, static_cast<float>(z) / size };
     };
 
-    for (int i = 0; i < circle.size() - 1; ++i)
+    std::vector<std::array<Vertex, 3>> triangles;
+    for (int z = 0; z < size; ++z)
     {
-        addEdge(i, i + 1);
+        for (int x = 0; x < size; ++x)
+        {
+            triangles.push_back({ gridVertex(x, z), gridVertex(x, z + 1), gridVertex(x + 1, z) });
+            triangles.push_back({ gridVertex(x + 1, z), gridVertex(x, z + 1), gridVertex(x + 1, z + 1) });
+        }
     }
-    addEdge(static_cast<int>(circle.size() - 1), 0);
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937(seed));
 
+    ModelInfo info;
+    for (auto& triangle : triangles)
+    {
+        for (auto& vertex : triangle)
+        {
+            info.indices.push_back(static_cast<unsigned int>(info.vertices.size()));
+            info.vertices.push_back(vertex);
+        }
+    }
     return info;
 }
 
-void DrawMesh(const Mesh& mesh)
+void LogMeshOptimization(std::string_view name, ModelInfo modelInfo)
 {
-    glBindVertexArray(mesh.vao);
-    glDrawElements(GL_TRIANGLES, mesh.indicesSize, GL_UNSIGNED_INT, nullptr);
+    ModelInfo indexed = modelInfo;
+    MeshOptimizer::WeldVertices(indexed);
+    float weldedAcmr = MeshOptimizer::ComputeAcmr(indexed.indices, indexed.vertices.size(), MeshOptimizer::DefaultCacheSize);
+
+    MeshOptimizationStats stats = MeshOptimizer::Optimize(modelInfo);
+    spdlog::info("{}: {} triangles, {} -> {} vertices, ACMR {:.3f} -> {:.3f} (welded only {:.3f}), FIFO cache of {}",
+        name, stats.triangles, stats.verticesBefore, stats.verticesAfter, stats.acmrBefore, stats.acmrAfter, weldedAcmr,
+        MeshOptimizer::DefaultCacheSize);
 }
 
-GLuint LoadTexture(std::string_view path)
+// lab3 --mesh-optimizer-report, simulated cache so no GPU is needed
+int RunMeshOptimizerReport()
+{
+    LogMeshOptimization("pyramid", GeneratePyramid(5, 3, 8));
+    LogMeshOptimization("grid soup 256x256", GenerateTriangleSoupGrid(256, 1));
+    return EXIT_SUCCESS;
+}
+
+// Animated grid rewritten every frame, stands in for CPU generated geometry
+struct StreamedGeometry
 {
+    static constexpr int GridSize = 32;
+    static constexpr int VertexCount = (GridSize + 1) * (GridSize + 1);
+    static constexpr int IndexCount = GridSize * GridSize * 6;
+
+    // Only the vertex array, the buffers belong to the ring
+    Mesh mesh;
+    GLintptr indexOffset = 0;
+    GLint baseVertex = 0;
+
+    // The ring buffer is both the vertex and the index buffer, draws select their region with offsets
+    static StreamedGeometry Create(const PersistentRingBuffer& ring)
+    {
+        StreamedGeometry result;
+        result.mesh.indicesSize = IndexCount;
+        GLuint& vao = result.mesh.vao;
+        glCreateVertexArrays(1, &vao);
+        glVertexArrayVertexBuffer(vao, 0, ring.buffer, 0, sizeof(Vertex));
+        glVertexArrayElementBuffer(vao, ring.buffer);
+        const GLuint sizes[3] = { 3, 3, 2 };
+        const GLuint offsets[3] = { offsetof(Vertex, x), offsetof(Vertex, nx), offsetof(Vertex, tx) };
+        for (GLuint attribute = 0; attribute < 3; ++attribute)
+        {
+            glEnableVertexArrayAttrib(vao, attribute);
+            glVertexArrayAttribFormat(vao, attribute, sizes[attribute], GL_FLOAT, GL_FALSE, offsets[attribute]);
+            glVertexArrayAttribBinding(vao, attribute, 0);
+        }
+        return result;
+    }
+
+    bool Stream(PersistentRingBuffer& ring, float time)
+    {
+        PersistentRingBuffer::Allocation vertices, indices;
+        if (!ring.Allocate(VertexCount * sizeof(Vertex), sizeof(Vertex), vertices) || !ring.Allocate(IndexCount * sizeof(unsigned int), sizeof(unsigned int), indices))
+        {
+            return false;
+        }
+        baseVertex = static_cast<GLint>(vertices.offset / sizeof(Vertex));
+        indexOffset = indices.offset;
+
+        // Height field below the pyramid, normals from the analytic derivatives
+        constexpr float Extent = 12.0f;
+        constexpr float Height = -3.5f;
+        auto vertex = static_cast<Vertex*>(vertices.data);
+        for (int z = 0; z <= GridSize; ++z)
+        {
+            for (int x = 0; x <= GridSize; ++x)
+            {
+                float u = static_cast<float>(x) / GridSize;
+                float v = static_cast<float>(z) / GridSize;
+                float worldX = (u - 0.5f) * Extent;
+                float worldZ = (v - 0.5f) * Extent;
+                float phase = 0.8f * worldX + 0.6f * worldZ + 2.0f * time;
+                float y = Height + 0.25f * std::sin(phase);
+                float slope = 0.25f * std::cos(phase);
+                glm::vec3 normal = glm::normalize(glm::vec3{ -0.8f * slope, 1.0f, -0.6f * slope });
+                *vertex++ = { worldX, y, worldZ, normal.x, normal.y, normal.z, u, v };
+            }
+        }
+
+        // Same winding as the pyramid faces
+        auto index = static_cast<unsigned int*>(indices.data);
+        for (int z = 0; z < GridSize; ++z)
+        {
+            for (int x = 0; x < GridSize; ++x)
+            {
+                unsigned int v00 = z * (GridSize + 1) + x;
+                unsigned int v10 = v00 + 1;
+                unsigned int v01 = v00 + GridSize + 1;
+                unsigned int v11 = v01 + 1;
+                for (unsigned int i : { v00, v10, v01, v10, v11, v01 })
+                {
+                    *index++ = i;
+                }
+            }
+        }
+        return true;
+    }
+
+    // This frame's grid, drawn with the scene program like the other meshes
+    DrawCommand Command(GLuint program, GLuint texture) const
+    {
+        DrawCommand result;
+        result.program = program;
+        result.texture = texture;
+        result.mesh = &mesh;
+        result.indexOffset = indexOffset;
+        result.baseVertex = baseVertex;
+        return result;
+    }
+
+    void Destroy()
+    {
+        glDeleteVertexArrays(1, &mesh.vao);
+        mesh.vao = 0;
+    }
+};
+
+// Binds this frame's copy of the block, the previous copies stay untouched until the GPU is done with them
+bool UploadFrameUniforms(PersistentRingBuffer& ring, const FrameUniforms& frameUniforms, GLint uniformAlignment)
+{
+    PersistentRingBuffer::Allocation allocation;
+    if (!ring.Allocate(sizeof(FrameUniforms), static_cast<std::uint64_t>(uniformAlignment), allocation))
+    {
+        return false;
+    }
+    std::memcpy(allocation.data, &frameUniforms, sizeof(FrameUniforms));
+    glBindBufferRange(GL_UNIFORM_BUFFER, FrameUniforms::Binding, ring.buffer, allocation.offset, sizeof(FrameUniforms));
+    return true;
+}
+
+int CullingThreadCount()
+{
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+}
+
+// lab3 --bench-frustum-culling, scalar against SIMD against SIMD on every hardware thread
+int RunFrustumCullingBenchmark()
+{
+    constexpr int Runs = 11;
+    Camera camera = CreateCullingTestCamera();
+    FrustumPlanes frustum = FrustumPlanes::FromMatrix(BuildCullingTestPerspective(0.1f, 1000.0f) * camera.BuildWorldToCameraMatrix());
+    const int threadCount = CullingThreadCount();
+    WorkerPool workers;
+    workers.Start(threadCount);
+
+    for (std::size_t count : { std::size_t(100000), std::size_t(1000000) })
+    {
+        BoundingSphereArray spheres;
+        BoundingBoxArray boxes;
+        GenerateRandomBounds(count, 2, spheres, boxes);
+        std::vector<std::uint32_t> visible(count);
+
+        auto measure = [&](auto cull) {
+            std::vector<double> milliseconds;
+            for (int run = 0; run < Runs; ++run)
+            {
+                auto start = std::chrono::steady_clock::now();
+                cull();
+                milliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            }
+            std::sort(milliseconds.begin(), milliseconds.end());
+            return milliseconds[milliseconds.size() / 2];
+        };
+
+        double sphereScalar = measure([&] { FrustumCulling::CullSpheresScalar(frustum, spheres, 0, count, visible.data()); });
+        double sphereSimd = measure([&] { FrustumCulling::CullSpheres(frustum, spheres, 0, count, visible.data()); });
+        double sphereThreaded = measure([&] { FrustumCulling::CullParallel(workers, frustum, spheres, FrustumCulling::CullSpheres, visible); });
+        visible.resize(count);
+        double boxScalar = measure([&] { FrustumCulling::CullBoxesScalar(frustum, boxes, 0, count, visible.data()); });
+        double boxSimd = measure([&] { FrustumCulling::CullBoxes(frustum, boxes, 0, count, visible.data()); });
+        double boxThreaded = measure([&] { FrustumCulling::CullParallel(workers, frustum, boxes, FrustumCulling::CullBoxes, visible); });
+        visible.resize(count);
+
+        spdlog::info("{} spheres: scalar {:.3f} ms, {}-wide {:.3f} ms, {} threads {:.3f} ms", count, sphereScalar, FrustumCulling::Width, sphereSimd,
+            threadCount, sphereThreaded);
+        spdlog::info("{} boxes: scalar {:.3f} ms, {}-wide {:.3f} ms, {} threads {:.3f} ms", count, boxScalar, FrustumCulling::Width, boxSimd,
+            threadCount, boxThreaded);
+    }
+    return EXIT_SUCCESS;
+}
+
+// Wall of small rotating objects in front of the camera, several meshes and texture layers in one batch
+struct InstancedScene
+{
+    MeshBatch batch;
+    ShaderRegistry::Handle program = ShaderRegistry::InvalidHandle;
+    GLuint textures = 0;
+    // xyz position, w scale
+    std::vector<glm::vec4> placements;
+    std::vector<BatchInstance> instances;
+    // Bounding spheres in world space, rotation does not change them
+    BoundingSphereArray bounds;
+    std::vector<std::uint32_t> visibleIndices;
+    std::vector<BatchInstance> visibleInstances;
+
+    bool IsValid() const
+    {
+        return batch.vao != 0 && program != ShaderRegistry::InvalidHandle && textures != 0;
+    }
+};
+
+InstancedScene CreateInstancedScene(ShaderRegistry& shaders, int instanceCount)
+{
+    InstancedScene scene;
+    std::vector<ModelInfo> models = { GeneratePyramid(5, 3, 3), GeneratePyramid(5, 3, 4), GeneratePyramid(5, 3, 8) };
+    float modelRadius = 0.0f;
+    for (auto& model : models)
+    {
+        MeshOptimizer::Optimize(model);
+        for (auto& vertex : model.vertices)
+        {
+            modelRadius = std::max(modelRadius, glm::length(glm::vec3{ vertex.x, vertex.y, vertex.z }));
+        }
+    }
+    scene.batch = MeshBatch::Create(models);
+
+    scene.program = shaders.Load(InstancedVertexShaderPath, InstancedFragmentShaderPath, [](const ShaderProgram& program) {
+        Shader::SetUniformBlockBinding(program.program, "FrameUniforms", FrameUniforms::Binding);
+        glProgramUniform1i(program.program, program.uniforms.Location("colorTextures"), 0);
+    });
+
+    // Tinted copies of the scene texture stand in for different materials
     int width, height, bpp;
     stbi_set_flip_vertically_on_load(true);
-    unsigned char* data = stbi_load(path.data(), &width, &height, &bpp, 0);
+    unsigned char* data = stbi_load(TexturePath, &width, &height, &bpp, 4);
+    if (data == nullptr)
+    {
+        spdlog::critical("Unable to decode texture \"{}\"", TexturePath);
+        return scene;
+    }
+    const std::array<glm::vec3, 4> Tints = { glm::vec3{ 1.0f, 1.0f, 1.0f }, glm::vec3{ 1.0f, 0.5f, 0.4f },
+        glm::vec3{ 0.5f, 1.0f, 0.5f }, glm::vec3{ 1.0f, 0.9f, 0.3f } };
+    std::size_t layerSize = static_cast<std::size_t>(width) * height * 4;
+    std::vector<std::uint8_t> tinted(layerSize * Tints.size());
+    std::vector<const std::uint8_t*> layers;
+    for (std::size_t layer = 0; layer < Tints.size(); ++layer)
+    {
+        std::uint8_t* pixels = tinted.data() + layer * layerSize;
+        for (std::size_t i = 0; i < layerSize; ++i)
+        {
+            pixels[i] = i % 4 == 3 ? data[i] : static_cast<std::uint8_t>(data[i] * Tints[layer][static_cast<int>(i % 4)]);
+        }
+        layers.push_back(pixels);
+    }
+    stbi_image_free(data);
+    scene.textures = CreateTextureArray(width, height, layers);
 
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    int columns = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(instanceCount))));
+    float spacing = 8.0f / columns;
+    scene.bounds.Resize(instanceCount);
+    for (int i = 0; i < instanceCount; ++i)
+    {
+        float x = -4.0f + (i % columns + 0.5f) * spacing;
+        float y = -3.2f + (i / columns + 0.5f) * spacing;
+        float scale = spacing * 0.12f;
+        scene.placements.push_back({ x, y, 10.0f, scale });
+        scene.instances.push_back({ static_cast<std::uint32_t>(i % models.size()), static_cast<std::uint32_t>(i / models.size() % Tints.size()), glm::mat4{ 1.0f } });
+        scene.bounds.centerX[i] = x;
+        scene.bounds.centerY[i] = y;
+        scene.bounds.centerZ[i] = 10.0f;
+        scene.bounds.radius[i] = modelRadius * scale;
+    }
+    return scene;
+}
 
-    stbi_image_free(data);
+// Culls against the camera, then rotates the visible instances around the vertical axis, each at its own phase
+void UpdateInstancedScene(InstancedScene& scene, WorkerPool& cullingWorkers, float time, const FrustumPlanes& frustum)
+{
+    FrustumCulling::CullParallel(cullingWorkers, frustum, scene.bounds, FrustumCulling::CullSpheres, scene.visibleIndices);
 
-    return texture;
+    scene.visibleInstances.resize(scene.visibleIndices.size());
+    for (std::size_t v = 0; v < scene.visibleIndices.size(); ++v)
+    {
+        std::uint32_t i = scene.visibleIndices[v];
+        const glm::vec4& placement = scene.placements[i];
+        float angle = time + static_cast<float>(i) * 0.1f;
+        float c = std::cos(angle) * placement.w;
+        float s = std::sin(angle) * placement.w;
+        BatchInstance& instance = scene.visibleInstances[v];
+        instance = scene.instances[i];
+        instance.modelMatrix[0] = { c, 0.0f, -s, 0.0f };
+        instance.modelMatrix[1] = { 0.0f, placement.w, 0.0f, 0.0f };
+        instance.modelMatrix[2] = { s, 0.0f, c, 0.0f };
+        instance.modelMatrix[3] = { placement.x, placement.y, placement.z, 1.0f };
+    }
+}
+
+void DestroyInstancedScene(InstancedScene& scene)
+{
+    scene.batch.Destroy();
+    glDeleteTextures(1, &scene.textures);
+    scene = {};
+}
+
+int TextureStreamerWorkerCount()
+{
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+}
+
+int RunTextureStreamingBenchmark(GLFWwindow* window, int textureCount)
+{
+    // Synchronous loading of the same images for comparison, the window does not present meanwhile
+    auto start = std::chrono::steady_clock::now();
+    std::vector<GLuint> loaded;
+    for (int i = 0; i < textureCount; ++i)
+    {
+        loaded.push_back(LoadTexture(TexturePath));
+    }
+    glFinish();
+    double synchronousMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    glDeleteTextures(static_cast<GLsizei>(loaded.size()), loaded.data());
+
+    TextureStreamer streamer;
+    streamer.Start(TextureStreamerWorkerCount());
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < textureCount; ++i)
+    {
+        streamer.Request(TexturePath);
+    }
+
+    std::vector<double> frameMilliseconds;
+    std::size_t maxPendingDecodes = 0;
+    std::size_t maxPendingUploads = 0;
+    while (!streamer.IsIdle())
+    {
+        auto frameStart = std::chrono::steady_clock::now();
+        glfwPollEvents();
+        glClear(GL_COLOR_BUFFER_BIT);
+        streamer.Update();
+        glfwSwapBuffers(window);
+        frameMilliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+
+        auto stats = streamer.Stats();
+        maxPendingDecodes = std::max(maxPendingDecodes, stats.pendingDecodes);
+        maxPendingUploads = std::max(maxPendingUploads, stats.pendingUploads);
+    }
+    glFinish();
+    double streamingMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    auto stats = streamer.Stats();
+    streamer.Stop();
+    if (stats.texturesReady != static_cast<std::size_t>(textureCount))
+    {
+        spdlog::error("{} of {} textures streamed in", stats.texturesReady, textureCount);
+        return EXIT_FAILURE;
+    }
+
+    std::sort(frameMilliseconds.begin(), frameMilliseconds.end());
+    spdlog::info("{} textures: synchronous {:.1f} ms without presenting, streamed {:.1f} ms over {} frames", textureCount,
+        synchronousMilliseconds, streamingMilliseconds, frameMilliseconds.size());
+    spdlog::info("Frame time median {:.3f} ms, max {:.3f} ms, upload budget {} KiB per frame, queue depth max {} decodes, {} uploads",
+        frameMilliseconds[frameMilliseconds.size() / 2], frameMilliseconds.back(), stats.uploadBudget / 1024, maxPendingDecodes,
+        maxPendingUploads);
+    return EXIT_SUCCESS;
+}
+
+// lab3 --bench-gl-debug [messages], frame time while the application inserts messages into the debug output,
+// formatted on the driver's stack against queued for the logger thread
+int RunGLDebugBenchmark(GLFWwindow* window, GLDebugOutput& debugOutput, int messagesPerFrame)
+{
+    constexpr int FrameCount = 200;
+    constexpr int MessageIdCount = 16;
+    for (bool synchronous : { true, false })
+    {
+        GLDebugSettings settings;
+        settings.synchronous = synchronous;
+        debugOutput.Uninstall();
+        debugOutput.Install(settings);
+
+        std::vector<double> frameMilliseconds;
+        for (int frame = 0; frame < FrameCount; ++frame)
+        {
+            auto frameStart = std::chrono::steady_clock::now();
+            glClear(GL_COLOR_BUFFER_BIT);
+            for (int i = 0; i < messagesPerFrame; ++i)
+            {
+                glDebugMessageInsert(GL_DEBUG_SOURCE_APPLICATION, GL_DEBUG_TYPE_PERFORMANCE, i % MessageIdCount, GL_DEBUG_SEVERITY_LOW, -1,
+                    "Benchmark message standing in for a noisy driver warning");
+            }
+            glfwSwapBuffers(window);
+            frameMilliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+        }
+        std::sort(frameMilliseconds.begin(), frameMilliseconds.end());
+        spdlog::info("{} debug output, {} messages per frame: median {:.3f} ms, max {:.3f} ms per frame", synchronous ? "Synchronous" : "Queued",
+            messagesPerFrame, frameMilliseconds[frameMilliseconds.size() / 2], frameMilliseconds.back());
+    }
+    debugOutput.Uninstall();
+    auto stats = debugOutput.Stats();
+    spdlog::info("Queued: {} received, {} logged, {} suppressed, {} dropped", stats.received, stats.logged, stats.suppressed, stats.dropped);
+    return EXIT_SUCCESS;
 }
 
 GLuint CreateSampler()
@@ -155,23 +750,319 @@ GLuint CreateSampler()
     GLuint sampler;
     glGenSamplers(1, &sampler);
     glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     return sampler;
 }
 
-int main()
+// grid x grid copies of the scene model shrunk to fit the view of the default camera, 1 is the scene itself
+ModelInfo GenerateGridScene(int grid)
+{
+    ModelInfo model = GenerateSceneModel();
+    ModelInfo result;
+    float scale = 1.0f / grid;
+    for (int row = 0; row < grid; ++row)
+    {
+        for (int column = 0; column < grid; ++column)
+        {
+            glm::vec3 offset{ (column + 0.5f) * 8.0f / grid - 4.0f, (row + 0.5f) * 6.4f / grid - 3.2f, 0.0f };
+            if (grid == 1)
+            {
+                offset = glm::vec3{ 0.0f };
+            }
+            auto firstVertex = static_cast<unsigned int>(result.vertices.size());
+            for (Vertex vertex : model.vertices)
+            {
+                vertex.x = vertex.x * scale + offset.x;
+                vertex.y = vertex.y * scale + offset.y;
+                vertex.z = vertex.z * scale + offset.z;
+                result.vertices.push_back(vertex);
+            }
+            for (unsigned int index : model.indices)
+            {
+                result.indices.push_back(firstVertex + index);
+            }
+        }
+    }
+    return result;
+}
+
+// What the main loop uploads on its first frame
+FrameUniforms BuildDefaultFrameUniforms(int width, int height)
+{
+    Camera camera;
+    camera.frustum.nearPlane = 0.1f;
+    camera.frustum.farPlane = 1000.0f;
+    camera.frustum.horizontalFovDegrees = 90.0f;
+    camera.position = glm::vec3{ 0.0f, 0.0f, -6.0f };
+    camera.pitchDegrees = 0.0f;
+    camera.yawDegrees = 90.0f;
+    camera.SyncDirectionVectors();
+
+    FrameUniforms frameUniforms;
+    frameUniforms.worldToCameraMatrix = camera.BuildWorldToCameraMatrix();
+    frameUniforms.projectionMatrix = camera.BuildProjectionMatrix(width, height);
+    frameUniforms.lightDirection = glm::vec4(camera.forwardDirection, 0.0f);
+    return frameUniforms;
+}
+
+bool LoadSoftwareTexture(SoftwareTexture& texture)
+{
+    int width, height, bpp;
+    stbi_set_flip_vertically_on_load(true);
+    unsigned char* data = stbi_load(TexturePath, &width, &height, &bpp, 4);
+    if (data == nullptr)
+    {
+        spdlog::critical("Unable to decode texture \"{}\"", TexturePath);
+        return false;
+    }
+    texture = SoftwareTexture::FromRgba(width, height, data);
+    stbi_image_free(data);
+    return true;
+}
+
+// Median frame and the frame stats closest to it
+SoftwareFrameStats RenderSoftwareFrames(SoftwareRenderer& renderer, SoftwareFramebuffer& framebuffer, const FrameUniforms& frameUniforms,
+    const std::vector<SoftwareDraw>& draws, int frameCount)
+{
+    std::vector<SoftwareFrameStats> frames;
+    for (int frame = 0; frame < frameCount; ++frame)
+    {
+        frames.push_back(renderer.Render(framebuffer, frameUniforms, draws));
+    }
+    std::sort(frames.begin(), frames.end(), [](const SoftwareFrameStats& a, const SoftwareFrameStats& b) {
+        return a.TotalMilliseconds() < b.TotalMilliseconds();
+    });
+    return frames[frames.size() / 2];
+}
+
+// lab3 --render-software [frames] [grid] [output.ppm] [threads], needs neither a GPU nor a window. Renders with one
+// thread and with threads, every hardware thread by default, and the two images have to match exactly.
+int RunSoftwareRender(int frameCount, int grid, const char* outputPath, int threadCount)
+{
+    constexpr int Width = 1000;
+    constexpr int Height = 800;
+    SoftwareTexture texture;
+    if (!LoadSoftwareTexture(texture))
+    {
+        return EXIT_FAILURE;
+    }
+    ModelInfo model = GenerateGridScene(grid);
+    std::vector<SoftwareDraw> draws = { SoftwareDraw::FromModel(model, texture) };
+    FrameUniforms frameUniforms = BuildDefaultFrameUniforms(Width, Height);
+
+    std::vector<std::uint8_t> singleThreadImage;
+    for (int threads : { 1, threadCount })
+    {
+        SoftwareRenderer renderer;
+        renderer.Start(threads);
+        SoftwareFramebuffer framebuffer = SoftwareFramebuffer::Create(Width, Height);
+        SoftwareFrameStats stats = RenderSoftwareFrames(renderer, framebuffer, frameUniforms, draws, frameCount);
+        spdlog::info("{} threads, {} triangles ({} rasterized), {} fragments: {:.3f} ms per frame (vertex {:.3f}, bin {:.3f}, raster {:.3f})",
+            threads, stats.triangles, stats.rasterizedTriangles, stats.fragments, stats.TotalMilliseconds(), stats.vertexMilliseconds,
+            stats.binMilliseconds, stats.rasterMilliseconds);
+
+        if (singleThreadImage.empty())
+        {
+            singleThreadImage = framebuffer.color;
+        }
+        else if (framebuffer.color != singleThreadImage)
+        {
+            spdlog::error("Image rendered with {} threads differs from the single threaded one", threads);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!WritePpm(outputPath, Width, Height, singleThreadImage.data()))
+    {
+        spdlog::critical("Unable to write \"{}\"", outputPath);
+        return EXIT_FAILURE;
+    }
+    spdlog::info("Wrote \"{}\"", outputPath);
+    return EXIT_SUCCESS;
+}
+
+// lab3 --compare-software [frames] [grid], the same frame through GL and the software renderer, both timed and
+// written to gl.ppm and software.ppm. GL minifies with trilinear filtering where the software sampler reads
+// the nearest texel of level 0, so differences concentrate where the texture is minified.
+int RunSoftwareComparison(int frameCount, int grid)
+{
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    const int width = viewport[2];
+    const int height = viewport[3];
+
+    SoftwareTexture softwareTexture;
+    if (!LoadSoftwareTexture(softwareTexture))
+    {
+        return EXIT_FAILURE;
+    }
+    ModelInfo model = GenerateGridScene(grid);
+    FrameUniforms frameUniforms = BuildDefaultFrameUniforms(width, height);
+
+    ShaderRegistry shaders;
+    auto handle = shaders.Load(VertexShaderPath, FragmentShaderPath, ConfigureSceneProgram);
+    GLuint texture = LoadTexture(TexturePath);
+    if (handle == ShaderRegistry::InvalidHandle || texture == 0)
+    {
+        return EXIT_FAILURE;
+    }
+    Mesh mesh = CreateMesh(model);
+    GLuint uniformBuffer;
+    glCreateBuffers(1, &uniformBuffer);
+    glNamedBufferStorage(uniformBuffer, sizeof(FrameUniforms), &frameUniforms, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FrameUniforms::Binding, uniformBuffer);
+    GLuint sampler = CreateSampler();
+    glBindSampler(0, sampler);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    const ShaderProgram& program = shaders.Get(handle);
+    glUseProgram(program.program);
+    SetVertexDecodingUniforms(program.uniforms, mesh.decoding);
+    // Culling and the depth test are main's interactive state, the software renderer mirrors it
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+
+    std::vector<double> glMilliseconds;
+    for (int frame = 0; frame < frameCount; ++frame)
+    {
+        auto start = std::chrono::steady_clock::now();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        DrawMesh(mesh);
+        glFinish();
+        glMilliseconds.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(glMilliseconds.begin(), glMilliseconds.end());
+    std::vector<std::uint8_t> glImage(static_cast<std::size_t>(width) * height * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, glImage.data());
+
+    glDeleteSamplers(1, &sampler);
+    glDeleteBuffers(1, &uniformBuffer);
+    glDeleteTextures(1, &texture);
+    DestroyMesh(mesh);
+    shaders.Destroy();
+
+    SoftwareRenderer renderer;
+    renderer.Start(std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+    SoftwareFramebuffer framebuffer = SoftwareFramebuffer::Create(width, height);
+    SoftwareFrameStats stats = RenderSoftwareFrames(renderer, framebuffer, frameUniforms, { SoftwareDraw::FromModel(model, softwareTexture) }, frameCount);
+
+    double totalDifference = 0.0;
+    std::size_t differentPixels = 0;
+    for (std::size_t pixel = 0; pixel < glImage.size() / 4; ++pixel)
+    {
+        int maxDifference = 0;
+        for (int channel = 0; channel < 3; ++channel)
+        {
+            int difference = std::abs(glImage[pixel * 4 + channel] - framebuffer.color[pixel * 4 + channel]);
+            totalDifference += difference;
+            maxDifference = std::max(maxDifference, difference);
+        }
+        differentPixels += maxDifference > 8;
+    }
+
+    spdlog::info("{}x{}, {} triangles: GL {:.3f} ms, software {:.3f} ms on {} threads per frame", width, height, model.indices.size() / 3,
+        glMilliseconds[glMilliseconds.size() / 2], stats.TotalMilliseconds(), renderer.ThreadCount());
+    spdlog::info("Mean channel difference {:.3f}, {:.2f}% of pixels differ by more than 8", totalDifference / (glImage.size() / 4 * 3),
+        100.0 * differentPixels / (glImage.size() / 4));
+    bool written = WritePpm("gl.ppm", width, height, glImage.data()) && WritePpm("software.ppm", width, height, framebuffer.color.data());
+    return written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Flags of the interactive session, any combination in any order:
+// --gl-debug-sync --no-pack --compressed-vertices --no-late-latch --instances [count]
+struct SessionOptions
+{
+    bool glDebugSync = false;
+    bool usePack = true;
+    bool compressedVertices = false;
+    bool lateLatch = true;
+    // 0 draws no instanced batch
+    int instanceCount = 0;
+
+    static SessionOptions Parse(int argc, char* argv[])
+    {
+        SessionOptions result;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string_view flag = argv[i];
+            if (flag == "--gl-debug-sync")
+            {
+                result.glDebugSync = true;
+            }
+            else if (flag == "--no-pack")
+            {
+                result.usePack = false;
+            }
+            else if (flag == "--compressed-vertices")
+            {
+                result.compressedVertices = true;
+            }
+            else if (flag == "--no-late-latch")
+            {
+                result.lateLatch = false;
+            }
+            else if (flag == "--instances")
+            {
+                result.instanceCount = 10000;
+                if (i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+                {
+                    result.instanceCount = std::max(1, std::atoi(argv[++i]));
+                }
+            }
+            else
+            {
+                spdlog::warn("Ignoring unknown argument \"{}\"", flag);
+            }
+        }
+        return result;
+    }
+};
+
+int main(int argc, char* argv[])
 {
     spdlog::set_pattern("[%^%l%$] %v");
 
+    std::string_view mode = argc > 1 ? argv[1] : "";
+    int checkExitCode;
+    if (RunCheck(mode, checkExitCode))
+    {
+        return checkExitCode;
+    }
+    if (mode == "--pack")
+    {
+        return PackAssets(argc > 2 ? argv[2] : AssetPackPath);
+    }
+    if (mode == "--mesh-optimizer-report")
+    {
+        return RunMeshOptimizerReport();
+    }
+    if (mode == "--bench-frustum-culling")
+    {
+        return RunFrustumCullingBenchmark();
+    }
+    if (mode == "--render-software")
+    {
+        return RunSoftwareRender(argc > 2 ? std::max(1, std::atoi(argv[2])) : 20, argc > 3 ? std::max(1, std::atoi(argv[3])) : 1,
+            argc > 4 ? argv[4] : "software.ppm", argc > 5 ? std::max(1, std::atoi(argv[5])) : std::max(1, static_cast<int>(std::thread::hardware_concurrency())));
+    }
+
+    // The remaining modes are exclusive and read their arguments by position, the session flags combine
+    const bool isBenchmark = mode == "--compare-software" || mode == "--bench-gl-debug" || mode == "--bench-startup"
+        || mode == "--bench-uniforms" || mode == "--bench-texture-streaming";
+    const SessionOptions options = isBenchmark ? SessionOptions{} : SessionOptions::Parse(argc, argv);
+
     if (!glfwInit())
     {
         spdlog::critical("Unable to init GLFW");
         return EXIT_FAILURE;
     }
 
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
+    glfwWindowHint(GLFW_DEPTH_BITS, 24);
+
     int screenWidth = 1000;
     int screeHeight = 800;
     auto window = glfwCreateWindow(screenWidth, screeHeight, "OpenGLDemo", nullptr, nullptr);
@@ -191,30 +1082,104 @@ int main()
 
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
-    glEnable(GL_DEBUG_OUTPUT);
-    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
-    glDebugMessageCallback(GLDebugMessageCallback, nullptr);
-    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+    // Queued and rate limited by default, lab3 --gl-debug-sync logs on the driver's stack and breaks on errors
+    GLDebugOutput debugOutput;
+    GLDebugSettings debugSettings;
+    debugSettings.synchronous = options.glDebugSync;
+    debugSettings.breakOnErrors = debugSettings.synchronous;
+    debugOutput.Install(debugSettings);
 
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
     glFrontFace(GL_CW);
+    // The instanced wall overlaps itself and the model, draw order alone does not resolve it
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
 
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-    auto modelInfo = GeneratePyramid(5, 3, 8);
-    auto mesh = CreateMesh(modelInfo);
+    if (mode == "--compare-software")
+    {
+        int result = RunSoftwareComparison(argc > 2 ? std::max(1, std::atoi(argv[2])) : 20, argc > 3 ? std::max(1, std::atoi(argv[3])) : 1);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return result;
+    }
+
+    if (mode == "--bench-gl-debug")
+    {
+        int result = RunGLDebugBenchmark(window, debugOutput, argc > 2 ? std::max(1, std::atoi(argv[2])) : 100);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return result;
+    }
+
+    // lab3 --bench-startup files|pack [repeats] [no-shader-cache]
+    if (mode == "--bench-startup")
+    {
+        AssetSource source = argc > 2 && std::string_view{ argv[2] } == "files" ? AssetSource::Files : AssetSource::Pack;
+        bool useShaderCache = !(argc > 4 && std::string_view{ argv[4] } == "no-shader-cache");
+        int result = RunStartupBenchmark(source, useShaderCache, argc > 3 ? std::max(1, std::atoi(argv[3])) : 20);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return result;
+    }
+
+    if (mode == "--bench-uniforms")
+    {
+        int result = RunUniformBenchmark(argc > 2 ? std::max(1, std::atoi(argv[2])) : 100000);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return result;
+    }
+
+    // lab3 --bench-texture-streaming [count], keeps presenting frames while count copies of the texture stream in
+    if (mode == "--bench-texture-streaming")
+    {
+        int result = RunTextureStreamingBenchmark(window, argc > 2 ? std::max(1, std::atoi(argv[2])) : 64);
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return result;
+    }
+
+    // Loads from the pack when one has been built, --no-pack forces the original file path
+    AssetPack assetPack;
+    if (options.usePack)
+    {
+        assetPack = AssetPack::Open(AssetPackPath);
+        if (!assetPack.IsOpen() && std::filesystem::exists(AssetPackPath))
+        {
+            spdlog::warn("\"{}\" was built by another version of lab3 or is damaged, loading from files. Run \"lab3 --pack\" to rebuild it",
+                AssetPackPath);
+        }
+    }
+
+    // Edited shader sources are rebuilt while running, a build that fails keeps the previous program
+    ShaderRegistry shaders;
+    shaders.binaryCache.Enable(ShaderCacheDirectory);
+
+    double loadMilliseconds;
+    SceneAssets assets = LoadSceneAssets(assetPack.IsOpen() ? &assetPack : nullptr, shaders, loadMilliseconds);
+    if (!assets.IsValid())
+    {
+        return EXIT_FAILURE;
+    }
+    spdlog::info("Loaded assets from {} in {:.3f} ms", assetPack.IsOpen() ? AssetPackPath : "files", loadMilliseconds);
+    // The GL objects hold their own copies, the mapping is not needed anymore
+    assetPack = AssetPack{};
 
-    auto shader = Shader::LoadProgram("res/simple.vert", "res/simple.frag");
-    glUseProgram(shader);
+    auto& mesh = assets.mesh;
 
-    auto texture = LoadTexture("res/water.png");
+    auto texture = assets.texture;
     auto sampler = CreateSampler();
     glBindSampler(0, sampler);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, texture);
-    Shader::SetTextureUniform(shader, "colorTexture", 0);
+
+    // C switches between the float and the compressed vertex layout of the same model
+    auto compressedMesh = CreateMesh(VertexCompression::Compress(GenerateSceneModel()));
+    bool useCompressedVertices = options.compressedVertices;
+    bool cWasPressed = false;
 
     Clock clock;
     Camera camera;
@@ -225,13 +1190,66 @@ int main()
     camera.pitchDegrees = 0.0f;
     camera.yawDegrees = 90.0f;
     camera.SyncDirectionVectors();
+    FPSCameraController cameraController;
 
     float lightAngle = 0.0f;
 
+    RenderQueue renderQueue;
+    renderQueue.maxDepth = camera.frustum.farPlane;
+    RenderStateCache renderStateCache;
+    GLRenderBackend renderBackend(shaders);
+    RenderStats renderStats;
+
+    // Per frame uniforms, streamed geometry and batch instances share one persistently mapped ring,
+    // sized for three frames in flight of 10k instances with plenty to spare
+    constexpr std::uint64_t RingBufferCapacity = 16 * 1024 * 1024;
+    GLint uniformAlignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+    auto ringBuffer = PersistentRingBuffer::Create(RingBufferCapacity);
+    if (!ringBuffer.IsValid())
+    {
+        return EXIT_FAILURE;
+    }
+    auto streamedGeometry = StreamedGeometry::Create(ringBuffer);
+
+    // The grid's texture streams in, the placeholder shows for the first frames
+    TextureStreamer textureStreamer;
+    textureStreamer.Start(TextureStreamerWorkerCount());
+    auto gridTexture = textureStreamer.Request(TexturePath);
+    float time = 0.0f;
+
+    // lab3 --instances [count], M switches between instanced draws per mesh and one multi draw indirect
+    InstancedScene instancedScene;
+    WorkerPool cullingWorkers;
+    if (options.instanceCount > 0)
+    {
+        instancedScene = CreateInstancedScene(shaders, options.instanceCount);
+        if (!instancedScene.IsValid())
+        {
+            return EXIT_FAILURE;
+        }
+        cullingWorkers.Start(CullingThreadCount());
+    }
+    BatchDrawMode batchDrawMode = BatchDrawMode::MultiDrawIndirect;
+    BatchStats batchStats;
+    double batchMilliseconds = 0.0;
+    std::uint64_t culledInstances = 0;
+    std::uint64_t frameCount = 0;
+    bool mWasPressed = false;
+
+    // lab3 --no-late-latch builds the view from the input sampled at the start of the frame, to compare the latency
+    const bool lateLatch = options.lateLatch;
+    LatencyTracker<GLFenceBackend> latencyTracker;
+
+    shaders.StartWatching();
+
     while (!glfwWindowShouldClose(window))
     {
         glfwPollEvents();
-        glClear(GL_COLOR_BUFFER_BIT);
+        latencyTracker.Poll(glfwGetTime());
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        shaders.Update();
+        const ShaderProgram& sceneProgram = shaders.Get(assets.shader);
 
         auto dt = clock.GetElapsedTime();
 
@@ -244,23 +1262,124 @@ int main()
             lightAngle += 3.0f * dt;
         }
 
-        FPSCameraController::UpdateFPSCamera(camera, window, dt);
+        bool cIsPressed = GLFWKeyIsPressed(window, GLFW_KEY_C);
+        if (cIsPressed && !cWasPressed)
+        {
+            useCompressedVertices = !useCompressedVertices;
+            spdlog::info("Drawing {} vertices", useCompressedVertices ? "compressed" : "float");
+        }
+        cWasPressed = cIsPressed;
+
+        bool mIsPressed = GLFWKeyIsPressed(window, GLFW_KEY_M);
+        if (mIsPressed && !mWasPressed)
+        {
+            batchDrawMode = batchDrawMode == BatchDrawMode::Instanced ? BatchDrawMode::MultiDrawIndirect : BatchDrawMode::Instanced;
+            spdlog::info("Drawing batches with {}", batchDrawMode == BatchDrawMode::Instanced ? "instancing" : "multi draw indirect");
+        }
+        mWasPressed = mIsPressed;
 
-        auto worldToCameraMatrix = camera.BuildWorldToCameraMatrix();
+        double inputTime = cameraController.Update(camera, window, dt);
         auto projectionMatrix = camera.BuildProjectionMatrix(screenWidth, screeHeight);
 
-        Shader::SetMat4Uniform(shader, "worldToCameraMatrix", worldToCameraMatrix);
-        Shader::SetMat4Uniform(shader, "projectionMatrix", projectionMatrix);
-        Shader::SetVec3Uniform(shader, "lightDirection", camera.forwardDirection);
+        // Work that does not need the final view runs before the late latch
+        textureStreamer.Update();
+        time += dt;
+        bool streamed = streamedGeometry.Stream(ringBuffer, time);
 
-        DrawMesh(mesh);
+        double batchFrameMilliseconds = 0.0;
+        if (instancedScene.IsValid())
+        {
+            // Culls with the view from the start of the frame, the late latch only turns it by a fraction of a degree
+            auto cullStart = std::chrono::steady_clock::now();
+            UpdateInstancedScene(instancedScene, cullingWorkers, time, FrustumPlanes::FromMatrix(projectionMatrix * camera.BuildWorldToCameraMatrix()));
+            batchFrameMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cullStart).count();
+        }
+
+        if (lateLatch)
+        {
+            inputTime = cameraController.LateLatch(camera, window);
+        }
+
+        FrameUniforms frameUniforms;
+        frameUniforms.worldToCameraMatrix = camera.BuildWorldToCameraMatrix();
+        frameUniforms.projectionMatrix = projectionMatrix;
+        frameUniforms.lightDirection = glm::vec4(camera.forwardDirection, 0.0f);
+        UploadFrameUniforms(ringBuffer, frameUniforms, uniformAlignment);
+
+        DrawCommand command;
+        command.program = sceneProgram.program;
+        command.texture = texture;
+        command.mesh = useCompressedVertices ? &compressedMesh : &mesh;
+        command.depth = glm::length(camera.position);
+
+        renderQueue.Clear();
+        renderQueue.Submit(command);
+        if (streamed)
+        {
+            DrawCommand gridCommand = streamedGeometry.Command(sceneProgram.program, textureStreamer.Get(gridTexture));
+            // The grid is centered below the origin
+            gridCommand.depth = glm::length(camera.position);
+            renderQueue.Submit(gridCommand);
+        }
+        renderQueue.Sort();
+        renderStateCache.Reset();
+        renderStats += renderQueue.Execute(renderBackend, renderStateCache);
+
+        if (instancedScene.IsValid())
+        {
+            // The batch binds its own program, texture array and vertex array, the cache no longer knows what is bound
+            auto drawStart = std::chrono::steady_clock::now();
+            glUseProgram(shaders.Get(instancedScene.program).program);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, instancedScene.textures);
+            instancedScene.batch.Draw(ringBuffer, instancedScene.visibleInstances, batchDrawMode, batchStats);
+            renderStateCache.Reset();
+            culledInstances += instancedScene.instances.size() - instancedScene.visibleInstances.size();
+            batchFrameMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - drawStart).count();
+        }
+        batchMilliseconds += batchFrameMilliseconds;
+        ringBuffer.EndFrame();
+        ++frameCount;
 
         glfwSwapBuffers(window);
+        latencyTracker.FramePresented(inputTime, glfwGetTime());
     }
 
+    auto presentLatency = LatencyPercentiles::Compute(latencyTracker.presentMilliseconds);
+    auto completionLatency = LatencyPercentiles::Compute(latencyTracker.completionMilliseconds);
+    spdlog::info("Input to present{}: p50 {:.2f} ms, p90 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms", lateLatch ? " (late latched)" : "",
+        presentLatency.p50, presentLatency.p90, presentLatency.p99, presentLatency.max);
+    spdlog::info("Input to GPU completion: p50 {:.2f} ms, p90 {:.2f} ms, p99 {:.2f} ms, max {:.2f} ms", completionLatency.p50,
+        completionLatency.p90, completionLatency.p99, completionLatency.max);
+    latencyTracker.Release();
+
+    spdlog::info("Render queue: {} draws, {} GL calls issued, {} skipped", renderStats.draws, renderStats.callsIssued, renderStats.callsSkipped);
+
+    if (instancedScene.IsValid() && frameCount > 0)
+    {
+        spdlog::info("Batch: {} instances ({} culled) in {:.1f} draw calls per frame, {:.3f} ms CPU per frame", batchStats.instances / frameCount,
+            culledInstances / frameCount, static_cast<double>(batchStats.drawCalls) / frameCount, batchMilliseconds / frameCount);
+    }
+
+    auto& ringStats = ringBuffer.allocator.stats;
+    spdlog::info("Ring buffer: {} allocations, {} wraps, {} stalls", ringStats.allocations, ringStats.wraps, ringStats.stalls);
+    auto debugStats = debugOutput.Stats();
+    spdlog::info("GL debug output: {} messages, {} logged, {} suppressed, {} dropped", debugStats.received, debugStats.logged,
+        debugStats.suppressed, debugStats.dropped);
+    spdlog::info("Shaders: {} compiled, {} loaded from binaries, {} reloads, {} failed reloads", shaders.stats.compiled,
+        shaders.stats.cacheHits, shaders.stats.reloads, shaders.stats.failedReloads);
+
+    textureStreamer.Stop();
+    if (instancedScene.IsValid())
+    {
+        DestroyInstancedScene(instancedScene);
+    }
+    streamedGeometry.Destroy();
+    ringBuffer.Destroy();
     glDeleteSamplers(1, &sampler);
-    glDeleteTextures(1, &texture);
-    glDeleteProgram(shader);
+    DestroyMesh(compressedMesh);
+    DestroySceneAssets(assets);
+    shaders.Destroy();
+    debugOutput.Uninstall();
     glfwDestroyWindow(window);
     glfwTerminate();
 